@@ -0,0 +1,201 @@
+/* Measure the search of ext2fs allocation bitmaps.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Fill GROUPS block bitmaps of 32768 blocks, as for 4 KiB blocks, to
+   several levels with a fragmented pattern of free blocks, and allocate
+   every free block in them one at a time, the way ext2_new_block falls
+   back to searching a group: with the old scanner, which reads the
+   bitmap 32 bits at a time, with find_next_zero_bit, and with
+   find_next_zero_bit starting at the group's first free hint, checking
+   that each takes the first free block, and printing the rate of
+   each.
+
+   Usage: bitmap-search [GROUPS]
+
+   This can be built on GNU/Linux from the top of the source tree with:
+
+     gcc -O2 -o bitmap-search benchmarks/bitmap-search.c  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <error.h>
+#include <time.h>
+
+#include "../ext2fs/bitmap.c"
+
+#define GROUP_BITS	32768
+
+static unsigned long ngroups = 64;
+
+/* How many blocks of every thousand are used, for each run.  */
+static const int fullness[] = { 500, 900, 990, 999 };
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+test_bit (unsigned num, const unsigned char *bitmap)
+{
+  return bitmap[num >> 3] & (1 << (num & 7));
+}
+
+static void
+set_bit (unsigned num, unsigned char *bitmap)
+{
+  bitmap[num >> 3] |= 1 << (num & 7);
+}
+
+/* The scanner ext2fs used before, reading the bitmap as 32-bit words
+   whatever the size of a long.  */
+static unsigned long
+old_find_next_zero_bit (void *addr, unsigned long size,
+			unsigned long offset)
+{
+  unsigned int *p = ((unsigned int *) addr) + (offset >> 5);
+  unsigned long result = offset & ~31UL;
+  unsigned int tmp;
+
+  if (offset >= size)
+    return size;
+  size -= result;
+  offset &= 31UL;
+  if (offset)
+    {
+      tmp = *(p++);
+      tmp |= ~0U >> (32 - offset);
+      if (size < 32)
+	goto found_first;
+      if (~tmp)
+	goto found_middle;
+      size -= 32;
+      result += 32;
+    }
+  while (size & ~31UL)
+    {
+      if (~(tmp = *(p++)))
+	goto found_middle;
+      result += 32;
+      size -= 32;
+    }
+  if (!size)
+    return result;
+  tmp = *p;
+
+found_first:
+  tmp |= ~0U << size;
+  if (!~tmp)
+    return result + size;
+found_middle:
+  return result + ffs (~tmp) - 1;
+}
+
+/* Fill the bitmaps in MAPS so that PERMILLE of every thousand blocks are
+   used, the free ones coming in short runs scattered over the group, and
+   return the number of free blocks.  */
+static unsigned long
+fill (unsigned char *maps, int permille)
+{
+  unsigned long g, b, n, nfree = 0;
+
+  memset (maps, 0xff, ngroups * GROUP_BITS / 8);
+  srandom (permille);
+  for (g = 0; g < ngroups; g++)
+    for (b = 0; b < GROUP_BITS; b += n)
+      {
+	n = 1 + random () % 8;
+	if (random () % 1000 >= permille)
+	  for (; n > 0 && b < GROUP_BITS; n--, b++, nfree++)
+	    maps[g * GROUP_BITS / 8 + b / 8] &= ~(1 << (b % 8));
+      }
+  return nfree;
+}
+
+/* Allocate every free block in MAPS, as NAME, with the scanner given by
+   MODE: 0 for the old one, 1 for find_next_zero_bit from the start of
+   the group, and 2 for it from the hint.  */
+static void
+run (const char *name, unsigned char *maps, int permille, int mode)
+{
+  unsigned long nfree = fill (maps, permille), done = 0, g, b, hint;
+  unsigned char *map;
+  double start, elapsed;
+
+  start = now ();
+  for (g = 0; g < ngroups; g++)
+    {
+      map = maps + g * GROUP_BITS / 8;
+      hint = 0;
+      for (;;)
+	{
+	  if (mode == 0)
+	    b = old_find_next_zero_bit (map, GROUP_BITS, 0);
+	  else
+	    b = find_next_zero_bit (map, GROUP_BITS, mode == 2 ? hint : 0);
+	  if (b >= GROUP_BITS)
+	    break;
+	  /* Each block taken is the first free one if they come in order,
+	     and all of them get taken.  */
+	  if (test_bit (b, map) || b < hint)
+	    error (1, 0, "%s: block %lu of group %lu is not the first free",
+		   name, b, g);
+	  set_bit (b, map);
+	  hint = b + 1;
+	  done++;
+	}
+    }
+  elapsed = now () - start;
+
+  if (done != nfree)
+    error (1, 0, "%s: allocated %lu of %lu free blocks", name, done, nfree);
+  printf ("%-8s %5.1f%% used  %8lu blocks  %10.0f allocs/s\n", name,
+	  permille / 10.0, nfree, nfree / elapsed);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned char *maps;
+  unsigned long i;
+
+  if (argc > 1)
+    ngroups = strtoul (argv[1], NULL, 0);
+  if (ngroups == 0 || argc > 2)
+    error (1, 0, "usage: %s [GROUPS]", argv[0]);
+
+  maps = aligned_alloc (64, ngroups * GROUP_BITS / 8);
+  if (! maps)
+    error (1, 0, "out of memory");
+
+  for (i = 0; i < sizeof fullness / sizeof fullness[0]; i++)
+    {
+      run ("old", maps, fullness[i], 0);
+      run ("wide", maps, fullness[i], 1);
+      run ("hinted", maps, fullness[i], 2);
+    }
+
+  free (maps);
+  return 0;
+}
@@ -0,0 +1,133 @@
+/* Measure file creation and lookup in a large directory.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Create FILES empty files in a new directory under DIRECTORY, then look
+   each of them up in random order, look up as many names which are not
+   there, and remove them all, printing the rate of each.  Without an
+   index, each of these scans the directory, so the rates fall as FILES
+   grows; with one, they should stay about the same.
+
+   Usage: dir-lookup [FILES [DIRECTORY]]  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static unsigned long nfiles = 100000;
+static const char *directory = ".";
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Print the rate of NFILES operations started at START as NAME.  */
+static void
+report (const char *name, double start)
+{
+  double elapsed = now () - start;
+  printf ("%-8s %8lu files  %10.0f ops/s\n", name, nfiles,
+	  nfiles / elapsed);
+}
+
+int
+main (int argc, char **argv)
+{
+  char dir[1024], name[1100];
+  unsigned long *order, i, j, t;
+  struct stat st;
+  double start;
+  int fd;
+
+  if (argc > 1)
+    nfiles = strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    directory = argv[2];
+  if (nfiles == 0 || argc > 3)
+    error (1, 0, "usage: %s [FILES [DIRECTORY]]", argv[0]);
+
+  order = malloc (nfiles * sizeof *order);
+  if (! order)
+    error (1, errno, "malloc");
+  srandom (1);
+  for (i = 0; i < nfiles; i++)
+    order[i] = i;
+  for (i = nfiles - 1; i > 0; i--)
+    {
+      j = random () % (i + 1);
+      t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+
+  snprintf (dir, sizeof dir, "%s/dir-lookup.%d", directory, getpid ());
+  if (mkdir (dir, 0755))
+    error (1, errno, "%s", dir);
+
+  start = now ();
+  for (i = 0; i < nfiles; i++)
+    {
+      sprintf (name, "%s/msg-%lu", dir, i);
+      fd = open (name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if (fd < 0)
+	error (1, errno, "%s", name);
+      close (fd);
+    }
+  report ("create", start);
+
+  start = now ();
+  for (i = 0; i < nfiles; i++)
+    {
+      sprintf (name, "%s/msg-%lu", dir, order[i]);
+      if (stat (name, &st))
+	error (1, errno, "%s", name);
+    }
+  report ("lookup", start);
+
+  start = now ();
+  for (i = 0; i < nfiles; i++)
+    {
+      sprintf (name, "%s/missing-%lu", dir, order[i]);
+      if (stat (name, &st) == 0 || errno != ENOENT)
+	error (1, errno, "%s", name);
+    }
+  report ("missing", start);
+
+  start = now ();
+  for (i = 0; i < nfiles; i++)
+    {
+      sprintf (name, "%s/msg-%lu", dir, order[i]);
+      if (unlink (name))
+	error (1, errno, "%s", name);
+    }
+  report ("remove", start);
+
+  if (rmdir (dir))
+    error (1, errno, "%s", dir);
+  free (order);
+  return 0;
+}
@@ -0,0 +1,115 @@
+/* Measure the latency of additions to a growing hash table.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Add KEYS elements to an empty struct hurd_ihash, timing every
+   addition, and print the median, 99.9th percentile and worst case.
+   This is done with the table enlarged all at once, enlarged
+   incrementally, and reserved beforehand.
+
+   Usage: ihash-latency [KEYS]
+
+   This does not depend on Mach, and can be built on GNU/Linux from the
+   top of the source tree with:
+
+     mkdir -p /tmp/ihash-inc && ln -sfn $PWD/libihash /tmp/ihash-inc/hurd
+     gcc -O2 -D_GNU_SOURCE -I/tmp/ihash-inc -o ihash-latency \
+       benchmarks/ihash-latency.c libihash/ihash.c  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <error.h>
+#include <time.h>
+#include <hurd/ihash.h>
+
+static unsigned long nkeys = 1000000;
+
+/* The values stored under the keys; any non-null pointers will do.  */
+static char *values;
+
+/* The time each addition took, in nanoseconds.  */
+static unsigned long *latency;
+
+static unsigned long
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int
+compare (const void *a, const void *b)
+{
+  unsigned long x = *(const unsigned long *) a;
+  unsigned long y = *(const unsigned long *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Fill a fresh hash table, set up as specified, and print the
+   latencies as NAME.  */
+static void
+run (const char *name, int incremental, int reserve)
+{
+  struct hurd_ihash ht = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+  unsigned long i, start, total;
+
+  hurd_ihash_set_incremental (&ht, incremental);
+  if (reserve && hurd_ihash_reserve (&ht, nkeys))
+    error (1, 0, "out of memory");
+
+  total = now ();
+  for (i = 0; i < nkeys; i++)
+    {
+      /* Spread the keys a little, as port names are.  */
+      hurd_ihash_key_t key = i * 5 + 3;
+
+      start = now ();
+      if (hurd_ihash_add (&ht, key, &values[i]))
+	error (1, 0, "out of memory");
+      latency[i] = now () - start;
+    }
+  total = now () - total;
+
+  qsort (latency, nkeys, sizeof *latency, compare);
+  printf ("%-12s total %8lu us  median %6lu ns  99.9%% %8lu ns  "
+	  "max %10lu ns\n", name, total / 1000, latency[nkeys / 2],
+	  latency[nkeys - nkeys / 1000 - 1], latency[nkeys - 1]);
+
+  hurd_ihash_destroy (&ht);
+}
+
+int
+main (int argc, char **argv)
+{
+  if (argc > 1)
+    nkeys = strtoul (argv[1], NULL, 0);
+  if (nkeys == 0)
+    error (1, 0, "usage: %s [KEYS]", argv[0]);
+
+  values = malloc (nkeys);
+  latency = malloc (nkeys * sizeof *latency);
+  if (values == NULL || latency == NULL)
+    error (1, 0, "out of memory");
+
+  run ("all at once", 0, 0);
+  run ("incremental", 1, 0);
+  run ("reserved", 1, 1);
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+/* Measure hash table throughput for mixes of lookups and updates.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Fill a struct hurd_ihash with KEYS elements, and run OPS random
+   operations on it for each of several mixes of successful lookups,
+   failed lookups, and removals each followed by an addition.  The
+   number of elements stays the same, so the table is not enlarged
+   while measuring; what is measured is the cost of probing, and the
+   effect removals have on later probes.
+
+   Usage: ihash-mix [KEYS [OPS]]
+
+   To compare two versions of libihash, build this against each of
+   them.  This does not depend on Mach, and can be built on GNU/Linux
+   from the top of the source tree with:
+
+     mkdir -p /tmp/ihash-inc && ln -sfn $PWD/libihash /tmp/ihash-inc/hurd
+     gcc -O2 -D_GNU_SOURCE -I/tmp/ihash-inc -o ihash-mix \
+       benchmarks/ihash-mix.c libihash/ihash.c  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <error.h>
+#include <time.h>
+#include <hurd/ihash.h>
+
+static unsigned long nkeys = 100000;
+static unsigned long nops = 10000000;
+
+/* An element, which knows its slot like the users of libihash
+   do.  */
+struct elem
+{
+  hurd_ihash_key_t key;
+  hurd_ihash_locp_t slot;
+};
+
+/* The elements which may be in the table, twice as many as are in it
+   at any time.  */
+static struct elem *elems;
+
+/* The indices of the elements which are in the table first, and the
+   ones which are not after them.  */
+static unsigned long *present;
+
+struct mix
+{
+  const char *name;
+  /* Percentages of the operations; the rest are removals.  */
+  unsigned int find_hit;
+  unsigned int find_miss;
+};
+
+static const struct mix mixes[] =
+  {
+    { "find only",	100,  0 },
+    { "find/miss",	 50, 50 },
+    { "mixed",		 45, 45 },
+    { "90/10 update",	 90,  0 },
+    { "50/50 update",	 50,  0 },
+    { "churn",		  0,  0 },
+  };
+
+static inline unsigned long
+random_next (unsigned long *state)
+{
+  /* xorshift; good enough to pick keys.  */
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run the operations of MIX on a freshly filled table, and print the
+   throughput.  */
+static void
+run (const struct mix *mix)
+{
+  struct hurd_ihash ht =
+    HURD_IHASH_INITIALIZER (offsetof (struct elem, slot));
+  unsigned long state = 88172645463325252UL;
+  unsigned long i, r, j, k, tmp, found = 0;
+  double start, elapsed;
+
+  for (i = 0; i < 2 * nkeys; i++)
+    present[i] = i;
+  for (i = 0; i < nkeys; i++)
+    if (hurd_ihash_add (&ht, elems[i].key, &elems[i]))
+      error (1, 0, "out of memory");
+
+  start = now ();
+  for (i = 0; i < nops; i++)
+    {
+      r = random_next (&state) % 100;
+      j = random_next (&state) % nkeys;
+      if (r < mix->find_hit)
+	found += hurd_ihash_find (&ht, elems[present[j]].key) != NULL;
+      else if (r < mix->find_hit + mix->find_miss)
+	found += hurd_ihash_find (&ht, elems[present[nkeys + j]].key) != NULL;
+      else
+	{
+	  /* Replace an element by one which is not in the table.  */
+	  k = nkeys + random_next (&state) % nkeys;
+	  hurd_ihash_locp_remove (&ht, elems[present[j]].slot);
+	  if (hurd_ihash_add (&ht, elems[present[k]].key, &elems[present[k]]))
+	    error (1, 0, "out of memory");
+	  tmp = present[j];
+	  present[j] = present[k];
+	  present[k] = tmp;
+	}
+    }
+  elapsed = now () - start;
+
+  printf ("%-14s %8lu keys  %12.0f ops/s  (%lu found)\n", mix->name,
+	  nkeys, nops / elapsed, found);
+  hurd_ihash_destroy (&ht);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned long i;
+
+  if (argc > 1)
+    nkeys = strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    nops = strtoul (argv[2], NULL, 0);
+  if (nkeys == 0)
+    error (1, 0, "usage: %s [KEYS [OPS]]", argv[0]);
+
+  elems = malloc (2 * nkeys * sizeof *elems);
+  present = malloc (2 * nkeys * sizeof *present);
+  if (elems == NULL || present == NULL)
+    error (1, 0, "out of memory");
+
+  /* Scatter the keys, so that their home slots collide now and then
+     as in any real table.  Each step of this mix is invertible, so the
+     keys stay distinct.  */
+  for (i = 0; i < 2 * nkeys; i++)
+    {
+      uint32_t x = i;
+      x ^= x >> 16;
+      x *= 0x45d9f3b;
+      x ^= x >> 16;
+      elems[i].key = x;
+    }
+
+  for (i = 0; i < sizeof mixes / sizeof mixes[0]; i++)
+    run (&mixes[i]);
+
+  return 0;
+}
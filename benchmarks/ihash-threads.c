@@ -0,0 +1,188 @@
+/* Compare hash table lookup throughput under concurrency.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Several threads look up random keys in a table, and replace some of
+   them, the way the RPC threads of a server look up ports.  This is
+   done once with a struct hurd_ihash behind a pthread_rwlock_t, as
+   libports does, and once with a struct hurd_cihash.
+
+   Usage: ihash-threads [THREADS [KEYS [WRITE-PERCENT [OPS]]]]
+
+   This does not depend on Mach, and can be built on GNU/Linux from the
+   top of the source tree with:
+
+     mkdir -p /tmp/ihash-inc && ln -sfn $PWD/libihash /tmp/ihash-inc/hurd
+     gcc -O2 -D_GNU_SOURCE -I/tmp/ihash-inc -o ihash-threads \
+       benchmarks/ihash-threads.c libihash/ihash.c libihash/cihash.c \
+       -lpthread  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <error.h>
+#include <pthread.h>
+#include <time.h>
+#include <hurd/ihash.h>
+#include <hurd/cihash.h>
+
+static int nthreads = 4;
+static unsigned long nkeys = 10000;
+static unsigned int write_percent = 1;
+static unsigned long nops = 2000000;
+
+/* The values stored under the keys; any non-null pointers will do.  */
+static char *values;
+
+static struct hurd_ihash ihash = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+static pthread_rwlock_t ihash_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct hurd_cihash cihash;
+
+static pthread_barrier_t start_barrier;
+
+static inline unsigned long
+random_next (unsigned long *state)
+{
+  /* xorshift; good enough to pick keys.  */
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void *
+ihash_worker (void *arg)
+{
+  unsigned long state = (unsigned long) arg * 2654435761UL + 1;
+  unsigned long i, key, found = 0;
+
+  pthread_barrier_wait (&start_barrier);
+  for (i = 0; i < nops; i++)
+    {
+      key = random_next (&state) % nkeys;
+      if (random_next (&state) % 100 < write_percent)
+	{
+	  pthread_rwlock_wrlock (&ihash_lock);
+	  hurd_ihash_remove (&ihash, key);
+	  hurd_ihash_add (&ihash, key, &values[key]);
+	  pthread_rwlock_unlock (&ihash_lock);
+	}
+      else
+	{
+	  pthread_rwlock_rdlock (&ihash_lock);
+	  found += hurd_ihash_find (&ihash, key) != NULL;
+	  pthread_rwlock_unlock (&ihash_lock);
+	}
+    }
+
+  return (void *) found;
+}
+
+static void *
+cihash_worker (void *arg)
+{
+  unsigned long state = (unsigned long) arg * 2654435761UL + 1;
+  unsigned long i, key, found = 0;
+
+  pthread_barrier_wait (&start_barrier);
+  for (i = 0; i < nops; i++)
+    {
+      key = random_next (&state) % nkeys;
+      if (random_next (&state) % 100 < write_percent)
+	{
+	  hurd_cihash_remove (&cihash, key);
+	  hurd_cihash_add (&cihash, key, &values[key]);
+	}
+      else
+	found += hurd_cihash_find (&cihash, key) != NULL;
+    }
+
+  return (void *) found;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run WORKER in all threads, and print the throughput as NAME.  */
+static void
+run (const char *name, void *(*worker) (void *))
+{
+  pthread_t threads[nthreads];
+  double start, elapsed;
+  int i, err;
+
+  pthread_barrier_init (&start_barrier, NULL, nthreads + 1);
+  for (i = 0; i < nthreads; i++)
+    {
+      err = pthread_create (&threads[i], NULL, worker, (void *) (long) i + 1);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  start = now ();
+  pthread_barrier_wait (&start_barrier);
+  for (i = 0; i < nthreads; i++)
+    pthread_join (threads[i], NULL);
+  elapsed = now () - start;
+  pthread_barrier_destroy (&start_barrier);
+
+  printf ("%-16s %3d threads  %10.0f ops/s\n", name, nthreads,
+	  nthreads * nops / elapsed);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned long key;
+
+  if (argc > 1)
+    nthreads = atoi (argv[1]);
+  if (argc > 2)
+    nkeys = strtoul (argv[2], NULL, 0);
+  if (argc > 3)
+    write_percent = atoi (argv[3]);
+  if (argc > 4)
+    nops = strtoul (argv[4], NULL, 0);
+  if (nthreads <= 0 || nkeys == 0 || write_percent > 100)
+    error (1, 0, "usage: %s [THREADS [KEYS [WRITE-PERCENT [OPS]]]]",
+	   argv[0]);
+
+  values = malloc (nkeys);
+  if (values == NULL)
+    error (1, 0, "out of memory");
+
+  hurd_cihash_init (&cihash);
+  for (key = 0; key < nkeys; key++)
+    {
+      if (hurd_ihash_add (&ihash, key, &values[key])
+	  || hurd_cihash_add (&cihash, key, &values[key]))
+	error (1, 0, "out of memory");
+    }
+
+  run ("ihash+rwlock", ihash_worker);
+  run ("cihash", cihash_worker);
+
+  hurd_ihash_destroy (&ihash);
+  hurd_cihash_destroy (&cihash);
+  return 0;
+}
@@ -0,0 +1,103 @@
+/* Just enough of <mach/mach.h> to build libpipe's packet queues on GNU/Linux.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* This is only used to run benchmarks such as pq-throughput on machines
+   without Mach.  vm_copy is a plain copy here, so transfers which share
+   pages on the Hurd are measured with their copying cost.  */
+
+#ifndef _MACH_H
+#define _MACH_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* On the Hurd, MAP_ANON alone gives private memory.  */
+#undef MAP_ANON
+#define MAP_ANON (MAP_ANONYMOUS | MAP_PRIVATE)
+
+typedef int kern_return_t;
+typedef unsigned int mach_port_t;
+typedef uintptr_t vm_address_t;
+typedef uintptr_t vm_offset_t;
+typedef uintptr_t vm_size_t;
+typedef struct { int seconds, microseconds; } time_value_t;
+
+#define KERN_SUCCESS		0
+#define KERN_NO_SPACE		3
+#define MACH_PORT_NULL		((mach_port_t) 0)
+
+#define vm_page_size		((vm_size_t) getpagesize ())
+#define trunc_page(x)		((vm_offset_t) (x) & ~(vm_page_size - 1))
+#define round_page(x)		trunc_page ((vm_offset_t) (x) + vm_page_size - 1)
+
+#define pthread_hurd_cond_wait_np(c, m) \
+  (pthread_cond_wait ((c), (m)), 0)
+#define pthread_hurd_cond_timedwait_np(c, m, t) \
+  pthread_cond_timedwait ((c), (m), (t))
+
+static inline mach_port_t
+mach_task_self (void)
+{
+  return 1;
+}
+
+static inline kern_return_t
+mach_port_deallocate (mach_port_t task, mach_port_t name)
+{
+  return KERN_SUCCESS;
+}
+
+static inline kern_return_t
+vm_allocate (mach_port_t task, vm_address_t *addr, vm_size_t size,
+	     int anywhere)
+{
+  void *p;
+
+  if (! anywhere)
+    /* Allocating at a given address is only used to try to grow a buffer
+       in place, and may always fail.  */
+    return KERN_NO_SPACE;
+
+  p = mmap (0, size, PROT_READ|PROT_WRITE, MAP_ANON, -1, 0);
+  if (p == MAP_FAILED)
+    return KERN_NO_SPACE;
+  *addr = (vm_address_t) p;
+  return KERN_SUCCESS;
+}
+
+static inline kern_return_t
+vm_deallocate (mach_port_t task, vm_address_t addr, vm_size_t size)
+{
+  munmap ((void *) addr, size);
+  return KERN_SUCCESS;
+}
+
+static inline kern_return_t
+vm_copy (mach_port_t task, vm_address_t src, vm_size_t size,
+	 vm_address_t dst)
+{
+  memcpy ((void *) dst, (void *) src, size);
+  return KERN_SUCCESS;
+}
+
+#endif /* _MACH_H */
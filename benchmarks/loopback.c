@@ -0,0 +1,218 @@
+/* Measure TCP throughput over the loopback interface.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+/* Open CONNECTIONS TCP connections to 127.0.0.1, and send data over
+   all of them at once for SECONDS seconds, with a thread on each end
+   of each connection.  This is done with 1, 2, 4 and so on
+   connections up to CONNECTIONS, and the total throughput of each run
+   is printed.  With a TCP/IP stack which can handle independent
+   connections in parallel, the throughput grows with the number of
+   connections until the processors are busy.
+
+   Usage: loopback [CONNECTIONS [SECONDS [SIZE]]]
+
+   SIZE is the number of bytes written at once.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static int nconnections = 8;
+static int seconds = 5;
+static size_t size = 16384;
+
+/* Set once the senders are to stop.  */
+static int stop;
+
+struct connection
+{
+  int sender, receiver;
+  unsigned long long received;
+};
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+send_data (void *arg)
+{
+  struct connection *c = arg;
+  char *buf = calloc (1, size);
+  ssize_t done;
+
+  if (buf == NULL)
+    error (1, errno, "calloc");
+
+  while (! __atomic_load_n (&stop, __ATOMIC_RELAXED))
+    {
+      done = write (c->sender, buf, size);
+      if (done < 0 && errno != EINTR)
+	error (1, errno, "write");
+    }
+
+  shutdown (c->sender, SHUT_WR);
+  free (buf);
+  return NULL;
+}
+
+static void *
+receive_data (void *arg)
+{
+  struct connection *c = arg;
+  char *buf = malloc (size);
+  ssize_t done;
+
+  if (buf == NULL)
+    error (1, errno, "malloc");
+
+  for (;;)
+    {
+      done = read (c->receiver, buf, size);
+      if (done == 0)
+	break;
+      if (done < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error (1, errno, "read");
+	}
+      c->received += done;
+    }
+
+  free (buf);
+  return NULL;
+}
+
+/* Connect to the listening socket LISTENER, whose address is ADDR, and
+   fill in both ends of C.  */
+static void
+open_connection (int listener, struct sockaddr_in *addr,
+		 struct connection *c)
+{
+  c->sender = socket (PF_INET, SOCK_STREAM, 0);
+  if (c->sender < 0)
+    error (1, errno, "socket");
+  if (connect (c->sender, (struct sockaddr *) addr, sizeof *addr) < 0)
+    error (1, errno, "connect");
+  c->receiver = accept (listener, NULL, NULL);
+  if (c->receiver < 0)
+    error (1, errno, "accept");
+  c->received = 0;
+}
+
+/* Run with N connections, and print the throughput.  */
+static void
+run (int listener, struct sockaddr_in *addr, int n)
+{
+  struct connection *c = calloc (n, sizeof *c);
+  pthread_t *threads = calloc (2 * n, sizeof *threads);
+  unsigned long long total = 0;
+  double start, elapsed;
+  int i, err;
+
+  if (c == NULL || threads == NULL)
+    error (1, errno, "calloc");
+
+  for (i = 0; i < n; i++)
+    open_connection (listener, addr, &c[i]);
+
+  stop = 0;
+  start = now ();
+  for (i = 0; i < n; i++)
+    {
+      err = pthread_create (&threads[2 * i], NULL, receive_data, &c[i]);
+      if (! err)
+	err = pthread_create (&threads[2 * i + 1], NULL, send_data, &c[i]);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  sleep (seconds);
+  __atomic_store_n (&stop, 1, __ATOMIC_RELAXED);
+
+  for (i = 0; i < 2 * n; i++)
+    pthread_join (threads[i], NULL);
+  elapsed = now () - start;
+
+  for (i = 0; i < n; i++)
+    {
+      total += c[i].received;
+      close (c[i].sender);
+      close (c[i].receiver);
+    }
+
+  printf ("%3d connections  %10.1f MB/s  (%.1f MB/s each)\n", n,
+	  total / elapsed / 1e6, total / elapsed / 1e6 / n);
+
+  free (threads);
+  free (c);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof addr;
+  int listener, n;
+
+  if (argc > 1)
+    nconnections = atoi (argv[1]);
+  if (argc > 2)
+    seconds = atoi (argv[2]);
+  if (argc > 3)
+    size = strtoul (argv[3], NULL, 0);
+  if (nconnections <= 0 || seconds <= 0 || size == 0)
+    error (1, 0, "usage: %s [CONNECTIONS [SECONDS [SIZE]]]", argv[0]);
+
+  listener = socket (PF_INET, SOCK_STREAM, 0);
+  if (listener < 0)
+    error (1, errno, "socket");
+
+  memset (&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind (listener, (struct sockaddr *) &addr, sizeof addr) < 0)
+    error (1, errno, "bind");
+  if (getsockname (listener, (struct sockaddr *) &addr, &addrlen) < 0)
+    error (1, errno, "getsockname");
+  if (listen (listener, nconnections) < 0)
+    error (1, errno, "listen");
+
+  for (n = 1; n < nconnections; n *= 2)
+    run (listener, &addr, n);
+  run (listener, &addr, nconnections);
+
+  close (listener);
+  return 0;
+}
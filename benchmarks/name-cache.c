@@ -0,0 +1,571 @@
+/* Compare the probes of libdiskfs's directory name lookup cache.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Look up the components of a trace of paths, one after the other, with
+   diskfs_check_lookup_cache, and enter those it misses with
+   diskfs_enter_lookup_cache, the way diskfs_lookup does.  This is done
+   with three builds of the cache: with buckets of four entries probed
+   one entry at a time, as the cache was, with buckets as wide as the
+   cache has on this target probed one at a time, and with those probed
+   by comparing all their keys at once with vector instructions.  For
+   each, print the rate of the lookups and the share of them answered by
+   the cache, then the time a hit takes, measured over lookups known to
+   hit.
+
+   TRACE is a file of paths, one per line, such as `find /usr' prints
+   or the paths opened in a strace log.  Without it, the paths are
+   picked from a made up source tree, the more popular files more often
+   (following Zipf's law), and one in four is first looked for in a few
+   directories which don't have it, the way a compiler searches its
+   include path, making negative entries.
+
+   Usage: name-cache [CACHE-SIZE [TRACE]]
+
+   The few functions of libdiskfs the cache calls are provided here, so
+   that this can be built on GNU/Linux from the top of the source tree
+   with:
+
+     gcc -O2 -D_GNU_SOURCE -pthread -o name-cache benchmarks/name-cache.c
+
+   adding -mavx2 to compare the probe the cache has on targets with
+   AVX2 rather than SSE2.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Keep the headers of libdiskfs out; what the cache needs of them
+   follows.  */
+#define DISKFS_PRIV_H
+
+struct node
+{
+  pthread_mutex_t lock;
+  int references;
+  ino64_t cache_id;
+};
+
+struct diskfs_lookup_cache_stats
+{
+  unsigned long size;
+  unsigned long entries;
+  unsigned long hits;
+  unsigned long negative_hits;
+  unsigned long misses;
+  unsigned long evictions;
+};
+
+struct node *diskfs_root_node;
+
+/* The nodes of the tree looked up in, by cache id less one.  */
+static struct node *nodes;
+
+void
+diskfs_nref (struct node *np)
+{
+  np->references++;
+}
+
+void
+diskfs_nput (struct node *np)
+{
+  np->references--;
+}
+
+error_t
+diskfs_cached_lookup (ino64_t cache_id, struct node **npp)
+{
+  *npp = &nodes[cache_id - 1];
+  diskfs_nref (*npp);
+  return 0;
+}
+
+/* The cache is included once for each build of it compared, with its
+   identifiers prefixed by CACHE so that they don't clash.  */
+#define PASTE(a, b)	PASTE_1 (a, b)
+#define PASTE_1(a, b)	a ## b
+#define CACHE_NAME(name) PASTE (CACHE, name)
+
+#define cache_bucket			CACHE_NAME (cache_bucket)
+#define diskfs_name_cache_size		CACHE_NAME (diskfs_name_cache_size)
+#define name_cache			CACHE_NAME (name_cache)
+#define cache_buckets			CACHE_NAME (cache_buckets)
+#define cache_mask			CACHE_NAME (cache_mask)
+#define cache_init_once			CACHE_NAME (cache_init_once)
+#define cache_init			CACHE_NAME (cache_init)
+#define charp				CACHE_NAME (charp)
+#define frequ				CACHE_NAME (frequ)
+#define add_entry			CACHE_NAME (add_entry)
+#define remove_entry			CACHE_NAME (remove_entry)
+#define valid_entry			CACHE_NAME (valid_entry)
+#define rotl32				CACHE_NAME (rotl32)
+#define getblock32			CACHE_NAME (getblock32)
+#define fmix32				CACHE_NAME (fmix32)
+#define MurmurHash3_x86_32		CACHE_NAME (MurmurHash3_x86_32)
+#define match_keys			CACHE_NAME (match_keys)
+#define lookup				CACHE_NAME (lookup)
+#define hash				CACHE_NAME (hash)
+#define diskfs_enter_lookup_cache	CACHE_NAME (diskfs_enter_lookup_cache)
+#define diskfs_purge_lookup_cache	CACHE_NAME (diskfs_purge_lookup_cache)
+#define diskfs_check_lookup_cache	CACHE_NAME (diskfs_check_lookup_cache)
+#define diskfs_get_lookup_cache_stats \
+  CACHE_NAME (diskfs_get_lookup_cache_stats)
+
+/* The cache as it is built for this target.  */
+#define CACHE vec_
+#include "../libdiskfs/name-cache.c"
+#if defined (PROBE_AVX2)
+#define VEC_PROBE "AVX2"
+#elif defined (PROBE_SSE2)
+#define VEC_PROBE "SSE2"
+#else
+#define VEC_PROBE "scalar"
+#endif
+enum { vec_bucket_size = BUCKET_SIZE };
+#undef CACHE
+#undef BUCKET_SIZE
+#undef DEFAULT_CACHE_SIZE
+#undef PROBE_AVX2
+#undef PROBE_SSE2
+
+/* The same, but probing one entry at a time.  */
+#define CACHE scalar_
+#define BUCKET_SIZE vec_bucket_size
+#define SCALAR_PROBE
+#include "../libdiskfs/name-cache.c"
+#undef CACHE
+#undef BUCKET_SIZE
+#undef DEFAULT_CACHE_SIZE
+
+/* The cache as it was before its buckets were made wider.  */
+#define CACHE old_
+#define BUCKET_SIZE 4
+#include "../libdiskfs/name-cache.c"
+#undef CACHE
+#undef BUCKET_SIZE
+#undef DEFAULT_CACHE_SIZE
+#undef SCALAR_PROBE
+
+struct cache
+{
+  const char *name;
+  int bucket_size;
+  int *size;
+  void (*enter) (struct node *dir, struct node *np, const char *name);
+  struct node *(*check) (struct node *dir, const char *name);
+  void (*get_stats) (struct diskfs_lookup_cache_stats *stats);
+};
+
+static const struct cache caches[] =
+  {
+    { "scalar", 4, &old_diskfs_name_cache_size,
+      old_diskfs_enter_lookup_cache, old_diskfs_check_lookup_cache,
+      old_diskfs_get_lookup_cache_stats },
+    { "scalar", vec_bucket_size, &scalar_diskfs_name_cache_size,
+      scalar_diskfs_enter_lookup_cache, scalar_diskfs_check_lookup_cache,
+      scalar_diskfs_get_lookup_cache_stats },
+    { VEC_PROBE, vec_bucket_size, &vec_diskfs_name_cache_size,
+      vec_diskfs_enter_lookup_cache, vec_diskfs_check_lookup_cache,
+      vec_diskfs_get_lookup_cache_stats },
+  };
+
+/* Hits are timed over the lookups of this many steps at the end of
+   the trace which hit, repeated until about HIT_LOOKUPS are made.  */
+#define HIT_STEPS	4096
+#define HIT_LOOKUPS	4000000
+
+/* The number of paths looked up in the made up tree.  */
+#define ACCESSES	500000
+
+static int cache_size = 1024;
+
+/* The tree looked up in.  The name and the parent of node ID are
+   NAMES[ID] and PARENTS[ID]; the root is node 1, its own parent.  */
+static char **names;
+static ino64_t *parents;
+static ino64_t nnodes;
+static size_t nodes_alloced;
+
+/* The entries of the tree, hashed by directory and name.  */
+struct dirent_link
+{
+  struct dirent_link *next;
+  ino64_t id;
+};
+#define DIRENT_BUCKETS	(1 << 16)
+static struct dirent_link *dirents[DIRENT_BUCKETS];
+
+/* A single lookup of a trace: NAME in DIR, which finds ID, or nothing if
+   ID is 0.  */
+struct step
+{
+  ino64_t dir, id;
+  const char *name;
+};
+static struct step *steps;
+static size_t nsteps, steps_alloced;
+
+/* Return the node called NAME in DIR, making it if MAKE is true and
+   there is none, or 0 if there is none.  */
+static ino64_t
+dir_entry (ino64_t dir, const char *name, int make)
+{
+  struct dirent_link **l = &dirents[vec_hash (dir, name)
+				   & (DIRENT_BUCKETS - 1)];
+  struct dirent_link *d;
+
+  for (d = *l; d; d = d->next)
+    if (parents[d->id] == dir && strcmp (names[d->id], name) == 0)
+      return d->id;
+  if (! make)
+    return 0;
+
+  if (nnodes + 1 >= nodes_alloced)
+    {
+      nodes_alloced = nodes_alloced ? 2 * nodes_alloced : 4096;
+      names = realloc (names, nodes_alloced * sizeof *names);
+      parents = realloc (parents, nodes_alloced * sizeof *parents);
+      if (! names || ! parents)
+	error (1, errno, "realloc");
+    }
+  d = malloc (sizeof *d);
+  if (! d)
+    error (1, errno, "malloc");
+  d->id = ++nnodes;
+  names[d->id] = strdup (name);
+  parents[d->id] = dir;
+  d->next = *l;
+  *l = d;
+  return d->id;
+}
+
+static void
+add_step (ino64_t dir, const char *name, ino64_t id)
+{
+  if (nsteps == steps_alloced)
+    {
+      steps_alloced = steps_alloced ? 2 * steps_alloced : 65536;
+      steps = realloc (steps, steps_alloced * sizeof *steps);
+      if (! steps)
+	error (1, errno, "realloc");
+    }
+  steps[nsteps].dir = dir;
+  steps[nsteps].id = id;
+  steps[nsteps].name = name;
+  nsteps++;
+}
+
+/* Add the steps of looking up node ID from the root.  */
+static void
+add_path (ino64_t id)
+{
+  if (id == 1)
+    return;
+  add_path (parents[id]);
+  add_step (parents[id], names[id], id);
+}
+
+/* Read the paths in the file TRACE, and add the steps of looking them
+   up.  "." and ".." are gone through without looking them up.  */
+static void
+read_trace (const char *trace)
+{
+  FILE *f = fopen (trace, "r");
+  char *line = NULL, *p, *component;
+  size_t line_len = 0;
+  ssize_t len;
+  ino64_t dir;
+
+  if (! f)
+    error (1, errno, "%s", trace);
+  while ((len = getline (&line, &line_len, f)) > 0)
+    {
+      if (line[len - 1] == '\n')
+	line[len - 1] = '\0';
+      dir = 1;
+      for (p = line; (component = strsep (&p, "/")); )
+	if (! *component || strcmp (component, ".") == 0)
+	  continue;
+	else if (strcmp (component, "..") == 0)
+	  dir = parents[dir];
+	else
+	  {
+	    ino64_t id = dir_entry (dir, component, 1);
+	    add_step (dir, names[id], id);
+	    dir = id;
+	  }
+    }
+  free (line);
+  fclose (f);
+}
+
+static inline unsigned long
+random_next (unsigned long *state)
+{
+  /* xorshift; good enough to make up a tree.  */
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static unsigned long seed = 1;
+
+#define PICK(array) (array[random_next (&seed) % (sizeof array \
+						 / sizeof array[0])])
+
+static const char *const dir_names[] =
+  {
+    "src", "lib", "include", "doc", "tests", "util", "net", "fs", "mm",
+    "kernel", "drivers", "arch", "scripts", "tools", "po", "sys", "bits",
+    "hurd", "mach", "device", "linux", "gnu", "misc", "config", "libc",
+    "x86", "common", "core", "io", "ipc",
+  };
+
+static const char *const stems[] =
+  {
+    "main", "util", "config", "parse", "io", "init", "alloc", "hash",
+    "list", "lock", "file", "dir", "node", "port", "msg", "error",
+    "debug", "cache", "buffer", "string", "time", "signal", "thread",
+    "socket", "pipe", "device", "pager", "store", "table", "queue",
+    "inode", "super", "block", "bitmap", "name", "lookup", "link",
+    "stat", "open", "close", "read", "write", "seek", "map", "sync",
+  };
+
+static const char *const exts[] =
+  { ".c", ".c", ".c", ".h", ".h", ".o", ".o", ".d", "~", "" };
+
+static const char *const other_files[] =
+  { "Makefile", "ChangeLog", "README", "NEWS", "TODO", ".gitignore" };
+
+/* The files of the made up tree, and the directories in it.  */
+static ino64_t *files, *dirs;
+static size_t nfiles, ndirs;
+
+/* Fill directory DIR, at DEPTH below the root, with made up files and
+   subdirectories.  */
+static void
+make_dir (ino64_t dir, int depth)
+{
+  char name[64];
+  int n, i;
+
+  dirs = realloc (dirs, (ndirs + 1) * sizeof *dirs);
+  if (! dirs)
+    error (1, errno, "realloc");
+  dirs[ndirs++] = dir;
+
+  n = 4 + random_next (&seed) % 40;
+  for (i = 0; i < n; i++)
+    {
+      if (i < 2)
+	strcpy (name, PICK (other_files));
+      else if (random_next (&seed) % 2)
+	snprintf (name, sizeof name, "%s%s", PICK (stems), PICK (exts));
+      else
+	snprintf (name, sizeof name, "%s-%s%s", PICK (stems), PICK (stems),
+		  PICK (exts));
+      if (dir_entry (dir, name, 0))
+	continue;
+      files = realloc (files, (nfiles + 1) * sizeof *files);
+      if (! files)
+	error (1, errno, "realloc");
+      files[nfiles++] = dir_entry (dir, name, 1);
+    }
+
+  n = depth < 5 ? 1 + random_next (&seed) % (8 - depth) : 0;
+  for (i = 0; i < n; i++)
+    {
+      const char *dir_name = PICK (dir_names);
+      if (! dir_entry (dir, dir_name, 0))
+	make_dir (dir_entry (dir, dir_name, 1), depth + 1);
+    }
+}
+
+/* Make up a source tree, and add the steps of looking up ACCESSES paths
+   in it.  */
+static void
+make_trace (void)
+{
+  double *cdf, total = 0;
+  ino64_t search[3];
+  size_t i, j;
+
+  make_dir (1, 0);
+
+  /* Shuffle the files, and give them Zipf-distributed popularities.  */
+  for (i = nfiles - 1; i > 0; i--)
+    {
+      ino64_t t;
+      j = random_next (&seed) % (i + 1);
+      t = files[i], files[i] = files[j], files[j] = t;
+    }
+  cdf = malloc (nfiles * sizeof *cdf);
+  if (! cdf)
+    error (1, errno, "malloc");
+  for (i = 0; i < nfiles; i++)
+    cdf[i] = total += 1.0 / (i + 1);
+
+  for (i = 0; i < 3; i++)
+    search[i] = dirs[random_next (&seed) % ndirs];
+
+  for (i = 0; i < ACCESSES; i++)
+    {
+      double u = (random_next (&seed) % 1000000) / 1e6 * total;
+      size_t lo = 0, hi = nfiles - 1;
+      ino64_t id;
+
+      while (lo < hi)
+	{
+	  size_t mid = (lo + hi) / 2;
+	  if (cdf[mid] < u)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      id = files[lo];
+
+      if (random_next (&seed) % 4 == 0)
+	{
+	  for (j = 0; j < 3 && ! dir_entry (search[j], names[id], 0); j++)
+	    add_step (search[j], names[id], 0);
+	}
+      add_path (id);
+    }
+  free (cdf);
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Look up the name of step S in cache C, and check the answer.  Return
+   true if it was a hit.  */
+static inline int
+check_step (const struct cache *c, const struct step *s)
+{
+  struct node *np = (*c->check) (&nodes[s->dir - 1], s->name);
+
+  if (np == NULL)
+    return 0;
+  if (np == (struct node *) -1 ? s->id != 0 : np != &nodes[s->id - 1])
+    error (1, 0, "%s: wrong node for %s in %llu", c->name, s->name,
+	   (unsigned long long) s->dir);
+  if (np != (struct node *) -1)
+    diskfs_nput (np);
+  return 1;
+}
+
+/* Go through the trace with cache C, and print how it did.  */
+static void
+run (const struct cache *c)
+{
+  struct diskfs_lookup_cache_stats stats;
+  const struct step **hit_steps;
+  size_t i, nhits, rounds;
+  double start, elapsed, hit_time;
+
+  *c->size = cache_size;
+
+  start = now ();
+  for (i = 0; i < nsteps; i++)
+    if (! check_step (c, &steps[i]))
+      (*c->enter) (&nodes[steps[i].dir - 1],
+		   steps[i].id ? &nodes[steps[i].id - 1] : NULL,
+		   steps[i].name);
+  elapsed = now () - start;
+  (*c->get_stats) (&stats);
+
+  /* Time the hits.  */
+  hit_steps = malloc (HIT_STEPS * sizeof *hit_steps);
+  if (! hit_steps)
+    error (1, errno, "malloc");
+  for (i = 0, nhits = 0; i < nsteps && i < HIT_STEPS; i++)
+    if (check_step (c, &steps[nsteps - 1 - i]))
+      hit_steps[nhits++] = &steps[nsteps - 1 - i];
+  rounds = nhits ? HIT_LOOKUPS / nhits + 1 : 0;
+  start = now ();
+  for (i = 0; i < rounds * nhits; i++)
+    if (! check_step (c, hit_steps[i % nhits]))
+      error (1, 0, "%s: %s in %llu was evicted by a hit", c->name,
+	     hit_steps[i % nhits]->name,
+	     (unsigned long long) hit_steps[i % nhits]->dir);
+  hit_time = nhits ? (now () - start) / (rounds * nhits) : 0;
+  free (hit_steps);
+
+  printf ("%2d-way %-6s  %10.0f lookups/s  hits %5.1f%% "
+	  "(negative %4.1f%%)  evictions %8lu  %5.1f ns/hit\n",
+	  c->bucket_size, c->name, nsteps / elapsed,
+	  100.0 * (stats.hits + stats.negative_hits) / nsteps,
+	  100.0 * stats.negative_hits / nsteps, stats.evictions,
+	  hit_time * 1e9);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t i;
+
+  if (argc > 1)
+    cache_size = atoi (argv[1]);
+  if (cache_size <= 0 || argc > 3)
+    error (1, 0, "usage: %s [CACHE-SIZE [TRACE]]", argv[0]);
+
+  /* The root.  */
+  dir_entry (0, "/", 1);
+  parents[1] = 1;
+
+  if (argc > 2)
+    read_trace (argv[2]);
+  else
+    make_trace ();
+
+  nodes = calloc (nnodes, sizeof *nodes);
+  if (! nodes)
+    error (1, errno, "calloc");
+  for (i = 0; i < nnodes; i++)
+    {
+      pthread_mutex_init (&nodes[i].lock, NULL);
+      nodes[i].cache_id = i + 1;
+    }
+  diskfs_root_node = &nodes[0];
+
+  printf ("cache size %d  names %llu  lookups %zu\n", cache_size,
+	  (unsigned long long) nnodes - 1, nsteps);
+  for (i = 0; i < sizeof caches / sizeof caches[0]; i++)
+    run (&caches[i]);
+
+  return 0;
+}
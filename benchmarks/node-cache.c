@@ -0,0 +1,271 @@
+/* Check that a sync leaves libdiskfs's node cache as it was.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Bring NODES nodes into the node cache one after the other, and give
+   each back, so that the last CACHE-SIZE of them are kept unused and
+   the ones before are evicted.  Every fourth node keeps a light
+   reference, the way the pager of a file which has been read keeps its
+   node alive after it is evicted, and every fiftieth stays in use.
+   Then go through the nodes with diskfs_node_iterate, as
+   diskfs_sync_everything does, and check that every node was visited
+   once, that the unused nodes are the same ones, in the same order, and
+   that none was evicted or dropped.
+
+   Usage: node-cache [NODES [CACHE-SIZE]]
+
+   The parts of libdiskfs the node cache uses are provided here, so
+   that this does not depend on Mach, and can be built on GNU/Linux from
+   the top of the source tree with:
+
+     mkdir -p /tmp/ihash-inc && ln -sfn $PWD/libihash /tmp/ihash-inc/hurd
+     gcc -O2 -D_GNU_SOURCE -I/tmp/ihash-inc -o node-cache \
+       benchmarks/node-cache.c libihash/ihash.c  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <error.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <hurd/ihash.h>
+
+/* Keep the headers of libdiskfs out; what the node cache needs of them
+   follows.  */
+#define DISKFS_PRIV_H
+
+struct node
+{
+  hurd_ihash_locp_t slot;
+  struct node *lru_next, **lru_prevp;
+  int cache_ref;
+  pthread_mutex_t lock;
+  int references, light_references;
+  ino64_t cache_id;
+  struct
+  {
+    nlink_t st_nlink;
+  } dn_stat;
+};
+
+struct lookup_context;
+
+struct diskfs_node_cache_stats
+{
+  unsigned long nodes;
+  unsigned long unused;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+};
+
+pthread_spinlock_t diskfs_node_refcnt_lock;
+
+void diskfs_drop_node (struct node *np);
+void diskfs_nrele (struct node *np);
+void diskfs_nrele_light (struct node *np);
+void diskfs_node_norefs (struct node *np);
+void diskfs_lost_hardrefs (struct node *np);
+error_t diskfs_user_make_node (struct node **npp,
+			       struct lookup_context *ctx);
+error_t diskfs_user_read_node (struct node *np, struct lookup_context *ctx);
+void diskfs_user_node_norefs (struct node *np);
+void diskfs_user_try_dropping_softrefs (struct node *np);
+void diskfs_user_new_hardrefs (struct node *np);
+
+#include "../libdiskfs/node-cache.c"
+
+static unsigned long nnodes = 4096;
+
+/* The number of nodes dropped.  */
+static unsigned long dropped;
+
+/* As libdiskfs does, but without writing anything out.  */
+void
+diskfs_drop_node (struct node *np)
+{
+  dropped++;
+  diskfs_node_norefs (np);
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+}
+
+/* As libdiskfs does, for nodes which are never unlinked.  */
+void
+diskfs_nrele (struct node *np)
+{
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  assert (np->references);
+  np->references--;
+  if (np->references + np->light_references == 0)
+    {
+      pthread_mutex_lock (&np->lock);
+      diskfs_drop_node (np);
+    }
+  else if (np->references == 0)
+    {
+      pthread_mutex_lock (&np->lock);
+      pthread_spin_unlock (&diskfs_node_refcnt_lock);
+      diskfs_lost_hardrefs (np);
+      pthread_mutex_unlock (&np->lock);
+    }
+  else
+    pthread_spin_unlock (&diskfs_node_refcnt_lock);
+}
+
+void
+diskfs_nrele_light (struct node *np)
+{
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  assert (np->light_references);
+  np->light_references--;
+  if (np->references + np->light_references == 0)
+    {
+      pthread_mutex_lock (&np->lock);
+      diskfs_drop_node (np);
+    }
+  else
+    pthread_spin_unlock (&diskfs_node_refcnt_lock);
+}
+
+/* Bring node ID into the cache with one hard reference, as
+   diskfs_cached_lookup_context does when it is not in core; the
+   default diskfs_user_make_node, which is in the same file, cannot be
+   replaced from here.  */
+static struct node *
+make_node (ino64_t id)
+{
+  struct node *np = calloc (1, sizeof *np);
+
+  if (! np)
+    error (1, errno, "calloc");
+  pthread_mutex_init (&np->lock, NULL);
+  np->cache_id = id;
+  np->dn_stat.st_nlink = 1;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  if (hurd_ihash_add (&nodecache, (hurd_ihash_key_t) id, np))
+    error (1, ENOMEM, "hurd_ihash_add");
+  cache_misses++;
+  np->references = 1;
+  np->light_references = 1;
+  np->cache_ref = 1;
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+  return np;
+}
+
+static unsigned long visited;
+
+static error_t
+visit (struct node *np)
+{
+  if (pthread_mutex_trylock (&np->lock) == 0)
+    error (1, 0, "node %llu not locked while visited",
+	   (unsigned long long) np->cache_id);
+  visited++;
+  return 0;
+}
+
+/* Put the cache ids of the unused nodes, least recently used first,
+   into IDS, and return their number.  */
+static size_t
+list_unused (ino64_t *ids)
+{
+  struct node *np;
+  size_t n = 0;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  for (np = lru_first; np; np = np->lru_next)
+    ids[n++] = np->cache_id;
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+  return n;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct diskfs_node_cache_stats before, after;
+  ino64_t *lru_before, *lru_after;
+  size_t n_before, n_after, i;
+  unsigned long dropped_before;
+  struct node *np;
+  ino64_t id;
+
+  if (argc > 1)
+    nnodes = strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    diskfs_node_cache_size = atoi (argv[2]);
+  else
+    diskfs_node_cache_size = nnodes / 4;
+  if (nnodes == 0 || diskfs_node_cache_size <= 0 || argc > 3)
+    error (1, 0, "usage: %s [NODES [CACHE-SIZE]]", argv[0]);
+
+  pthread_spin_init (&diskfs_node_refcnt_lock, PTHREAD_PROCESS_PRIVATE);
+  lru_before = malloc (nnodes * sizeof *lru_before);
+  lru_after = malloc (nnodes * sizeof *lru_after);
+  if (! lru_before || ! lru_after)
+    error (1, errno, "malloc");
+
+  for (id = 1; id <= nnodes; id++)
+    {
+      np = make_node (id);
+      if (id % 4 == 0)
+	/* The pager's reference.  */
+	{
+	  pthread_spin_lock (&diskfs_node_refcnt_lock);
+	  np->light_references++;
+	  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+	}
+      if (id % 50 != 0)
+	diskfs_nrele (np);
+    }
+
+  diskfs_get_node_cache_stats (&before);
+  n_before = list_unused (lru_before);
+  dropped_before = dropped;
+
+  /* What diskfs_sync_everything does.  */
+  diskfs_node_iterate (visit);
+
+  diskfs_get_node_cache_stats (&after);
+  n_after = list_unused (lru_after);
+
+  printf ("nodes %lu  unused %lu  evictions %lu  dropped %lu  visited %lu\n",
+	  before.nodes, before.unused, before.evictions, dropped_before,
+	  visited);
+  printf ("after: nodes %lu  unused %lu  evictions %lu  dropped %lu\n",
+	  after.nodes, after.unused, after.evictions, dropped);
+
+  if (visited != before.nodes)
+    error (1, 0, "%lu nodes visited, not %lu", visited, before.nodes);
+  if (after.evictions != before.evictions || dropped != dropped_before
+      || after.nodes != before.nodes)
+    error (1, 0, "the iteration evicted nodes from the cache");
+  if (n_after != n_before)
+    error (1, 0, "%zu unused nodes after the iteration, not %zu",
+	   n_after, n_before);
+  for (i = 0; i < n_before; i++)
+    if (lru_after[i] != lru_before[i])
+      error (1, 0, "unused node %zu is %llu after the iteration, not %llu",
+	     i, (unsigned long long) lru_after[i],
+	     (unsigned long long) lru_before[i]);
+
+  printf ("ok\n");
+  return 0;
+}
@@ -0,0 +1,169 @@
+/* Measure the throughput of libpipe's stream packet queues.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Push MEGABYTES of data through the packet queue of a stream pipe, in
+   messages of several sizes, the way pipe_send and pipe_recv do but
+   without the locking and the RPCs around them.  This is done with
+   every message read back right after it's written (ping-pong), and
+   with the writer staying up to a full pipe ahead of the reader
+   (streaming).
+
+   Usage: pq-throughput [MEGABYTES]
+
+   This can be built on GNU/Linux from the top of the source tree, using
+   the minimal <mach/mach.h> in benchmarks/linux, with:
+
+     gcc -O2 -D_GNU_SOURCE -Ibenchmarks/linux -Ilibpipe -o pq-throughput \
+       benchmarks/pq-throughput.c libpipe/pq.c libpipe/stream.c  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <error.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "pipe.h"
+#include "pq.h"
+
+/* The default write limit of a pipe.  */
+#define PIPE_LIMIT	(16 * 1024)
+
+static unsigned long megabytes = 1024;
+
+static const size_t sizes[] =
+  { 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+/* The source addresses of stream pipes are always null.  */
+void
+pipe_dealloc_addr (void *addr)
+{
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Write the SIZE bytes of MSG to PQ.  */
+static void
+send (struct pq *pq, char *msg, size_t size)
+{
+  size_t amount;
+
+  if ((*stream_pipe_class->write) (pq, NULL, msg, size, &amount)
+      || amount != size)
+    error (1, 0, "write failed");
+}
+
+/* Read up to SIZE bytes from PQ into BUF, returning the amount read.
+   Like the mig stubs would, deallocate any memory the read returned
+   instead of BUF.  */
+static size_t
+receive (struct pq *pq, char *buf, size_t size)
+{
+  struct packet *packet = pq_head (pq, PACKET_TYPE_DATA, NULL);
+  char *data = buf;
+  size_t data_len = size;
+  int dequeue;
+
+  if (! packet)
+    return 0;
+  if ((*stream_pipe_class->read) (packet, &dequeue, NULL,
+				  &data, &data_len, size))
+    error (1, 0, "read failed");
+  if (dequeue)
+    pq_dequeue (pq);
+  if (data != buf)
+    munmap ((void *) trunc_page (data),
+	    round_page (data + data_len) - trunc_page (data));
+  return data_len;
+}
+
+/* Return the number of bytes in PQ.  */
+static size_t
+readable (struct pq *pq)
+{
+  struct packet *packet;
+  size_t total = 0;
+
+  for (packet = pq_head (pq, PACKET_TYPE_ANY, NULL); packet;
+       packet = packet->next)
+    total += packet_readable (packet);
+  return total;
+}
+
+/* Push the data through PQ in SIZE byte messages, keeping up to AHEAD
+   bytes in it, and print the throughput as NAME.  */
+static void
+run (const char *name, size_t size, size_t ahead)
+{
+  size_t total = megabytes << 20;
+  size_t msgs = total / size, sent = 0, received = 0;
+  struct pq *pq;
+  char *msg, *buf;
+  double start, elapsed;
+
+  /* Page-aligned, like the out-of-line data of an io_write.  */
+  msg = mmap (0, size, PROT_READ|PROT_WRITE, MAP_ANON, -1, 0);
+  buf = malloc (size);
+  if (msg == MAP_FAILED || buf == NULL || pq_create (&pq))
+    error (1, 0, "out of memory");
+  memset (msg, 'x', size);
+
+  start = now ();
+  while (received < msgs * size)
+    {
+      do
+	send (pq, msg, size);
+      while (++sent < msgs && readable (pq) + size <= ahead);
+
+      do
+	received += receive (pq, buf, size);
+      while (readable (pq) > (sent < msgs ? ahead - size : 0));
+    }
+  elapsed = now () - start;
+
+  printf ("%-10s %6zu bytes  %10.0f msgs/s  %8.1f MB/s\n", name, size,
+	  msgs / elapsed, (msgs * size) / elapsed / (1 << 20));
+
+  pq_free (pq);
+  munmap (msg, size);
+  free (buf);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned long i;
+
+  if (argc > 1)
+    megabytes = strtoul (argv[1], NULL, 0);
+  if (megabytes == 0)
+    error (1, 0, "usage: %s [MEGABYTES]", argv[0]);
+
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+    run ("ping-pong", sizes[i], sizes[i]);
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+    run ("streaming", sizes[i],
+	 PIPE_LIMIT > sizes[i] ? PIPE_LIMIT : sizes[i]);
+
+  return 0;
+}
@@ -62,6 +62,7 @@ ext2_free_blocks (block_t block, unsigned long count)
   unsigned long bit;
   unsigned long i;
   struct ext2_group_desc *gdp;
+  struct group_hint *hint;
 
   pthread_spin_lock (&global_lock);
 
@@ -94,6 +95,13 @@ ext2_free_blocks (block_t block, unsigned long count)
       gdp = group_desc (block_group);
       bh = disk_cache_block_ref (gdp->bg_block_bitmap);
 
+      hint = group_hint (block_group);
+      hint->max_free_run = 0;
+      if (bit < hint->first_free_block)
+	hint->first_free_block = bit;
+      if ((bit >> 3) < hint->first_free_byte)
+	hint->first_free_byte = bit >> 3;
+
       if (in_range (gdp->bg_block_bitmap, block, gcount) ||
 	  in_range (gdp->bg_inode_bitmap, block, gcount) ||
 	  in_range (block, gdp->bg_inode_table, itb_per_group) ||
@@ -128,23 +136,104 @@ ext2_free_blocks (block_t block, unsigned long count)
   alloc_sync (0);
 }
 
+/* Return the most free blocks there may be in a row in group GROUP.  */
+static inline unsigned
+max_free_run (int group)
+{
+  unsigned run = group_hint (group)->max_free_run;
+  unsigned free = group_desc (group)->bg_free_blocks_count;
+  return run && run < free ? run : free;
+}
+
+/* Return the first bit at or after START of the block bitmap BH of group
+   GROUP which starts a run of WANT free blocks, or -1 if there is none.
+   A search of the whole group which fails records the longest run it
+   found, so that the group is not searched again for as long a run until
+   blocks are freed in it.  */
+static int
+find_free_run (char *bh, int group, unsigned start, unsigned want)
+{
+  struct group_hint *hint = group_hint (group);
+  unsigned long bpg = sblock->s_blocks_per_group;
+  unsigned long b, e, longest = 0;
+  int whole;
+
+  if (start <= hint->first_free_block)
+    start = hint->first_free_block;
+  whole = start == hint->first_free_block;
+
+  for (b = find_next_zero_bit (bh, bpg, start); b < bpg;
+       b = find_next_zero_bit (bh, bpg, e))
+    {
+      e = find_next_set_bit (bh, bpg, b);
+      if (e - b >= want)
+	return b;
+      if (e - b > longest)
+	longest = e - b;
+    }
+
+  if (whole)
+    hint->max_free_run = longest;
+  return -1;
+}
+
+/* Look for a run of WANT free blocks, from bit *BIT of group *GROUP on
+   and then in the other groups which may have one.  If there is one,
+   return nonzero, with *GROUP and *BIT set to its start and a reference
+   to the bitmap of its group in *BH.  global_lock is held.  */
+static int
+find_run (int *group, int *bit, unsigned want, char **bh)
+{
+  int i, k, j = *bit;
+
+  for (k = 0; k < groups_count; k++, j = 0)
+    {
+      i = (*group + k) % groups_count;
+      if (max_free_run (i) < want)
+	continue;
+      *bh = disk_cache_block_ref (group_desc (i)->bg_block_bitmap);
+      j = find_free_run (*bh, i, j, want);
+      if (j >= 0)
+	{
+	  *group = i;
+	  *bit = j;
+	  return 1;
+	}
+      disk_cache_block_deref (*bh);
+      *bh = NULL;
+    }
+  return 0;
+}
+
 /*
  * ext2_new_block uses a goal block to assist allocation.  If the goal is
  * free, or there is a free block within 32 blocks of the goal, that block
  * is allocated.  Otherwise a forward search is made for a free block; within
  * each block group the search first looks for an entire free byte in the block
  * bitmap, and then for any free bit if that fails.
+ *
+ * A file being written sequentially asks to preallocate more than the
+ * default number of blocks after the one allocated.  When its goal is not
+ * free, a run of free blocks that long is looked for first, after the
+ * goal and then in the other groups, so that the file is laid out in few
+ * large pieces rather than filling in every hole near the goal.
+ *
+ * The free blocks set aside by delayed allocation are only allocated, or
+ * preallocated, if RESERVED is true, meaning that the caller is writing
+ * out file data they were set aside for.
  */
 block_t
 ext2_new_block (block_t goal,
 		block_t prealloc_goal,
-		block_t *prealloc_count, block_t *prealloc_block)
+		block_t *prealloc_count, block_t *prealloc_block,
+		int reserved)
 {
   char *bh = NULL;
   char *p, *r;
-  int i, j, k, tmp;
-  unsigned long lmap;
+  int i, j, k, tmp, start;
   struct ext2_group_desc *gdp;
+  struct group_hint *hint;
+  block_t avail;
 
 #ifdef EXT2FS_DEBUG
   static int goal_hits = 0, goal_attempts = 0;
@@ -163,6 +252,16 @@ ext2_new_block (block_t goal,
     }
 #endif
 
+  avail = sblock->s_free_blocks_count;
+  if (! reserved)
+    avail = (avail > delalloc_reserved_blocks
+	     ? avail - delalloc_reserved_blocks : 0);
+  if (avail == 0)
+    {
+      pthread_spin_unlock (&global_lock);
+      return 0;
+    }
+
   ext2_debug ("goal=%u", goal);
 
 repeat:
@@ -174,9 +273,10 @@ repeat:
     goal = sblock->s_first_data_block;
   i = (goal - sblock->s_first_data_block) / sblock->s_blocks_per_group;
   gdp = group_desc (i);
+  hint = group_hint (i);
+  j = ((goal - sblock->s_first_data_block) % sblock->s_blocks_per_group);
   if (gdp->bg_free_blocks_count > 0)
     {
-      j = ((goal - sblock->s_first_data_block) % sblock->s_blocks_per_group);
 #ifdef EXT2FS_DEBUG
       if (j)
 	goal_attempts++;
@@ -193,30 +293,43 @@ repeat:
 #endif
 	  goto got_block;
 	}
+    }
+
+#ifdef EXT2_PREALLOCATE
+  if (prealloc_goal > EXT2_DEFAULT_PREALLOC_BLOCKS)
+    {
+      if (bh)
+	{
+	  disk_cache_block_deref (bh);
+	  bh = NULL;
+	}
+      if (find_run (&i, &j, prealloc_goal, &bh))
+	{
+	  ext2_debug ("run of %u found at %d:%d", prealloc_goal, i, j);
+	  gdp = group_desc (i);
+	  hint = group_hint (i);
+	  goto got_block;
+	}
+      if (gdp->bg_free_blocks_count > 0)
+	bh = disk_cache_block_ref (gdp->bg_block_bitmap);
+    }
+#endif
+
+  if (bh)
+    {
       if (j)
 	{
 	  /*
 	     * The goal was occupied; search forward for a free
 	     * block within the next 32 blocks
 	   */
-	  if ((j & 31) == 31)
-	    lmap = 0;
-	  else
-	    lmap = ((((unsigned long *) bh)[j >> 5]) >>
-		    ((j & 31) + 1));
-	  if (j < sblock->s_blocks_per_group - 32)
-	    lmap |= (((unsigned long *) bh)[(j >> 5) + 1]) <<
-	      (31 - (j & 31));
-	  else
-	    lmap |= 0xffffffff << (31 - (j & 31));
-	  if (lmap != 0xffffffffl)
+	  tmp = j + 33 < sblock->s_blocks_per_group
+		? j + 33 : sblock->s_blocks_per_group;
+	  k = find_next_zero_bit (bh, tmp, j + 1);
+	  if (k < tmp)
 	    {
-	      k = ffz (lmap) + 1;
-	      if ((j + k) < sblock->s_blocks_per_group)
-		{
-		  j += k;
-		  goto got_block;
-		}
+	      j = k;
+	      goto got_block;
 	    }
 	}
 
@@ -230,18 +343,30 @@ repeat:
        *
        * Search first in the remainder of the current group; then,
        * cyclicly search through the rest of the groups.
+       *
+       * Neither search need look before what the hints say is the
+       * first free space in the group, and one which starts there
+       * moves them up to what it finds.
        */
-      p = ((char *) bh) + (j >> 3);
-      r = memscan (p, 0, (sblock->s_blocks_per_group - j + 7) >> 3);
+      start = j >> 3;
+      if (start <= hint->first_free_byte)
+	start = hint->first_free_byte;
+      p = ((char *) bh) + start;
+      r = memscan (p, 0, ((sblock->s_blocks_per_group + 7) >> 3) - start);
+      if (start == hint->first_free_byte)
+	hint->first_free_byte = r - (char *) bh;
       k = (r - ((char *) bh)) << 3;
       if (k < sblock->s_blocks_per_group)
 	{
 	  j = k;
 	  goto search_back;
 	}
-      k = find_next_zero_bit ((unsigned long *) bh,
-			      sblock->s_blocks_per_group,
-			      j);
+      start = j;
+      if (start <= hint->first_free_block)
+	start = hint->first_free_block;
+      k = find_next_zero_bit (bh, sblock->s_blocks_per_group, start);
+      if (start == hint->first_free_block)
+	hint->first_free_block = k;
       if (k < sblock->s_blocks_per_group)
 	{
 	  j = k;
@@ -274,13 +399,26 @@ repeat:
     }
   assert (bh == NULL);
   bh = disk_cache_block_ref (gdp->bg_block_bitmap);
-  r = memscan (bh, 0, sblock->s_blocks_per_group >> 3);
+  hint = group_hint (i);
+  r = memscan (bh + hint->first_free_byte, 0,
+	       ((sblock->s_blocks_per_group + 7) >> 3) - hint->first_free_byte);
+  hint->first_free_byte = r - bh;
   j = (r - bh) << 3;
   if (j < sblock->s_blocks_per_group)
     goto search_back;
   else
-    j = find_first_zero_bit ((unsigned long *) bh,
-			     sblock->s_blocks_per_group);
+    j = find_next_zero_bit (bh, sblock->s_blocks_per_group,
+			    hint->first_free_block);
+  if (j >= sblock->s_blocks_per_group && hint->first_free_block > 0)
+    {
+      /* The hints were wrong; look again without them.  */
+      ext2_warning ("free space hints wrong for block group %d", i);
+      memset (hint, 0, sizeof *hint);
+      disk_cache_block_deref (bh);
+      bh = NULL;
+      goto repeat;
+    }
+  hint->first_free_block = j;
   if (j >= sblock->s_blocks_per_group)
     {
       disk_cache_block_deref (bh);
@@ -340,7 +478,9 @@ got_block:
       *prealloc_count = 0;
       *prealloc_block = tmp + 1;
       for (k = 1;
-	   k < prealloc_goal && (j + k) < sblock->s_blocks_per_group; k++)
+	   k < prealloc_goal && k < avail
+	     && (j + k) < sblock->s_blocks_per_group;
+	   k++)
 	{
 	  if (set_bit (j + k, bh))
 	    break;
@@ -357,9 +497,15 @@ got_block:
       gdp->bg_free_blocks_count -= *prealloc_count;
       sblock->s_free_blocks_count -= *prealloc_count;
       ext2_debug ("preallocated a further %u bits", *prealloc_count);
+
+      if (hint->first_free_block == j)
+	hint->first_free_block = j + 1 + *prealloc_count;
     }
 #endif
 
+  if (hint->first_free_block == j)
+    hint->first_free_block = j + 1;
+
   j = tmp;
 
   record_global_poke (bh);
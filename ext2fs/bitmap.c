@@ -18,7 +18,12 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
-#define ffz(word)	(ffs (~(unsigned int) (word)) - 1)
+#include <stdint.h>
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*
  *  linux/fs/ext2/bitmap.c (&c)
@@ -47,62 +52,82 @@ unsigned long count_free (char * map, unsigned int numchars)
 
 /* ---------------------------------------------------------------- */
 
-/*
- * Copyright 1994, David S. Miller (davem@caip.rutgers.edu).
- */
-
-/* find_next_zero_bit() finds the first zero bit in a bit string of length
- * 'size' bits, starting the search at bit 'offset'. This is largely based
- * on Linus's ALPHA routines, which are pretty portable BTW.
- */
+/* Returns the first clear bit of the SIZE bits at ADDR which is at or
+   after OFFSET, or SIZE if there is none.  ADDR must be 8-byte aligned,
+   and readable up to SIZE rounded up to a multiple of 64 bits, as block
+   bitmaps are.  Bits are numbered from the least significant bit of the
+   first byte, as in the bitmaps on disk, which on a little-endian host
+   is the order of the bits in a 64-bit word.
 
+   Allocation on a nearly full filesystem mostly skips over words with no
+   clear bit, so those are skipped in vector registers where possible.  */
 static inline unsigned long
-find_next_zero_bit(void *addr, unsigned long size, unsigned long offset)
+find_next_zero_bit (void *addr, unsigned long size, unsigned long offset)
 {
-  unsigned long *p = ((unsigned long *) addr) + (offset >> 5);
-  unsigned long result = offset & ~31UL;
-  unsigned long tmp;
+  const uint64_t *words = addr;
+  unsigned long i = offset >> 6;
+  unsigned long nwords = (size + 63) >> 6;
+  uint64_t word;
 
   if (offset >= size)
     return size;
-  size -= result;
-  offset &= 31UL;
-  if (offset)
+
+  word = ~words[i] & (~(uint64_t) 0 << (offset & 63));
+  while (! word)
     {
-      tmp = *(p++);
-      tmp |= ~0UL >> (32-offset);
-      if (size < 32)
-	goto found_first;
-      if (~tmp)
-	goto found_middle;
-      size -= 32;
-      result += 32;
+      if (++i >= nwords)
+	return size;
+#if defined (__AVX2__)
+      while (i + 4 <= nwords
+	     && _mm256_movemask_epi8
+		  (_mm256_cmpeq_epi8 (_mm256_loadu_si256
+					((const __m256i *) &words[i]),
+				      _mm256_set1_epi8 (-1))) == -1)
+	i += 4;
+#elif defined (__SSE2__)
+      while (i + 2 <= nwords
+	     && _mm_movemask_epi8
+		  (_mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) &words[i]),
+				   _mm_set1_epi8 (-1))) == 0xffff)
+	i += 2;
+#endif
+      if (i >= nwords)
+	return size;
+      word = ~words[i];
     }
-  while (size & ~31UL)
+
+  offset = (i << 6) + __builtin_ctzll (word);
+  return offset < size ? offset : size;
+}
+
+/* Returns the first set bit of the SIZE bits at ADDR which is at or after
+   OFFSET, or SIZE if there is none, ADDR being as for find_next_zero_bit.
+   This finds the end of a run of free blocks, which is seldom far.  */
+static inline unsigned long
+find_next_set_bit (void *addr, unsigned long size, unsigned long offset)
+{
+  const uint64_t *words = addr;
+  unsigned long i = offset >> 6;
+  unsigned long nwords = (size + 63) >> 6;
+  uint64_t word;
+
+  if (offset >= size)
+    return size;
+
+  word = words[i] & (~(uint64_t) 0 << (offset & 63));
+  while (! word)
     {
-      if (~(tmp = *(p++)))
-	goto found_middle;
-      result += 32;
-      size -= 32;
+      if (++i >= nwords)
+	return size;
+      word = words[i];
     }
-  if (!size)
-    return result;
-  tmp = *p;
-
-found_first:
-  tmp |= ~0UL << size;
-  if (!~tmp)
-    return result + size;
-found_middle:
-  return result + ffz(tmp);
-}
 
-/* Linus sez that gcc can optimize the following correctly, we'll see if this
- * holds on the Sparc as it does for the ALPHA.
- */
+  offset = (i << 6) + __builtin_ctzll (word);
+  return offset < size ? offset : size;
+}
 
-static inline int
-find_first_zero_bit(void *buf, unsigned len)
+static inline unsigned long
+find_first_zero_bit (void *buf, unsigned long size)
 {
-  return find_next_zero_bit(buf, len, 0);
+  return find_next_zero_bit (buf, size, 0);
 }
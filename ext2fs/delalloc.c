@@ -0,0 +1,261 @@
+/* Delayed allocation of file data blocks for ext2fs
+
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <string.h>
+#include "ext2fs.h"
+
+/* With delayed allocation, making a page of a regular file writable
+   doesn't allocate the blocks under it, but only sets aside as many free
+   blocks, so that writing them out cannot run out of space.  The blocks
+   are allocated when the page is written out, by file_pager_write_pages,
+   which then knows how many of them come in a row and gets them
+   together.
+
+   Each file keeps the blocks it has free blocks set aside for as a sorted
+   array of runs.  Since they are counted against the free blocks of the
+   filesystem, each run is also charged for the indirect and double
+   indirect blocks it may need, however sparse the file, and each file
+   for a triple indirect block.  */
+
+int delayed_allocation;
+
+block_t delalloc_reserved_blocks;
+
+/* Return the number of free blocks to set aside for a run of COUNT
+   blocks from START: the blocks themselves, and an indirect and a double
+   indirect block for each range of the file mapped by one that the run
+   touches.  */
+static block_t
+run_charge (block_t start, block_t count)
+{
+  block_t apb = EXT2_ADDR_PER_BLOCK (sblock);
+  block_t last = start + count - 1;
+
+  return (count + last / apb - start / apb + 1
+	  + last / (apb * apb) - start / (apb * apb) + 1);
+}
+
+/* Set aside CHARGE free blocks for DN, in place of those it has.  Unless
+   FORCE is true, return ENOSPC rather than set aside more blocks than
+   are free.  */
+static error_t
+recharge (struct disknode *dn, block_t charge, int force)
+{
+  pthread_spin_lock (&global_lock);
+  if (! force && charge > dn->delalloc_charge
+      && (sblock->s_free_blocks_count
+	  < delalloc_reserved_blocks + (charge - dn->delalloc_charge)))
+    {
+      pthread_spin_unlock (&global_lock);
+      return ENOSPC;
+    }
+  delalloc_reserved_blocks -= dn->delalloc_charge;
+  delalloc_reserved_blocks += charge;
+  pthread_spin_unlock (&global_lock);
+  dn->delalloc_charge = charge;
+  return 0;
+}
+
+/* Return the index of the first run of DN which ends after BLOCK, or the
+   number of runs if there is none.  */
+static unsigned
+run_index (struct disknode *dn, block_t block)
+{
+  unsigned lo = 0, hi = dn->delalloc_nruns, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (dn->delalloc_runs[mid].start + dn->delalloc_runs[mid].count
+	  <= block)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Make sure DN has room for another run.  */
+static error_t
+grow_runs (struct disknode *dn)
+{
+  struct delalloc_run *runs;
+  unsigned alloced;
+
+  if (dn->delalloc_nruns < dn->delalloc_runs_alloced)
+    return 0;
+
+  alloced = dn->delalloc_runs_alloced ? 2 * dn->delalloc_runs_alloced : 4;
+  runs = realloc (dn->delalloc_runs, alloced * sizeof *runs);
+  if (! runs)
+    return ENOMEM;
+  dn->delalloc_runs = runs;
+  dn->delalloc_runs_alloced = alloced;
+  return 0;
+}
+
+error_t
+delalloc_reserve (struct node *node, block_t block)
+{
+  struct disknode *dn = node->dn;
+  struct delalloc_run *runs;
+  unsigned i = run_index (dn, block), n = dn->delalloc_nruns;
+  block_t start, end, charge;
+  int prev, next;
+  error_t err;
+
+  if (i < n && dn->delalloc_runs[i].start <= block)
+    return 0;
+
+  err = grow_runs (dn);
+  if (err)
+    return err;
+
+  /* BLOCK is added to the run ending just before it, the one starting
+     just after it, or both, or else makes a new run.  */
+  runs = dn->delalloc_runs;
+  prev = i > 0 && runs[i - 1].start + runs[i - 1].count == block;
+  next = i < n && runs[i].start == block + 1;
+  start = prev ? runs[i - 1].start : block;
+  end = next ? runs[i].start + runs[i].count : block + 1;
+
+  charge = dn->delalloc_charge + run_charge (start, end - start);
+  if (n == 0)
+    /* The triple indirect block.  */
+    charge++;
+  if (prev)
+    charge -= run_charge (runs[i - 1].start, runs[i - 1].count);
+  if (next)
+    charge -= run_charge (runs[i].start, runs[i].count);
+
+  err = recharge (dn, charge, 0);
+  if (err)
+    return err;
+  dn->delalloc_blocks++;
+
+  if (prev)
+    {
+      runs[i - 1].count = end - start;
+      if (next)
+	{
+	  memmove (runs + i, runs + i + 1, (n - i - 1) * sizeof *runs);
+	  dn->delalloc_nruns--;
+	}
+    }
+  else if (next)
+    {
+      runs[i].start = start;
+      runs[i].count = end - start;
+    }
+  else
+    {
+      memmove (runs + i + 1, runs + i, (n - i) * sizeof *runs);
+      runs[i].start = block;
+      runs[i].count = 1;
+      dn->delalloc_nruns++;
+    }
+
+  return 0;
+}
+
+block_t
+delalloc_reserved (struct node *node, block_t block)
+{
+  struct disknode *dn = node->dn;
+  unsigned i = run_index (dn, block);
+
+  if (i < dn->delalloc_nruns && dn->delalloc_runs[i].start <= block)
+    return dn->delalloc_runs[i].start + dn->delalloc_runs[i].count - block;
+  return 0;
+}
+
+void
+delalloc_release (struct node *node, block_t start, block_t end)
+{
+  struct disknode *dn = node->dn;
+  struct delalloc_run *run;
+  block_t from, to, run_end, released = 0, charge = dn->delalloc_charge;
+  unsigned i;
+
+  for (i = run_index (dn, start); i < dn->delalloc_nruns; )
+    {
+      run = &dn->delalloc_runs[i];
+      run_end = run->start + run->count;
+      from = run->start > start ? run->start : start;
+      to = run_end < end ? run_end : end;
+      if (from >= to)
+	break;
+
+      if (from > run->start && to < run_end)
+	{
+	  /* Split the run in two around the blocks given back.  If there is
+	     no memory for that, keep them set aside until the file is
+	     truncated or forgotten.  */
+	  if (grow_runs (dn))
+	    break;
+	  run = &dn->delalloc_runs[i];
+	  charge -= run_charge (run->start, run->count);
+	  memmove (run + 2, run + 1,
+		   (dn->delalloc_nruns - i - 1) * sizeof *run);
+	  run[1].start = to;
+	  run[1].count = run_end - to;
+	  run->count = from - run->start;
+	  charge += (run_charge (run[0].start, run[0].count)
+		     + run_charge (run[1].start, run[1].count));
+	  dn->delalloc_nruns++;
+	  i += 2;
+	}
+      else if (from > run->start)
+	{
+	  charge -= run_charge (run->start, run->count);
+	  run->count = from - run->start;
+	  charge += run_charge (run->start, run->count);
+	  i++;
+	}
+      else if (to < run_end)
+	{
+	  charge -= run_charge (run->start, run->count);
+	  run->start = to;
+	  run->count = run_end - to;
+	  charge += run_charge (run->start, run->count);
+	  i++;
+	}
+      else
+	{
+	  charge -= run_charge (run->start, run->count);
+	  memmove (run, run + 1, (dn->delalloc_nruns - i - 1) * sizeof *run);
+	  dn->delalloc_nruns--;
+	}
+
+      released += to - from;
+    }
+
+  if (released == 0)
+    return;
+
+  if (dn->delalloc_nruns == 0)
+    /* Nor is the triple indirect block needed any more.  */
+    charge = 0;
+
+  /* Splitting a run may charge the file a few more blocks than before,
+     for indirect blocks the two halves may not both need.  Set them aside
+     even if they aren't free: the blocks the file needs can only have
+     gone down.  */
+  recharge (dn, charge, 1);
+  dn->delalloc_blocks -= released;
+}
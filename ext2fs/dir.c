@@ -33,6 +33,10 @@
    entries that straddle device blocks (but read those that do)...  */
 #define DIRBLKSIZ block_size
 
+/* Directories of at least this many blocks, without an index on disk,
+   get an in-core index when names are first looked up in them.  */
+#define DIR_INDEX_MIN_BLOCKS	8
+
 enum slot_status
 {
   /* This means we haven't yet found room for a new entry.  */
@@ -86,6 +90,25 @@ struct dirstat
   /* For stat COMPRESS, this is the number of bytes needed to be copied
      in order to undertake the compression. */
   size_t nbytes;
+
+  /* How the lookup used the directory's index, and for DX_SPLIT, the way
+     through it to the leaf to split.  */
+  enum
+    {
+      /* The index, if any, wasn't used, and will be dropped if the
+	 directory is changed.  */
+      DX_NONE,
+
+      /* The entry is where the index says it should be.  */
+      DX_INDEXED,
+
+      /* For stat EXTEND, the leaf the entry belongs in must be split.  */
+      DX_SPLIT,
+
+      /* For stat EXTEND, the directory should get an index first.  */
+      DX_MAKE_INDEX,
+    } dx;
+  struct dx_path path;
 };
 
 const size_t diskfs_dirstat_size = sizeof (struct dirstat);
@@ -103,6 +126,84 @@ dirscanblock (vm_address_t blockoff, struct node *dp, int idx,
 	      struct dirstat *ds, ino_t *inum);
 
 
+/* Return true if ENTRY, at offset OFF in its block, is fit to be used.  */
+static inline int
+entry_ok (vm_address_t off, struct ext2_dir_entry_2 *entry)
+{
+  return (entry->rec_len
+	  && entry->rec_len % EXT2_DIR_PAD == 0
+	  && entry->name_len <= EXT2_NAME_LEN
+	  && off + entry->rec_len <= DIRBLKSIZ
+	  && EXT2_DIR_REC_LEN (entry->name_len) <= entry->rec_len
+	  && !memchr (entry->name, '\0', entry->name_len));
+}
+
+/* Return the size of the largest entry which fits in the directory block
+   at BLOCKADDR without moving the others.  */
+static size_t
+block_room (vm_address_t blockaddr)
+{
+  struct ext2_dir_entry_2 *entry;
+  vm_address_t off;
+  size_t room = 0, thisroom;
+
+  for (off = 0; off < DIRBLKSIZ; off += entry->rec_len)
+    {
+      entry = (struct ext2_dir_entry_2 *) (blockaddr + off);
+      if (entry->inode == 0)
+	thisroom = entry->rec_len;
+      else
+	thisroom = entry->rec_len - EXT2_DIR_REC_LEN (entry->name_len);
+      if (thisroom > room)
+	room = thisroom;
+    }
+  return room;
+}
+
+/* Give DP, whose contents are mapped at BUF, an in-core index of its
+   entries by block, if it is large enough to be worth one and has no
+   index on disk.  Return true if it has one.  */
+static int
+make_dir_index (struct node *dp, vm_address_t buf)
+{
+  int nblocks = dp->dn_stat.st_size / DIRBLKSIZ;
+  struct ext2_dir_entry_2 *entry;
+  vm_address_t blockaddr, off;
+  error_t err;
+  int idx;
+
+  if (dp->dir_index)
+    return 1;
+  if (nblocks < DIR_INDEX_MIN_BLOCKS || dp->dn->no_dir_index
+      || ext2_dx_indexed (dp))
+    return 0;
+
+  err = diskfs_dir_index_create (dp, nblocks);
+  for (idx = 0; !err && idx < nblocks; idx++)
+    {
+      blockaddr = buf + idx * DIRBLKSIZ;
+      for (off = 0; !err && off < DIRBLKSIZ; off += entry->rec_len)
+	{
+	  entry = (struct ext2_dir_entry_2 *) (blockaddr + off);
+	  if (! entry_ok (off, entry))
+	    {
+	      /* Let the scan complain about it.  */
+	      diskfs_dir_index_drop (dp);
+	      err = EIO;
+	    }
+	  else if (entry->inode)
+	    err = diskfs_dir_index_add (dp, entry->name, entry->name_len,
+					idx);
+	}
+      if (! err)
+	diskfs_dir_index_set_room (dp, idx, block_room (blockaddr));
+    }
+
+  if (err == EIO || err == ENOSPC)
+    dp->dn->no_dir_index = 1;
+  return dp->dir_index != NULL;
+}
+
 #if 0				/* XXX unused for now */
 static const unsigned char ext2_file_type[EXT2_FT_MAX] =
 {
@@ -149,6 +250,8 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
   vm_address_t blockaddr;
   int idx, lastidx;
   int looped;
+  int dotname;
+  struct dx_path path;
 
   if ((type == REMOVE) || (type == RENAME))
     assert (npp);
@@ -160,6 +263,8 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
   type &= ~SPEC_DOTDOT;
 
   namelen = strlen (name);
+  dotname = (name[0] == '.'
+	     && (namelen == 1 || (namelen == 2 && name[1] == '.')));
 
   if (namelen > EXT2_NAME_LEN)
     {
@@ -174,6 +279,7 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
       ds->type = LOOKUP;
       ds->mapbuf = 0;
       ds->mapextent = 0;
+      ds->dx = DX_NONE;
     }
   if (buf)
     {
@@ -190,8 +296,9 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
     return errno;
 
   buf = 0;
-  /* We allow extra space in case we have to do an EXTEND. */
-  buflen = round_page (dp->dn_stat.st_size + DIRBLKSIZ);
+  /* We allow extra space in case we have to do an EXTEND, which takes two
+     blocks when the directory gets an index or its index grows.  */
+  buflen = round_page (dp->dn_stat.st_size + 2 * DIRBLKSIZ);
   err = vm_map (mach_task_self (),
 		&buf, buflen, 0, 1, memobj, 0, 0, prot, prot, 0);
   mach_port_deallocate (mach_task_self (), memobj);
@@ -202,39 +309,99 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
 
   diskfs_set_node_atime (dp);
 
-  /* Start the lookup at DP->dn->dir_idx.  */
-  idx = dp->dn->dir_idx;
-  if (idx * DIRBLKSIZ > dp->dn_stat.st_size)
-    idx = 0;			/* just in case */
-  blockaddr = buf + idx * DIRBLKSIZ;
-  looped = (idx == 0);
-  lastidx = idx;
-  if (lastidx == 0)
-    lastidx = dp->dn_stat.st_size / DIRBLKSIZ;
-
-  while (!looped || idx < lastidx)
+  if (ext2_dx_indexed (dp) && !dotname
+      && !ext2_dx_probe (dp, buf, name, namelen, &path))
+    {
+      /* Only the leaf the index leads NAME to need be scanned, and the
+	 ones after it while they continue the run of entries with its
+	 hash.  "." and ".." are in the first block, before the index.  */
+      do
+	err = dirscanblock (buf + path.leaf * DIRBLKSIZ, dp, path.leaf,
+			    name, namelen, type, ds, &inum);
+      while (err == ENOENT && ext2_dx_next_leaf (dp, buf, &path));
+
+      if (err && err != ENOENT)
+	{
+	  munmap ((caddr_t) buf, buflen);
+	  return err;
+	}
+
+      if (ds)
+	{
+	  ds->dx = DX_INDEXED;
+	  ds->path = path;
+	}
+    }
+  else if (make_dir_index (dp, buf))
     {
-      err = dirscanblock (blockaddr, dp, idx, name, namelen, type, ds, &inum);
-      if (!err)
+      /* Only the blocks the in-core index gives for NAME need be
+	 scanned; if it is in none of them, a new entry goes in a block
+	 the index says has room for it.  */
+      int cursor = 0;
+
+      err = ENOENT;
+      while (err == ENOENT
+	     && (idx = diskfs_dir_index_lookup (dp, name, namelen,
+						&cursor)) >= 0)
+	err = dirscanblock (buf + idx * DIRBLKSIZ, dp, idx, name, namelen,
+			    type, ds, &inum);
+
+      if (err == ENOENT && ds && (type == CREATE || type == RENAME)
+	  && ds->stat == LOOKING)
 	{
-	  dp->dn->dir_idx = idx;
-	  break;
+	  idx = diskfs_dir_index_find_room (dp, EXT2_DIR_REC_LEN (namelen));
+	  if (idx >= 0)
+	    err = dirscanblock (buf + idx * DIRBLKSIZ, dp, idx, name,
+				namelen, type, ds, &inum);
 	}
-      if (err != ENOENT)
+
+      if (err && err != ENOENT)
 	{
 	  munmap ((caddr_t) buf, buflen);
 	  return err;
 	}
-
-      blockaddr += DIRBLKSIZ;
-      idx++;
-      if (blockaddr - buf >= dp->dn_stat.st_size && !looped)
+    }
+  else
+    {
+      /* Start the lookup at DP->dn->dir_idx.  */
+      idx = dp->dn->dir_idx;
+      if (idx * DIRBLKSIZ > dp->dn_stat.st_size)
+	idx = 0;			/* just in case */
+      blockaddr = buf + idx * DIRBLKSIZ;
+      looped = (idx == 0);
+      lastidx = idx;
+      if (lastidx == 0)
+	lastidx = dp->dn_stat.st_size / DIRBLKSIZ;
+
+      while (!looped || idx < lastidx)
 	{
-	  /* We've gotten to the end; start back at the beginning */
-	  looped = 1;
-	  blockaddr = buf;
-	  idx = 0;
+	  err = dirscanblock (blockaddr, dp, idx, name, namelen, type, ds,
+			      &inum);
+	  if (!err)
+	    {
+	      dp->dn->dir_idx = idx;
+	      break;
+	    }
+	  if (err != ENOENT)
+	    {
+	      munmap ((caddr_t) buf, buflen);
+	      return err;
+	    }
+
+	  blockaddr += DIRBLKSIZ;
+	  idx++;
+	  if (blockaddr - buf >= dp->dn_stat.st_size && !looped)
+	    {
+	      /* We've gotten to the end; start back at the beginning */
+	      looped = 1;
+	      blockaddr = buf;
+	      idx = 0;
+	    }
 	}
+
+      /* Changing "." or ".." in place leaves the index alone.  */
+      if (ds && inum && dotname && ext2_dx_indexed (dp))
+	ds->dx = DX_INDEXED;
     }
 
   diskfs_set_node_atime (dp);
@@ -306,7 +473,7 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
 
       /* Here below are the spec dotdot cases. */
       else if (type == RENAME || type == REMOVE)
-	np = ifind (inum);
+	np = diskfs_cached_ifind (inum);
 
       else if (type == LOOKUP)
 	{
@@ -325,6 +492,14 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
       ds->type = CREATE;
       ds->stat = EXTEND;
       ds->idx = dp->dn_stat.st_size / DIRBLKSIZ;
+
+      /* An indexed directory grows by splitting the leaf the entry
+	 belongs in, and, as in Linux, a directory outgrowing its first
+	 block gets an index.  */
+      if (ds->dx == DX_INDEXED)
+	ds->dx = DX_SPLIT;
+      else if (ext2_dx_may_index (dp, buf))
+	ds->dx = DX_MAKE_INDEX;
     }
 
   /* Return to the user; if we can't, release the reference
@@ -359,7 +534,7 @@ diskfs_lookup_hard (struct node *dp, const char *name, enum lookup_type type,
 		diskfs_nput (np);
 	    }
 	  else if (type == RENAME || type == REMOVE)
-	    /* We just did ifind to get np; that allocates
+	    /* We just did diskfs_cached_ifind to get np; that allocates
 	       no new references, so we don't have anything to do */
 	    ;
 	  else if (type == LOOKUP)
@@ -406,12 +581,7 @@ dirscanblock (vm_address_t blockaddr, struct node *dp, int idx,
     {
       entry = (struct ext2_dir_entry_2 *)currentoff;
 
-      if (!entry->rec_len
-	  || entry->rec_len % EXT2_DIR_PAD
-	  || entry->name_len > EXT2_NAME_LEN
-	  || currentoff + entry->rec_len > blockaddr + DIRBLKSIZ
-	  || EXT2_DIR_REC_LEN (entry->name_len) > entry->rec_len
-	  || memchr (entry->name, '\0', entry->name_len))
+      if (! entry_ok (currentoff - blockaddr, entry))
 	{
 	  ext2_warning ("bad directory entry: inode: %Ld offset: %zd",
 			dp->cache_id,
@@ -516,6 +686,90 @@ dirscanblock (vm_address_t blockaddr, struct node *dp, int idx,
   return 0;
 }
 
+/* Grow directory DP, mapped as DS says, by AMOUNT bytes.  On failure, the
+   mapping is dropped.  */
+static error_t
+extend_dir (struct node *dp, struct dirstat *ds, size_t amount,
+	    struct protid *cred)
+{
+  size_t oldsize = dp->dn_stat.st_size;
+  error_t err;
+
+  if ((off_t)(oldsize + amount) != (dp->dn_stat.st_size + amount))
+    {
+      /* We can't possibly map the whole directory in.  */
+      munmap ((caddr_t) ds->mapbuf, ds->mapextent);
+      return EOVERFLOW;
+    }
+  while (oldsize + amount > dp->allocsize)
+    {
+      err = diskfs_grow (dp, oldsize + amount, cred);
+      if (err)
+	{
+	  munmap ((caddr_t) ds->mapbuf, ds->mapextent);
+	  return err;
+	}
+    }
+
+  dp->dn_stat.st_size = oldsize + amount;
+  dp->dn_set_ctime = 1;
+  return 0;
+}
+
+/* Make room for the entry NAME, of length NAMELEN, in directory DP, as DS
+   says for stat EXTEND, by splitting the leaf of the index NAME belongs
+   in, after giving DP an index for DX_MAKE_INDEX.  Set DS to put the entry
+   in that leaf.  */
+static error_t
+dx_make_room (struct node *dp, const char *name, size_t namelen,
+	      struct dirstat *ds, struct protid *cred)
+{
+  size_t oldsize = dp->dn_stat.st_size;
+  block_t newblock = oldsize / DIRBLKSIZ;
+  int nblocks = 2;
+  error_t err;
+  int i;
+
+  if (ds->dx == DX_SPLIT)
+    {
+      err = ext2_dx_split_blocks (dp, ds->mapbuf, &ds->path, &nblocks);
+      if (err)
+	{
+	  munmap ((caddr_t) ds->mapbuf, ds->mapextent);
+	  return err;
+	}
+    }
+
+  err = extend_dir (dp, ds, nblocks * DIRBLKSIZ, cred);
+  if (err)
+    return err;
+
+  if (ds->dx == DX_MAKE_INDEX)
+    {
+      ext2_dx_make_index (dp, ds->mapbuf, name, namelen, &ds->path);
+      dp->dn->info.i_flags |= EXT2_INDEX_FL;
+      newblock++;
+    }
+
+  /* Entries move from the leaf to the new block.  */
+  if (dp->dn->dirents)
+    {
+      dp->dn->dirents = realloc (dp->dn->dirents,
+				 (dp->dn_stat.st_size / DIRBLKSIZ
+				  * sizeof (int)));
+      for (i = oldsize / DIRBLKSIZ; i < dp->dn_stat.st_size / DIRBLKSIZ; i++)
+	dp->dn->dirents[i] = -1;
+      dp->dn->dirents[0] = -1;
+      dp->dn->dirents[ds->path.leaf] = -1;
+    }
+
+  ds->entry = ext2_dx_split (dp, ds->mapbuf, &ds->path, newblock);
+  ds->stat = SHRINK;
+  ds->idx = ds->path.leaf;
+  ds->dx = DX_INDEXED;
+  return 0;
+}
+
 /* Following a lookup call for CREATE, this adds a node to a directory.
    DP is the directory to be modified; NAME is the name to be entered;
    NP is the node being linked in; DS is the cached information returned
@@ -541,6 +795,13 @@ diskfs_direnter_hard (struct node *dp, const char *name, struct node *np,
 
   dp->dn_set_mtime = 1;
 
+  if (ds->stat == EXTEND && ds->dx != DX_NONE)
+    {
+      err = dx_make_room (dp, name, namelen, ds, cred);
+      if (err)
+	return err;
+    }
+
   /* Select a location for the new directory entry.  Each branch of this
      switch is responsible for setting NEW to point to the on-disk
      directory entry being written, and setting NEW->rec_len appropriately.  */
@@ -603,27 +864,12 @@ diskfs_direnter_hard (struct node *dp, const char *name, struct node *np,
       assert (needed <= DIRBLKSIZ);
 
       oldsize = dp->dn_stat.st_size;
-      if ((off_t)(oldsize + DIRBLKSIZ) != (dp->dn_stat.st_size + DIRBLKSIZ))
-	{
-	  /* We can't possibly map the whole directory in.  */
-	  munmap ((caddr_t) ds->mapbuf, ds->mapextent);
-	  return EOVERFLOW;
-	}
-      while (oldsize + DIRBLKSIZ > dp->allocsize)
-	{
-	  err = diskfs_grow (dp, oldsize + DIRBLKSIZ, cred);
-	  if (err)
-	    {
-	      munmap ((caddr_t) ds->mapbuf, ds->mapextent);
-	      return err;
-	    }
-	}
+      err = extend_dir (dp, ds, DIRBLKSIZ, cred);
+      if (err)
+	return err;
 
       new = (struct ext2_dir_entry_2 *) (ds->mapbuf + oldsize);
 
-      dp->dn_stat.st_size = oldsize + DIRBLKSIZ;
-      dp->dn_set_ctime = 1;
-
       new->rec_len = DIRBLKSIZ;
       break;
 
@@ -652,10 +898,26 @@ diskfs_direnter_hard (struct node *dp, const char *name, struct node *np,
   new->name_len = namelen;
   memcpy (new->name, name, namelen);
 
-  /* Mark the directory inode has having been written.  */
-  dp->dn->info.i_flags &= ~EXT2_BTREE_FL;
+  /* Mark the directory inode has having been written.  Unless the entry
+     went where the index says it should be, the directory is no longer
+     indexed, which is how Linux keeps the index valid too.  */
+  if (ds->dx == DX_NONE)
+    dp->dn->info.i_flags &= ~EXT2_INDEX_FL;
   dp->dn_set_mtime = 1;
 
+  /* Keep the in-core index up to date.  It doesn't follow the entries
+     moved to split a leaf of the index on disk, and isn't needed once
+     there is one, so it is dropped then.  */
+  if (dp->dir_index)
+    {
+      if (ds->dx != DX_NONE)
+	diskfs_dir_index_drop (dp);
+      else if (! diskfs_dir_index_add (dp, name, namelen, ds->idx))
+	diskfs_dir_index_set_room (dp, ds->idx,
+				   block_room (ds->mapbuf
+					       + ds->idx * DIRBLKSIZ));
+    }
+
   munmap ((caddr_t) ds->mapbuf, ds->mapextent);
 
   if (ds->stat != EXTEND)
@@ -710,6 +972,10 @@ diskfs_dirremove_hard (struct node *dp, struct dirstat *ds)
 
   assert (!diskfs_readonly);
 
+  if (dp->dir_index)
+    diskfs_dir_index_remove (dp, ds->entry->name, ds->entry->name_len,
+			     ds->idx);
+
   if (ds->preventry == 0)
     ds->entry->inode = 0;
   else
@@ -720,7 +986,12 @@ diskfs_dirremove_hard (struct node *dp, struct dirstat *ds)
     }
 
   dp->dn_set_mtime = 1;
-  dp->dn->info.i_flags &= ~EXT2_BTREE_FL;
+  if (ds->dx == DX_NONE)
+    dp->dn->info.i_flags &= ~EXT2_INDEX_FL;
+
+  if (dp->dir_index)
+    diskfs_dir_index_set_room (dp, ds->idx,
+			       block_room (ds->mapbuf + ds->idx * DIRBLKSIZ));
 
   munmap ((caddr_t) ds->mapbuf, ds->mapextent);
 
@@ -751,7 +1022,8 @@ diskfs_dirrewrite_hard (struct node *dp, struct node *np, struct dirstat *ds)
 
   ds->entry->inode = np->cache_id;
   dp->dn_set_mtime = 1;
-  dp->dn->info.i_flags &= ~EXT2_BTREE_FL;
+  if (ds->dx == DX_NONE)
+    dp->dn->info.i_flags &= ~EXT2_INDEX_FL;
 
   munmap ((caddr_t) ds->mapbuf, ds->mapextent);
 
@@ -60,6 +60,10 @@ char *diskfs_disk_name;
 int ext2_debug_flag;
 #endif
 
+#define OPT_READAHEAD	700	/* --readahead */
+#define OPT_DELALLOC	701	/* --delayed-allocation */
+#define OPT_NO_DELALLOC	702	/* --no-delayed-allocation */
+
 /* Ext2fs-specific options.  */
 static const struct argp_option
 options[] =
@@ -71,6 +75,12 @@ options[] =
   },
   {"sblock", 'S', "BLOCKNO", 0,
    "Use alternate superblock location (1kb blocks)"},
+  {"readahead", OPT_READAHEAD, "PAGES", 0,
+   "Read up to PAGES pages ahead for sequential readers (0 disables)"},
+  {"delayed-allocation", OPT_DELALLOC, 0, 0,
+   "Choose the disk blocks of file data only when it is written out"},
+  {"no-delayed-allocation", OPT_NO_DELALLOC, 0, 0,
+   "Choose the disk blocks of file data when it is first written (default)"},
   {0}
 };
 
@@ -84,6 +94,8 @@ parse_opt (int key, char *arg, struct argp_state *state)
   {
     int debug_flag;
     unsigned int sb_block;
+    int readahead;
+    int delalloc;
   } *values = state->hook;
 
   switch (key)
@@ -99,6 +111,20 @@ parse_opt (int key, char *arg, struct argp_state *state)
 	  return EINVAL;
 	}
       break;
+    case OPT_READAHEAD:
+      values->readahead = strtol (arg, &arg, 0);
+      if (!arg || *arg != '\0' || values->readahead < 0)
+	{
+	  argp_error (state, "invalid number for --readahead");
+	  return EINVAL;
+	}
+      break;
+    case OPT_DELALLOC:
+      values->delalloc = 1;
+      break;
+    case OPT_NO_DELALLOC:
+      values->delalloc = 0;
+      break;
 
     case ARGP_KEY_INIT:
       state->child_inputs[0] = state->input;
@@ -108,6 +134,8 @@ parse_opt (int key, char *arg, struct argp_state *state)
       state->hook = values;
       memset (values, 0, sizeof *values);
       values->sb_block = SBLOCK_BLOCK;
+      values->readahead = -1;
+      values->delalloc = -1;
       break;
 
     case ARGP_KEY_SUCCESS:
@@ -122,6 +150,14 @@ parse_opt (int key, char *arg, struct argp_state *state)
 #endif
 	}
 
+      if (values->readahead >= 0)
+	set_readahead_max_pages (values->readahead);
+      /* Delayed allocation may be switched either way while running:
+	 the blocks already set aside for files are still allocated when
+	 they are written out, whichever way it is now.  */
+      if (values->delalloc >= 0)
+	delayed_allocation = values->delalloc;
+
       break;
 
     default:
@@ -143,12 +179,31 @@ diskfs_append_args (char **argz, size_t *argz_len)
   if (!err && ext2_debug_flag)
     err = argz_add (argz, argz_len, "--debug");
 #endif
+  if (! err && readahead_max_pages != READAHEAD_DEFAULT_MAX_PAGES)
+    {
+      char buf[40];
+      sprintf (buf, "--readahead=%d", readahead_max_pages);
+      err = argz_add (argz, argz_len, buf);
+    }
+  if (! err && delayed_allocation)
+    err = argz_add (argz, argz_len, "--delayed-allocation");
   if (! err)
     err = store_parsed_append_args (store_parsed, argz, argz_len);
 
   return err;
 }
 
+/* Override the standard diskfs routine so we can add our own
+   statistics.  */
+error_t
+diskfs_print_statistics (FILE *stream)
+{
+  error_t err = diskfs_print_std_statistics (stream);
+  if (! err)
+    print_pager_statistics (stream);
+  return err;
+}
+
 /* Add our startup arguments to the standard diskfs set.  */
 static const struct argp_child startup_children[] =
   {{&diskfs_store_startup_argp}, {0}};
@@ -185,8 +240,6 @@ main (int argc, char **argv)
 
   map_hypermetadata ();
 
-  inode_init ();
-
   /* Set diskfs_root_node to the root inode. */
   err = diskfs_cached_lookup (EXT2_ROOT_INO, &diskfs_root_node);
   if (err)
@@ -159,9 +159,6 @@ struct disknode
      each DIRBLKSIZE piece of the directory. */
   int *dirents;
 
-  /* Links on hash list. */
-  struct node *hnext, **hprevp;
-
   /* Lock to lock while fiddling with this inode's block allocation info.  */
   pthread_rwlock_t alloc_lock;
 
@@ -181,6 +178,23 @@ struct disknode
 
   /* Index to start a directory lookup at.  */
   int dir_idx;
+
+  /* True if this directory is not to get an in-core index, being too
+     large or damaged.  */
+  int no_dir_index;
+
+  /* With delayed allocation, the runs of blocks of the file which have
+     been made writable but have no disk blocks yet, in order, the number
+     of blocks in them, and the number of free blocks set aside for them
+     and the indirect blocks they may need.  Protected by ALLOC_LOCK.  */
+  struct delalloc_run *delalloc_runs;
+  unsigned delalloc_nruns, delalloc_runs_alloced;
+  block_t delalloc_blocks;
+  block_t delalloc_charge;
+
+  /* The number of blocks about to be allocated to the file in a row,
+     which ext2_alloc_block should preallocate together.  */
+  block_t alloc_want;
 };
 
 struct user_pager_info
@@ -192,6 +206,13 @@ struct user_pager_info
     } type;
   struct node *node;
   vm_prot_t max_prot;
+
+  /* Read-ahead state of a FILE_DATA pager.  This is only used while
+     reading pages, which libpager serializes for each pager.  */
+  vm_offset_t ra_next;		/* Offset just past the last read.  */
+  vm_size_t ra_window;		/* Size of the next read.  */
+  unsigned long ra_hits;	/* Reads continuing a sequential stream.  */
+  unsigned long ra_misses;	/* Other reads.  */
 };
 
 /* ---------------------------------------------------------------- */
@@ -214,6 +235,18 @@ void allow_pager_softrefs (struct node *node);
 
 /* Invalidate any pager data associated with NODE.  */
 void flush_node_pager (struct node *node);
+
+/* The most file pagers may read ahead for a sequential reader, in pages.
+   Zero disables read-ahead.  */
+extern int readahead_max_pages;
+#define READAHEAD_DEFAULT_MAX_PAGES 32
+
+/* Set READAHEAD_MAX_PAGES to PAGES, and apply it to existing file
+   pagers.  */
+void set_readahead_max_pages (int pages);
+
+/* Print to STREAM the statistics of the pagers.  */
+void print_pager_statistics (FILE *stream);
 
 /* ---------------------------------------------------------------- */
 
@@ -386,6 +419,25 @@ bptr_offs (void *ptr)
 #define group_desc(num)	(&group_desc_image[num])
 struct ext2_group_desc *group_desc_image;
 
+/* What allocation has learned of the free blocks and inodes of a block
+   group, so that it needn't scan the full start of its bitmaps again.
+   None of the bits before each of these is clear.  Allocation moves them
+   up past what it takes, and freeing moves them down.  Protected by
+   global_lock.  */
+struct group_hint
+{
+  unsigned first_free_block;	/* Bit of the first free block.  */
+  unsigned first_free_byte;	/* Byte of the first 8 free blocks.  */
+  unsigned first_free_inode;	/* Bit of the first free inode.  */
+
+  /* If nonzero, no run of free blocks in the group is longer.  Cleared
+     when blocks are freed, and set again by a search of the group.  */
+  unsigned max_free_run;
+};
+
+#define group_hint(num)	(&group_hints[num])
+struct group_hint *group_hints;
+
 #define inode_group_num(inum) (((inum) - 1) / sblock->s_inodes_per_group)
 
 extern struct ext2_inode *dino (ino_t inum);
@@ -420,11 +472,6 @@ dino_deref (struct ext2_inode *inode)
 /* Write all active disknodes into the inode pager. */
 void write_all_disknodes ();
 
-/* Lookup node INUM (which must have a reference already) and return it
-   without allocating any new references. */
-struct node *ifind (ino_t inum);
-
-void inode_init (void);
 
 /* ---------------------------------------------------------------- */
 
@@ -543,11 +590,110 @@ error_t ext2_getblk (struct node *node, block_t block, int create, block_t *disk
 
 block_t ext2_new_block (block_t goal,
 			block_t prealloc_goal,
-			block_t *prealloc_count, block_t *prealloc_block);
+			block_t *prealloc_count, block_t *prealloc_block,
+			int reserved);
 
 void ext2_free_blocks (block_t block, unsigned long count);
 
 /* ---------------------------------------------------------------- */
+/* delalloc.c */
+
+/* A run of COUNT blocks of a file, starting at START.  */
+struct delalloc_run
+{
+  block_t start;
+  block_t count;
+};
+
+/* True if the disk blocks of file data are to be chosen only when it is
+   written out.  */
+extern int delayed_allocation;
+
+/* The free blocks set aside for file data not yet written out, and for
+   the indirect blocks it may need.  Protected by global_lock.  */
+extern block_t delalloc_reserved_blocks;
+
+/* Set aside a free block for block BLOCK of NODE, unless one already is.
+   Return ENOSPC if there are no more free blocks to set aside.  NODE's
+   alloc_lock is held for writing.  */
+error_t delalloc_reserve (struct node *node, block_t block);
+
+/* Return how many blocks of NODE from BLOCK on have free blocks set aside
+   for them, in a row.  */
+block_t delalloc_reserved (struct node *node, block_t block);
+
+/* Give back the free blocks set aside for the blocks of NODE from START
+   up to END.  NODE's alloc_lock is held for writing.  */
+void delalloc_release (struct node *node, block_t start, block_t end);
+
+/* ---------------------------------------------------------------- */
+/* htree.c */
+
+/* The most index blocks on the way from the root of a directory index to
+   one of its leaves, including the root.  */
+#define EXT2_DX_MAX_LEVELS	2
+
+/* The way through the index of a directory to the leaf block holding the
+   entries whose names have some hash.  */
+struct dx_path
+{
+  __u32 hash;
+
+  /* The number of index blocks followed, starting with the root, and for
+     each its block number in the directory and the position of the entry
+     followed in it.  */
+  int levels;
+  struct dx_frame
+  {
+    block_t block;
+    unsigned at;
+  } frames[EXT2_DX_MAX_LEVELS];
+
+  /* The block number of the leaf in the directory.  */
+  block_t leaf;
+};
+
+/* Return true if directory DP has an index which should be used.  */
+int ext2_dx_indexed (struct node *dp);
+
+/* Look NAME, of length NAMELEN, up in the index of directory DP, mapped at
+   BUF, and return the way to the leaf its entry belongs in in PATH.  If
+   the index is damaged, return EIO.  */
+error_t ext2_dx_probe (struct node *dp, vm_address_t buf,
+		       const char *name, size_t namelen, struct dx_path *path);
+
+/* If the leaf after that of PATH in directory DP, mapped at BUF, continues
+   the run of entries with PATH->hash, move PATH to it and return true.  */
+int ext2_dx_next_leaf (struct node *dp, vm_address_t buf,
+		       struct dx_path *path);
+
+/* Return in NBLOCKS the number of blocks directory DP, mapped at BUF, must
+   grow by for ext2_dx_split to split the leaf of PATH.  Return ENOSPC if
+   the index is full, and EIO if the leaf is damaged.  */
+error_t ext2_dx_split_blocks (struct node *dp, vm_address_t buf,
+			      struct dx_path *path, int *nblocks);
+
+/* Move about half of the entries of the leaf of PATH in directory DP,
+   mapped at BUF, to the empty block NEWBLOCK, and enter it in the index,
+   using the empty block after it for the index if ext2_dx_split_blocks
+   said so.  Update PATH for the leaf where PATH->hash now belongs, and
+   return the last entry in it, after which there is room for a new one.  */
+struct ext2_dir_entry_2 *ext2_dx_split (struct node *dp, vm_address_t buf,
+					struct dx_path *path,
+					block_t newblock);
+
+/* Return true if directory DP, mapped at BUF, which has just one full
+   block, should be indexed before it grows.  */
+int ext2_dx_may_index (struct node *dp, vm_address_t buf);
+
+/* Index directory DP, mapped at BUF, moving the entries in its first block
+   to its second, empty block, which becomes the only leaf of the index.
+   Return the way to it for NAME, of length NAMELEN, in PATH.  */
+void ext2_dx_make_index (struct node *dp, vm_address_t buf,
+			 const char *name, size_t namelen,
+			 struct dx_path *path);
+
+/* ---------------------------------------------------------------- */
 
 /* Write disk block ADDR with DATA of LEN bytes, waiting for completion.  */
 error_t dev_write_sync (block_t addr, vm_address_t data, long len);
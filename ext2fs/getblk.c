@@ -70,6 +70,10 @@ ext2_alloc_block (struct node *node, block_t goal, int zero)
   static unsigned long alloc_hits = 0, alloc_attempts = 0;
 #endif
   block_t result;
+#ifdef EXT2_PREALLOCATE
+  struct ext2_inode_info *info = &node->dn->info;
+  block_t prealloc_goal;
+#endif
 
 #ifdef EXT2_PREALLOCATE
   if (node->dn->info.i_prealloc_count &&
@@ -86,20 +90,51 @@ ext2_alloc_block (struct node *node, block_t goal, int zero)
       ext2_debug ("preallocation miss (%lu/%lu)",
 		  alloc_hits, ++alloc_attempts);
       ext2_discard_prealloc (node);
-      result = ext2_new_block
-	(goal,
-	 S_ISREG (node->dn_stat.st_mode)
-	 ? (sblock->s_prealloc_blocks ?: EXT2_DEFAULT_PREALLOC_BLOCKS)
-	 : (S_ISDIR (node->dn_stat.st_mode)
-	    && EXT2_HAS_COMPAT_FEATURE(sblock,
-				       EXT2_FEATURE_COMPAT_DIR_PREALLOC))
-	 ? sblock->s_prealloc_dir_blocks
-	 : 0,
-	 &node->dn->info.i_prealloc_count,
-	 &node->dn->info.i_prealloc_block);
+
+      if (S_ISREG (node->dn_stat.st_mode))
+	{
+	  prealloc_goal
+	    = sblock->s_prealloc_blocks ?: EXT2_DEFAULT_PREALLOC_BLOCKS;
+
+	  /* If the file has gone on past the end of what was last
+	     preallocated for it, it is being written sequentially: each
+	     time, preallocate twice as much, up to a limit, so that a large
+	     file is allocated in large runs.  */
+	  if (info->i_prealloc_window
+	      && (goal == info->i_prealloc_block
+		  || goal + 1 == info->i_prealloc_block))
+	    {
+	      if (info->i_prealloc_window < EXT2_MAX_PREALLOC_BLOCKS)
+		info->i_prealloc_window *= 2;
+	      if (prealloc_goal < info->i_prealloc_window)
+		prealloc_goal = info->i_prealloc_window;
+	    }
+
+	  /* Blocks written out together after their allocation was
+	     delayed are allocated together, but no more, as only they
+	     have free blocks set aside for them.  */
+	  if (node->dn->alloc_want)
+	    prealloc_goal = (node->dn->alloc_want < EXT2_MAX_PREALLOC_BLOCKS
+			     ? node->dn->alloc_want
+			     : EXT2_MAX_PREALLOC_BLOCKS);
+	  info->i_prealloc_window = prealloc_goal;
+	}
+      else if (S_ISDIR (node->dn_stat.st_mode)
+	       && EXT2_HAS_COMPAT_FEATURE(sblock,
+					  EXT2_FEATURE_COMPAT_DIR_PREALLOC))
+	prealloc_goal = sblock->s_prealloc_dir_blocks;
+      else
+	prealloc_goal = 0;
+
+      /* A file's alloc_want is only set while it is spending the free
+	 blocks set aside for it.  */
+      result = ext2_new_block (goal, prealloc_goal,
+			       &info->i_prealloc_count,
+			       &info->i_prealloc_block,
+			       node->dn->alloc_want > 0);
     }
 #else
-  result = ext2_new_block (goal, 0, 0);
+  result = ext2_new_block (goal, 0, 0, 0, node->dn->alloc_want > 0);
 #endif
 
   if (result && zero)
@@ -0,0 +1,784 @@
+/* Hashed directory indexes
+
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* This is the dir_index format of ext3, also known as htree.  An indexed
+   directory has the EXT2_INDEX_FL flag.  Its first block holds "." and
+   "..", whose record covers the rest of the block, where the root of the
+   index lives.  The root, and any other index blocks below it, hold
+   sorted (hash, block) pairs, each leading to the block with the entries
+   whose names hash at least as high as it, but below the next pair.  At
+   the bottom are the leaves, ordinary directory blocks.  The other index
+   blocks start with a free entry covering the whole block, so to anything
+   scanning the directory block by block, the index is just free space.
+
+   When a leaf fills up, about half of its entries are moved to a new
+   block, which is entered in the index after it.  A run of entries with
+   the same hash may not fit in one leaf; the hash of each leaf continuing
+   the run then has its low bit set in the index.  */
+
+#include "ext2fs.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+/* The start of a directory entry.  */
+struct dx_dirent
+{
+  __u32 inode;
+  __u16 rec_len;
+  __u8 name_len;
+  __u8 file_type;
+};
+
+struct dx_root_info
+{
+  __u32 reserved_zero;
+  __u8 hash_version;
+  __u8 info_length;		/* sizeof (struct dx_root_info) */
+  __u8 indirect_levels;
+  __u8 unused_flags;
+};
+
+/* The start of the first block of an indexed directory, which is followed
+   by the entries of the root.  */
+struct dx_root
+{
+  struct dx_dirent dot;
+  char dot_name[4];
+  struct dx_dirent dotdot;
+  char dotdot_name[4];
+  struct dx_root_info info;
+};
+
+struct dx_entry
+{
+  __u32 hash;
+  __u32 block;
+};
+
+/* Any other index block.  */
+struct dx_node
+{
+  struct dx_dirent fake;
+  struct dx_entry entries[0];
+};
+
+/* The first entry of each index block has its count and limit in place of
+   the hash, which is implicitly the lowest one covered by the block.  */
+struct dx_countlimit
+{
+  __u16 limit;
+  __u16 count;
+};
+
+/* Return the address of block BLOCK of the directory mapped at BUF.  */
+#define DX_BLOCK(buf, block) \
+  ((buf) + ((vm_address_t) (block) << log2_block_size))
+
+static inline unsigned
+dx_count (struct dx_entry *entries)
+{
+  return ((struct dx_countlimit *) entries)->count;
+}
+
+static inline unsigned
+dx_limit (struct dx_entry *entries)
+{
+  return ((struct dx_countlimit *) entries)->limit;
+}
+
+static inline void
+dx_set_count (struct dx_entry *entries, unsigned count)
+{
+  ((struct dx_countlimit *) entries)->count = count;
+}
+
+static inline void
+dx_set_limit (struct dx_entry *entries, unsigned limit)
+{
+  ((struct dx_countlimit *) entries)->limit = limit;
+}
+
+static inline block_t
+dx_block (struct dx_entry *entry)
+{
+  return entry->block & 0x0fffffff;
+}
+
+static inline unsigned
+dx_root_limit (unsigned info_length)
+{
+  return ((block_size - offsetof (struct dx_root, info) - info_length)
+	  / sizeof (struct dx_entry));
+}
+
+static inline unsigned
+dx_node_limit (void)
+{
+  return (block_size - sizeof (struct dx_node)) / sizeof (struct dx_entry);
+}
+
+/* Return the entries of index block BLOCK of the directory mapped at
+   BUF.  */
+static struct dx_entry *
+dx_entries (vm_address_t buf, block_t block)
+{
+  if (block == 0)
+    {
+      struct dx_root *root = (struct dx_root *) buf;
+      return (struct dx_entry *) ((char *) &root->info
+				  + root->info.info_length);
+    }
+  else
+    return ((struct dx_node *) DX_BLOCK (buf, block))->entries;
+}
+
+/* Hash functions, as in Linux.  */
+
+#define DX_DELTA 0x9E3779B9
+
+static void
+dx_tea_transform (__u32 buf[4], const __u32 in[4])
+{
+  __u32 sum = 0;
+  __u32 b0 = buf[0], b1 = buf[1];
+  __u32 a = in[0], b = in[1], c = in[2], d = in[3];
+  int n = 16;
+
+  do
+    {
+      sum += DX_DELTA;
+      b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+      b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    }
+  while (--n);
+
+  buf[0] += b0;
+  buf[1] += b1;
+}
+
+#define ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+/* The basic MD4 functions: selection, majority and parity.  */
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+
+#define ROUND(f, a, b, c, d, x, s) \
+  (a += f (b, c, d) + (x), a = ROL32 (a, s))
+#define K1 0
+#define K2 013240474631UL
+#define K3 015666365641UL
+
+/* A cut-down version of MD4, in which BUF is hashed with the eight words
+   IN.  */
+static void
+dx_half_md4_transform (__u32 buf[4], const __u32 in[8])
+{
+  __u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+  /* Round 1.  */
+  ROUND (F, a, b, c, d, in[0] + K1,  3);
+  ROUND (F, d, a, b, c, in[1] + K1,  7);
+  ROUND (F, c, d, a, b, in[2] + K1, 11);
+  ROUND (F, b, c, d, a, in[3] + K1, 19);
+  ROUND (F, a, b, c, d, in[4] + K1,  3);
+  ROUND (F, d, a, b, c, in[5] + K1,  7);
+  ROUND (F, c, d, a, b, in[6] + K1, 11);
+  ROUND (F, b, c, d, a, in[7] + K1, 19);
+
+  /* Round 2.  */
+  ROUND (G, a, b, c, d, in[1] + K2,  3);
+  ROUND (G, d, a, b, c, in[3] + K2,  5);
+  ROUND (G, c, d, a, b, in[5] + K2,  9);
+  ROUND (G, b, c, d, a, in[7] + K2, 13);
+  ROUND (G, a, b, c, d, in[0] + K2,  3);
+  ROUND (G, d, a, b, c, in[2] + K2,  5);
+  ROUND (G, c, d, a, b, in[4] + K2,  9);
+  ROUND (G, b, c, d, a, in[6] + K2, 13);
+
+  /* Round 3.  */
+  ROUND (H, a, b, c, d, in[3] + K3,  3);
+  ROUND (H, d, a, b, c, in[7] + K3,  9);
+  ROUND (H, c, d, a, b, in[2] + K3, 11);
+  ROUND (H, b, c, d, a, in[6] + K3, 15);
+  ROUND (H, a, b, c, d, in[1] + K3,  3);
+  ROUND (H, d, a, b, c, in[5] + K3,  9);
+  ROUND (H, c, d, a, b, in[0] + K3, 11);
+  ROUND (H, b, c, d, a, in[4] + K3, 15);
+
+  buf[0] += a;
+  buf[1] += b;
+  buf[2] += c;
+  buf[3] += d;
+}
+
+#undef ROUND
+#undef F
+#undef G
+#undef H
+
+/* Return the next character of a name, as a signed or an unsigned char
+   depending on UNSIGNED_CHARS.  */
+#define DX_CHAR(p, unsigned_chars) \
+  ((unsigned_chars) ? (int) *(const unsigned char *) (p) \
+		    : (int) *(const signed char *) (p))
+
+/* The original hash function of the index, which is kept for old
+   filesystems.  */
+static __u32
+dx_hack_hash (const char *name, int len, int unsigned_chars)
+{
+  __u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+  while (len--)
+    {
+      hash = hash1 + (hash0 ^ (DX_CHAR (name++, unsigned_chars) * 7152373));
+      if (hash & 0x80000000)
+	hash -= 0x7fffffff;
+      hash1 = hash0;
+      hash0 = hash;
+    }
+  return hash0 << 1;
+}
+
+/* Fill the NUM words at BUF with the first LEN characters of MSG, padded
+   with its length.  */
+static void
+dx_str2hashbuf (const char *msg, int len, __u32 *buf, int num,
+		int unsigned_chars)
+{
+  __u32 pad, val;
+  int i;
+
+  pad = (__u32) len | ((__u32) len << 8);
+  pad |= pad << 16;
+
+  val = pad;
+  if (len > num * 4)
+    len = num * 4;
+  for (i = 0; i < len; i++)
+    {
+      val = DX_CHAR (msg + i, unsigned_chars) + (val << 8);
+      if (i % 4 == 3)
+	{
+	  *buf++ = val;
+	  val = pad;
+	  num--;
+	}
+    }
+  if (--num >= 0)
+    *buf++ = val;
+  while (--num >= 0)
+    *buf++ = pad;
+}
+
+/* Return the hash of NAME, of length LEN, with hash function VERSION, one
+   of the EXT2_HASH_* values.  */
+static __u32
+dx_hash (int version, const char *name, int len)
+{
+  __u32 hash, in[8], buf[4];
+  int i, unsigned_chars = 0;
+
+  buf[0] = 0x67452301;
+  buf[1] = 0xefcdab89;
+  buf[2] = 0x98badcfe;
+  buf[3] = 0x10325476;
+  for (i = 0; i < 4; i++)
+    if (sblock->s_hash_seed[i])
+      {
+	memcpy (buf, sblock->s_hash_seed, sizeof buf);
+	break;
+      }
+
+  switch (version)
+    {
+    case EXT2_HASH_LEGACY_UNSIGNED:
+      unsigned_chars = 1;
+    case EXT2_HASH_LEGACY:
+      hash = dx_hack_hash (name, len, unsigned_chars);
+      break;
+
+    case EXT2_HASH_HALF_MD4_UNSIGNED:
+      unsigned_chars = 1;
+    case EXT2_HASH_HALF_MD4:
+      for (; len > 0; len -= 32, name += 32)
+	{
+	  dx_str2hashbuf (name, len, in, 8, unsigned_chars);
+	  dx_half_md4_transform (buf, in);
+	}
+      hash = buf[1];
+      break;
+
+    case EXT2_HASH_TEA_UNSIGNED:
+      unsigned_chars = 1;
+    case EXT2_HASH_TEA:
+      for (; len > 0; len -= 16, name += 16)
+	{
+	  dx_str2hashbuf (name, len, in, 4, unsigned_chars);
+	  dx_tea_transform (buf, in);
+	}
+      hash = buf[0];
+      break;
+
+    default:
+      hash = 0;
+      assert (! "impossible: bogus directory hash version");
+    }
+
+  /* The low bit marks continued runs in the index, and the highest hash
+     is kept for the end of the directory by Linux.  */
+  hash &= ~1;
+  if (hash == (__u32) 0x7fffffff << 1)
+    hash = (__u32) (0x7fffffff - 1) << 1;
+  return hash;
+}
+
+/* Return the hash of NAME, of length LEN, in the index of the directory
+   mapped at BUF.  */
+static __u32
+dx_hash_name (vm_address_t buf, const char *name, int len)
+{
+  struct dx_root *root = (struct dx_root *) buf;
+  int version = root->info.hash_version;
+
+  /* Filesystems made where char is unsigned say so.  */
+  if (version <= EXT2_HASH_TEA
+      && (sblock->s_flags & EXT2_FLAGS_UNSIGNED_HASH))
+    version += EXT2_HASH_LEGACY_UNSIGNED;
+  return dx_hash (version, name, len);
+}
+
+int
+ext2_dx_indexed (struct node *dp)
+{
+  return (EXT2_HAS_COMPAT_FEATURE (sblock, EXT2_FEATURE_COMPAT_DIR_INDEX)
+	  && (dp->dn->info.i_flags & EXT2_INDEX_FL));
+}
+
+/* Return the last of the entries of an index block, ENTRIES, whose hash is
+   not above HASH.  */
+static struct dx_entry *
+dx_search (struct dx_entry *entries, __u32 hash)
+{
+  struct dx_entry *p = entries + 1, *q = entries + dx_count (entries) - 1;
+
+  while (p <= q)
+    {
+      struct dx_entry *m = p + (q - p) / 2;
+      if (m->hash > hash)
+	q = m - 1;
+      else
+	p = m + 1;
+    }
+  return p - 1;
+}
+
+error_t
+ext2_dx_probe (struct node *dp, vm_address_t buf,
+	       const char *name, size_t namelen, struct dx_path *path)
+{
+  struct dx_root *root = (struct dx_root *) buf;
+  block_t nblocks = dp->dn_stat.st_size >> log2_block_size;
+  struct dx_entry *entries, *at;
+  block_t block = 0;
+  unsigned limit;
+  int level;
+
+  if (nblocks < 2
+      || root->dot.rec_len != EXT2_DIR_REC_LEN (1)
+      || root->dotdot.rec_len != block_size - EXT2_DIR_REC_LEN (1)
+      || root->info.reserved_zero != 0
+      || root->info.hash_version > EXT2_HASH_TEA
+      || root->info.info_length < sizeof root->info
+      || root->info.unused_flags & 1
+      || root->info.indirect_levels >= EXT2_DX_MAX_LEVELS)
+    goto bad;
+
+  path->hash = dx_hash_name (buf, name, namelen);
+  path->levels = root->info.indirect_levels + 1;
+  limit = dx_root_limit (root->info.info_length);
+  for (level = 0; level < path->levels; level++)
+    {
+      entries = dx_entries (buf, block);
+      if (dx_limit (entries) != limit
+	  || dx_count (entries) == 0 || dx_count (entries) > limit)
+	goto bad;
+
+      at = dx_search (entries, path->hash);
+      path->frames[level].block = block;
+      path->frames[level].at = at - entries;
+
+      block = dx_block (at);
+      if (block == 0 || block >= nblocks)
+	goto bad;
+      limit = dx_node_limit ();
+    }
+
+  path->leaf = block;
+  return 0;
+
+ bad:
+  ext2_warning ("bad directory index: inode: %Ld", dp->cache_id);
+  return EIO;
+}
+
+int
+ext2_dx_next_leaf (struct node *dp, vm_address_t buf, struct dx_path *path)
+{
+  block_t nblocks = dp->dn_stat.st_size >> log2_block_size;
+  struct dx_path next = *path;
+  struct dx_entry *entries;
+  block_t block;
+  int level;
+
+  /* Find the lowest index block with an entry after the one followed.  */
+  for (level = next.levels - 1; level >= 0; level--)
+    {
+      entries = dx_entries (buf, next.frames[level].block);
+      if (++next.frames[level].at < dx_count (entries))
+	break;
+    }
+  if (level < 0)
+    return 0;
+
+  /* That entry leads to the leaf after PATH's, so go on only if it has
+     the same hash, and so continues the run.  */
+  if ((entries[next.frames[level].at].hash & ~1) != path->hash)
+    return 0;
+
+  /* Follow the first entries down to that leaf.  */
+  for (;;)
+    {
+      block = dx_block (dx_entries (buf, next.frames[level].block)
+			+ next.frames[level].at);
+      if (block == 0 || block >= nblocks)
+	{
+	  ext2_warning ("bad directory index: inode: %Ld", dp->cache_id);
+	  return 0;
+	}
+      if (++level == next.levels)
+	break;
+      next.frames[level].block = block;
+      next.frames[level].at = 0;
+    }
+
+  next.leaf = block;
+  *path = next;
+  return 1;
+}
+
+/* Return true if the entries in directory block BLOCK, whose address is
+   ADDR, are all sound.  */
+static int
+dx_block_valid (struct node *dp, vm_address_t addr, block_t block)
+{
+  struct ext2_dir_entry_2 *entry;
+  vm_size_t off;
+
+  for (off = 0; off < block_size; off += entry->rec_len)
+    {
+      entry = (struct ext2_dir_entry_2 *) (addr + off);
+      if (entry->rec_len < EXT2_DIR_REC_LEN (0)
+	  || entry->rec_len % EXT2_DIR_PAD
+	  || off + entry->rec_len > block_size
+	  || EXT2_DIR_REC_LEN (entry->name_len) > entry->rec_len)
+	{
+	  ext2_warning ("bad directory entry: inode: %Ld offset: %zd",
+			dp->cache_id,
+			((vm_size_t) block << log2_block_size) + off);
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+error_t
+ext2_dx_split_blocks (struct node *dp, vm_address_t buf,
+		      struct dx_path *path, int *nblocks)
+{
+  struct dx_entry *entries;
+
+  if (! dx_block_valid (dp, DX_BLOCK (buf, path->leaf), path->leaf))
+    return EIO;
+
+  /* The new leaf can be entered in the lowest index block if it has room.
+     If not, the root can take the new index block it is split into, or if
+     it is the root which is full, the new index block its entries move
+     to.  */
+  *nblocks = 1;
+  entries = dx_entries (buf, path->frames[path->levels - 1].block);
+  if (dx_count (entries) == dx_limit (entries))
+    {
+      entries = dx_entries (buf, 0);
+      if (path->levels == EXT2_DX_MAX_LEVELS
+	  && dx_count (entries) == dx_limit (entries))
+	return ENOSPC;
+      *nblocks = 2;
+    }
+  return 0;
+}
+
+/* Add an entry for BLOCK, which holds the hashes from HASH, in the index
+   block of FRAME, after the entry followed.  */
+static void
+dx_insert (vm_address_t buf, struct dx_frame *frame,
+	   __u32 hash, block_t block)
+{
+  struct dx_entry *entries = dx_entries (buf, frame->block);
+  struct dx_entry *new = entries + frame->at + 1;
+  unsigned count = dx_count (entries);
+
+  assert (count < dx_limit (entries));
+  memmove (new + 1, new, (entries + count - new) * sizeof *new);
+  new->hash = hash;
+  new->block = block;
+  dx_set_count (entries, count + 1);
+}
+
+/* Start an empty index block at ADDR.  */
+static struct dx_entry *
+dx_new_node (vm_address_t addr)
+{
+  struct dx_node *node = (struct dx_node *) addr;
+
+  node->fake.inode = 0;
+  node->fake.rec_len = block_size;
+  node->fake.name_len = 0;
+  node->fake.file_type = 0;
+  return node->entries;
+}
+
+/* A live entry of a leaf being split.  */
+struct dx_map
+{
+  __u32 hash;
+  __u16 offs;
+  __u16 size;
+};
+
+static int
+dx_map_cmp (const void *a, const void *b)
+{
+  const struct dx_map *x = a, *y = b;
+  if (x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+  return x->offs - y->offs;
+}
+
+/* Pack the live entries of the directory block at ADDR at its start, and
+   return the last of them, which is given the rest of the block.  */
+static struct ext2_dir_entry_2 *
+dx_pack (vm_address_t addr)
+{
+  struct ext2_dir_entry_2 *entry, *to = 0;
+  vm_size_t from, top = 0, rec_len;
+
+  for (from = 0; from < block_size; from += rec_len)
+    {
+      entry = (struct ext2_dir_entry_2 *) (addr + from);
+      rec_len = entry->rec_len;
+      if (entry->inode)
+	{
+	  to = (struct ext2_dir_entry_2 *) (addr + top);
+	  if (to != entry)
+	    memmove (to, entry, EXT2_DIR_REC_LEN (entry->name_len));
+	  to->rec_len = EXT2_DIR_REC_LEN (to->name_len);
+	  top += to->rec_len;
+	}
+    }
+
+  assert (to);
+  to->rec_len += block_size - top;
+  return to;
+}
+
+struct ext2_dir_entry_2 *
+ext2_dx_split (struct node *dp, vm_address_t buf, struct dx_path *path,
+	       block_t newblock)
+{
+  struct dx_frame *frame = &path->frames[path->levels - 1];
+  struct dx_entry *entries = dx_entries (buf, frame->block), *new_entries;
+  vm_address_t leaf = DX_BLOCK (buf, path->leaf);
+  vm_address_t new = DX_BLOCK (buf, newblock);
+  struct dx_map map[block_size / EXT2_DIR_REC_LEN (0)];
+  struct ext2_dir_entry_2 *entry, *last, *last2 = 0;
+  unsigned count, count1, i, split, moved;
+  vm_size_t off, top;
+  __u32 hash2;
+  int continued;
+
+  if (dx_count (entries) == dx_limit (entries))
+    {
+      block_t indexblock = newblock + 1;
+
+      count = dx_count (entries);
+      new_entries = dx_new_node (DX_BLOCK (buf, indexblock));
+      if (path->levels == 1)
+	{
+	  /* Move all the entries of the root into the new index block,
+	     which becomes the only one under the root.  */
+	  struct dx_root *root = (struct dx_root *) buf;
+
+	  memcpy (new_entries, entries, count * sizeof *entries);
+	  dx_set_limit (new_entries, dx_node_limit ());
+	  dx_set_count (entries, 1);
+	  entries[0].block = indexblock;
+	  root->info.indirect_levels = 1;
+
+	  path->levels = 2;
+	  path->frames[1].block = indexblock;
+	  path->frames[1].at = frame->at;
+	  path->frames[0].at = 0;
+	  frame = &path->frames[1];
+	}
+      else
+	{
+	  /* Move the upper half of the entries into the new index block,
+	     and enter it in the root after this one.  */
+	  count1 = count / 2;
+	  hash2 = entries[count1].hash;
+	  memcpy (new_entries, entries + count1,
+		  (count - count1) * sizeof *entries);
+	  dx_set_limit (new_entries, dx_node_limit ());
+	  dx_set_count (new_entries, count - count1);
+	  dx_set_count (entries, count1);
+	  dx_insert (buf, &path->frames[0], hash2, indexblock);
+
+	  if (frame->at >= count1)
+	    {
+	      frame->block = indexblock;
+	      frame->at -= count1;
+	      path->frames[0].at++;
+	    }
+	}
+    }
+
+  /* Sort the live entries of the leaf by hash.  */
+  count = 0;
+  for (off = 0; off < block_size; off += entry->rec_len)
+    {
+      entry = (struct ext2_dir_entry_2 *) (leaf + off);
+      if (entry->inode)
+	{
+	  map[count].hash = dx_hash_name (buf, entry->name, entry->name_len);
+	  map[count].offs = off;
+	  map[count].size = EXT2_DIR_REC_LEN (entry->name_len);
+	  count++;
+	}
+    }
+  assert (count >= 2);
+  qsort (map, count, sizeof *map, dx_map_cmp);
+
+  /* Move the entries with the highest hashes which take up half of the
+     leaf.  */
+  moved = 0;
+  for (split = count; split > 1; split--)
+    {
+      if (moved + map[split - 1].size / 2 > block_size / 2)
+	break;
+      moved += map[split - 1].size;
+    }
+  if (split == count)
+    split--;
+  hash2 = map[split].hash;
+  continued = hash2 == map[split - 1].hash;
+
+  top = 0;
+  for (i = split; i < count; i++)
+    {
+      entry = (struct ext2_dir_entry_2 *) (leaf + map[i].offs);
+      last2 = (struct ext2_dir_entry_2 *) (new + top);
+      memcpy (last2, entry, map[i].size);
+      last2->rec_len = map[i].size;
+      top += map[i].size;
+      entry->inode = 0;
+    }
+  last2->rec_len += block_size - top;
+  last = dx_pack (leaf);
+
+  dx_insert (buf, frame, hash2 | continued, newblock);
+
+  if (path->hash >= hash2)
+    {
+      frame->at++;
+      path->leaf = newblock;
+      return last2;
+    }
+  else
+    return last;
+}
+
+int
+ext2_dx_may_index (struct node *dp, vm_address_t buf)
+{
+  struct dx_root *root = (struct dx_root *) buf;
+
+  return (EXT2_HAS_COMPAT_FEATURE (sblock, EXT2_FEATURE_COMPAT_DIR_INDEX)
+	  && ! (dp->dn->info.i_flags & EXT2_INDEX_FL)
+	  && dp->dn_stat.st_size == block_size
+	  && sblock->s_def_hash_version <= EXT2_HASH_TEA
+	  && dx_block_valid (dp, buf, 0)
+	  && root->dot.name_len == 1 && root->dot_name[0] == '.'
+	  && root->dot.rec_len == EXT2_DIR_REC_LEN (1)
+	  && root->dotdot.name_len == 2
+	  && root->dotdot_name[0] == '.' && root->dotdot_name[1] == '.'
+	  && EXT2_DIR_REC_LEN (1) + root->dotdot.rec_len < block_size);
+}
+
+void
+ext2_dx_make_index (struct node *dp, vm_address_t buf,
+		    const char *name, size_t namelen, struct dx_path *path)
+{
+  struct dx_root *root = (struct dx_root *) buf;
+  vm_address_t first = buf + EXT2_DIR_REC_LEN (1) + root->dotdot.rec_len;
+  vm_size_t len = buf + block_size - first, off;
+  vm_address_t leaf = DX_BLOCK (buf, 1);
+  struct ext2_dir_entry_2 *entry;
+  struct dx_entry *entries;
+
+  /* Move the entries after ".." to the leaf, giving the last one the rest
+     of the block.  */
+  memcpy ((void *) leaf, (void *) first, len);
+  off = 0;
+  do
+    {
+      entry = (struct ext2_dir_entry_2 *) (leaf + off);
+      off += entry->rec_len;
+    }
+  while (off < len);
+  entry->rec_len += block_size - len;
+
+  /* Put the root after "..", with a single entry for the leaf.  */
+  root->dotdot.rec_len = block_size - EXT2_DIR_REC_LEN (1);
+  memset (&root->info, 0, buf + block_size - (vm_address_t) &root->info);
+  root->info.hash_version = sblock->s_def_hash_version;
+  root->info.info_length = sizeof root->info;
+  entries = dx_entries (buf, 0);
+  dx_set_limit (entries, dx_root_limit (sizeof root->info));
+  dx_set_count (entries, 1);
+  entries[0].block = 1;
+
+  path->hash = dx_hash_name (buf, name, namelen);
+  path->levels = 1;
+  path->frames[0].block = 0;
+  path->frames[0].at = 0;
+  path->leaf = 1;
+}
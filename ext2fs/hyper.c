@@ -144,6 +144,11 @@ get_hypermetadata (void)
   addr_per_block = block_size / sizeof (block_t);
   db_per_group = (groups_count + desc_per_block - 1) / desc_per_block;
 
+  /* Whatever was known of the free space in the groups may be stale.  */
+  free (group_hints);
+  group_hints = calloc (groups_count, sizeof *group_hints);
+  assert (group_hints);
+
   ext2fs_clean = sblock->s_state & EXT2_VALID_FS;
   if (! ext2fs_clean)
     {
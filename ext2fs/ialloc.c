@@ -77,6 +77,9 @@ diskfs_free_node (struct node *np, mode_t old_mode)
   gdp = group_desc (block_group);
   bh = disk_cache_block_ref (gdp->bg_inode_bitmap);
 
+  if (bit < group_hint (block_group)->first_free_inode)
+    group_hint (block_group)->first_free_inode = bit;
+
   if (!clear_bit (bit, bh))
     ext2_warning ("bit already cleared for inode %Ld", inum);
   else
@@ -119,6 +122,7 @@ ext2_alloc_inode (ino_t dir_inum, mode_t mode)
   ino_t inum;
   struct ext2_group_desc *gdp;
   struct ext2_group_desc *tmp;
+  struct group_hint *hint;
 
   pthread_spin_lock (&global_lock);
 
@@ -218,11 +222,14 @@ repeat:
       return 0;
     }
 
+  /* No inode before the hint is free; the search moves it up.  */
   bh = disk_cache_block_ref (gdp->bg_inode_bitmap);
-  if ((inum =
-       find_first_zero_bit ((unsigned long *) bh, sblock->s_inodes_per_group))
-      < sblock->s_inodes_per_group)
+  hint = group_hint (i);
+  inum = find_next_zero_bit (bh, sblock->s_inodes_per_group,
+			     hint->first_free_inode);
+  if (inum < sblock->s_inodes_per_group)
     {
+      hint->first_free_inode = inum + 1;
       if (set_bit (inum, bh))
 	{
 	  ext2_warning ("bit already set for inode %d", inum);
@@ -237,6 +244,13 @@ repeat:
     {
       disk_cache_block_deref (bh);
       bh = NULL;
+      if (gdp->bg_free_inodes_count != 0 && hint->first_free_inode > 0)
+	{
+	  /* The hint was wrong; look again without it.  */
+	  ext2_warning ("free inode hint wrong for block group %d", i);
+	  hint->first_free_inode = 0;
+	  goto repeat;
+	}
       if (gdp->bg_free_inodes_count != 0)
 	{
 	  ext2_error ("free inodes count corrupted in group %d", i);
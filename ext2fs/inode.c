@@ -39,77 +39,45 @@
 #define UF_IMMUTABLE 0
 #endif
 
-#define	INOHSZ	8192
-#if	((INOHSZ&(INOHSZ-1)) == 0)
-#define	INOHASH(ino)	((ino)&(INOHSZ-1))
-#else
-#define	INOHASH(ino)	(((unsigned)(ino))%INOHSZ)
-#endif
-
-static struct node *nodehash[INOHSZ];
-static size_t nodehash_nr_items;
-
 static error_t read_node (struct node *np);
 
 pthread_spinlock_t generation_lock = PTHREAD_SPINLOCK_INITIALIZER;
 
-/* Initialize the inode hash table. */
-void
-inode_init ()
-{
-  int n;
-  for (n = 0; n < INOHSZ; n++)
-    nodehash[n] = 0;
-}
-
-/* Fetch inode INUM, set *NPP to the node structure;
-   gain one user reference and lock the node.  */
+/* Create and return in *NPP a new node for the node cache, along with
+   its format specific data.  */
 error_t
-diskfs_cached_lookup (ino_t inum, struct node **npp)
+diskfs_user_make_node (struct node **npp, struct lookup_context *ctx)
 {
-  error_t err;
   struct node *np;
   struct disknode *dn;
 
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-  for (np = nodehash[INOHASH(inum)]; np; np = np->dn->hnext)
-    if (np->cache_id == inum)
-      {
-	np->references++;
-	pthread_spin_unlock (&diskfs_node_refcnt_lock);
-	pthread_mutex_lock (&np->lock);
-	*npp = np;
-	return 0;
-      }
-
-  /* Format specific data for the new node.  */
-  dn = malloc (sizeof (struct disknode));
-  if (! dn)
-    {
-      pthread_spin_unlock (&diskfs_node_refcnt_lock);
-      return ENOMEM;
-    }
+  np = diskfs_make_node_alloc (sizeof (struct disknode));
+  if (! np)
+    return ENOMEM;
+
+  dn = np->dn;
   dn->dirents = 0;
   dn->dir_idx = 0;
+  dn->no_dir_index = 0;
   dn->pager = 0;
+  dn->delalloc_runs = 0;
+  dn->delalloc_nruns = dn->delalloc_runs_alloced = 0;
+  dn->delalloc_blocks = 0;
+  dn->delalloc_charge = 0;
+  dn->alloc_want = 0;
   pthread_rwlock_init (&dn->alloc_lock, NULL);
   pokel_init (&dn->indir_pokel, diskfs_disk_pager, disk_cache);
 
-  /* Create the new node.  */
-  np = diskfs_make_node (dn);
-  np->cache_id = inum;
-
-  pthread_mutex_lock (&np->lock);
-
-  /* Put NP in NODEHASH.  */
-  dn->hnext = nodehash[INOHASH(inum)];
-  if (dn->hnext)
-    dn->hnext->dn->hprevp = &dn->hnext;
-  dn->hprevp = &nodehash[INOHASH(inum)];
-  nodehash[INOHASH(inum)] = np;
-  nodehash_nr_items += 1;
+  *npp = np;
+  return 0;
+}
 
-  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+/* Fill in NP, which was just created by diskfs_user_make_node, from
+   the disk.  */
+error_t
+diskfs_user_read_node (struct node *np, struct lookup_context *ctx)
+{
+  error_t err;
 
   /* Get the contents of NP off disk.  */
   err = read_node (np);
@@ -124,79 +92,46 @@ diskfs_cached_lookup (ino_t inum, struct node **npp)
       np->dn_set_ctime = 1;
     }
 
-  if (err)
-    return err;
-  else
-    {
-      *npp = np;
-      return 0;
-    }
-}
-
-/* Lookup node INUM (which must have a reference already) and return it
-   without allocating any new references. */
-struct node *
-ifind (ino_t inum)
-{
-  struct node *np;
-
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-  for (np = nodehash[INOHASH(inum)]; np; np = np->dn->hnext)
-    {
-      if (np->cache_id != inum)
-	continue;
-
-      assert (np->references);
-      pthread_spin_unlock (&diskfs_node_refcnt_lock);
-      return np;
-    }
-  assert (0);
+  return err;
 }
 
-/* The last reference to a node has gone away; drop
-   it from the hash table and clean all state in the dn structure. */
+/* The last reference to a node has gone away, and it has been dropped
+   from the node cache; clean all state in the dn structure.  */
 void
-diskfs_node_norefs (struct node *np)
+diskfs_user_node_norefs (struct node *np)
 {
-  *np->dn->hprevp = np->dn->hnext;
-  if (np->dn->hnext)
-    np->dn->hnext->dn->hprevp = np->dn->hprevp;
-  nodehash_nr_items -= 1;
-
   if (np->dn->dirents)
     free (np->dn->dirents);
+  diskfs_dir_index_drop (np);
   assert (!np->dn->pager);
 
+  /* Pages made writable but never written leave free blocks set aside.  */
+  delalloc_release (np, 0, (block_t) -1);
+  free (np->dn->delalloc_runs);
+
   /* Move any pending writes of indirect blocks.  */
   pokel_inherit (&global_pokel, &np->dn->indir_pokel);
   pokel_finalize (&np->dn->indir_pokel);
 
-  free (np->dn);
   free (np);
 }
 
 /* The last hard reference to a node has gone away; arrange to have
    all the weak references dropped that can be. */
 void
-diskfs_try_dropping_softrefs (struct node *np)
+diskfs_user_try_dropping_softrefs (struct node *np)
 {
   drop_pager_softrefs (np);
 }
 
-/* The last hard reference to a node has gone away. */
-void
-diskfs_lost_hardrefs (struct node *np)
-{
-}
-
 /* A new hard reference to a node has been created; it's now OK to
    have unused weak references. */
 void
-diskfs_new_hardrefs (struct node *np)
+diskfs_user_new_hardrefs (struct node *np)
 {
   allow_pager_softrefs (np);
 }
-
+
 /* Read stat information out of the ext2_inode. */
 static error_t
 read_node (struct node *np)
@@ -302,6 +237,7 @@ read_node (struct node *np)
   info->i_next_alloc_block = 0;
   info->i_next_alloc_goal = 0;
   info->i_prealloc_count = 0;
+  info->i_prealloc_window = 0;
 
   /* Set to a conservative value.  */
   dn->last_page_partially_writable = 0;
@@ -538,6 +474,8 @@ diskfs_node_reload (struct node *node)
       free (dn->dirents);
       dn->dirents = 0;
     }
+  diskfs_dir_index_drop (node);
+  dn->no_dir_index = 0;
   pokel_flush (&dn->indir_pokel);
   flush_node_pager (node);
   read_node (node);
@@ -545,63 +483,6 @@ diskfs_node_reload (struct node *node)
   return 0;
 }
 
-/* For each active node, call FUN.  The node is to be locked around the call
-   to FUN.  If FUN returns non-zero for any node, then immediately stop, and
-   return that value.  */
-error_t
-diskfs_node_iterate (error_t (*fun)(struct node *))
-{
-  error_t err = 0;
-  int n;
-  size_t num_nodes;
-  struct node *node, **node_list, **p;
-
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-
-  /* We must copy everything from the hash table into another data structure
-     to avoid running into any problems with the hash-table being modified
-     during processing (normally we delegate access to hash-table with
-     diskfs_node_refcnt_lock, but we can't hold this while locking the
-     individual node locks).  */
-  num_nodes = nodehash_nr_items;
-
-  /* TODO This method doesn't scale beyond a few dozen nodes and should be
-     replaced.  */
-  node_list = malloc (num_nodes * sizeof (struct node *));
-  if (node_list == NULL)
-    {
-      pthread_spin_unlock (&diskfs_node_refcnt_lock);
-      ext2_debug ("unable to allocate temporary node table");
-      return ENOMEM;
-    }
-
-  p = node_list;
-  for (n = 0; n < INOHSZ; n++)
-    for (node = nodehash[n]; node; node = node->dn->hnext)
-      {
-	*p++ = node;
-	node->references++;
-      }
-
-  pthread_spin_unlock (&diskfs_node_refcnt_lock);
-
-  p = node_list;
-  while (num_nodes-- > 0)
-    {
-      node = *p++;
-      if (!err)
-	{
-	  pthread_mutex_lock (&node->lock);
-	  err = (*fun)(node);
-	  pthread_mutex_unlock (&node->lock);
-	}
-      diskfs_nrele (node);
-    }
-
-  free (node_list);
-  return err;
-}
-
 /* Write all active disknodes into the ext2_inode pager. */
 void
 write_all_disknodes ()
@@ -652,6 +533,10 @@ diskfs_set_statfs (struct statfs *st)
   st->f_bsize = block_size;
   st->f_blocks = sblock->s_blocks_count;
   st->f_bfree = sblock->s_free_blocks_count;
+  if (st->f_bfree > delalloc_reserved_blocks)
+    st->f_bfree -= delalloc_reserved_blocks;
+  else
+    st->f_bfree = 0;
   st->f_bavail = st->f_bfree - sblock->s_r_blocks_count;
   if (st->f_bfree < sblock->s_r_blocks_count)
     st->f_bavail = 0;
@@ -697,7 +582,7 @@ diskfs_set_translator (struct node *np, const char *name, unsigned namelen,
 	ext2_new_block ((np->dn->info.i_block_group
 			 * EXT2_BLOCKS_PER_GROUP (sblock))
 			+ sblock->s_first_data_block,
-			0, 0, 0);
+			0, 0, 0, 0);
       if (blkno == 0)
 	{
 	  dino_deref (di);
@@ -43,6 +43,13 @@ pthread_spinlock_t node_to_page_lock = PTHREAD_SPINLOCK_INITIALIZER;
 #define MAY_CACHE 1
 #endif
 
+/* The size of the first read-ahead done once a file pager's faults look
+   sequential, in pages.  The window doubles with every further sequential
+   fault, up to READAHEAD_MAX_PAGES.  */
+#define READAHEAD_INITIAL_PAGES 4
+
+int readahead_max_pages = READAHEAD_DEFAULT_MAX_PAGES;
+
 #define STATS
 
 #ifdef STATS
@@ -62,6 +69,10 @@ struct ext2fs_pager_stats
 
   unsigned long file_page_unlocks;
   unsigned long file_grows;
+  unsigned long file_delalloc_blocks; /* Blocks allocated at writeback */
+
+  unsigned long file_readahead_hits;
+  unsigned long file_readahead_misses;
 };
 
 static struct ext2fs_pager_stats ext2s_pager_stats =
@@ -287,6 +298,74 @@ file_pager_read_page (struct node *node, vm_offset_t page,
   return err;
 }
 
+/* Read the run of pages for the pager backing NODE starting at START, at
+   most *LENGTH bytes long, into BUF.  Only whole pages which lie within
+   the allocated part of NODE and whose blocks are contiguous on disk are
+   read together, in a single device read; *LENGTH is set to the amount
+   read.  If less than two pages qualify, EOPNOTSUPP is returned and the
+   caller should use file_pager_read_page instead.  */
+static error_t
+file_pager_read_pages (struct node *node, vm_offset_t start,
+		       vm_size_t *length, void **buf, int *writelock)
+{
+  error_t err;
+  pthread_rwlock_t *lock = NULL;
+  vm_offset_t offset, limit;
+  block_t first, block;
+  vm_size_t run = 0;
+  size_t read = 0;
+
+  pthread_rwlock_rdlock (&node->dn->alloc_lock);
+  lock = &node->dn->alloc_lock;
+
+  limit = start + *length;
+  if (limit > trunc_page (node->allocsize))
+    limit = trunc_page (node->allocsize);
+
+  err = EOPNOTSUPP;
+  if (start + 2 * vm_page_size > limit
+      || find_block (node, start, &first, &lock) || first == 0)
+    goto out;
+
+  for (offset = start; offset < limit; offset += block_size)
+    {
+      if (find_block (node, offset, &block, &lock)
+	  || block != first + ((offset - start) >> log2_block_size))
+	break;
+      if ((offset + block_size - start) % vm_page_size == 0)
+	run = offset + block_size - start;
+    }
+
+  if (run < 2 * vm_page_size)
+    goto out;
+
+  ext2_debug ("reading inode %llu pages %lu[%lu]",
+	      node->cache_id, start, run);
+
+  STAT_INC (file_pageins);
+  STAT_INC (file_pagein_reads);
+
+  *buf = 0;
+  err = store_read (store,
+		    (store_offset_t) first << log2_dev_blocks_per_fs_block,
+		    run, buf, &read);
+  if (!err && read != run)
+    {
+      munmap (*buf, read);
+      err = EIO;
+    }
+
+  if (!err)
+    {
+      *length = run;
+      *writelock = 0;
+    }
+
+ out:
+  pthread_rwlock_unlock (lock);
+  return err;
+}
+
 struct pending_blocks
 {
   /* The block number of the first of the blocks.  */
@@ -312,16 +391,31 @@ pending_blocks_write (struct pending_blocks *pb)
 
       ext2_debug ("writing block %u[%ld]", pb->block, pb->num);
 
-      if (pb->offs > 0)
+      if (pb->offs % vm_page_size)
 	/* Put what we're going to write into a page-aligned buffer.  */
 	{
-	  void *page_buf = get_page_buf ();
+	  size_t buf_len = round_page (length);
+	  void *page_buf;
+
+	  if (buf_len == vm_page_size)
+	    page_buf = get_page_buf ();
+	  else
+	    {
+	      page_buf = mmap (0, buf_len, PROT_READ|PROT_WRITE,
+			       MAP_ANON, 0, 0);
+	      if (page_buf == MAP_FAILED)
+		page_buf = 0;
+	    }
+	  if (! page_buf)
+	    return ENOMEM;
+
 	  memcpy ((void *)page_buf, pb->buf + pb->offs, length);
 	  err = store_write (store, dev_block, page_buf, length, &amount);
-	  free_page_buf (page_buf);
+	  munmap (page_buf, buf_len);
 	}
       else
-	err = store_write (store, dev_block, pb->buf, length, &amount);
+	err = store_write (store, dev_block, pb->buf + pb->offs,
+			   length, &amount);
       if (err)
 	return err;
       else if (amount != length)
@@ -369,17 +463,54 @@ pending_blocks_add (struct pending_blocks *pb, block_t block)
   return 0;
 }
 
-/* Write one page for the pager backing NODE, at OFFSET, into BUF.  This
-   may need to write several filesystem blocks to satisfy one page, and tries
-   to consolidate the i/o if possible.  */
+/* Give the block of NODE at OFFSET, which has a free block set aside for
+   it by delayed allocation, a disk block, and return it in *BLOCK.  LEFT
+   bytes are being written from OFFSET on, so that the blocks after it
+   being written too can be allocated in one run with it.  NODE's
+   alloc_lock is held for writing.  */
 static error_t
-file_pager_write_page (struct node *node, vm_offset_t offset, void *buf)
+delalloc_block (struct node *node, vm_offset_t offset, vm_size_t left,
+		block_t *block)
+{
+  error_t err;
+  block_t index = offset >> log2_block_size;
+  block_t run = delalloc_reserved (node, index);
+  block_t blocks = (left + block_size - 1) >> log2_block_size;
+
+  assert (run > 0);
+  node->dn->alloc_want = run < blocks ? run : blocks;
+
+  err = diskfs_catch_exception ();
+  if (!err)
+    err = ext2_getblk (node, index, 1, block);
+  diskfs_end_catch_exception ();
+
+  node->dn->alloc_want = 0;
+
+  if (err)
+    ext2_warning ("inode=%Ld, block=%u: %s",
+		  node->cache_id, index, strerror (err));
+  else
+    {
+      delalloc_release (node, index, index + 1);
+      STAT_INC (file_delalloc_blocks);
+    }
+
+  return err;
+}
+
+/* Write LENGTH bytes of pages for the pager backing NODE, at OFFSET, from
+   BUF.  This may need to write several filesystem blocks, and tries to
+   consolidate the i/o if possible.  */
+static error_t
+file_pager_write_pages (struct node *node, vm_offset_t offset,
+			vm_size_t length, void *buf)
 {
   error_t err = 0;
   struct pending_blocks pb;
   pthread_rwlock_t *lock = &node->dn->alloc_lock;
   block_t block;
-  int left = vm_page_size;
+  vm_size_t left = length;
 
   pending_blocks_init (&pb, buf);
 
@@ -387,13 +518,20 @@ file_pager_write_page (struct node *node, vm_offset_t offset, void *buf)
      at least for the cases we care about: pager_unlock_page,
      diskfs_grow and diskfs_truncate.  */
   pthread_rwlock_rdlock (&node->dn->alloc_lock);
+  if (node->dn->delalloc_blocks)
+    /* Some of the blocks may have to be allocated now, which needs the
+       lock held for writing.  */
+    {
+      pthread_rwlock_unlock (&node->dn->alloc_lock);
+      pthread_rwlock_wrlock (&node->dn->alloc_lock);
+    }
 
   if (offset >= node->allocsize)
     left = 0;
   else if (offset + left > node->allocsize)
     left = node->allocsize - offset;
 
-  ext2_debug ("writing inode %d page %d[%d]", node->cache_id, offset, left);
+  ext2_debug ("writing inode %d pages %d[%d]", node->cache_id, offset, left);
 
   STAT_INC (file_pageouts);
 
@@ -402,10 +540,16 @@ file_pager_write_page (struct node *node, vm_offset_t offset, void *buf)
       err = find_block (node, offset, &block, &lock);
       if (err)
 	break;
+      if (! block)
+	{
+	  err = delalloc_block (node, offset, left, &block);
+	  if (err)
+	    break;
+	}
       assert (block);
       pending_blocks_add (&pb, block);
       offset += block_size;
-      left -= block_size;
+      left -= block_size < left ? block_size : left;
     }
 
   if (!err)
@@ -547,7 +691,80 @@ pager_read_page (struct user_pager_info *pager, vm_offset_t page,
   if (pager->type == DISK)
     return disk_pager_read_page (page, (void **)buf, writelock);
   else
-    return file_pager_read_page (pager->node, page, (void **)buf, writelock);
+    {
+      pager->ra_next = page + vm_page_size;
+      return file_pager_read_page (pager->node, page, (void **)buf,
+				   writelock);
+    }
+}
+
+/* Return how much the file pager UPI should read for a fault at START,
+   and update its read-ahead state accordingly.  A fault just past the end
+   of a previous read-ahead means the reader consumed all of it, so the
+   window grows; a fault just past a single page read, or at the start of
+   the file, starts a new sequential stream; anything else is taken to be
+   random access, and gets no read-ahead at all.  */
+static vm_size_t
+readahead_window (struct user_pager_info *upi, vm_offset_t start)
+{
+  vm_size_t initial = READAHEAD_INITIAL_PAGES * vm_page_size;
+  vm_size_t max = readahead_max_pages * vm_page_size;
+
+  if (start == upi->ra_next && upi->ra_window >= initial)
+    {
+      upi->ra_hits++;
+      STAT_INC (file_readahead_hits);
+      upi->ra_window *= 2;
+    }
+  else
+    {
+      upi->ra_misses++;
+      STAT_INC (file_readahead_misses);
+      if (start == 0 || start == upi->ra_next)
+	upi->ra_window = initial;
+      else
+	upi->ra_window = vm_page_size;
+    }
+
+  if (upi->ra_window > max)
+    upi->ra_window = max;
+  if (upi->ra_window < vm_page_size)
+    upi->ra_window = vm_page_size;
+
+  return upi->ra_window;
+}
+
+/* Satisfy a pager read request for the file pager PAGER, for the pages
+   starting at START, reading as far ahead as its read-ahead window
+   allows.  The disk pager's pages are not contiguous on disk, so it is
+   left to read them one by one.  */
+error_t
+pager_read_pages (struct user_pager_info *pager, vm_offset_t start,
+		  vm_size_t *length, vm_address_t *buf, int *writelock)
+{
+  error_t err;
+  vm_size_t window;
+
+  if (pager->type == DISK)
+    return EOPNOTSUPP;
+
+  window = readahead_window (pager, start);
+  if (*length > window)
+    *length = window;
+
+  err = EOPNOTSUPP;
+  if (*length > vm_page_size)
+    err = file_pager_read_pages (pager->node, start, length,
+				 (void **)buf, writelock);
+
+  if (! err)
+    pager->ra_next = start + *length;
+  else
+    /* Either a single page will be read by pager_read_page, or the read
+       failed; either way, don't count on any read-ahead.  */
+    pager->ra_next = start + vm_page_size;
+
+  return err;
 }
 
 /* Satisfy a pager write request for either the disk pager or file pager
@@ -559,7 +776,20 @@ pager_write_page (struct user_pager_info *pager, vm_offset_t page,
   if (pager->type == DISK)
     return disk_pager_write_page (page, (void *)buf);
   else
-    return file_pager_write_page (pager->node, page, (void *)buf);
+    return file_pager_write_pages (pager->node, page, vm_page_size,
+				   (void *)buf);
+}
+
+/* Satisfy a pager write request for the file pager PAGER, from the
+   LENGTH bytes of pages at START from BUF.  */
+error_t
+pager_write_pages (struct user_pager_info *pager, vm_offset_t start,
+		   vm_size_t length, vm_address_t buf)
+{
+  if (pager->type == DISK)
+    return EOPNOTSUPP;
+  else
+    return file_pager_write_pages (pager->node, start, length, (void *)buf);
 }
 
 void
@@ -570,9 +800,36 @@ pager_notify_evict (struct user_pager_info *pager, vm_offset_t page)
 }
 
 
+/* Make block BLOCK of NODE writable: allocate it, or with delayed
+   allocation, if it has no disk block, set aside a free block for it.
+   NODE's alloc_lock is held for writing.  */
+static error_t
+unlock_block (struct node *node, block_t block)
+{
+  error_t err;
+  block_t disk_block;
+
+  if (delalloc_reserved (node, block))
+    /* A free block is set aside for it already, perhaps before delayed
+       allocation was switched off; it gets its disk block when written
+       out.  */
+    return 0;
+
+  if (delayed_allocation && S_ISREG (node->dn_stat.st_mode))
+    {
+      err = ext2_getblk (node, block, 0, &disk_block);
+      if (err == EINVAL)
+	err = delalloc_reserve (node, block);
+      return err;
+    }
+
+  return ext2_getblk (node, block, 1, &disk_block);
+}
+
 /* Make page PAGE writable, at least up to ALLOCSIZE.  This function and
    diskfs_grow are the only places that blocks are actually added to the
-   file.  */
+   file, but for those whose allocation is delayed until they are written
+   out.  */
 error_t
 pager_unlock_page (struct user_pager_info *pager, vm_offset_t page)
 {
@@ -597,8 +854,7 @@ pager_unlock_page (struct user_pager_info *pager, vm_offset_t page)
 
 	  while (left > 0)
 	    {
-	      block_t disk_block;
-	      err = ext2_getblk (node, block++, 1, &disk_block);
+	      err = unlock_block (node, block++);
 	      if (err)
 		break;
 	      left -= block_size;
@@ -698,10 +954,7 @@ diskfs_grow (struct node *node, off_t size, struct protid *cred)
 
 	      err = diskfs_catch_exception ();
 	      while (!err && end_block < writable_end)
-		{
-		  block_t disk_block;
-		  err = ext2_getblk (node, end_block++, 1, &disk_block);
-		}
+		err = unlock_block (node, end_block++);
 	      diskfs_end_catch_exception ();
 
 	      if (! err)
@@ -1256,6 +1509,10 @@ diskfs_get_filemap (struct node *node, vm_prot_t prot)
 	  upi->type = FILE_DATA;
 	  upi->node = node;
 	  upi->max_prot = prot;
+	  upi->ra_next = 0;
+	  upi->ra_window = 0;
+	  upi->ra_hits = 0;
+	  upi->ra_misses = 0;
 	  diskfs_nref_light (node);
 	  node->dn->pager =
 	    pager_create (upi, file_pager_bucket, MAY_CACHE,
@@ -1267,6 +1524,8 @@ diskfs_get_filemap (struct node *node, vm_prot_t prot)
 	      pthread_spin_unlock (&node_to_page_lock);
 	      return MACH_PORT_NULL;
 	    }
+	  pager_set_cluster_size (node->dn->pager,
+				  readahead_max_pages * vm_page_size);
 
 	  right = pager_get_port (node->dn->pager);
 	  ports_port_deref (node->dn->pager);
@@ -1322,6 +1581,65 @@ allow_pager_softrefs (struct node *node)
     ports_port_deref (pager);
 }
 
+/* Set READAHEAD_MAX_PAGES to PAGES, and apply it to existing file
+   pagers.  */
+void
+set_readahead_max_pages (int pages)
+{
+  error_t set_cluster_size (void *v_p)
+    {
+      struct pager *p = v_p;
+      pager_set_cluster_size (p, readahead_max_pages * vm_page_size);
+      return 0;
+    }
+
+  readahead_max_pages = pages;
+
+  if (file_pager_bucket)
+    ports_bucket_iterate (file_pager_bucket, set_cluster_size);
+}
+
+/* Print to STREAM the statistics of the pagers: their totals, and the
+   read-ahead state of each file pager.  That is read without the
+   serialization libpager provides, so it may be a little stale.  */
+void
+print_pager_statistics (FILE *stream)
+{
+  error_t print_one (void *v_p)
+    {
+      struct pager *p = v_p;
+      struct user_pager_info *upi = pager_get_upi (p);
+
+      if (upi->type == FILE_DATA)
+	fprintf (stream, "file-pager inode=%Ld readahead-window=%zu"
+		 " readahead-hits=%lu readahead-misses=%lu\n",
+		 upi->node->cache_id, upi->ra_window,
+		 upi->ra_hits, upi->ra_misses);
+      return 0;
+    }
+#ifdef STATS
+  struct ext2fs_pager_stats stats;
+
+  pthread_spin_lock (&ext2s_pager_stats.lock);
+  stats = ext2s_pager_stats;
+  pthread_spin_unlock (&ext2s_pager_stats.lock);
+
+  fprintf (stream, "pagers disk-pageins=%lu disk-pageouts=%lu"
+	   " file-pageins=%lu file-pagein-reads=%lu file-pageouts=%lu"
+	   " file-page-unlocks=%lu file-grows=%lu file-delalloc-blocks=%lu"
+	   " readahead-hits=%lu readahead-misses=%lu\n",
+	   stats.disk_pageins, stats.disk_pageouts,
+	   stats.file_pageins, stats.file_pagein_reads, stats.file_pageouts,
+	   stats.file_page_unlocks, stats.file_grows,
+	   stats.file_delalloc_blocks,
+	   stats.file_readahead_hits, stats.file_readahead_misses);
+#endif /* STATS */
+
+  fprintf (stream, "readahead max-pages=%d\n", readahead_max_pages);
+  if (file_pager_bucket)
+    ports_bucket_iterate (file_pager_bucket, print_one);
+}
+
 /* Call this to find out the struct pager * corresponding to the
    FILE_DATA pager of inode IP.  This should be used *only* as a subsequent
    argument to register_memory_fault_area, and will be deleted when
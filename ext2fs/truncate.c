@@ -291,7 +291,11 @@ diskfs_truncate (struct node *node, off_t length)
   if (length >= node->dn_stat.st_size)
     return 0;
 
-  if (! node->dn_stat.st_blocks)
+  /* The entries of a directory go away here without
+     diskfs_dirremove_hard.  */
+  diskfs_dir_index_drop (node);
+
+  if (! node->dn_stat.st_blocks && ! node->dn->delalloc_blocks)
     /* There aren't really any blocks allocated, so just frob the size.  This
        is true for fast symlinks, and also apparently for some device nodes
        in linux.  */
@@ -351,6 +355,8 @@ diskfs_truncate (struct node *node, off_t length)
 
       free_block_run_finish (&fbr);
 
+      delalloc_release (node, end, (block_t) -1);
+
       node->allocsize = round_block (length);
 
       /* Set our last_page_partially_writable to a pessimistic state -- it
@@ -37,120 +37,36 @@
 #define UF_IMMUTABLE 0
 #endif
 
-#define INOHSZ  512
-#if     ((INOHSZ&(INOHSZ-1)) == 0)
-#define INOHASH(ino)    ((ino)&(INOHSZ-1))
-#else
-#define INOHASH(ino)    (((unsigned)(ino))%INOHSZ)
-#endif
-
-static struct node *nodehash[INOHSZ];
-static size_t nodehash_nr_items;
+/* Passed from diskfs_cached_lookup_in_dirbuf to read_node.  */
+struct lookup_context
+{
+  vm_address_t buf;
+};
 
 static error_t read_node (struct node *np, vm_address_t buf);
 
-/* Initialize the inode hash table.  */
-void
-inode_init ()
-{
-  int n;
-  for (n = 0; n < INOHSZ; n++)
-    nodehash[n] = 0;
-}
-
-/* Fetch inode INUM, set *NPP to the node structure; gain one user
-   reference and lock the node.  */
+/* Fetch inode INUM, set *NPP to the node structure;
+   gain one user reference and lock the node.
+   On the way, use BUF as the directory file map.  */
 error_t
-diskfs_cached_lookup (ino64_t inum, struct node **npp)
+diskfs_cached_lookup_in_dirbuf (int inum, struct node **npp, vm_address_t buf)
 {
-  error_t err;
-  struct node *np;
-  struct disknode *dn;
-
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-  for (np = nodehash[INOHASH(inum)]; np; np = np->dn->hnext)
-    if (np->cache_id == inum)
-      {
-        np->references++;
-        pthread_spin_unlock (&diskfs_node_refcnt_lock);
-        pthread_mutex_lock (&np->lock);
-        *npp = np;
-        return 0;
-      }
-
-  /* Format specific data for the new node.  */
-  dn = malloc (sizeof (struct disknode));
-  if (! dn)
-    {
-      pthread_spin_unlock (&diskfs_node_refcnt_lock);
-      return ENOMEM;
-    }
-  dn->pager = 0;
-  dn->first = 0;
-  dn->last = 0;
-  dn->length_of_chain = 0;
-  dn->chain_complete = 0;
-  dn->chain_extension_lock = PTHREAD_SPINLOCK_INITIALIZER;
-  pthread_rwlock_init (&dn->alloc_lock, NULL);
-  pthread_rwlock_init (&dn->dirent_lock, NULL);
-  
-  /* Create the new node.  */
-  np = diskfs_make_node (dn);
-  np->cache_id = inum;
-  np->dn->inode = vi_lookup(inum);
+  struct lookup_context ctx = { buf: buf };
 
-  pthread_mutex_lock (&np->lock);
-  
-  /* Put NP in NODEHASH.  */
-  dn->hnext = nodehash[INOHASH(inum)];
-  if (dn->hnext)
-    dn->hnext->dn->hprevp = &dn->hnext;
-  dn->hprevp = &nodehash[INOHASH(inum)];
-  nodehash[INOHASH(inum)] = np;
-  nodehash_nr_items += 1;
-
-  pthread_spin_unlock (&diskfs_node_refcnt_lock);
-  
-  /* Get the contents of NP off disk.  */
-  err = read_node (np, 0);
-
-  if (err)
-    return err;
-  else
-    {
-      *npp = np;
-      return 0;
-    }
+  return diskfs_cached_lookup_context (inum, npp, &ctx);
 }
 
-/* Fetch inode INUM, set *NPP to the node structure;
-   gain one user reference and lock the node.
-   On the way, use BUF as the directory file map.  */
+/* Create and return in *NPP a new node for the node cache, along with
+   its format specific data.  */
 error_t
-diskfs_cached_lookup_in_dirbuf (int inum, struct node **npp, vm_address_t buf)
+diskfs_user_make_node (struct node **npp, struct lookup_context *ctx)
 {
-  error_t err;
-  struct node *np;
   struct disknode *dn;
 
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-  for (np = nodehash[INOHASH(inum)]; np; np = np->dn->hnext)
-    if (np->cache_id == inum)
-      {
-        np->references++;
-        pthread_spin_unlock (&diskfs_node_refcnt_lock);
-        pthread_mutex_lock (&np->lock);
-        *npp = np;
-        return 0;
-      }
-
   /* Format specific data for the new node.  */
   dn = malloc (sizeof (struct disknode));
   if (! dn)
-    {
-      pthread_spin_unlock (&diskfs_node_refcnt_lock);
-      return ENOMEM;
-    }
+    return ENOMEM;
   dn->pager = 0;
   dn->first = 0;
   dn->last = 0;
@@ -159,68 +75,35 @@ diskfs_cached_lookup_in_dirbuf (int inum, struct node **npp, vm_address_t buf)
   dn->chain_extension_lock = PTHREAD_SPINLOCK_INITIALIZER;
   pthread_rwlock_init (&dn->alloc_lock, NULL);
   pthread_rwlock_init (&dn->dirent_lock, NULL);
-  
-  /* Create the new node.  */
-  np = diskfs_make_node (dn);
-  np->cache_id = inum;
-  np->dn->inode = vi_lookup(inum);
-
-  pthread_mutex_lock (&np->lock);
-  
-  /* Put NP in NODEHASH.  */
-  dn->hnext = nodehash[INOHASH(inum)];
-  if (dn->hnext)
-    dn->hnext->dn->hprevp = &dn->hnext;
-  dn->hprevp = &nodehash[INOHASH(inum)];
-  nodehash[INOHASH(inum)] = np;
-  nodehash_nr_items += 1;
-
-  pthread_spin_unlock (&diskfs_node_refcnt_lock);
-  
-  /* Get the contents of NP off disk.  */
-  err = read_node (np, buf);
 
-  if (err)
-    return err;
-  else
+  /* Create the new node.  */
+  *npp = diskfs_make_node (dn);
+  if (! *npp)
     {
-      *npp = np;
-      return 0;
+      free (dn);
+      return ENOMEM;
     }
+  return 0;
 }
 
-/* Lookup node INUM (which must have a reference already) and return
-   it without allocating any new references.  */
-struct node *
-ifind (ino_t inum)
+/* Fill in NP, which was just created by diskfs_user_make_node, from
+   its directory entry.  */
+error_t
+diskfs_user_read_node (struct node *np, struct lookup_context *ctx)
 {
-  struct node *np;
+  np->dn->inode = vi_lookup (np->cache_id);
 
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-  for (np = nodehash[INOHASH(inum)]; np; np = np->dn->hnext)
-    {
-      if (np->cache_id != inum)
-        continue;
-
-      assert (np->references);
-      pthread_spin_unlock (&diskfs_node_refcnt_lock);
-      return np;
-    }
-  assert (0);
+  /* Get the contents of NP off disk.  */
+  return read_node (np, ctx ? ctx->buf : 0);
 }
 
-/* The last reference to a node has gone away; drop it from the hash
-   table and clean all state in the dn structure.  */
+/* The last reference to a node has gone away, and it has been dropped
+   from the node cache; clean all state in the dn structure.  */
 void
-diskfs_node_norefs (struct node *np)
+diskfs_user_node_norefs (struct node *np)
 {
   struct cluster_chain *last = np->dn->first;
 
-  *np->dn->hprevp = np->dn->hnext;
-  if (np->dn->hnext)
-    np->dn->hnext->dn->hprevp = np->dn->hprevp;
-  nodehash_nr_items -= 1;
-
   while (last)
     {
       struct cluster_chain *next = last->next;
@@ -249,21 +132,15 @@ diskfs_node_norefs (struct node *np)
 /* The last hard reference to a node has gone away; arrange to have
    all the weak references dropped that can be.  */
 void
-diskfs_try_dropping_softrefs (struct node *np)
+diskfs_user_try_dropping_softrefs (struct node *np)
 {
   drop_pager_softrefs (np);
 }
 
-/* The last hard reference to a node has gone away.  */
-void
-diskfs_lost_hardrefs (struct node *np)
-{
-}
-
 /* A new hard reference to a node has been created; it's now OK to
    have unused weak references. */
 void
-diskfs_new_hardrefs (struct node *np)
+diskfs_user_new_hardrefs (struct node *np)
 {
   allow_pager_softrefs (np);
 }
@@ -317,7 +194,7 @@ read_node (struct node *np, vm_address_t buf)
 	  /* FIXME: We know intimately that the parent dir is locked
 	     by libdiskfs.  The only case it is not locked is for NFS
 	     (fsys_getfile) and we disabled that.  */
-	  dp = ifind (vk.dir_inode);
+	  dp = diskfs_cached_ifind (vk.dir_inode);
 	  assert (dp);
       
 	  /* Map in the directory contents. */
@@ -543,54 +420,6 @@ diskfs_node_reload (struct node *node)
   return 0;
 }
 
-/* For each active node, call FUN.  The node is to be locked around the call
-   to FUN.  If FUN returns non-zero for any node, then immediately stop, and
-   return that value.  */
-error_t
-diskfs_node_iterate (error_t (*fun)(struct node *))
-{
-  error_t err = 0;
-  int n;
-  size_t num_nodes;
-  struct node *node, **node_list, **p;
-
-  pthread_spin_lock (&diskfs_node_refcnt_lock);
-
-  /* We must copy everything from the hash table into another data structure
-     to avoid running into any problems with the hash-table being modified
-     during processing (normally we delegate access to hash-table with
-     diskfs_node_refcnt_lock, but we can't hold this while locking the
-     individual node locks).  */
-
-  num_nodes = nodehash_nr_items;
-
-  node_list = alloca (num_nodes * sizeof (struct node *));
-  p = node_list;
-  for (n = 0; n < INOHSZ; n++)
-    for (node = nodehash[n]; node; node = node->dn->hnext)
-      {
-        *p++ = node;
-        node->references++;
-      }
-
-  pthread_spin_unlock (&diskfs_node_refcnt_lock);
-
-  p = node_list;
-  while (num_nodes-- > 0)
-    {
-      node = *p++;
-      if (!err)
-        {
-          pthread_mutex_lock (&node->lock);
-          err = (*fun)(node);
-          pthread_mutex_unlock (&node->lock);
-        }
-      diskfs_nrele (node);
-    }
-
-  return err;
-}
-
 /* Write all active disknodes into the ext2_inode pager. */
 void
 write_all_disknodes ()
@@ -44,6 +44,9 @@ pthread_spinlock_t node_to_page_lock = PTHREAD_SPINLOCK_INITIALIZER;
 
 #define MAX_FREE_PAGE_BUFS 32
 
+/* The most a single page fault on a file pager may read.  */
+#define FILE_PAGER_CLUSTER_SIZE (32 * vm_page_size)
+
 static pthread_spinlock_t free_page_bufs_lock = PTHREAD_SPINLOCK_INITIALIZER;
 static void *free_page_bufs = 0;
 static int num_free_page_bufs = 0;
@@ -565,6 +568,71 @@ pager_read_page (struct user_pager_info *pager, vm_offset_t page,
     }
 }
 
+/* Satisfy a pager read request for the file pager PAGER, for the pages
+   starting at START, as far as the clusters holding them follow one
+   another on disk, up to *LENGTH bytes.  The pages of the FAT and of
+   the root dir of a FAT12/16 fs, and a run too short to be worth it,
+   are left to pager_read_page.  */
+error_t
+pager_read_pages (struct user_pager_info *pager, vm_offset_t start,
+		  vm_size_t *length, vm_address_t *buf, int *writelock)
+{
+  error_t err;
+  struct node *node = pager->node;
+  pthread_rwlock_t *lock = NULL;
+  cluster_t first, cluster;
+  vm_size_t len = *length, run;
+  size_t read = 0;
+
+  if (pager->type != FILE_DATA
+      || (node == diskfs_root_node
+	  && (fat_type == FAT12 || fat_type == FAT16)))
+    return EOPNOTSUPP;
+
+  *writelock = 0;
+
+  err = find_cluster (node, start, &first, &lock);
+  if (err)
+    {
+      pthread_rwlock_unlock (lock);
+      return EOPNOTSUPP;
+    }
+
+  /* Only whole pages within the allocated clusters are read here.  */
+  if (start + len > trunc_page (node->allocsize))
+    len = (trunc_page (node->allocsize) > start
+	   ? trunc_page (node->allocsize) - start : 0);
+
+  /* Find how far the clusters following FIRST on disk hold the file.  */
+  run = bytes_per_cluster - (start & (bytes_per_cluster - 1));
+  for (cluster = first + 1; run < len; cluster++, run += bytes_per_cluster)
+    {
+      cluster_t next;
+      if (find_cluster (node, start + run, &next, &lock) || next != cluster)
+	break;
+    }
+  len = trunc_page (run < len ? run : len);
+
+  if (len < 2 * vm_page_size)
+    err = EOPNOTSUPP;
+  else
+    {
+      err = store_read (store,
+			FAT_FIRST_CLUSTER_BLOCK(first)
+			+ ((start & (bytes_per_cluster - 1))
+			   >> store->log2_block_size),
+			len, (void **) buf, &read);
+      if (!err && read != len)
+	err = EIO;
+    }
+
+  pthread_rwlock_unlock (lock);
+
+  if (!err)
+    *length = len;
+  return err;
+}
+
 /* Satisfy a pager write request for either the disk pager or file pager
    PAGER, from the page at offset PAGE from BUF.  */
 error_t
@@ -826,6 +894,7 @@ diskfs_get_filemap (struct node *node, vm_prot_t prot)
               pthread_spin_unlock (&node_to_page_lock);
               return MACH_PORT_NULL;
             }
+          pager_set_cluster_size (node->dn->pager, FILE_PAGER_CLUSTER_SIZE);
 
           right = pager_get_port (node->dn->pager);
           ports_port_deref (node->dn->pager);
@@ -26,6 +26,9 @@ pthread_spinlock_t node2pagelock = PTHREAD_SPINLOCK_INITIALIZER;
 
 struct port_bucket *pager_bucket;
 
+/* The most a single page fault on a file pager may read.  */
+#define FILE_PAGER_CLUSTER_SIZE (32 * vm_page_size)
+
 /* Mapped image of the disk */
 void *disk_image;
 
@@ -80,6 +83,47 @@ pager_read_page (struct user_pager_info *upi,
   return 0;
 }
 
+/* Implement the pager_read_pages callback from the pager library.  File
+   data is contiguous on the medium, so the whole run of pages lying
+   within the file can be read at once; the page holding the end of the
+   file is left to pager_read_page.  */
+error_t
+pager_read_pages (struct user_pager_info *upi,
+		  vm_offset_t start,
+		  vm_size_t *length,
+		  vm_address_t *buf,
+		  int *writelock)
+{
+  error_t err;
+  struct node *np = upi->np;
+  vm_size_t len = *length;
+  size_t read = 0;
+
+  if (upi->type != FILE_DATA)
+    return EOPNOTSUPP;
+
+  if (start + len > trunc_page (np->dn_stat.st_size))
+    len = (trunc_page (np->dn_stat.st_size) > start
+	   ? trunc_page (np->dn_stat.st_size) - start : 0);
+  if (len < 2 * vm_page_size)
+    return EOPNOTSUPP;
+
+  /* This is a read-only medium */
+  *writelock = 1;
+
+  err = store_read (store,
+		    np->dn->file_start + (start >> store->log2_block_size),
+		    len, (void **) buf, &read);
+  if (err)
+    return err;
+
+  if (read != len)
+    return EIO;
+
+  *length = len;
+  return 0;
+}
+
 /* This function should never be called.  */
 error_t
 pager_write_page (struct user_pager_info *pager,
@@ -187,6 +231,7 @@ diskfs_get_filemap (struct node *np, vm_prot_t prot)
 	    pthread_spin_unlock (&node2pagelock);
 	    return MACH_PORT_NULL;
 	  }
+	pager_set_cluster_size (upi->p, FILE_PAGER_CLUSTER_SIZE);
 	np->dn->fileinfo = upi;
 	right = pager_get_port (np->dn->fileinfo->p);
 	ports_port_deref (np->dn->fileinfo->p);
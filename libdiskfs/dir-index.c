@@ -0,0 +1,429 @@
+/* In-core directory indexes
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA. */
+
+#include "priv.h"
+#include <string.h>
+
+/* An index is a hash table, probed linearly, of the hashes of the names
+   in a directory and the locations of their entries.  Names whose
+   hashes collide each have their own slot, so a lookup yields every
+   location which may hold the name, and the filesystem checks them.
+
+   The table grows by doubling once it is three quarters full, and is
+   charged for all the names it can hold before that.  The indexes are
+   kept on a list, least recently used first; when the charges of all
+   of them exceed DISKFS_DIR_INDEX_SIZE, the oldest are dropped.  Each
+   index is protected by the lock of its directory; the list, the
+   charges and the statistics by index_lock.  An index is only dropped
+   to make room for another if the lock of its directory can be taken
+   without waiting.  */
+
+/* Default number of names to keep in all the indexes.  */
+#define DEFAULT_DIR_INDEX_SIZE	262144
+
+/* The number of names all the indexes may hold together.  */
+int diskfs_dir_index_size __attribute__ ((weak)) = DEFAULT_DIR_INDEX_SIZE;
+
+/* The number of slots of a new table.  */
+#define MIN_SLOTS	64
+
+/* The location of an empty slot.  */
+#define NO_LOC		((unsigned) -1)
+
+struct dir_slot
+{
+  unsigned hash;
+  unsigned loc;
+};
+
+struct diskfs_dir_index
+{
+  struct node *dir;
+
+  /* The table, and its number of slots less one.  */
+  struct dir_slot *slots;
+  unsigned mask;
+  unsigned nnames;
+
+  /* The room for new entries at each location.  */
+  unsigned *room;
+  unsigned nlocs;
+  unsigned room_alloced;
+
+  /* The number of names this index is charged for.  */
+  unsigned long charge;
+
+  struct diskfs_dir_index *lru_next, **lru_prevp;
+};
+
+static pthread_spinlock_t index_lock = PTHREAD_SPINLOCK_INITIALIZER;
+
+static struct diskfs_dir_index *lru_first;
+static struct diskfs_dir_index **lru_lastp = &lru_first;
+static unsigned long nr_indexes, charged;
+
+static unsigned long index_builds, index_lookups, index_evictions;
+
+/* Return the hash of NAME, NAMELEN bytes long.  */
+static unsigned
+name_hash (const char *name, size_t namelen)
+{
+  unsigned hash = 2166136261U;
+
+  while (namelen-- > 0)
+    hash = (hash ^ (unsigned char) *name++) * 16777619U;
+
+  /* Bring the last characters, which often make the difference, into
+     the low bits the table is indexed with.  */
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+static void
+lru_remove (struct diskfs_dir_index *ix)
+{
+  *ix->lru_prevp = ix->lru_next;
+  if (ix->lru_next)
+    ix->lru_next->lru_prevp = ix->lru_prevp;
+  else
+    lru_lastp = ix->lru_prevp;
+}
+
+static void
+lru_append (struct diskfs_dir_index *ix)
+{
+  ix->lru_next = NULL;
+  ix->lru_prevp = lru_lastp;
+  *lru_lastp = ix;
+  lru_lastp = &ix->lru_next;
+}
+
+static void
+free_index (struct diskfs_dir_index *ix)
+{
+  free (ix->slots);
+  free (ix->room);
+  free (ix);
+}
+
+/* Drop the least recently used indexes other than KEEP until the
+   charges are within bounds, or nothing more can be dropped.
+   index_lock is held.  Return the indexes dropped, chained through
+   their lru_next, for the caller to free once it has released
+   index_lock.  */
+static struct diskfs_dir_index *
+trim (struct diskfs_dir_index *keep)
+{
+  struct diskfs_dir_index *ix, *next, *dropped = NULL;
+  struct node *dp;
+
+  for (ix = lru_first; ix && charged > diskfs_dir_index_size; ix = next)
+    {
+      next = ix->lru_next;
+      dp = ix->dir;
+      if (ix == keep || pthread_mutex_trylock (&dp->lock))
+	continue;
+
+      lru_remove (ix);
+      charged -= ix->charge;
+      nr_indexes--;
+      index_evictions++;
+      dp->dir_index = NULL;
+      pthread_mutex_unlock (&dp->lock);
+      ix->lru_next = dropped;
+      dropped = ix;
+    }
+
+  return dropped;
+}
+
+/* Charge IX for holding NAMES names, dropping other indexes to make
+   room.  Return ENOSPC if the indexes may never hold so many names, and
+   ENOBUFS if no other index could be dropped.  */
+static error_t
+charge (struct diskfs_dir_index *ix, unsigned long names)
+{
+  struct diskfs_dir_index *dropped, *next;
+  error_t err = 0;
+
+  if (diskfs_dir_index_size <= 0
+      || names > (unsigned long) diskfs_dir_index_size)
+    return ENOSPC;
+
+  pthread_spin_lock (&index_lock);
+  charged += names - ix->charge;
+  ix->charge = names;
+  dropped = trim (ix);
+  if (charged > diskfs_dir_index_size)
+    {
+      charged -= names;
+      ix->charge = 0;
+      err = ENOBUFS;
+    }
+  pthread_spin_unlock (&index_lock);
+
+  for (; dropped; dropped = next)
+    {
+      next = dropped->lru_next;
+      free_index (dropped);
+    }
+  return err;
+}
+
+/* Give IX a table of SIZE slots holding the names it has.  */
+static error_t
+resize (struct diskfs_dir_index *ix, unsigned size)
+{
+  struct dir_slot *slots;
+  unsigned i, j;
+  error_t err;
+
+  err = charge (ix, size / 4 * 3);
+  if (err)
+    return err;
+
+  slots = malloc (size * sizeof *slots);
+  if (! slots)
+    return ENOMEM;
+  memset (slots, 0xff, size * sizeof *slots);
+
+  if (ix->slots)
+    for (i = 0; i <= ix->mask; i++)
+      if (ix->slots[i].loc != NO_LOC)
+	{
+	  for (j = ix->slots[i].hash & (size - 1);
+	       slots[j].loc != NO_LOC;
+	       j = (j + 1) & (size - 1))
+	    ;
+	  slots[j] = ix->slots[i];
+	}
+
+  free (ix->slots);
+  ix->slots = slots;
+  ix->mask = size - 1;
+  return 0;
+}
+
+/* Give directory DP, which is locked, a new, empty index with NLOCS
+   locations, each without room, in place of any it has.  */
+error_t
+diskfs_dir_index_create (struct node *dp, unsigned nlocs)
+{
+  struct diskfs_dir_index *ix;
+  error_t err;
+
+  diskfs_dir_index_drop (dp);
+
+  ix = calloc (1, sizeof *ix);
+  if (! ix)
+    return ENOMEM;
+  ix->dir = dp;
+  ix->nlocs = ix->room_alloced = nlocs;
+  ix->room = calloc (nlocs ?: 1, sizeof *ix->room);
+  if (! ix->room)
+    {
+      free (ix);
+      return ENOMEM;
+    }
+
+  pthread_spin_lock (&index_lock);
+  lru_append (ix);
+  nr_indexes++;
+  index_builds++;
+  pthread_spin_unlock (&index_lock);
+  dp->dir_index = ix;
+
+  err = resize (ix, MIN_SLOTS);
+  if (err)
+    diskfs_dir_index_drop (dp);
+  return err;
+}
+
+/* Drop the index of directory DP, if it has one.  */
+void
+diskfs_dir_index_drop (struct node *dp)
+{
+  struct diskfs_dir_index *ix;
+
+  pthread_spin_lock (&index_lock);
+  ix = dp->dir_index;
+  if (ix)
+    {
+      lru_remove (ix);
+      charged -= ix->charge;
+      nr_indexes--;
+      dp->dir_index = NULL;
+    }
+  pthread_spin_unlock (&index_lock);
+
+  if (ix)
+    free_index (ix);
+}
+
+/* Note that directory DP has an entry for NAME at location LOC.  */
+error_t
+diskfs_dir_index_add (struct node *dp, const char *name, size_t namelen,
+		      unsigned loc)
+{
+  struct diskfs_dir_index *ix = dp->dir_index;
+  unsigned hash = name_hash (name, namelen);
+  unsigned i;
+  error_t err;
+
+  assert (ix);
+  if (ix->nnames + 1 > (ix->mask + 1) / 4 * 3)
+    {
+      err = resize (ix, (ix->mask + 1) * 2);
+      if (err)
+	{
+	  diskfs_dir_index_drop (dp);
+	  return err;
+	}
+    }
+
+  for (i = hash & ix->mask; ix->slots[i].loc != NO_LOC;
+       i = (i + 1) & ix->mask)
+    ;
+  ix->slots[i].hash = hash;
+  ix->slots[i].loc = loc;
+  ix->nnames++;
+  return 0;
+}
+
+/* Note that the entry for NAME at location LOC of directory DP has gone
+   away.  */
+void
+diskfs_dir_index_remove (struct node *dp, const char *name, size_t namelen,
+			 unsigned loc)
+{
+  struct diskfs_dir_index *ix = dp->dir_index;
+  unsigned hash = name_hash (name, namelen);
+  unsigned i, j;
+
+  assert (ix);
+  for (i = hash & ix->mask;
+       ix->slots[i].loc != loc || ix->slots[i].hash != hash;
+       i = (i + 1) & ix->mask)
+    if (ix->slots[i].loc == NO_LOC)
+      {
+	/* It was never there; don't trust the index any more.  */
+	diskfs_dir_index_drop (dp);
+	return;
+      }
+
+  /* Move back the slots after I which may be, so that no lookup of them
+     stops short at I.  */
+  for (j = (i + 1) & ix->mask; ix->slots[j].loc != NO_LOC;
+       j = (j + 1) & ix->mask)
+    if (((j - ix->slots[j].hash) & ix->mask) >= ((j - i) & ix->mask))
+      {
+	ix->slots[i] = ix->slots[j];
+	i = j;
+      }
+  ix->slots[i].loc = NO_LOC;
+  ix->nnames--;
+}
+
+/* Note that location LOC of directory DP has room for a new entry of
+   ROOM bytes.  */
+void
+diskfs_dir_index_set_room (struct node *dp, unsigned loc, size_t room)
+{
+  struct diskfs_dir_index *ix = dp->dir_index;
+
+  assert (ix);
+  if (loc >= ix->room_alloced)
+    {
+      unsigned n = loc + 1 > 2 * ix->room_alloced
+		   ? loc + 1 : 2 * ix->room_alloced;
+      unsigned *new = realloc (ix->room, n * sizeof *new);
+      if (! new)
+	{
+	  diskfs_dir_index_drop (dp);
+	  return;
+	}
+      ix->room = new;
+      ix->room_alloced = n;
+    }
+  while (ix->nlocs <= loc)
+    ix->room[ix->nlocs++] = 0;
+  ix->room[loc] = room;
+}
+
+/* Return the next location of directory DP which may hold an entry for
+   NAME, or -1 if there are no more.  */
+int
+diskfs_dir_index_lookup (struct node *dp, const char *name, size_t namelen,
+			 int *cursor)
+{
+  struct diskfs_dir_index *ix = dp->dir_index;
+  unsigned hash = name_hash (name, namelen);
+  unsigned i;
+
+  assert (ix);
+  if (*cursor == 0)
+    {
+      pthread_spin_lock (&index_lock);
+      lru_remove (ix);
+      lru_append (ix);
+      index_lookups++;
+      pthread_spin_unlock (&index_lock);
+    }
+
+  for (i = (hash + *cursor) & ix->mask; ix->slots[i].loc != NO_LOC;
+       i = (i + 1) & ix->mask)
+    {
+      ++*cursor;
+      if (ix->slots[i].hash == hash)
+	return ix->slots[i].loc;
+    }
+  return -1;
+}
+
+/* Return a location of directory DP with room for a new entry of ROOM
+   bytes, or -1 if there is none.  */
+int
+diskfs_dir_index_find_room (struct node *dp, size_t room)
+{
+  struct diskfs_dir_index *ix = dp->dir_index;
+  unsigned loc;
+
+  assert (ix);
+  for (loc = 0; loc < ix->nlocs; loc++)
+    if (ix->room[loc] >= room)
+      return loc;
+  return -1;
+}
+
+/* Fill STATS with the current statistics of the directory indexes.  */
+void
+diskfs_get_dir_index_stats (struct diskfs_dir_index_stats *stats)
+{
+  memset (stats, 0, sizeof *stats);
+
+  pthread_spin_lock (&index_lock);
+  stats->indexes = nr_indexes;
+  stats->names = charged;
+  stats->builds = index_builds;
+  stats->lookups = index_lookups;
+  stats->evictions = index_evictions;
+  pthread_spin_unlock (&index_lock);
+}
@@ -21,11 +21,13 @@
 #define _HURD_DISKFS
 
 #include <assert.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <hurd/ports.h>
 #include <hurd/fshelp.h>
 #include <hurd/iohelp.h>
+#include <hurd/ihash.h>
 #include <idvec.h>
 #include <features.h>
 #include <refcount.h>
@@ -120,6 +122,15 @@ struct node
   ino64_t cache_id;
 
   int author_tracks_uid;
+
+  /* Used by the node cache: the location of the node in it, the links
+     on the list of unused nodes, and whether the cache holds a light
+     reference.  */
+  hurd_ihash_locp_t slot;
+  struct node *lru_next, **lru_prevp;
+  int cache_ref;
+  /* The in-core index of a directory, if it has one.  */
+  struct diskfs_dir_index *dir_index;
 };
 
 struct diskfs_control
@@ -217,6 +228,12 @@ extern struct port_class *diskfs_shutdown_notification_class;
 
 extern struct port_bucket *diskfs_port_bucket;
 
+/* The lane of diskfs_port_bucket serving diskfs_control_class and
+   diskfs_shutdown_notification_class, so that fsys RPCs do not wait
+   behind the I/O RPCs on protids.  Its threads are started along with
+   the others by diskfs_spawn_first_thread.  */
+extern struct port_lane *diskfs_control_lane;
+
 
 
 /* Declarations of things the user must or may define.  */
@@ -297,6 +314,30 @@ int diskfs_shortcut_ifsock;
    thread is started up (in diskfs_spawn_first_threa).   */
 extern int diskfs_default_sync_interval;
 
+/* The user may define this variable, otherwise it has a default value
+   of 1024.  It is the number of entries in the directory lookup cache;
+   it may also be set with the --name-cache-size startup option, and
+   must be set before the first lookup.  */
+extern int diskfs_name_cache_size;
+
+/* The user may define this variable, otherwise it has a default value
+   of 1024.  It is the number of nodes without hard references the node
+   cache keeps in core; it may also be set with the --node-cache-size
+   startup option.  */
+extern int diskfs_node_cache_size;
+
+/* The user may define this variable, otherwise it has a default value
+   of 262144.  It is the number of names the in-core directory indexes
+   may hold together; it may also be set with the --dir-index-size
+   startup option.  If zero, no directory gets an index.  */
+extern int diskfs_dir_index_size;
+
+/* The user may define this variable, otherwise it has a default value
+   of 0.  If nonzero, it is the number of threads serving
+   diskfs_port_bucket at most; it may also be set with the
+   --max-threads option.  */
+extern int diskfs_max_threads;
+
 /* The user must define this variable, which should be a string that somehow
    identifies the particular disk this filesystem is interpreting.  It is
    generally only used to print messages or to distinguish instances of the
@@ -447,25 +488,28 @@ error_t diskfs_alloc_node (struct node *dp, mode_t mode, struct node **np);
    mode used to be MODE.  */
 void diskfs_free_node (struct node *np, mode_t mode);
 
-/* Node NP has no more references; free local state, including *NP
+/* The user must define this function unless it uses the node cache.
+   Node NP has no more references; free local state, including *NP
    if it isn't to be retained.  diskfs_node_refcnt_lock is held. */
 void diskfs_node_norefs (struct node *np);
 
-/* The user must define this function.  Node NP has some light
-   references, but has just lost its last hard references.  Take steps
+/* The user must define this function unless it uses the node cache.
+   Node NP has some light references, but has just lost its last hard
+   references.  Take steps
    so that if any light references can be freed, they are.  NP is locked
    as is the pager refcount lock.  This function will be called after
    diskfs_lost_hardrefs.  */
 void diskfs_try_dropping_softrefs (struct node *np);
 
-/* The user must define this funcction.  Node NP has some light
-   references but has just lost its last hard reference.  NP is locked. */
+/* The user must define this function unless it uses the node cache.
+   Node NP has some light references but has just lost its last hard
+   reference.  NP is locked. */
 void diskfs_lost_hardrefs (struct node *np);
 
-/* The user must define this function.  Node NP has just acquired
-   a hard reference where it had none previously.  It is thus now
-   OK again to have light references without real users.  NP is
-   locked. */
+/* The user must define this function unless it uses the node cache.
+   Node NP has just acquired a hard reference where it had none
+   previously.  It is thus now OK again to have light references
+   without real users.  NP is locked. */
 void diskfs_new_hardrefs (struct node *np);
 
 /* The user must define this function.  Return non-zero if locked
@@ -514,10 +558,10 @@ void diskfs_write_disknode (struct node *np, int wait);
    then return only after the physical media has been completely updated.  */
 void diskfs_file_update (struct node *np, int wait);
 
-/* The user must define this function.  For each active node, call
-   FUN.  The node is to be locked around the call to FUN.  If FUN
-   returns non-zero for any node, then immediately stop, and return
-   that value. */
+/* The user must define this function unless it uses the node cache.
+   For each active node, call FUN.  The node is to be locked around the
+   call to FUN.  If FUN returns non-zero for any node, then immediately
+   stop, and return that value. */
 error_t diskfs_node_iterate (error_t (*fun)(struct node *));
 
 /* The user must define this function.  Sync all the pagers and any
@@ -804,9 +848,142 @@ error_t diskfs_dirrewrite (struct node *dp, struct node *oldnp,
 error_t diskfs_dirremove (struct node *dp, struct node *np,
 			  const char *name, struct dirstat *ds);
 
-/* Return the node corresponding to CACHE_ID in *NPP. */
+/* The user must define this function unless it uses the node cache.
+   Return the node corresponding to CACHE_ID in *NPP. */
 error_t diskfs_cached_lookup (ino64_t cache_id, struct node **npp);
 
+/* Node cache.
+
+   libdiskfs provides diskfs_cached_lookup, diskfs_node_norefs,
+   diskfs_try_dropping_softrefs, diskfs_lost_hardrefs,
+   diskfs_new_hardrefs and diskfs_node_iterate for filesystems which do
+   not define them.  These keep the in-core nodes in a hash table
+   indexed by cache id, and keep up to diskfs_node_cache_size nodes
+   without hard references in core.  A filesystem using them must
+   define the diskfs_user_* functions below.  */
+
+/* Format specific information passed from diskfs_cached_lookup_context
+   to diskfs_user_make_node and diskfs_user_read_node.  The user may
+   define this structure.  */
+struct lookup_context;
+
+/* Like diskfs_cached_lookup, but pass CTX on to diskfs_user_make_node
+   and diskfs_user_read_node if the node is not in core yet.  */
+error_t diskfs_cached_lookup_context (ino64_t cache_id, struct node **npp,
+				      struct lookup_context *ctx);
+
+/* Return the node with cache id CACHE_ID, which must have a reference
+   already, without allocating any new references.  */
+struct node *diskfs_cached_ifind (ino64_t cache_id);
+
+/* The user must define this function if it uses the node cache.
+   Create a new node and its format specific data, and return it in
+   *NPP.  The node will be entered in the cache under the cache id
+   being looked up.  diskfs_node_refcnt_lock is held, so this must
+   not block.  */
+error_t diskfs_user_make_node (struct node **npp, struct lookup_context *ctx);
+
+/* The user must define this function if it uses the node cache.
+   Fill in NP, which was just created by diskfs_user_make_node, from
+   the disk.  NP is locked.  */
+error_t diskfs_user_read_node (struct node *np, struct lookup_context *ctx);
+
+/* The user must define this function if it uses the node cache.
+   Node NP has no more references and has been removed from the cache;
+   free local state, including *NP.  diskfs_node_refcnt_lock is
+   held.  */
+void diskfs_user_node_norefs (struct node *np);
+
+/* The user may define this function if it uses the node cache.  Node NP
+   has no more hard references and no links; drop the light references
+   the user holds on it if possible.  NP is locked.  */
+void diskfs_user_try_dropping_softrefs (struct node *np);
+
+/* The user may define this function if it uses the node cache.  Node NP
+   has just acquired a hard reference where it had none previously.  NP
+   is locked.  */
+void diskfs_user_new_hardrefs (struct node *np);
+
+/* Statistics about the node cache.  */
+struct diskfs_node_cache_stats
+{
+  unsigned long nodes;		/* Nodes in core.  */
+  unsigned long unused;		/* Nodes kept without hard references.  */
+  unsigned long hits;		/* Lookups of nodes already in core.  */
+  unsigned long misses;		/* Lookups which read a node in.  */
+  unsigned long evictions;	/* Unused nodes given up to make room.  */
+};
+
+/* Fill STATS with the current statistics of the node cache.  */
+void diskfs_get_node_cache_stats (struct diskfs_node_cache_stats *stats);
+
+/* In-core directory indexes.
+
+   A filesystem which finds names by scanning its directories may keep
+   an in-core index of a large directory, which tells for each name
+   the locations, such as the numbers of the blocks, whose entries may
+   be for it, and for each location how much room it has for a new
+   entry.  The index of a directory is kept in DP->dir_index, and is
+   protected by the lock of the directory; the filesystem must keep
+   it up to date as entries come and go, and drop it with
+   diskfs_dir_index_drop before the node is freed.  All the indexes
+   together hold up to diskfs_dir_index_size names; beyond that, those
+   of the least recently used directories are dropped.  */
+
+struct diskfs_dir_index;
+
+/* Give directory DP, which is locked, a new, empty index with NLOCS
+   locations, each without room, in place of any it has.  Return
+   ENOSPC if no index can hold the names DP has, and ENOBUFS or ENOMEM
+   if there is no room for one now.  */
+error_t diskfs_dir_index_create (struct node *dp, unsigned nlocs);
+
+/* Drop the index of directory DP, if it has one.  DP is locked, or
+   about to be freed.  */
+void diskfs_dir_index_drop (struct node *dp);
+
+/* Note that directory DP, which is locked and has an index, has an
+   entry for NAME, NAMELEN bytes long, at location LOC.  If the index
+   can't hold it, it is dropped, and ENOSPC, ENOBUFS or ENOMEM is
+   returned as for diskfs_dir_index_create.  */
+error_t diskfs_dir_index_add (struct node *dp, const char *name,
+			      size_t namelen, unsigned loc);
+
+/* Note that the entry for NAME, NAMELEN bytes long, at location LOC of
+   directory DP, which is locked and has an index, has gone away.  */
+void diskfs_dir_index_remove (struct node *dp, const char *name,
+			      size_t namelen, unsigned loc);
+
+/* Note that location LOC of directory DP, which is locked and has an
+   index, has room for a new entry of ROOM bytes.  LOC may be past the
+   locations the index has so far.  */
+void diskfs_dir_index_set_room (struct node *dp, unsigned loc,
+				size_t room);
+
+/* Return the next location of directory DP, which is locked and has an
+   index, which may hold an entry for NAME, NAMELEN bytes long, or -1 if
+   there are no more.  *CURSOR must be zero before the first call, and
+   keeps the place between calls.  */
+int diskfs_dir_index_lookup (struct node *dp, const char *name,
+			     size_t namelen, int *cursor);
+
+/* Return a location of directory DP, which is locked and has an index,
+   with room for a new entry of ROOM bytes, or -1 if there is none.  */
+int diskfs_dir_index_find_room (struct node *dp, size_t room);
+
+/* Statistics about the in-core directory indexes.  */
+struct diskfs_dir_index_stats
+{
+  unsigned long indexes;	/* Directories with an index.  */
+  unsigned long names;		/* Names the indexes have room for.  */
+  unsigned long builds;		/* Indexes made.  */
+  unsigned long lookups;	/* Lookups through an index.  */
+  unsigned long evictions;	/* Indexes dropped to make room.  */
+};
+
+/* Fill STATS with the current statistics of the directory indexes.  */
+void diskfs_get_dir_index_stats (struct diskfs_dir_index_stats *stats);
+
 /* Create a new node. Give it MODE; if that includes IFDIR, also
    initialize `.' and `..' in the new directory.  Return the node in NPP.
    CRED identifies the user responsible for the call.  If NAME is nonzero,
@@ -955,6 +1132,20 @@ void diskfs_purge_lookup_cache (struct node *dp, struct node *np);
    a newly allocated reference. */
 struct node *diskfs_check_lookup_cache (struct node *dir, const char *name);
 
+/* Statistics about the lookup cache.  */
+struct diskfs_lookup_cache_stats
+{
+  unsigned long size;		/* Number of slots.  */
+  unsigned long entries;	/* Number of slots in use.  */
+  unsigned long hits;		/* Lookups answered with a node.  */
+  unsigned long negative_hits;	/* Lookups answered with `no such name'.  */
+  unsigned long misses;		/* Lookups the cache didn't know about.  */
+  unsigned long evictions;	/* Entries replaced to make room.  */
+};
+
+/* Fill STATS with the current statistics of the lookup cache.  */
+void diskfs_get_lookup_cache_stats (struct diskfs_lookup_cache_stats *stats);
+
 /* Rename directory node FNP (whose parent is FDP, and which has name
    FROMNAME in that directory) to have name TONAME inside directory
    TDP.  None of these nodes are locked, and none should be locked
@@ -1035,6 +1226,11 @@ error_t diskfs_set_options (const char *argz, size_t argz_len);
    routine simply calls diskfs_append_std_options.  */
 error_t diskfs_append_args (char **argz, size_t *argz_len);
 
+/* Print to STREAM the statistics this translator keeps, one line for each
+   kind, for fsys_get_statistics.  The default definition of this routine
+   simply calls diskfs_print_std_statistics.  */
+error_t diskfs_print_statistics (FILE *stream);
+
 /* If this is defined or set to an argp structure, it will be used by the
    default diskfs_set_options to handle runtime option parsing.  The default
    definition is initialized to a pointer to DISKFS_STD_RUNTIME_ARGP.  */
@@ -1062,6 +1258,9 @@ extern const struct argp diskfs_store_startup_argp;
    must already have a sane value).  */
 error_t diskfs_append_std_options (char **argz, size_t *argz_len);
 
+/* Print to STREAM the statistics kept by libdiskfs.  */
+error_t diskfs_print_std_statistics (FILE *stream);
+
 /* Demultiplex incoming messages on ports created by libdiskfs.  */
 int diskfs_demuxer (mach_msg_header_t *, mach_msg_header_t *);
 
@@ -0,0 +1,57 @@
+/* Get the statistics of a diskfs translator
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "priv.h"
+#include "fsys_S.h"
+
+/* Implement fsys_get_statistics as described in <hurd/fsys.defs>. */
+error_t
+diskfs_S_fsys_get_statistics (struct diskfs_control *port,
+			      mach_port_t reply,
+			      mach_msg_type_name_t replytype,
+			      char **data, mach_msg_type_number_t *data_len)
+{
+  char *text = 0;
+  size_t text_len = 0;
+  FILE *stream;
+  error_t err;
+
+  if (!port
+      || port->pi.class != diskfs_control_class)
+    return EOPNOTSUPP;
+
+  stream = open_memstream (&text, &text_len);
+  if (! stream)
+    return errno;
+
+  err = diskfs_print_statistics (stream);
+  if (fclose (stream) && ! err)
+    err = errno;
+
+  if (! err)
+    /* Move TEXT from a malloced buffer into a vm_alloced one.  */
+    err = iohelp_return_malloced_buffer (text, text_len, data, data_len);
+  else
+    free (text);
+
+  return err;
+}
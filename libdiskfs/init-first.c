@@ -48,6 +48,15 @@ master_thread_function (void *demuxer)
   return NULL;
 }
 
+static void *
+control_thread_function (void *demuxer)
+{
+  ports_manage_lane_operations_multithread (diskfs_control_lane,
+					    (ports_demuxer_type) demuxer,
+					    thread_timeout, 0, 0);
+  return NULL;
+}
+
 void
 diskfs_spawn_first_thread (ports_demuxer_type demuxer)
 {
@@ -62,4 +71,13 @@ diskfs_spawn_first_thread (ports_demuxer_type demuxer)
       errno = err;
       perror ("pthread_create");
     }
+
+  err = pthread_create (&thread, NULL, control_thread_function, demuxer);
+  if (!err)
+    pthread_detach (thread);
+  else
+    {
+      errno = err;
+      perror ("pthread_create");
+    }
 }
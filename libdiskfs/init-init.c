@@ -53,6 +53,9 @@ struct port_class *diskfs_execboot_class;
 struct port_class *diskfs_shutdown_notification_class;
 
 struct port_bucket *diskfs_port_bucket;
+struct port_lane *diskfs_control_lane;
+
+int diskfs_max_threads __attribute__ ((weak)) = 0;
 
 /* Call this after arguments have been parsed to initialize the
    library.  */
@@ -99,6 +102,14 @@ diskfs_init_diskfs (void)
   diskfs_shutdown_notification_class = ports_create_class (0, 0);
 
   diskfs_port_bucket = ports_create_bucket ();
+  ports_set_max_threads (diskfs_port_bucket, diskfs_max_threads);
+
+  diskfs_control_lane = ports_create_lane (diskfs_port_bucket, -1);
+  if (! diskfs_control_lane)
+    return errno;
+  ports_lane_add_class (diskfs_control_lane, diskfs_control_class);
+  ports_lane_add_class (diskfs_control_lane,
+			diskfs_shutdown_notification_class);
 
   _hurd_port_init (&_diskfs_exec_portcell, MACH_PORT_NULL);
 
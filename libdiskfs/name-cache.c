@@ -22,6 +22,11 @@
 #include "priv.h"
 #include <assert.h>
 #include <string.h>
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* The name cache is implemented using a hash table.
 
@@ -29,44 +34,111 @@
    least-frequently used cache algorithm by counting the number of
    lookups using saturating arithmetic in the two lowest bits of the
    pointer to the name.  Using this strategy we achieve a constant
-   worst-case lookup and insertion time.  */
-
-/* Number of buckets.  Must be a power of two. */
-#define CACHE_SIZE	256
-
-/* Entries per bucket.  */
+   worst-case lookup and insertion time.
+
+   Each bucket has its own lock, so that lookups hashing to different
+   buckets never contend with each other.  The lock is a spin lock,
+   as it is only ever held for the few string comparisons a probe of
+   a single bucket takes.
+
+   A probe compares the keys of all entries of a bucket at once using
+   vector instructions if the target has them, and only looks at the
+   entries whose key matches.  Buckets are wider on such targets, as
+   that comes at almost no cost and improves the hit rate.  */
+
+/* Entries per bucket.  Must be a power of two.  */
+#ifndef BUCKET_SIZE
+#if defined (__AVX2__)
+#define BUCKET_SIZE	16
+#elif defined (__SSE2__)
+#define BUCKET_SIZE	8
+#else
 #define BUCKET_SIZE	4
-
-/* A mask for fast binary modulo.  */
-#define CACHE_MASK	(CACHE_SIZE - 1)
+#endif
+#endif
+
+/* How a probe compares the keys of a bucket.  Defining SCALAR_PROBE
+   makes it compare them one at a time even if the target has vector
+   instructions, so that benchmarks/name-cache.c can measure what they
+   gain.  */
+#if defined (SCALAR_PROBE)
+#elif defined (__AVX2__) && BUCKET_SIZE % 8 == 0
+#define PROBE_AVX2
+#elif defined (__SSE2__) && BUCKET_SIZE % 4 == 0
+#define PROBE_SSE2
+#endif
+
+/* Default number of entries.  */
+#define DEFAULT_CACHE_SIZE	1024
 
 /* Cache bucket with BUCKET_SIZE entries.
 
-   The layout of the bucket is chosen so that it will be straight
-   forward to use vector operations in the future.  */
+   The fields are laid out as arrays, so that the keys of a bucket can
+   be loaded into vector registers directly.  */
 struct cache_bucket
 {
+  /* The key.  */
+  uint32_t key[BUCKET_SIZE];
+
   /* Name of the node NODE_CACHE_ID in the directory DIR_CACHE_ID.  If
      NULL, the entry is unused.  */
   unsigned long name[BUCKET_SIZE];
 
-  /* The key.  */
-  unsigned long key[BUCKET_SIZE];
-
   /* Used to indentify nodes to the fs dependent code.  */
   ino64_t dir_cache_id[BUCKET_SIZE];
 
   /* 0 for NODE_CACHE_ID means a `negative' entry -- recording that
      there's definitely no node with this name.  */
   ino64_t node_cache_id[BUCKET_SIZE];
+
+  /* Protects the above, the replacement index and the statistics.  */
+  pthread_spinlock_t lock;
+
+  /* The slot to replace next when no entry is a better candidate.  */
+  int replace;
+
+  /* Statistics, summed up by diskfs_get_lookup_cache_stats.  */
+  unsigned long hits, negative_hits, misses, evictions;
 };
 
-/* The cache.  */
-static struct cache_bucket name_cache[CACHE_SIZE];
+/* The number of entries in the cache.  */
+int diskfs_name_cache_size __attribute__ ((weak)) = DEFAULT_CACHE_SIZE;
+
+/* The cache, and the number of buckets in it.  */
+static struct cache_bucket *name_cache;
+static size_t cache_buckets;
+
+/* A mask for fast binary modulo.  */
+static unsigned long cache_mask;
+
+static pthread_once_t cache_init_once = PTHREAD_ONCE_INIT;
+
+/* Allocate the cache according to DISKFS_NAME_CACHE_SIZE.  */
+static void
+cache_init (void)
+{
+  size_t i;
+
+  /* The number of buckets must be a power of two.  */
+  for (cache_buckets = 1;
+       cache_buckets * BUCKET_SIZE < (size_t) diskfs_name_cache_size;
+       cache_buckets <<= 1)
+    ;
+
+  name_cache = calloc (cache_buckets, sizeof *name_cache);
+  if (name_cache == NULL)
+    {
+      /* Make do with a single bucket rather than failing lookups.  */
+      static struct cache_bucket fallback;
+      name_cache = &fallback;
+      cache_buckets = 1;
+    }
+  cache_mask = cache_buckets - 1;
+
+  for (i = 0; i < cache_buckets; i++)
+    pthread_spin_init (&name_cache[i].lock, PTHREAD_PROCESS_PRIVATE);
+}
 
-/* Protected by this lock.  */
-static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
-
 /* Given VALUE, return the char pointer.  */
 static inline char *
 charp (unsigned long value)
@@ -81,33 +153,33 @@ frequ (unsigned long value)
   return value & 3;
 }
 
-/* Add an entry in the Ith slot of the given bucket.  If there is a
-   value there, remove it first.  */
-static inline void
+/* Add an entry in the Ith slot of the given bucket, with NAME, a
+   malloced copy of the name.  Return the name of the entry that was
+   there, if any, for the caller to free once the bucket is unlocked.  */
+static inline char *
 add_entry (struct cache_bucket *b, int i,
-	   const char *name, unsigned long key,
+	   char *name, uint32_t key,
 	   ino64_t dir_cache_id, ino64_t node_cache_id)
 {
-  if (b->name[i])
-    free (charp (b->name[i]));
+  char *old = charp (b->name[i]);
 
-  b->name[i] = (unsigned long) strdup (name);
+  b->name[i] = (unsigned long) name;
   assert ((b->name[i] & 3) == 0);
-  if (b->name[i] == 0)
-    return;
 
   b->key[i] = key;
   b->dir_cache_id[i] = dir_cache_id;
   b->node_cache_id[i] = node_cache_id;
+  return old;
 }
 
-/* Remove the entry in the Ith slot of the given bucket.  */
-static inline void
+/* Remove the entry in the Ith slot of the given bucket.  Return its
+   name, for the caller to free once the bucket is unlocked.  */
+static inline char *
 remove_entry (struct cache_bucket *b, int i)
 {
-  if (b->name[i])
-    free (charp (b->name[i]));
+  char *old = charp (b->name[i]);
   b->name[i] = 0;
+  return old;
 }
 
 /* Check if the entry in the Ith slot of the given bucket is
@@ -202,40 +274,85 @@ void MurmurHash3_x86_32 ( const void * key, int len,
   *(uint32_t*)out = h1;
 }
 
-/* If there is no best candidate to replace, pick any.  We approximate
-   any by picking the slot depicted by REPLACE, and increment REPLACE
-   then.  */
-static int replace;
+/* Return a mask with the Ith bit set if the key of the Ith entry in
+   bucket B is KEY.  */
+static inline unsigned int
+match_keys (const struct cache_bucket *b, uint32_t key)
+{
+  unsigned int mask = 0;
+  int i;
+
+#if defined (PROBE_AVX2)
+  __m256i k = _mm256_set1_epi32 (key);
+
+  for (i = 0; i < BUCKET_SIZE; i += 8)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) &b->key[i]);
+      mask |= (unsigned int)
+	_mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpeq_epi32 (v, k)))
+	<< i;
+    }
+#elif defined (PROBE_SSE2)
+  __m128i k = _mm_set1_epi32 (key);
+
+  for (i = 0; i < BUCKET_SIZE; i += 4)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) &b->key[i]);
+      mask |= (unsigned int)
+	_mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (v, k))) << i;
+    }
+#else
+  for (i = 0; i < BUCKET_SIZE; i++)
+    if (b->key[i] == key)
+      mask |= 1U << i;
+#endif
+
+  return mask;
+}
 
 /* Lookup (DIR_CACHE_ID, NAME, KEY) in the cache.  If it is found,
    return 1 and set BUCKET and INDEX to the item.  Otherwise, return 0
    and set BUCKET and INDEX to the slot where the item should be
-   inserted.  */
+   inserted.  BUCKET is returned locked.  */
 static inline int
-lookup (ino64_t dir_cache_id, const char *name, unsigned long key,
+lookup (ino64_t dir_cache_id, const char *name, uint32_t key,
 	struct cache_bucket **bucket, int *index)
 {
-  struct cache_bucket *b = *bucket = &name_cache[key & CACHE_MASK];
+  struct cache_bucket *b = *bucket = &name_cache[key & cache_mask];
   unsigned long best = 3;
+  unsigned int mask;
   int i;
 
-  for (i = 0; i < BUCKET_SIZE; i++)
+  pthread_spin_lock (&b->lock);
+
+  for (mask = match_keys (b, key); mask; mask &= mask - 1)
     {
-      unsigned long f = frequ (b->name[i]);
+      i = __builtin_ctz (mask);
 
       if (valid_entry (b, i)
-	  && b->key[i] == key
 	  && b->dir_cache_id[i] == dir_cache_id
 	  && strcmp (charp (b->name[i]), name) == 0)
 	{
-	  if (f < 3)
+	  if (frequ (b->name[i]) < 3)
 	    b->name[i] += 1;
 
 	  *index = i;
 	  return 1;
 	}
+    }
+
+  /* Find the replacement candidate.  An unused slot is always the
+     best one.  */
+  for (i = 0; i < BUCKET_SIZE; i++)
+    {
+      unsigned long f = frequ (b->name[i]);
+
+      if (! valid_entry (b, i))
+	{
+	  *index = i;
+	  return 0;
+	}
 
-      /* Keep track of the replacement candidate.  */
       if (f < best)
 	{
 	  best = f;
@@ -244,67 +361,93 @@ lookup (ino64_t dir_cache_id, const char *name, unsigned long key,
     }
 
   /* If there was no entry with a lower use frequency, just replace
-     any entry.  */
+     any entry.  We approximate any by picking the slot depicted by
+     the bucket's REPLACE, and increment that then.  */
   if (best == 3)
     {
-      *index = replace;
-      replace = (replace + 1) & (BUCKET_SIZE - 1);
+      *index = b->replace;
+      b->replace = (b->replace + 1) & (BUCKET_SIZE - 1);
     }
 
   return 0;
 }
 
 /* Hash the directory cache_id and the name.  */
-static inline unsigned long
+static inline uint32_t
 hash (ino64_t dir_cache_id, const char *name)
 {
-  unsigned long h;
+  uint32_t h;
   MurmurHash3_x86_32 (&dir_cache_id, sizeof dir_cache_id, 0, &h);
   MurmurHash3_x86_32 (name, strlen (name), h, &h);
   return h;
 }
 
+
+
 /* Node NP has just been found in DIR with NAME.  If NP is null, that
    means that this name has been confirmed as absent in the directory. */
 void
 diskfs_enter_lookup_cache (struct node *dir, struct node *np, const char *name)
 {
-  unsigned long key = hash (dir->cache_id, name);
+  uint32_t key = hash (dir->cache_id, name);
   ino64_t value = np ? np->cache_id : 0;
   struct cache_bucket *bucket;
   int i = 0, found;
+  char *copy, *old;
+
+  pthread_once (&cache_init_once, cache_init);
+
+  /* Copy the name before taking the bucket's spin lock, and free what
+     is left over only after releasing it.  */
+  copy = strdup (name);
+  if (! copy)
+    return;
 
-  pthread_mutex_lock (&cache_lock);
   found = lookup (dir->cache_id, name, key, &bucket, &i);
   if (! found)
-    add_entry (bucket, i, name, key, dir->cache_id, value);
+    {
+      if (valid_entry (bucket, i))
+	bucket->evictions++;
+      old = add_entry (bucket, i, copy, key, dir->cache_id, value);
+    }
   else
-    if (bucket->node_cache_id[i] != value)
-      bucket->node_cache_id[i] = value;
+    {
+      if (bucket->node_cache_id[i] != value)
+	bucket->node_cache_id[i] = value;
+      old = copy;
+    }
 
-  pthread_mutex_unlock (&cache_lock);
+  pthread_spin_unlock (&bucket->lock);
+  free (old);
 }
-
+
 /* Purge all references in the cache to NP as a node inside
    directory DP. */
 void
 diskfs_purge_lookup_cache (struct node *dp, struct node *np)
 {
-  int i;
+  int i, n;
   struct cache_bucket *b;
+  char *names[BUCKET_SIZE];
 
-  pthread_mutex_lock (&cache_lock);
-
-  for (b = &name_cache[0]; b < &name_cache[CACHE_SIZE]; b++)
-    for (i = 0; i < BUCKET_SIZE; i++)
-      if (valid_entry (b, i)
-	  && b->dir_cache_id[i] == dp->cache_id
-	  && b->node_cache_id[i] == np->cache_id)
-	remove_entry (b, i);
+  pthread_once (&cache_init_once, cache_init);
 
-  pthread_mutex_unlock (&cache_lock);
+  for (b = &name_cache[0]; b < &name_cache[cache_buckets]; b++)
+    {
+      n = 0;
+      pthread_spin_lock (&b->lock);
+      for (i = 0; i < BUCKET_SIZE; i++)
+	if (valid_entry (b, i)
+	    && b->dir_cache_id[i] == dp->cache_id
+	    && b->node_cache_id[i] == np->cache_id)
+	  names[n++] = remove_entry (b, i);
+      pthread_spin_unlock (&b->lock);
+
+      while (n > 0)
+	free (names[--n]);
+    }
 }
-
+
 /* Scan the cache looking for NAME inside DIR.  If we don't know
    anything entry at all, then return 0.  If the entry is confirmed to
    not exist, then return -1.  Otherwise, return NP for the entry, with
@@ -312,7 +455,7 @@ diskfs_purge_lookup_cache (struct node *dp, struct node *np)
 struct node *
 diskfs_check_lookup_cache (struct node *dir, const char *name)
 {
-  unsigned long key = hash (dir->cache_id, name);
+  uint32_t key = hash (dir->cache_id, name);
   int lookup_parent = name[0] == '.' && name[1] == '.' && name[2] == '\0';
   struct cache_bucket *bucket;
   int i, found;
@@ -321,12 +464,18 @@ diskfs_check_lookup_cache (struct node *dir, const char *name)
     /* This is outside our file system, return cache miss.  */
     return NULL;
 
-  pthread_mutex_lock (&cache_lock);
+  pthread_once (&cache_init_once, cache_init);
+
   found = lookup (dir->cache_id, name, key, &bucket, &i);
   if (found)
     {
       ino64_t id = bucket->node_cache_id[i];
-      pthread_mutex_unlock (&cache_lock);
+
+      if (id == 0)
+	bucket->negative_hits++;
+      else
+	bucket->hits++;
+      pthread_spin_unlock (&bucket->lock);
 
       if (id == 0)
 	/* A negative cache entry.  */
@@ -352,18 +501,17 @@ diskfs_check_lookup_cache (struct node *dir, const char *name)
 	      /* In the window where DP was unlocked, we might
 		 have lost.  So check the cache again, and see
 		 if it's still there; if so, then we win. */
-	      pthread_mutex_lock (&cache_lock);
 	      found = lookup (dir->cache_id, name, key, &bucket, &i);
 	      if (! found
-		  || ! bucket->node_cache_id[i] != id)
+		  || bucket->node_cache_id[i] != id)
 		{
-		  pthread_mutex_unlock (&cache_lock);
+		  pthread_spin_unlock (&bucket->lock);
 
 		  /* Lose */
 		  diskfs_nput (np);
 		  return 0;
 		}
-	      pthread_mutex_unlock (&cache_lock);
+	      pthread_spin_unlock (&bucket->lock);
 	    }
 	  else
 	    err = diskfs_cached_lookup (id, &np);
@@ -371,6 +519,34 @@ diskfs_check_lookup_cache (struct node *dir, const char *name)
 	}
     }
 
-  pthread_mutex_unlock (&cache_lock);
+  bucket->misses++;
+  pthread_spin_unlock (&bucket->lock);
   return 0;
 }
+
+/* Fill STATS with the current statistics of the lookup cache.  */
+void
+diskfs_get_lookup_cache_stats (struct diskfs_lookup_cache_stats *stats)
+{
+  struct cache_bucket *b;
+
+  pthread_once (&cache_init_once, cache_init);
+
+  memset (stats, 0, sizeof *stats);
+  stats->size = cache_buckets * BUCKET_SIZE;
+
+  for (b = &name_cache[0]; b < &name_cache[cache_buckets]; b++)
+    {
+      int i;
+
+      pthread_spin_lock (&b->lock);
+      for (i = 0; i < BUCKET_SIZE; i++)
+	if (valid_entry (b, i))
+	  stats->entries++;
+      stats->hits += b->hits;
+      stats->negative_hits += b->negative_hits;
+      stats->misses += b->misses;
+      stats->evictions += b->evictions;
+      pthread_spin_unlock (&b->lock);
+    }
+}
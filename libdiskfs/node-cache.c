@@ -0,0 +1,405 @@
+/* Node cache for diskfs
+   Copyright (C) 2014 Free Software Foundation
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA. */
+
+#include "priv.h"
+#include <stddef.h>
+#include <string.h>
+
+/* The in-core nodes are kept in a hash table indexed by cache id.
+
+   A node which loses its last hard reference is not dropped at once.
+   Instead, the cache holds a light reference on it (NP->cache_ref is
+   set while it does) and puts it on a list of unused nodes, least
+   recently used first.  Once there are more than
+   DISKFS_NODE_CACHE_SIZE nodes on that list, the oldest ones lose the
+   cache reference, and are freed unless something else (say, a pager)
+   still holds on to them.
+
+   The table, the list and the statistics are protected by
+   diskfs_node_refcnt_lock.  */
+
+/* Default number of unused nodes to keep.  */
+#define DEFAULT_NODE_CACHE_SIZE	1024
+
+/* The number of unused nodes to keep in core.  */
+int diskfs_node_cache_size __attribute__ ((weak)) = DEFAULT_NODE_CACHE_SIZE;
+
+static struct hurd_ihash nodecache =
+  HURD_IHASH_INITIALIZER (offsetof (struct node, slot));
+
+static struct node *lru_first;
+static struct node **lru_lastp = &lru_first;
+static size_t lru_nr_items;
+
+static unsigned long cache_hits, cache_misses, cache_evictions;
+
+/* Take NP off the list of unused nodes, if it is on it.  */
+static void
+lru_remove (struct node *np)
+{
+  if (! np->lru_prevp)
+    return;
+
+  *np->lru_prevp = np->lru_next;
+  if (np->lru_next)
+    np->lru_next->lru_prevp = np->lru_prevp;
+  else
+    lru_lastp = np->lru_prevp;
+  np->lru_next = NULL;
+  np->lru_prevp = NULL;
+  lru_nr_items--;
+}
+
+/* Put NP at the most recently used end of the list of unused
+   nodes.  */
+static void
+lru_append (struct node *np)
+{
+  lru_remove (np);
+  np->lru_next = NULL;
+  np->lru_prevp = lru_lastp;
+  *lru_lastp = np;
+  lru_lastp = &np->lru_next;
+  lru_nr_items++;
+}
+
+/* Gain a hard reference on NP, which is in the cache, the way a lookup
+   does.  diskfs_node_refcnt_lock must be held.  */
+static void
+acquire (struct node *np)
+{
+  np->references++;
+  lru_remove (np);
+}
+
+/* Drop the cache reference of the least recently used nodes until no
+   more than MAX are left on the list of unused nodes.  A node is
+   briefly locked without hard references while diskfs_nput and
+   diskfs_nrele call diskfs_lost_hardrefs, so such a node is never
+   waited for; trimming stops instead, and the next call will pick up
+   where this one left off.  */
+static void
+lru_trim (size_t max)
+{
+  struct node *np;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  while (lru_nr_items > max)
+    {
+      np = lru_first;
+      assert (np->cache_ref);
+
+      if (np->references + np->light_references == 1)
+	{
+	  if (pthread_mutex_trylock (&np->lock))
+	    break;
+
+	  lru_remove (np);
+	  np->cache_ref = 0;
+	  np->light_references--;
+	  cache_evictions++;
+	  diskfs_drop_node (np);
+	  pthread_spin_lock (&diskfs_node_refcnt_lock);
+	}
+      else
+	{
+	  lru_remove (np);
+	  np->cache_ref = 0;
+	  np->light_references--;
+	  cache_evictions++;
+	}
+    }
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+}
+
+/* Fetch the node with cache id CACHE_ID, set *NPP to the node
+   structure; gain one user reference and lock the node.  CTX is passed
+   on to diskfs_user_make_node and diskfs_user_read_node if the node
+   is not in core yet.  */
+error_t
+diskfs_cached_lookup_context (ino64_t cache_id, struct node **npp,
+			      struct lookup_context *ctx)
+{
+  error_t err;
+  struct node *np;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  np = hurd_ihash_find (&nodecache, (hurd_ihash_key_t) cache_id);
+  if (np)
+    {
+      acquire (np);
+      cache_hits++;
+      pthread_spin_unlock (&diskfs_node_refcnt_lock);
+      pthread_mutex_lock (&np->lock);
+      *npp = np;
+      return 0;
+    }
+  cache_misses++;
+
+  err = diskfs_user_make_node (&np, ctx);
+  if (err)
+    {
+      pthread_spin_unlock (&diskfs_node_refcnt_lock);
+      return err;
+    }
+  np->cache_id = cache_id;
+
+  err = hurd_ihash_add (&nodecache, (hurd_ihash_key_t) cache_id, np);
+  if (err)
+    {
+      diskfs_user_node_norefs (np);
+      pthread_spin_unlock (&diskfs_node_refcnt_lock);
+      return err;
+    }
+
+  /* The cache's own reference.  */
+  np->light_references++;
+  np->cache_ref = 1;
+
+  pthread_mutex_lock (&np->lock);
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+
+  /* Get the contents of NP off disk.  */
+  err = diskfs_user_read_node (np, ctx);
+  if (err)
+    return err;
+
+  *npp = np;
+  return 0;
+}
+
+/* Fetch the node with cache id CACHE_ID, set *NPP to the node
+   structure; gain one user reference and lock the node.  */
+error_t __attribute__ ((weak))
+diskfs_cached_lookup (ino64_t cache_id, struct node **npp)
+{
+  return diskfs_cached_lookup_context (cache_id, npp, NULL);
+}
+
+/* Return the node with cache id CACHE_ID, which must have a reference
+   already, without allocating any new references.  */
+struct node *
+diskfs_cached_ifind (ino64_t cache_id)
+{
+  struct node *np;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  np = hurd_ihash_find (&nodecache, (hurd_ihash_key_t) cache_id);
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+
+  assert (np);
+  assert (np->references);
+  return np;
+}
+
+/* The last reference to NP has gone away; drop it from the cache and
+   let the user free it.  */
+void __attribute__ ((weak))
+diskfs_node_norefs (struct node *np)
+{
+  assert (! np->cache_ref);
+  hurd_ihash_locp_remove (&nodecache, np->slot);
+  diskfs_user_node_norefs (np);
+}
+
+/* NP has no more hard references and no links; it will not be looked
+   up again, so give up the cache reference and let the user drop the
+   light references it knows about.  */
+void __attribute__ ((weak))
+diskfs_try_dropping_softrefs (struct node *np)
+{
+  int cache_ref;
+
+  /* Our caller holds a hard reference, so this cannot be the last
+     reference.  */
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  lru_remove (np);
+  cache_ref = np->cache_ref;
+  np->cache_ref = 0;
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+  if (cache_ref)
+    diskfs_nrele_light (np);
+
+  diskfs_user_try_dropping_softrefs (np);
+}
+
+/* NP has lost its last hard reference; keep it around as an unused
+   node.  */
+void __attribute__ ((weak))
+diskfs_lost_hardrefs (struct node *np)
+{
+  /* A node without links is about to be dropped by our caller.  */
+  if (! np->dn_stat.st_nlink)
+    return;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  if (np->references)
+    {
+      /* Someone looked it up again in the meantime.  */
+      pthread_spin_unlock (&diskfs_node_refcnt_lock);
+      return;
+    }
+  if (! np->cache_ref)
+    {
+      /* Evicted while still in use, and kept alive by another light
+	 reference since; adopt it again.  */
+      np->light_references++;
+      np->cache_ref = 1;
+    }
+  lru_append (np);
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+
+  lru_trim (diskfs_node_cache_size > 0 ? diskfs_node_cache_size : 1);
+}
+
+/* NP has a hard reference again; it is no longer unused.  */
+void __attribute__ ((weak))
+diskfs_new_hardrefs (struct node *np)
+{
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  lru_remove (np);
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+
+  diskfs_user_new_hardrefs (np);
+}
+
+/* For each node in the cache, call FUN.  The node is to be locked
+   around the call to FUN.  If FUN returns non-zero for any node, then
+   immediately stop, and return that value.  */
+error_t __attribute__ ((weak))
+diskfs_node_iterate (error_t (*fun)(struct node *))
+{
+  error_t err = 0;
+  size_t num_nodes, num_hard;
+  struct node *node, **node_list, **p, **q;
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+
+  /* We must copy everything from the hash table into another data
+     structure to avoid running into any problems with the hash-table
+     being modified during processing (normally we delegate access to
+     hash-table with diskfs_node_refcnt_lock, but we can't hold this
+     while locking the individual node locks).  */
+  num_nodes = nodecache.nr_items;
+
+  node_list = malloc (num_nodes * sizeof (struct node *));
+  if (node_list == NULL)
+    {
+      pthread_spin_unlock (&diskfs_node_refcnt_lock);
+      return ENOMEM;
+    }
+
+  /* Take the unused nodes first, least recently used first.  Each
+     node given back the last hard reference goes back to the most
+     recently used end of the list, so releasing them in this order
+     keeps the list in the order it was.  Then take the nodes in use.
+
+     Nodes evicted from the cache but kept alive by a light reference,
+     say from a pager, go last.  Only a light reference is taken on
+     those, as giving back a hard one would make diskfs_lost_hardrefs
+     adopt them into the cache again, evicting the nodes really in
+     it.  */
+  p = node_list;
+  q = node_list + num_nodes;
+  for (node = lru_first; node; node = node->lru_next)
+    *p++ = node;
+  HURD_IHASH_ITERATE (&nodecache, i)
+    {
+      node = i;
+      if (node->lru_prevp)
+	continue;
+      if (node->references || node->cache_ref)
+	*p++ = node;
+      else
+	*--q = node;
+    }
+  assert (p == q);
+  num_hard = p - node_list;
+
+  for (p = node_list; p < node_list + num_hard; p++)
+    acquire (*p);
+  for (; p < node_list + num_nodes; p++)
+    (*p)->light_references++;
+
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+
+  for (p = node_list; p < node_list + num_nodes; p++)
+    {
+      node = *p;
+      if (!err)
+	{
+	  pthread_mutex_lock (&node->lock);
+	  err = (*fun)(node);
+	  pthread_mutex_unlock (&node->lock);
+	}
+      if (p < node_list + num_hard)
+	diskfs_nrele (node);
+      else
+	diskfs_nrele_light (node);
+    }
+
+  free (node_list);
+  return err;
+}
+
+/* Fill STATS with the current statistics of the node cache.  */
+void
+diskfs_get_node_cache_stats (struct diskfs_node_cache_stats *stats)
+{
+  memset (stats, 0, sizeof *stats);
+
+  pthread_spin_lock (&diskfs_node_refcnt_lock);
+  stats->nodes = nodecache.nr_items;
+  stats->unused = lru_nr_items;
+  stats->hits = cache_hits;
+  stats->misses = cache_misses;
+  stats->evictions = cache_evictions;
+  pthread_spin_unlock (&diskfs_node_refcnt_lock);
+}
+
+/* Defaults for the hooks, for filesystems which do not use the node
+   cache.  They are never called in that case.  */
+
+error_t __attribute__ ((weak))
+diskfs_user_make_node (struct node **npp, struct lookup_context *ctx)
+{
+  return EOPNOTSUPP;
+}
+
+error_t __attribute__ ((weak))
+diskfs_user_read_node (struct node *np, struct lookup_context *ctx)
+{
+  return 0;
+}
+
+void __attribute__ ((weak))
+diskfs_user_node_norefs (struct node *np)
+{
+  free (np);
+}
+
+void __attribute__ ((weak))
+diskfs_user_try_dropping_softrefs (struct node *np)
+{
+}
+
+void __attribute__ ((weak))
+diskfs_user_new_hardrefs (struct node *np)
+{
+}
@@ -33,6 +33,10 @@ init_node (struct node *np, struct disknode *dn)
   np->light_references = 0;
   np->owner = 0;
   np->sockaddr = MACH_PORT_NULL;
+  np->lru_next = NULL;
+  np->lru_prevp = NULL;
+  np->cache_ref = 0;
+  np->dir_index = NULL;
 
   np->dirmod_reqs = 0;
   np->dirmod_tick = 0;
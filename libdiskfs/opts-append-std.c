@@ -44,6 +44,14 @@ diskfs_append_std_options (char **argz, size_t *argz_len)
     err = argz_add (argz, argz_len, "--no-atime");
   if (!err && _diskfs_no_inherit_dir_group)
     err = argz_add (argz, argz_len, "--no-inherit-dir-group");
+  if (!err && diskfs_max_threads)
+    {
+      char buf[80];
+      sprintf (buf, "--max-threads=%d", diskfs_max_threads);
+      err = argz_add (argz, argz_len, buf);
+    }
+  if (!err && ports_rpc_stats_enabled ())
+    err = argz_add (argz, argz_len, "--rpc-statistics");
 
   if (! err)
     {
@@ -55,5 +55,12 @@ const struct argp_option diskfs_common_options[] =
    "Create new nodes with gid of parent dir"},
   {"grpid",    0,   0, OPTION_ALIAS | OPTION_HIDDEN},
   {"bsdgroups", 0,   0, OPTION_ALIAS | OPTION_HIDDEN},
+  {"max-threads", OPT_MAX_THREADS, "THREADS", 0,
+   "Serve at most THREADS requests at once; 0 means no limit"
+   " (the default)"},
+  {"rpc-statistics", OPT_RPC_STATS, 0, 0,
+   "Collect statistics about the requests served"},
+  {"no-rpc-statistics", OPT_NO_RPC_STATS, 0, 0,
+   "Stop collecting statistics about the requests served (the default)"},
   {0, 0}
 };
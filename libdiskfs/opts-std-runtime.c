@@ -33,7 +33,7 @@ std_runtime_options[] =
 struct parse_hook
 {
   int readonly, sync, sync_interval, remount, nosuid, noexec, noatime,
-    noinheritdirgroup;
+    noinheritdirgroup, max_threads, rpc_stats;
 };
 
 /* Implement the options in H, and free H.  */
@@ -82,6 +82,13 @@ set_opts (struct parse_hook *h)
     _diskfs_noatime = h->noatime;
   if (h->noinheritdirgroup != -1)
     _diskfs_no_inherit_dir_group = h->noinheritdirgroup;
+  if (h->max_threads != -1)
+    {
+      diskfs_max_threads = h->max_threads;
+      ports_set_max_threads (diskfs_port_bucket, diskfs_max_threads);
+    }
+  if (h->rpc_stats != -1)
+    ports_enable_rpc_stats (h->rpc_stats);
 
   free (h);
 
@@ -107,6 +114,13 @@ parse_opt (int opt, char *arg, struct argp_state *state)
     case OPT_NO_INHERIT_DIR_GROUP: h->noinheritdirgroup = 1; break;
     case OPT_INHERIT_DIR_GROUP: h->noinheritdirgroup = 0; break;
     case 'n': h->sync_interval = 0; h->sync = 0; break;
+    case OPT_MAX_THREADS:
+      h->max_threads = atoi (arg);
+      if (h->max_threads < 0)
+	return EINVAL;
+      break;
+    case OPT_RPC_STATS: h->rpc_stats = 1; break;
+    case OPT_NO_RPC_STATS: h->rpc_stats = 0; break;
     case 's':
       if (arg)
 	{
@@ -130,6 +144,8 @@ parse_opt (int opt, char *arg, struct argp_state *state)
 	  h->sync_interval = -1;
 	  h->remount = 0;
 	  h->nosuid = h->noexec = h->noatime = h->noinheritdirgroup = -1;
+	  h->max_threads = -1;
+	  h->rpc_stats = -1;
 
 	  /* We know that we have one child, with which we share our hook.  */
 	  state->child_inputs[0] = h;
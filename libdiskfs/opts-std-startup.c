@@ -45,6 +45,9 @@ mach_port_t diskfs_exec_server_task = MACH_PORT_NULL;
 #define OPT_BOOT_COMMAND	(-5)
 #define OPT_BOOT_INIT_PROGRAM	(-6)
 #define OPT_BOOT_PAUSE		(-7)
+#define OPT_NAME_CACHE_SIZE	(-8)
+#define OPT_NODE_CACHE_SIZE	(-9)
+#define OPT_DIR_INDEX_SIZE	(-10)
 
 static const struct argp_option
 startup_options[] =
@@ -53,6 +56,13 @@ startup_options[] =
    "Use DIRECTORY as the root of the filesystem"},
   {"virtual-root",	 0, 0, OPTION_ALIAS},
   {"chroot",		 0, 0, OPTION_ALIAS},
+  {"name-cache-size",	 OPT_NAME_CACHE_SIZE,	 "ENTRIES", 0,
+   "Cache up to ENTRIES directory lookups (default 1024)"},
+  {"node-cache-size",	 OPT_NODE_CACHE_SIZE,	 "NODES", 0,
+   "Keep up to NODES unused nodes in core (default 1024)"},
+  {"dir-index-size",	 OPT_DIR_INDEX_SIZE,	 "NAMES", 0,
+   "Keep up to NAMES names in in-core directory indexes (default 262144),"
+   " or none if 0"},
 
   {0,0,0,0, "Boot options:", -2},
   {"multiboot-command-line", OPT_BOOT_CMDLINE, "ARGS", 0,
@@ -114,6 +124,30 @@ parse_startup_opt (int opt, char *arg, struct argp_state *state)
       _diskfs_boot_pause = 1; break;
     case 'C':
       _diskfs_chroot_directory = arg; break;
+    case OPT_NAME_CACHE_SIZE:
+      diskfs_name_cache_size = atoi (arg);
+      if (diskfs_name_cache_size <= 0)
+	argp_error (state, "invalid number for --name-cache-size");
+      break;
+    case OPT_MAX_THREADS:
+      diskfs_max_threads = atoi (arg);
+      if (diskfs_max_threads < 0)
+	argp_error (state, "invalid number for --max-threads");
+      break;
+    case OPT_RPC_STATS:
+      ports_enable_rpc_stats (1); break;
+    case OPT_NO_RPC_STATS:
+      ports_enable_rpc_stats (0); break;
+    case OPT_NODE_CACHE_SIZE:
+      diskfs_node_cache_size = atoi (arg);
+      if (diskfs_node_cache_size <= 0)
+	argp_error (state, "invalid number for --node-cache-size");
+      break;
+    case OPT_DIR_INDEX_SIZE:
+      diskfs_dir_index_size = atoi (arg);
+      if (diskfs_dir_index_size < 0)
+	argp_error (state, "invalid number for --dir-index-size");
+      break;
 
     case OPT_BOOT_COMMAND:
       if (state->next == state->argc)
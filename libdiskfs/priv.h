@@ -61,6 +61,9 @@ extern const struct argp_option diskfs_common_options[];
 #define OPT_ATIME	602	/* --atime */
 #define OPT_NO_INHERIT_DIR_GROUP	603	/* --no-inherit-dir-group */
 #define OPT_INHERIT_DIR_GROUP		604	/* --inherit-dir-group */
+#define OPT_MAX_THREADS		605	/* --max-threads */
+#define OPT_RPC_STATS		606	/* --rpc-statistics */
+#define OPT_NO_RPC_STATS	607	/* --no-rpc-statistics */
 
 /* Common value for diskfs_common_options and diskfs_default_sync_interval. */
 #define DEFAULT_SYNC_INTERVAL 30
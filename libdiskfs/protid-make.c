@@ -51,7 +51,7 @@ diskfs_finish_protid (struct protid *cred, struct iouser *user)
   assert_perror (err);
 
   err = mach_port_move_member (mach_task_self (), cred->pi.port_right, 
-			       diskfs_port_bucket->portset);
+			       ports_get_portset (cred));
   assert_perror (err);
 }
 
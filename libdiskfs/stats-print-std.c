@@ -0,0 +1,77 @@
+/* Print the standard diskfs statistics
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdio.h>
+
+#include "priv.h"
+
+/* Each kind of statistic is printed as one line, starting with its name
+   and followed by NAME=VALUE pairs.  */
+error_t
+diskfs_print_std_statistics (FILE *stream)
+{
+  struct diskfs_lookup_cache_stats lookup;
+  struct diskfs_node_cache_stats nodes;
+  struct diskfs_dir_index_stats dirs;
+  struct ports_thread_stats threads;
+  char *rpcs;
+  size_t rpcs_len;
+  error_t err;
+
+  diskfs_get_lookup_cache_stats (&lookup);
+  fprintf (stream, "lookup-cache size=%lu entries=%lu hits=%lu"
+	   " negative-hits=%lu misses=%lu evictions=%lu\n",
+	   lookup.size, lookup.entries, lookup.hits,
+	   lookup.negative_hits, lookup.misses, lookup.evictions);
+
+  /* Filesystems which keep their own nodes never use the node cache.  */
+  diskfs_get_node_cache_stats (&nodes);
+  if (nodes.hits || nodes.misses)
+    fprintf (stream, "node-cache nodes=%lu unused=%lu hits=%lu misses=%lu"
+	     " evictions=%lu\n", nodes.nodes, nodes.unused, nodes.hits,
+	     nodes.misses, nodes.evictions);
+
+  /* Only some filesystems index their directories.  */
+  diskfs_get_dir_index_stats (&dirs);
+  if (dirs.builds)
+    fprintf (stream, "dir-index indexes=%lu names=%lu builds=%lu"
+	     " lookups=%lu evictions=%lu\n", dirs.indexes, dirs.names,
+	     dirs.builds, dirs.lookups, dirs.evictions);
+
+  ports_get_thread_stats (diskfs_port_bucket, &threads);
+  fprintf (stream, "threads max=%u active=%u idle=%u peak=%u queued=%lu\n",
+	   threads.max, threads.active, threads.idle, threads.peak,
+	   threads.queued);
+
+  if (diskfs_control_lane)
+    {
+      ports_get_lane_thread_stats (diskfs_control_lane, &threads);
+      fprintf (stream, "control-threads max=%u active=%u idle=%u peak=%u"
+	       " queued=%lu\n", threads.max, threads.active, threads.idle,
+	       threads.peak, threads.queued);
+    }
+
+  err = ports_format_rpc_stats (&rpcs, &rpcs_len);
+  if (err)
+    return err;
+  fwrite (rpcs, 1, rpcs_len, stream);
+  free (rpcs);
+
+  return 0;
+}
@@ -35,6 +35,14 @@
 
 #define SLAB_PAGES 4
 
+/* The number of objects in a magazine.  */
+#define MAGAZINE_SIZE 15
+
+/* The number of full and of empty magazines the depot of a slab space
+   keeps at most.  Full magazines beyond that are returned to the
+   slabs, and empty ones are freed.  */
+#define DEPOT_MAX 16
+
 
 /* Number of pages the slab allocator has allocated.  */
 static int __hurd_slab_nr_pages;
@@ -67,6 +75,33 @@ struct hurd_slab
   union hurd_bufctl *free_list;
 };
 
+/* A magazine.  While it is in the depot, NEXT links it with the other
+   full or empty magazines.  */
+struct hurd_slab_magazine
+{
+  struct hurd_slab_magazine *next;
+
+  /* The number of objects in OBJS.  */
+  int rounds;
+  void *objs[MAGAZINE_SIZE];
+};
+
+
+/* The magazines of one thread.  LOADED is allocated from and freed
+   to.  PREVIOUS, if there is one, is either full or empty, so that
+   swapping the two always allows the thread to go on without the
+   depot.  Only the thread itself uses this, except for NEXT and PREVP,
+   which link all caches of SPACE under its depot lock.  */
+struct hurd_slab_cache
+{
+  hurd_slab_space_t space;
+  struct hurd_slab_magazine *loaded;
+  struct hurd_slab_magazine *previous;
+  struct hurd_slab_cache *next;
+  struct hurd_slab_cache **prevp;
+};
+
+
 /* Allocate a buffer in *PTR of size SIZE which must be a power of 2
    and self aligned (i.e. aligned on a SIZE byte boundary) for slab
    space SPACE.  Return 0 on success, an error code on failure.  */
@@ -204,6 +239,9 @@ reap (struct hurd_slab_space *space)
 }
 
 
+static void cache_destroy (void *arg);
+static void drop_caches (hurd_slab_space_t space);
+
 /* Initialize slab space SPACE.  */
 static void
 init_space (hurd_slab_space_t space)
@@ -228,6 +266,17 @@ init_space (hurd_slab_space_t space)
   /* FIXME: Notify pager's reap functionality about this slab
      space.  */
 
+  /* This is done here rather than in hurd_slab_init, as statically
+     initialized spaces never go through it.  Without the key, all
+     allocations simply go to the slabs.  */
+  if (pthread_mutex_init (&space->depot_lock, NULL) == 0)
+    {
+      if (pthread_key_create (&space->cache_key, cache_destroy) == 0)
+	__atomic_store_n (&space->caching, true, __ATOMIC_RELEASE);
+      else
+	pthread_mutex_destroy (&space->depot_lock);
+    }
+
   space->initialized = true;
 }
 
@@ -391,6 +440,10 @@ hurd_slab_destroy (hurd_slab_space_t space)
 {
   error_t err;
 
+  /* Give back what the threads have cached.  */
+  if (space->caching)
+    drop_caches (space);
+
   /* The caller wants to destroy the slab.  It can not be destroyed if
      there are any outstanding memory allocations.  */
   pthread_mutex_lock (&space->lock);
@@ -429,15 +482,14 @@ hurd_slab_free (hurd_slab_space_t space)
 }
 
 
-/* Allocate a new object from the slab space SPACE.  */
-error_t
-hurd_slab_alloc (hurd_slab_space_t space, void **buffer)
+/* Allocate a new object from the slabs of the slab space SPACE, which
+   must be locked.  */
+static error_t
+slab_alloc (hurd_slab_space_t space, void **buffer)
 {
   error_t err;
   union hurd_bufctl *bufctl;
 
-  pthread_mutex_lock (&space->lock);
-
   /* If there is no slabs with free buffer, the cache has to be
      expanded with another slab.  If the slab space has not yet been
      initialized this is always true.  */
@@ -445,10 +497,7 @@ hurd_slab_alloc (hurd_slab_space_t space, void **buffer)
     {
       err = grow (space);
       if (err)
-	{
-	  pthread_mutex_unlock (&space->lock);
-	  return err;
-	}
+	return err;
     }
 
   /* Remove buffer from the free list and update the reference
@@ -477,7 +526,6 @@ hurd_slab_alloc (hurd_slab_space_t space, void **buffer)
       space->first_free = new_first;
     }
   *buffer = ((void *) bufctl) - (space->size - sizeof *bufctl);
-  pthread_mutex_unlock (&space->lock);
   return 0;
 }
 
@@ -492,17 +540,14 @@ put_on_slab_list (struct hurd_slab *slab, union hurd_bufctl *bufctl)
 }
 
 
-/* Deallocate the object BUFFER from the slab space SPACE.  */
-void
-hurd_slab_dealloc (hurd_slab_space_t space, void *buffer)
+/* Return the object BUFFER to the slabs of the slab space SPACE,
+   which must be locked.  */
+static void
+slab_dealloc (hurd_slab_space_t space, void *buffer)
 {
   struct hurd_slab *slab;
   union hurd_bufctl *bufctl;
 
-  assert (space->initialized);
-
-  pthread_mutex_lock (&space->lock);
-
   bufctl = (buffer + (space->size - sizeof *bufctl));
   put_on_slab_list (slab = bufctl->slab, bufctl);
 
@@ -513,6 +558,278 @@ hurd_slab_dealloc (hurd_slab_space_t space, void *buffer)
   if (!space->first_free 
       || slab->refcount < space->first_free->refcount)
     space->first_free = slab;
+}
+
+
+/* Return the objects in the magazine MAG to the slabs of the slab
+   space SPACE, and free MAG.  MAG may be NULL.  */
+static void
+drop_magazine (hurd_slab_space_t space, struct hurd_slab_magazine *mag)
+{
+  if (!mag)
+    return;
+
+  if (mag->rounds > 0)
+    {
+      pthread_mutex_lock (&space->lock);
+      while (mag->rounds > 0)
+	slab_dealloc (space, mag->objs[--mag->rounds]);
+      pthread_mutex_unlock (&space->lock);
+    }
+  free (mag);
+}
+
+
+/* Return the cache of the calling thread for the slab space SPACE,
+   creating it if necessary.  Return NULL if SPACE does not use
+   per-thread caches, or if the cache could not be created.  */
+static struct hurd_slab_cache *
+get_cache (hurd_slab_space_t space)
+{
+  struct hurd_slab_cache *cache;
+
+  if (!__atomic_load_n (&space->caching, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  cache = pthread_getspecific (space->cache_key);
+  if (cache)
+    return cache;
+
+  cache = calloc (1, sizeof *cache);
+  if (!cache)
+    return NULL;
+  cache->space = space;
+  if (pthread_setspecific (space->cache_key, cache))
+    {
+      free (cache);
+      return NULL;
+    }
+
+  pthread_mutex_lock (&space->depot_lock);
+  cache->next = space->caches;
+  if (cache->next)
+    cache->next->prevp = &cache->next;
+  cache->prevp = &space->caches;
+  space->caches = cache;
+  pthread_mutex_unlock (&space->depot_lock);
+
+  return cache;
+}
+
+
+/* The thread owning the cache ARG exits.  Return what it holds to the
+   slabs.  */
+static void
+cache_destroy (void *arg)
+{
+  struct hurd_slab_cache *cache = arg;
+  hurd_slab_space_t space = cache->space;
+
+  pthread_mutex_lock (&space->depot_lock);
+  *cache->prevp = cache->next;
+  if (cache->next)
+    cache->next->prevp = cache->prevp;
+  pthread_mutex_unlock (&space->depot_lock);
+
+  drop_magazine (space, cache->loaded);
+  drop_magazine (space, cache->previous);
+  free (cache);
+}
+
+
+/* Stop using per-thread caches for the slab space SPACE, and return
+   all objects in them and in the depot to the slabs.  No other thread
+   may use SPACE meanwhile.  */
+static void
+drop_caches (hurd_slab_space_t space)
+{
+  struct hurd_slab_cache *cache;
+  struct hurd_slab_magazine *mag;
+
+  /* Deleting the key keeps cache_destroy from being called for the
+     caches freed here.  */
+  space->caching = false;
+  pthread_key_delete (space->cache_key);
+
+  while ((cache = space->caches))
+    {
+      space->caches = cache->next;
+      drop_magazine (space, cache->loaded);
+      drop_magazine (space, cache->previous);
+      free (cache);
+    }
+
+  while ((mag = space->depot_full))
+    {
+      space->depot_full = mag->next;
+      drop_magazine (space, mag);
+    }
+  while ((mag = space->depot_empty))
+    {
+      space->depot_empty = mag->next;
+      free (mag);
+    }
+  space->depot_nr_full = 0;
+  space->depot_nr_empty = 0;
+
+  pthread_mutex_destroy (&space->depot_lock);
+}
+
+
+/* Take an object for the slab space SPACE from the magazines of
+   CACHE, and return it in *BUFFER.  Return 0 if there are none, in
+   which case the caller has to go to the slabs.  */
+static int
+cache_alloc (hurd_slab_space_t space, struct hurd_slab_cache *cache,
+	     void **buffer)
+{
+  struct hurd_slab_magazine *mag;
+
+  if (cache->loaded && cache->loaded->rounds > 0)
+    goto pop;
+
+  if (cache->previous && cache->previous->rounds > 0)
+    {
+      /* PREVIOUS is full.  */
+      mag = cache->previous;
+      cache->previous = cache->loaded;
+      cache->loaded = mag;
+      goto pop;
+    }
+
+  /* Both magazines are empty.  Exchange one for a full one from the
+     depot.  */
+  pthread_mutex_lock (&space->depot_lock);
+  mag = space->depot_full;
+  if (!mag)
+    {
+      pthread_mutex_unlock (&space->depot_lock);
+      return 0;
+    }
+  space->depot_full = mag->next;
+  space->depot_nr_full--;
+
+  if (cache->previous)
+    {
+      if (space->depot_nr_empty < DEPOT_MAX)
+	{
+	  cache->previous->next = space->depot_empty;
+	  space->depot_empty = cache->previous;
+	  space->depot_nr_empty++;
+	}
+      else
+	free (cache->previous);
+    }
+  pthread_mutex_unlock (&space->depot_lock);
+
+  cache->previous = cache->loaded;
+  cache->loaded = mag;
+
+ pop:
+  *buffer = cache->loaded->objs[--cache->loaded->rounds];
+  return 1;
+}
+
+
+/* Put the object BUFFER of the slab space SPACE into the magazines of
+   CACHE.  Return 0 if that is not possible, in which case the caller
+   has to return it to the slabs.  */
+static int
+cache_dealloc (hurd_slab_space_t space, struct hurd_slab_cache *cache,
+	       void *buffer)
+{
+  struct hurd_slab_magazine *mag, *surplus = NULL;
 
+  if (cache->loaded && cache->loaded->rounds < MAGAZINE_SIZE)
+    goto push;
+
+  if (cache->previous && cache->previous->rounds == 0)
+    {
+      /* PREVIOUS is empty.  */
+      mag = cache->previous;
+      cache->previous = cache->loaded;
+      cache->loaded = mag;
+      goto push;
+    }
+
+  /* Both magazines are full, or there are none yet.  Get an empty one
+     from the depot, or allocate one, and give the depot a full one
+     instead.  */
+  pthread_mutex_lock (&space->depot_lock);
+  mag = space->depot_empty;
+  if (mag)
+    {
+      space->depot_empty = mag->next;
+      space->depot_nr_empty--;
+    }
+  pthread_mutex_unlock (&space->depot_lock);
+
+  if (!mag)
+    {
+      mag = malloc (sizeof *mag);
+      if (!mag)
+	return 0;
+    }
+  mag->rounds = 0;
+
+  if (cache->previous)
+    {
+      pthread_mutex_lock (&space->depot_lock);
+      if (space->depot_nr_full < DEPOT_MAX)
+	{
+	  cache->previous->next = space->depot_full;
+	  space->depot_full = cache->previous;
+	  space->depot_nr_full++;
+	}
+      else
+	surplus = cache->previous;
+      pthread_mutex_unlock (&space->depot_lock);
+    }
+
+  cache->previous = cache->loaded;
+  cache->loaded = mag;
+
+  /* The depot has enough objects; the slabs get these back.  */
+  if (surplus)
+    drop_magazine (space, surplus);
+
+ push:
+  cache->loaded->objs[cache->loaded->rounds++] = buffer;
+  return 1;
+}
+
+
+/* Allocate a new object from the slab space SPACE.  */
+error_t
+hurd_slab_alloc (hurd_slab_space_t space, void **buffer)
+{
+  error_t err;
+  struct hurd_slab_cache *cache;
+
+  cache = get_cache (space);
+  if (cache && cache_alloc (space, cache, buffer))
+    return 0;
+
+  pthread_mutex_lock (&space->lock);
+  err = slab_alloc (space, buffer);
+  pthread_mutex_unlock (&space->lock);
+  return err;
+}
+
+
+/* Deallocate the object BUFFER from the slab space SPACE.  */
+void
+hurd_slab_dealloc (hurd_slab_space_t space, void *buffer)
+{
+  struct hurd_slab_cache *cache;
+
+  assert (space->initialized);
+
+  cache = get_cache (space);
+  if (cache && cache_dealloc (space, cache, buffer))
+    return;
+
+  pthread_mutex_lock (&space->lock);
+  slab_dealloc (space, buffer);
   pthread_mutex_unlock (&space->lock);
 }
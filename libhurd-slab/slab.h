@@ -48,6 +48,13 @@ typedef error_t (*hurd_slab_constructor_t) (void *hook, void *object);
 typedef void (*hurd_slab_destructor_t) (void *hook, void *object);
 
 
+/* A magazine, holding a number of free objects.  */
+struct hurd_slab_magazine;
+
+/* The magazines of one thread for a slab space.  */
+struct hurd_slab_cache;
+
+
 /* The type of a slab space.  
 
    The structure is divided into two parts: the first is only used
@@ -55,7 +62,14 @@ typedef void (*hurd_slab_destructor_t) (void *hook, void *object);
    initialized by a static initializer (HURD_SLAB_SPACE_INITIALIZER)
    or by the hurd_slab_create function.  The initialization of the
    space is delayed until the first allocation.  After that only the
-   second part is used.  */
+   second part is used.
+
+   Each thread keeps a couple of magazines of free objects for every
+   slab space it uses, which it allocates from and frees to without
+   taking any lock.  Only when they run full or empty, it exchanges
+   one with the depot of the space, and only if the depot has none to
+   give, the slabs themselves are used.  The objects in the magazines
+   remain constructed.  */
 
 typedef struct hurd_slab_space *hurd_slab_space_t;
 struct hurd_slab_space
@@ -111,6 +125,28 @@ struct hurd_slab_space
   /* The size of one object.  Should include possible alignment as
      well as the size of the bufctl structure.  */
   size_t size;
+
+  /* True if allocations go through the per-thread magazines.  Set by
+     the initialization of the space if CACHE_KEY could be created.  */
+  bool caching;
+
+  /* The key of the magazines of each thread, which are a struct
+     hurd_slab_cache.  */
+  pthread_key_t cache_key;
+
+  /* Protects the depot and the list of per-thread caches.  If both
+     are taken, DEPOT_LOCK is taken before LOCK.  */
+  pthread_mutex_t depot_lock;
+
+  /* The depot: lists of full and of empty magazines, which threads
+     exchange theirs against.  */
+  struct hurd_slab_magazine *depot_full;
+  struct hurd_slab_magazine *depot_empty;
+  int depot_nr_full;
+  int depot_nr_empty;
+
+  /* All per-thread caches of this space.  */
+  struct hurd_slab_cache *caches;
 };
 
 
@@ -169,7 +205,10 @@ error_t hurd_slab_init (hurd_slab_space_t space, size_t size, size_t alignment,
 
 /* Destroy all objects and the slab space SPACE.  Returns EBUSY if
    there are still allocated objects in the slab.  The dual of
-   hurd_slab_init.  */
+   hurd_slab_init.  No other thread may use SPACE at the same time.
+   The objects cached by all threads are returned to the slabs first,
+   and the per-thread magazines are not used for SPACE anymore, even
+   if EBUSY is returned.  */
 error_t hurd_slab_destroy (hurd_slab_space_t space);
 
 /* Allocate a new object from the slab space SPACE.  */
@@ -0,0 +1,494 @@
+/* cihash.c - Concurrent integer-keyed hash table functions.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include <assert.h>
+
+#include "cihash.h"
+
+/* The table is open addressed with linear probing, like the one of
+   ihash.c.  A slot is in one of these states:
+
+     EMPTY	never used; probes stop here.
+     RESERVED	claimed by a writer which has not stored the key yet.
+     DELETED	the element with the slot's key was removed.
+     otherwise	the value of the element with the slot's key.
+
+   The key of a slot is written once, before its value is published,
+   and never changes afterwards; a removed key may only come back into
+   the slot it had.  Hence a reader which sees a value in a slot can
+   trust the key next to it, and there is at most one slot for any key.
+   Tombstones are only cleared by the next resize, which builds a new
+   table.  The old table is freed once no reader can be looking at it
+   anymore.  */
+
+#define EMPTY		((hurd_cihash_value_t) 0)
+#define RESERVED	((hurd_cihash_value_t) 1)
+#define DELETED		((hurd_cihash_value_t) -1)
+
+/* The size of the initial table.  Must be a power of two.  */
+#define MIN_SIZE	32
+
+/* The default maximum load in binary percent.  */
+#define MAX_LOAD_DEFAULT 96
+
+struct slot
+{
+  hurd_cihash_value_t value;
+  hurd_cihash_key_t key;
+};
+
+struct _hurd_cihash_table
+{
+  size_t size;
+
+  /* The number of slots which are not EMPTY.  */
+  size_t used;
+
+  struct slot slots[0];
+};
+
+static inline int
+is_value (hurd_cihash_value_t value)
+{
+  return value != EMPTY && value != RESERVED && value != DELETED;
+}
+
+static inline pthread_mutex_t *
+key_lock (hurd_cihash_t ht, hurd_cihash_key_t key)
+{
+  return &ht->locks[key & (HURD_CIHASH_LOCKS - 1)];
+}
+
+static struct _hurd_cihash_table *
+table_alloc (size_t size)
+{
+  struct _hurd_cihash_table *t;
+
+  /* calloc() will initialize all values to EMPTY implicitly.  */
+  t = calloc (1, sizeof *t + size * sizeof (struct slot));
+  if (t)
+    t->size = size;
+  return t;
+}
+
+
+/* Readers.
+
+   Active readers are counted in one of two sets of counters, and the
+   set is chosen by the low bit of HT->epoch.  To wait for the readers
+   which are active at some point, hurd_cihash_synchronize flips the
+   epoch twice, each time waiting for the readers counted in the set
+   it flipped away from.  New readers never go to the set being waited
+   for, so the wait always ends.  Each thread uses its own counter of
+   a set (modulo HURD_CIHASH_READERS), so that readers rarely share a
+   cache line.  */
+
+static unsigned int
+reader_index (void)
+{
+  static unsigned int next;
+  static __thread unsigned int self;
+
+  if (self == 0)
+    {
+      self = __atomic_add_fetch (&next, 1, __ATOMIC_RELAXED);
+      if (self == 0)
+	self = __atomic_add_fetch (&next, 1, __ATOMIC_RELAXED);
+    }
+  return self % HURD_CIHASH_READERS;
+}
+
+int
+hurd_cihash_reader_enter (hurd_cihash_t ht)
+{
+  int token = reader_index ();
+
+  if (__atomic_load_n (&ht->epoch, __ATOMIC_SEQ_CST) & 1)
+    token += HURD_CIHASH_READERS;
+  __atomic_add_fetch (&ht->readers[token / HURD_CIHASH_READERS]
+		      [token % HURD_CIHASH_READERS].count,
+		      1, __ATOMIC_SEQ_CST);
+  return token;
+}
+
+void
+hurd_cihash_reader_exit (hurd_cihash_t ht, int token)
+{
+  __atomic_sub_fetch (&ht->readers[token / HURD_CIHASH_READERS]
+		      [token % HURD_CIHASH_READERS].count,
+		      1, __ATOMIC_RELEASE);
+}
+
+/* Wait until no reader is counted in SET of HT.  */
+static void
+wait_for_readers (hurd_cihash_t ht, unsigned int set)
+{
+  int i;
+
+  for (i = 0; i < HURD_CIHASH_READERS; i++)
+    while (__atomic_load_n (&ht->readers[set][i].count, __ATOMIC_SEQ_CST))
+      sched_yield ();
+}
+
+void
+hurd_cihash_synchronize (hurd_cihash_t ht)
+{
+  unsigned int epoch;
+
+  pthread_mutex_lock (&ht->sync_lock);
+  epoch = __atomic_add_fetch (&ht->epoch, 1, __ATOMIC_SEQ_CST);
+  wait_for_readers (ht, (epoch - 1) & 1);
+  epoch = __atomic_add_fetch (&ht->epoch, 1, __ATOMIC_SEQ_CST);
+  wait_for_readers (ht, (epoch - 1) & 1);
+  pthread_mutex_unlock (&ht->sync_lock);
+}
+
+
+/* Construction and destruction of hash tables.  */
+
+void
+hurd_cihash_init (hurd_cihash_t ht)
+{
+  int i, j;
+
+  ht->table = NULL;
+  ht->nr_items = 0;
+  ht->max_load = MAX_LOAD_DEFAULT;
+  pthread_rwlock_init (&ht->resize_lock, NULL);
+  for (i = 0; i < HURD_CIHASH_LOCKS; i++)
+    pthread_mutex_init (&ht->locks[i], NULL);
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < HURD_CIHASH_READERS; j++)
+      ht->readers[i][j].count = 0;
+  ht->epoch = 0;
+  pthread_mutex_init (&ht->sync_lock, NULL);
+  ht->cleanup = 0;
+  ht->cleanup_data = 0;
+}
+
+void
+hurd_cihash_destroy (hurd_cihash_t ht)
+{
+  struct _hurd_cihash_table *t = ht->table;
+  size_t i;
+  int j;
+
+  if (t)
+    {
+      if (ht->cleanup)
+	for (i = 0; i < t->size; i++)
+	  if (is_value (t->slots[i].value))
+	    (*ht->cleanup) (t->slots[i].value, ht->cleanup_data);
+      free (t);
+    }
+
+  pthread_rwlock_destroy (&ht->resize_lock);
+  for (j = 0; j < HURD_CIHASH_LOCKS; j++)
+    pthread_mutex_destroy (&ht->locks[j]);
+  pthread_mutex_destroy (&ht->sync_lock);
+}
+
+error_t
+hurd_cihash_create (hurd_cihash_t *ht)
+{
+  *ht = malloc (sizeof (struct hurd_cihash));
+  if (*ht == NULL)
+    return ENOMEM;
+
+  hurd_cihash_init (*ht);
+
+  return 0;
+}
+
+void
+hurd_cihash_free (hurd_cihash_t ht)
+{
+  hurd_cihash_destroy (ht);
+  free (ht);
+}
+
+void
+hurd_cihash_set_cleanup (hurd_cihash_t ht, hurd_cihash_cleanup_t cleanup,
+			 void *cleanup_data)
+{
+  ht->cleanup = cleanup;
+  ht->cleanup_data = cleanup_data;
+}
+
+void
+hurd_cihash_set_max_load (hurd_cihash_t ht, unsigned int max_load)
+{
+  ht->max_load = max_load;
+}
+
+
+/* Return true if a table of SIZE slots may have USED slots in use
+   according to HT's maximum load.  */
+static inline int
+load_ok (hurd_cihash_t ht, size_t used, size_t size)
+{
+  return used * 128 <= size * ht->max_load && used < size;
+}
+
+/* Replace the table of HT by one without tombstones, which is large
+   enough for another element.  OLD is the table the caller found too
+   full.  */
+static error_t
+resize (hurd_cihash_t ht, struct _hurd_cihash_table *old)
+{
+  struct _hurd_cihash_table *new;
+  size_t size, i;
+
+  pthread_rwlock_wrlock (&ht->resize_lock);
+  if (ht->table != old)
+    {
+      /* Someone else was quicker.  */
+      pthread_rwlock_unlock (&ht->resize_lock);
+      return 0;
+    }
+
+  size = MIN_SIZE;
+  while (! load_ok (ht, 2 * (ht->nr_items + 1), size))
+    size <<= 1;
+
+  new = table_alloc (size);
+  if (new == NULL)
+    {
+      pthread_rwlock_unlock (&ht->resize_lock);
+      return ENOMEM;
+    }
+
+  /* No writer is active, so OLD does not change under us.  */
+  if (old)
+    for (i = 0; i < old->size; i++)
+      if (is_value (old->slots[i].value))
+	{
+	  size_t mask = new->size - 1;
+	  size_t idx = old->slots[i].key & mask;
+
+	  while (new->slots[idx].value != EMPTY)
+	    idx = (idx + 1) & mask;
+	  new->slots[idx] = old->slots[i];
+	  new->used++;
+	}
+
+  __atomic_store_n (&ht->table, new, __ATOMIC_SEQ_CST);
+  if (old)
+    {
+      hurd_cihash_synchronize (ht);
+      free (old);
+    }
+  pthread_rwlock_unlock (&ht->resize_lock);
+  return 0;
+}
+
+error_t
+hurd_cihash_add (hurd_cihash_t ht, hurd_cihash_key_t key,
+		 hurd_cihash_value_t item)
+{
+  struct _hurd_cihash_table *t;
+  pthread_mutex_t *lock = key_lock (ht, key);
+  hurd_cihash_value_t old;
+  size_t mask, idx, n;
+  error_t err;
+
+  assert (is_value (item));
+
+ retry:
+  pthread_rwlock_rdlock (&ht->resize_lock);
+  pthread_mutex_lock (lock);
+
+  t = ht->table;
+  if (t == NULL)
+    goto grow;
+  mask = t->size - 1;
+
+  /* Look for the slot of KEY.  Writers of other keys may claim slots
+     while we search, but none can claim a slot for KEY.  */
+  idx = key & mask;
+  for (n = 0; n < t->size; n++, idx = (idx + 1) & mask)
+    {
+      old = __atomic_load_n (&t->slots[idx].value, __ATOMIC_ACQUIRE);
+      if (old == EMPTY)
+	break;
+      if (old != RESERVED && t->slots[idx].key == key)
+	{
+	  __atomic_store_n (&t->slots[idx].value, item, __ATOMIC_RELEASE);
+	  if (old == DELETED)
+	    __atomic_add_fetch (&ht->nr_items, 1, __ATOMIC_RELAXED);
+	  else if (ht->cleanup)
+	    (*ht->cleanup) (old, ht->cleanup_data);
+	  goto out;
+	}
+    }
+
+  /* Claim an empty slot.  */
+  for (; n < t->size; n++, idx = (idx + 1) & mask)
+    {
+      size_t used = __atomic_load_n (&t->used, __ATOMIC_RELAXED);
+
+      if (! load_ok (ht, used + 1, t->size))
+	goto grow;
+
+      old = EMPTY;
+      if (__atomic_compare_exchange_n (&t->slots[idx].value, &old, RESERVED,
+				       0, __ATOMIC_ACQUIRE,
+				       __ATOMIC_RELAXED))
+	{
+	  __atomic_add_fetch (&t->used, 1, __ATOMIC_RELAXED);
+	  t->slots[idx].key = key;
+	  __atomic_store_n (&t->slots[idx].value, item, __ATOMIC_RELEASE);
+	  __atomic_add_fetch (&ht->nr_items, 1, __ATOMIC_RELAXED);
+	  goto out;
+	}
+    }
+
+ grow:
+  pthread_mutex_unlock (lock);
+  pthread_rwlock_unlock (&ht->resize_lock);
+  err = resize (ht, t);
+  if (err)
+    return err;
+  goto retry;
+
+ out:
+  pthread_mutex_unlock (lock);
+  pthread_rwlock_unlock (&ht->resize_lock);
+  return 0;
+}
+
+/* Return the value of KEY in T, or NULL.  */
+static hurd_cihash_value_t
+lookup (struct _hurd_cihash_table *t, hurd_cihash_key_t key)
+{
+  hurd_cihash_value_t value;
+  size_t mask, idx, n;
+
+  if (t == NULL)
+    return NULL;
+
+  mask = t->size - 1;
+  idx = key & mask;
+  for (n = 0; n < t->size; n++, idx = (idx + 1) & mask)
+    {
+      value = __atomic_load_n (&t->slots[idx].value, __ATOMIC_ACQUIRE);
+      if (value == EMPTY)
+	break;
+      if (value != RESERVED && t->slots[idx].key == key)
+	return value == DELETED ? NULL : value;
+    }
+
+  return NULL;
+}
+
+hurd_cihash_value_t
+hurd_cihash_find (hurd_cihash_t ht, hurd_cihash_key_t key)
+{
+  hurd_cihash_value_t value;
+  int token;
+
+  token = hurd_cihash_reader_enter (ht);
+  value = lookup (__atomic_load_n (&ht->table, __ATOMIC_SEQ_CST), key);
+  hurd_cihash_reader_exit (ht, token);
+
+  return value;
+}
+
+int
+hurd_cihash_remove (hurd_cihash_t ht, hurd_cihash_key_t key)
+{
+  struct _hurd_cihash_table *t;
+  pthread_mutex_t *lock = key_lock (ht, key);
+  hurd_cihash_value_t old;
+  size_t mask, idx, n;
+  int found = 0;
+
+  pthread_rwlock_rdlock (&ht->resize_lock);
+  pthread_mutex_lock (lock);
+
+  t = ht->table;
+  if (t)
+    {
+      mask = t->size - 1;
+      idx = key & mask;
+      for (n = 0; n < t->size; n++, idx = (idx + 1) & mask)
+	{
+	  old = __atomic_load_n (&t->slots[idx].value, __ATOMIC_ACQUIRE);
+	  if (old == EMPTY)
+	    break;
+	  if (old != RESERVED && t->slots[idx].key == key)
+	    {
+	      if (old != DELETED)
+		{
+		  __atomic_store_n (&t->slots[idx].value, DELETED,
+				    __ATOMIC_RELEASE);
+		  __atomic_sub_fetch (&ht->nr_items, 1, __ATOMIC_RELAXED);
+		  if (ht->cleanup)
+		    (*ht->cleanup) (old, ht->cleanup_data);
+		  found = 1;
+		}
+	      break;
+	    }
+	}
+    }
+
+  pthread_mutex_unlock (lock);
+  pthread_rwlock_unlock (&ht->resize_lock);
+  return found;
+}
+
+size_t
+hurd_cihash_count (hurd_cihash_t ht)
+{
+  return __atomic_load_n (&ht->nr_items, __ATOMIC_RELAXED);
+}
+
+error_t
+hurd_cihash_iterate (hurd_cihash_t ht,
+		     error_t (*fun) (hurd_cihash_key_t key,
+				     hurd_cihash_value_t value,
+				     void *arg),
+		     void *arg)
+{
+  struct _hurd_cihash_table *t;
+  hurd_cihash_value_t value;
+  error_t err = 0;
+  size_t i;
+  int token;
+
+  token = hurd_cihash_reader_enter (ht);
+  t = __atomic_load_n (&ht->table, __ATOMIC_SEQ_CST);
+  for (i = 0; t && i < t->size && ! err; i++)
+    {
+      value = __atomic_load_n (&t->slots[i].value, __ATOMIC_ACQUIRE);
+      if (is_value (value))
+	err = (*fun) (t->slots[i].key, value, arg);
+    }
+  hurd_cihash_reader_exit (ht, token);
+
+  return err;
+}
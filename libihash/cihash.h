@@ -0,0 +1,178 @@
+/* cihash.h - Concurrent integer keyed hash table interface.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#ifndef _HURD_CIHASH_H
+#define _HURD_CIHASH_H	1
+
+#include <errno.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+
+
+/* A hash table like the one in <hurd/ihash.h>, which may be used by
+   several threads at once without an external lock.
+
+   Lookups take no lock at all, and never wait for writers.  Writers
+   of different keys mostly proceed in parallel; they only serialize
+   with writers of keys which hash to the same lock, and with the
+   occasional resize of the table.
+
+   A value found by hurd_cihash_find may be removed by another thread
+   at any time.  If the caller needs to use it afterwards, the lookup
+   and the use have to be done between hurd_cihash_reader_enter and
+   hurd_cihash_reader_exit, and whoever removes the value must call
+   hurd_cihash_synchronize before freeing it.  */
+
+/* The type of the values corresponding to the keys.  Must be a
+   pointer type.  The values (hurd_cihash_value_t) 0, 1 and ~0 are
+   reserved for the implementation.  */
+typedef void *hurd_cihash_value_t;
+
+/* The type of integer we want to use for the keys.  */
+typedef uintptr_t hurd_cihash_key_t;
+
+/* The type of the cleanup function, which is called for every value
+   removed from the hash table.  */
+typedef void (*hurd_cihash_cleanup_t) (hurd_cihash_value_t value, void *arg);
+
+/* The number of writer locks.  Must be a power of two.  */
+#define HURD_CIHASH_LOCKS	64
+
+/* The number of counters readers are spread over.  */
+#define HURD_CIHASH_READERS	16
+
+struct _hurd_cihash_table;
+
+/* A counter of active readers, alone on its cache line.  */
+struct _hurd_cihash_readers
+{
+  unsigned long count;
+} __attribute__ ((aligned (64)));
+
+struct hurd_cihash
+{
+  /* The current table.  Replaced as a whole when resizing.  */
+  struct _hurd_cihash_table *table;
+
+  /* The number of hashed elements.  */
+  size_t nr_items;
+
+  /* The maximum load factor in binary percent.  */
+  unsigned int max_load;
+
+  /* Writers hold this for reading, a resize holds it for writing.  */
+  pthread_rwlock_t resize_lock;
+
+  /* Writers of a key hold the lock selected by the key.  */
+  pthread_mutex_t locks[HURD_CIHASH_LOCKS];
+
+  /* Active readers, counted in one of two sets selected by EPOCH.  */
+  struct _hurd_cihash_readers readers[2][HURD_CIHASH_READERS];
+  unsigned int epoch;
+
+  /* Serializes hurd_cihash_synchronize.  */
+  pthread_mutex_t sync_lock;
+
+  hurd_cihash_cleanup_t cleanup;
+  void *cleanup_data;
+};
+typedef struct hurd_cihash *hurd_cihash_t;
+
+
+/* Construction and destruction of hash tables.  */
+
+/* Initialize the hash table at address HT.  */
+void hurd_cihash_init (hurd_cihash_t ht);
+
+/* Destroy the hash table at address HT.  This first removes all
+   elements which are still in the hash table, and calling the cleanup
+   function for them (if any).  No other thread may use HT anymore.  */
+void hurd_cihash_destroy (hurd_cihash_t ht);
+
+/* Create a hash table, initialize it and return it in HT.  If a
+   memory allocation error occurs, ENOMEM is returned, otherwise 0.  */
+error_t hurd_cihash_create (hurd_cihash_t *ht);
+
+/* Destroy the hash table HT and release the memory allocated for it
+   by hurd_cihash_create().  */
+void hurd_cihash_free (hurd_cihash_t ht);
+
+
+/* Configuration of the hash table.  */
+
+/* Set the cleanup function for the hash table HT to CLEANUP.  The
+   second argument to CLEANUP will be CLEANUP_DATA on every
+   invocation.  CLEANUP is called with the lock of the key held.  */
+void hurd_cihash_set_cleanup (hurd_cihash_t ht, hurd_cihash_cleanup_t cleanup,
+			      void *cleanup_data);
+
+/* Set the maximum load factor in binary percent to MAX_LOAD, which
+   should be between 64 and 128.  Removed elements count towards the
+   load until the next resize.  */
+void hurd_cihash_set_max_load (hurd_cihash_t ht, unsigned int max_load);
+
+
+/* Add ITEM to the hash table HT under the key KEY.  If there already
+   is an item under this key, call the cleanup function (if any) for
+   it before overriding the value.  If a memory allocation error
+   occurs, ENOMEM is returned, otherwise 0.  */
+error_t hurd_cihash_add (hurd_cihash_t ht, hurd_cihash_key_t key,
+			 hurd_cihash_value_t item);
+
+/* Find and return the item in the hash table HT with key KEY, or NULL
+   if it doesn't exist.  */
+hurd_cihash_value_t hurd_cihash_find (hurd_cihash_t ht, hurd_cihash_key_t key);
+
+/* Remove the entry with the key KEY from the hash table HT.  If such
+   an entry was found and removed, 1 is returned, otherwise 0.  */
+int hurd_cihash_remove (hurd_cihash_t ht, hurd_cihash_key_t key);
+
+/* Return the number of elements in the hash table HT.  */
+size_t hurd_cihash_count (hurd_cihash_t ht);
+
+/* Call FUN with ARG for every element in the hash table HT, until it
+   returns non-zero, and return that value.  Elements added or removed
+   meanwhile may or may not be seen.  FUN is called as a reader, see
+   below.  */
+error_t hurd_cihash_iterate (hurd_cihash_t ht,
+			     error_t (*fun) (hurd_cihash_key_t key,
+					     hurd_cihash_value_t value,
+					     void *arg),
+			     void *arg);
+
+
+/* Read-side critical sections.  */
+
+/* Enter a read-side critical section of HT, and return a token to be
+   passed to hurd_cihash_reader_exit.  Values found before exiting it
+   stay valid until then, as long as their owner calls
+   hurd_cihash_synchronize between removing and freeing them.
+   Sections may nest, but must not contain a call to
+   hurd_cihash_synchronize or hurd_cihash_add.  */
+int hurd_cihash_reader_enter (hurd_cihash_t ht);
+
+/* Leave the read-side critical section of HT entered with TOKEN.  */
+void hurd_cihash_reader_exit (hurd_cihash_t ht, int token);
+
+/* Wait until all read-side critical sections of HT which were entered
+   before this call have been left.  */
+void hurd_cihash_synchronize (hurd_cihash_t ht);
+
+#endif	/* _HURD_CIHASH_H */
@@ -32,54 +32,112 @@
 
 #include "ihash.h"
 
-/* Return 1 if the slot with the index IDX in the hash table HT is
-   empty, and 0 otherwise.  */
-static inline int
-index_empty (hurd_ihash_t ht, unsigned int idx)
+/* The number of slots of the old array of an incrementally enlarged
+   hash table which are moved to the new array on each addition.  */
+#define MIGRATE_STEP	64
+
+
+/* The hash tables use open addressing with linear probing, and the
+   key modulo the size of the array as the hash function.  Elements
+   are placed following the Robin Hood scheme: an element which is
+   farther away from its home slot takes the slot of one which is
+   closer to its own.  This keeps the probe sequences short and even,
+   and lets a lookup for a missing key stop as soon as it meets an
+   element closer to home than the key would be.  Removal shifts the
+   following elements of the cluster back by one slot, so no
+   tombstones are ever left behind.  */
+
+
+/* Return the distance of the element in the slot with the index IDX
+   of the array ITEMS, which has MASK + 1 slots, from its home
+   slot.  */
+static inline unsigned int
+probe_distance (_hurd_ihash_item_t items, unsigned int mask, unsigned int idx)
 {
-  return ht->items[idx].value == _HURD_IHASH_EMPTY
-    || ht->items[idx].value == _HURD_IHASH_DELETED;
+  return (idx - (items[idx].key & mask)) & mask;
 }
 
 
-/* Return 1 if the index IDX in the hash table HT is occupied by the
-   element with the key KEY.  */
-static inline int
-index_valid (hurd_ihash_t ht, unsigned int idx, hurd_ihash_key_t key)
+/* Store the location of the value of ITEM in the value, if the hash
+   table HT has location pointers.  */
+static inline void
+set_locp (hurd_ihash_t ht, _hurd_ihash_item_t item)
 {
-  return !index_empty (ht, idx) && ht->items[idx].key == key;
+  if (ht->locp_offset != HURD_IHASH_NO_LOCP)
+    *((hurd_ihash_locp_t *) (((char *) item->value) + ht->locp_offset))
+      = &item->value;
 }
 
 
-/* Given a hash table HT, and a key KEY, find the index in the table
-   of that key.  You must subsequently check with index_valid() if the
-   returned index is valid.  */
+/* Given an array ITEMS of SIZE slots, and a key KEY, return the index
+   in the array of that key, or -1 if it is not in the array.  */
 static inline int
-find_index (hurd_ihash_t ht, hurd_ihash_key_t key)
+find_index (_hurd_ihash_item_t items, size_t size, hurd_ihash_key_t key)
 {
-  unsigned int idx;
-  unsigned int up_idx;
-  unsigned int mask = ht->size - 1;
+  unsigned int mask = size - 1;
+  unsigned int idx = key & mask;
+  unsigned int dist;
+
+  for (dist = 0; dist < size; dist++)
+    {
+      if (items[idx].value == _HURD_IHASH_EMPTY
+	  || probe_distance (items, mask, idx) < dist)
+	return -1;
+      if (items[idx].key == key)
+	return idx;
+      idx = (idx + 1) & mask;
+    }
+
+  return -1;
+}
+
+
+/* Return the location of the value of the element with the key KEY
+   in the hash table HT, or NULL if there is none.  */
+static inline hurd_ihash_locp_t
+find_locp (hurd_ihash_t ht, hurd_ihash_key_t key)
+{
+  int idx;
+
+  if (ht->size == 0)
+    return NULL;
+
+  idx = find_index (ht->items, ht->size, key);
+  if (idx >= 0)
+    return &ht->items[idx].value;
 
-  idx = key & mask;
+  if (ht->old_items)
+    {
+      idx = find_index (ht->old_items, ht->old_size, key);
+      if (idx >= 0)
+	return &ht->old_items[idx].value;
+    }
+
+  return NULL;
+}
 
-  if (ht->items[idx].value == _HURD_IHASH_EMPTY || ht->items[idx].key == key)
-    return idx;
 
-  up_idx = idx;
+/* Empty the slot with the index IDX of the array ITEMS of SIZE slots
+   of the hash table HT, and shift the elements following it in the
+   same cluster back by one slot, until one is met which is in its
+   home slot.  */
+static void
+remove_index (hurd_ihash_t ht, _hurd_ihash_item_t items, size_t size,
+	      unsigned int idx)
+{
+  unsigned int mask = size - 1;
+  unsigned int next = (idx + 1) & mask;
 
-  do
+  while (items[next].value != _HURD_IHASH_EMPTY
+	 && probe_distance (items, mask, next) > 0)
     {
-      up_idx = (up_idx + 1) & mask;
-      if (ht->items[up_idx].value == _HURD_IHASH_EMPTY
-	  || ht->items[up_idx].key == key)
-	return up_idx;
+      items[idx] = items[next];
+      set_locp (ht, &items[idx]);
+      idx = next;
+      next = (next + 1) & mask;
     }
-  while (up_idx != idx);
 
-  /* If we end up here, the item could not be found.  Return any
-     invalid index.  */
-  return idx;
+  items[idx].value = _HURD_IHASH_EMPTY;
 }
 
 
@@ -89,13 +147,21 @@ find_index (hurd_ihash_t ht, hurd_ihash_key_t key)
 static inline void
 locp_remove (hurd_ihash_t ht, hurd_ihash_locp_t locp)
 {
+  /* The value is the first member of the item.  */
+  _hurd_ihash_item_t item = (_hurd_ihash_item_t) locp;
+
   if (ht->cleanup)
     (*ht->cleanup) (*locp, ht->cleanup_data);
-  *locp = _HURD_IHASH_DELETED;
   ht->nr_items--;
+
+  if (ht->old_items
+      && item >= ht->old_items && item < &ht->old_items[ht->old_size])
+    remove_index (ht, ht->old_items, ht->old_size, item - ht->old_items);
+  else
+    remove_index (ht, ht->items, ht->size, item - ht->items);
 }
 
-
+
 /* Construction and destruction of hash tables.  */
 
 /* Initialize the hash table at address HT.  */
@@ -107,6 +173,10 @@ hurd_ihash_init (hurd_ihash_t ht, intptr_t locp_offs)
   ht->locp_offset = locp_offs;
   ht->max_load = HURD_IHASH_MAX_LOAD_DEFAULT;
   ht->cleanup = 0;
+  ht->old_items = NULL;
+  ht->old_size = 0;
+  ht->migrated = 0;
+  ht->incremental = 1;
 }
 
 
@@ -127,6 +197,8 @@ hurd_ihash_destroy (hurd_ihash_t ht)
 
   if (ht->size > 0)
     free (ht->items);
+  if (ht->old_items)
+    free (ht->old_items);
 }
 
 
@@ -173,7 +245,7 @@ hurd_ihash_set_cleanup (hurd_ihash_t ht, hurd_ihash_cleanup_t cleanup,
    hash table while the number of hashed elements is that much binary
    percent of the total size of the hash table.  If more elements are
    added, the hash table is first expanded and reorganized.  A
-   MAX_LOAD of 128 will always fill the whole table before enlarging
+   MAX_LOAD of 128 will fill all but one slot of the table before enlarging
    it, but note that this will increase the cost of operations
    significantly when the table is almost full.
 
@@ -187,61 +259,179 @@ hurd_ihash_set_max_load (hurd_ihash_t ht, unsigned int max_load)
 }
 
 
-/* Helper function for hurd_ihash_add.  Return 1 if the item was
-   added, and 0 if it could not be added because no empty slot was
-   found.  The arguments are identical to hurd_ihash_add.
+/* Set whether the hash table HT is enlarged incrementally to
+   INCREMENTAL.  */
+void
+hurd_ihash_set_incremental (hurd_ihash_t ht, int incremental)
+{
+  ht->incremental = incremental;
+}
 
-   We are using open address hashing.  As the hash function we use the
-   division method with linear probe.  */
-static inline int
+
+/* Helper function for hurd_ihash_add.  Put VALUE under the key KEY
+   into the current array of the hash table HT, which must have an
+   empty slot.  If KEY is in the array already, its value is
+   overridden, and 0 is returned.  Otherwise, elements which are closer
+   to their home slot than the one being placed are displaced, and
+   placed further on in turn, and 1 is returned.  Both is done in one
+   pass, as a key can only be found before the place where it would be
+   put.  */
+static int
 add_one (hurd_ihash_t ht, hurd_ihash_key_t key, hurd_ihash_value_t value)
 {
-  unsigned int idx;
-  unsigned int first_free;
+  struct _hurd_ihash_item carry = { .value = value, .key = key };
+  struct _hurd_ihash_item tmp;
   unsigned int mask = ht->size - 1;
+  unsigned int idx = key & mask;
+  unsigned int dist = 0;
+  unsigned int d;
 
-  idx = key & mask;
-  first_free = idx;
+  for (;;)
+    {
+      if (ht->items[idx].value == _HURD_IHASH_EMPTY)
+	break;
 
-  if (ht->items[idx].value != _HURD_IHASH_EMPTY && ht->items[idx].key != key)
+      d = probe_distance (ht->items, mask, idx);
+      if (d < dist)
+	break;
+
+      if (ht->items[idx].key == key)
+	{
+	  if (ht->cleanup)
+	    (*ht->cleanup) (ht->items[idx].value, ht->cleanup_data);
+	  ht->items[idx].value = value;
+	  set_locp (ht, &ht->items[idx]);
+	  return 0;
+	}
+
+      idx = (idx + 1) & mask;
+      dist++;
+    }
+
+  /* KEY is not in the array, and belongs into the slot IDX.  */
+  for (;;)
     {
-      unsigned int up_idx = idx;
+      if (ht->items[idx].value == _HURD_IHASH_EMPTY)
+	{
+	  ht->items[idx] = carry;
+	  set_locp (ht, &ht->items[idx]);
+	  return 1;
+	}
 
-      do
+      d = probe_distance (ht->items, mask, idx);
+      if (d < dist)
 	{
-        up_idx = (up_idx + 1) & mask;
-	  if (ht->items[up_idx].value == _HURD_IHASH_EMPTY
-	      || ht->items[up_idx].key == key)
-	    {
-	      idx = up_idx;
-	      break;
-	    }
+	  tmp = ht->items[idx];
+	  ht->items[idx] = carry;
+	  set_locp (ht, &ht->items[idx]);
+	  carry = tmp;
+	  dist = d;
 	}
-      while (up_idx != idx);
+
+      idx = (idx + 1) & mask;
+      dist++;
     }
+}
 
-  /* Remove the old entry for this key if necessary.  */
-  if (index_valid (ht, idx, key))
-    locp_remove (ht, &ht->items[idx].value);
 
-  /* If we have not found an empty slot, maybe the last one we
-     looked at was empty (or just got deleted).  */
-  if (!index_empty (ht, first_free))
-    first_free = idx;
- 
-  if (index_empty (ht, first_free))
+/* Move up to COUNT elements of the old array of the hash table HT to
+   its current array, and free the old array if it is done.  The old
+   array is emptied from the start; removing an element may shift the
+   next one of its cluster into the same slot, which is then moved
+   too.  */
+static void
+migrate (hurd_ihash_t ht, size_t count)
+{
+  struct _hurd_ihash_item item;
+
+  while (count > 0 && ht->migrated < ht->old_size)
     {
-      ht->nr_items++;
-      ht->items[first_free].value = value;
-      ht->items[first_free].key = key;
+      if (ht->old_items[ht->migrated].value == _HURD_IHASH_EMPTY)
+	ht->migrated++;
+      else
+	{
+	  item = ht->old_items[ht->migrated];
+	  remove_index (ht, ht->old_items, ht->old_size, ht->migrated);
+	  add_one (ht, item.key, item.value);
+	}
+      count--;
+    }
+
+  if (ht->migrated == ht->old_size)
+    {
+      free (ht->old_items);
+      ht->old_items = NULL;
+      ht->old_size = 0;
+      ht->migrated = 0;
+    }
+}
 
-      if (ht->locp_offset != HURD_IHASH_NO_LOCP)
-	*((hurd_ihash_locp_t *) (((char *) value) + ht->locp_offset))
-	  = &ht->items[first_free].value;
 
-      return 1;
+/* Replace the array of the hash table HT by one with SIZE slots, and
+   move all elements to it at once.  */
+static error_t
+rehash (hurd_ihash_t ht, size_t size)
+{
+  struct hurd_ihash old_ht;
+  unsigned int i;
+
+  if (ht->old_items)
+    migrate (ht, SIZE_MAX);
+  old_ht = *ht;
+
+  /* calloc() will initialize all values to _HURD_IHASH_EMPTY implicitly.  */
+  ht->items = calloc (size, sizeof (struct _hurd_ihash_item));
+  if (ht->items == NULL)
+    {
+      *ht = old_ht;
+      return ENOMEM;
     }
+  ht->size = size;
+
+  /* We have to rehash the old entries.  */
+  for (i = 0; i < old_ht.size; i++)
+    if (old_ht.items[i].value != _HURD_IHASH_EMPTY)
+      add_one (ht, old_ht.items[i].key, old_ht.items[i].value);
+
+  if (old_ht.size > 0)
+    free (old_ht.items);
+
+  return 0;
+}
+
+
+/* Enlarge the hash table HT.  In incremental mode, the elements are
+   left in the old array and moved over by later additions.  */
+static error_t
+grow (hurd_ihash_t ht)
+{
+  _hurd_ihash_item_t items;
+  size_t size;
+
+  if (ht->size == 0)
+    size = HURD_IHASH_MIN_SIZE;
+  else
+    size = ht->size << 1;
+
+  if (!ht->incremental || ht->size == 0)
+    return rehash (ht, size);
+
+  /* An earlier enlargement is finished first.  This rarely does
+     anything, as the new array fills up much slower than the old
+     array is emptied.  */
+  if (ht->old_items)
+    migrate (ht, SIZE_MAX);
+
+  /* calloc() will initialize all values to _HURD_IHASH_EMPTY implicitly.  */
+  items = calloc (size, sizeof (struct _hurd_ihash_item));
+  if (items == NULL)
+    return ENOMEM;
 
+  ht->old_items = ht->items;
+  ht->old_size = ht->size;
+  ht->migrated = 0;
+  ht->items = items;
+  ht->size = size;
   return 0;
 }
 
@@ -253,65 +443,79 @@ add_one (hurd_ihash_t ht, hurd_ihash_key_t key, hurd_ihash_value_t value)
 error_t
 hurd_ihash_add (hurd_ihash_t ht, hurd_ihash_key_t key, hurd_ihash_value_t item)
 {
-  struct hurd_ihash old_ht = *ht;
-  int was_added;
-  unsigned int i;
+  hurd_ihash_locp_t locp;
+  error_t err;
 
-  if (ht->size)
+  if (ht->old_items)
     {
-      /* Only fill the hash table up to its maximum load factor.  */
-      if (hurd_ihash_get_load (ht) <= ht->max_load)
-	if (add_one (ht, key, item))
-	  return 0;
-    }
-
-  /* The hash table is too small, and we have to increase it.  */
-  ht->nr_items = 0;
-  if (ht->size == 0)
-      ht->size = HURD_IHASH_MIN_SIZE;
-  else
-      ht->size <<= 1;
+      migrate (ht, MIGRATE_STEP);
 
-  /* calloc() will initialize all values to _HURD_IHASH_EMPTY implicitly.  */
-  ht->items = calloc (ht->size, sizeof (struct _hurd_ihash_item));
+      /* Override the old entry for this key in place if it was not
+	 moved yet.  */
+      if (ht->old_items)
+	{
+	  int idx = find_index (ht->old_items, ht->old_size, key);
+	  if (idx >= 0)
+	    {
+	      locp = &ht->old_items[idx].value;
+	      if (ht->cleanup)
+		(*ht->cleanup) (*locp, ht->cleanup_data);
+	      *locp = item;
+	      set_locp (ht, (_hurd_ihash_item_t) locp);
+	      return 0;
+	    }
+	}
+    }
 
-  if (ht->items == NULL)
+  /* Only fill the hash table up to its maximum load factor, and never
+     completely, so that every probe ends at an empty slot.  */
+  if (ht->size == 0
+      || ((hurd_ihash_get_load (ht) > ht->max_load
+	   || ht->nr_items + 1 >= ht->size)
+	  && find_index (ht->items, ht->size, key) < 0))
     {
-      *ht = old_ht;
-      return ENOMEM;
+      /* The hash table is too small, and we have to increase it.  */
+      err = grow (ht);
+      if (err)
+	return err;
     }
 
-  /* We have to rehash the old entries.  */
-  for (i = 0; i < old_ht.size; i++)
-    if (!index_empty (&old_ht, i))
-      {
-	was_added = add_one (ht, old_ht.items[i].key, old_ht.items[i].value);
-	assert (was_added);
-      }
-
   /* Finally add the new element!  */
-  was_added = add_one (ht, key, item);
-  assert (was_added);
-
-  if (old_ht.size > 0)
-    free (old_ht.items);
+  if (add_one (ht, key, item))
+    ht->nr_items++;
 
   return 0;
 }
 
 
+/* Make room in the hash table HT for COUNT elements, so that adding
+   up to that many elements will not enlarge it.  If a memory
+   allocation error occurs, ENOMEM is returned, otherwise 0.  */
+error_t
+hurd_ihash_reserve (hurd_ihash_t ht, size_t count)
+{
+  size_t size = HURD_IHASH_MIN_SIZE;
+
+  /* Keep the load at most at the maximum load factor, and below 100%
+     so that probes always end.  */
+  while (count * 128 > size * ht->max_load || count >= size)
+    size <<= 1;
+
+  if (size <= ht->size)
+    return 0;
+
+  return rehash (ht, size);
+}
+
+
 /* Find and return the item in the hash table HT with key KEY, or NULL
    if it doesn't exist.  */
 hurd_ihash_value_t
 hurd_ihash_find (hurd_ihash_t ht, hurd_ihash_key_t key)
 {
-  if (ht->size == 0)
-    return NULL;
-  else
-    {
-      int idx = find_index (ht, key);
-      return index_valid (ht, idx, key) ? ht->items[idx].value : NULL;
-    }
+  hurd_ihash_locp_t locp = find_locp (ht, key);
+
+  return locp ? *locp : NULL;
 }
 
 
@@ -320,15 +524,12 @@ hurd_ihash_find (hurd_ihash_t ht, hurd_ihash_key_t key)
 int
 hurd_ihash_remove (hurd_ihash_t ht, hurd_ihash_key_t key)
 {
-  if (ht->size != 0)
+  hurd_ihash_locp_t locp = find_locp (ht, key);
+
+  if (locp)
     {
-      int idx = find_index (ht, key);
-      
-      if (index_valid (ht, idx, key))
-	{
-	  locp_remove (ht, &ht->items[idx].value);
-	  return 1;
-	}
+      locp_remove (ht, locp);
+      return 1;
     }
 
   return 0;
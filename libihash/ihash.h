@@ -33,11 +33,11 @@
    (hurd_ihash_value_t) ~0 are reserved for the implementation.  */
 typedef void *hurd_ihash_value_t;
 
-/* When an value entry in the hash table is _HURD_IHASH_EMPTY or
-   _HURD_IHASH_DELETED, then the location is available, and none of
-   the other members of the item are valid at that index.  The
-   difference is that searches continue though _HURD_IHASH_DELETED,
-   but stop at _HURD_IHASH_EMPTY.  */
+/* When an value entry in the hash table is _HURD_IHASH_EMPTY, then
+   the location is available, and none of the other members of the
+   item are valid at that index.  Removed elements do not leave
+   anything behind, so _HURD_IHASH_DELETED is not used anymore, but
+   the value stays reserved.  */
 #define _HURD_IHASH_EMPTY	((hurd_ihash_value_t) 0)
 #define _HURD_IHASH_DELETED	((hurd_ihash_value_t) -1)
 
@@ -87,6 +87,18 @@ struct hurd_ihash
      second argument.  This does not happen if CLEANUP is NULL.  */
   hurd_ihash_cleanup_t cleanup;
   void *cleanup_data;
+
+  /* While the hash table is being enlarged incrementally, the
+     elements which have not been moved to ITEMS yet are in OLD_ITEMS,
+     an array of length OLD_SIZE.  The slots below MIGRATED have been
+     moved already.  OLD_ITEMS is NULL otherwise.  */
+  _hurd_ihash_item_t old_items;
+  size_t old_size;
+  size_t migrated;
+
+  /* True if enlarging the hash table is spread over the following
+     additions.  */
+  int incremental;
 };
 typedef struct hurd_ihash *hurd_ihash_t;
 
@@ -108,7 +120,7 @@ typedef struct hurd_ihash *hurd_ihash_t;
 #define HURD_IHASH_INITIALIZER(locp_offs)				\
   { .nr_items = 0, .size = 0, .cleanup = (hurd_ihash_cleanup_t) 0,	\
     .max_load = HURD_IHASH_MAX_LOAD_DEFAULT,				\
-    .locp_offset = (locp_offs)}
+    .locp_offset = (locp_offs), .old_items = 0, .incremental = 1}
 
 /* Initialize the hash table at address HT.  If LOCP_OFFSET is not
    HURD_IHASH_NO_LOCP, then this is an offset (in bytes) from the
@@ -150,7 +162,7 @@ void hurd_ihash_set_cleanup (hurd_ihash_t ht, hurd_ihash_cleanup_t cleanup,
    hash table while the number of hashed elements is that much binary
    percent of the total size of the hash table.  If more elements are
    added, the hash table is first expanded and reorganized.  A
-   MAX_LOAD of 128 will always fill the whole table before enlarging
+   MAX_LOAD of 128 will fill all but one slot of the table before enlarging
    it, but note that this will increase the cost of operations
    significantly when the table is almost full.
 
@@ -159,6 +171,20 @@ void hurd_ihash_set_cleanup (hurd_ihash_t ht, hurd_ihash_cleanup_t cleanup,
    added to the hash table.  */
 void hurd_ihash_set_max_load (hurd_ihash_t ht, unsigned int max_load);
 
+/* Set whether the hash table HT is enlarged incrementally to
+   INCREMENTAL.  This is the default.  In this mode, enlarging the
+   hash table only allocates the new array, and each following
+   addition moves a bounded number of elements to it, instead of all
+   of them being moved at once.  This avoids long pauses in the
+   addition which happens to enlarge a large hash table, at the cost
+   of keeping the old array around a little longer.  */
+void hurd_ihash_set_incremental (hurd_ihash_t ht, int incremental);
+
+/* Make room in the hash table HT for COUNT elements, so that adding
+   up to that many elements will not enlarge it.  If a memory
+   allocation error occurs, ENOMEM is returned, otherwise 0.  */
+error_t hurd_ihash_reserve (hurd_ihash_t ht, size_t count);
+
 
 /* Get the current load factor of HT in binary percent, where 128b%
    corresponds to 100%.  The reason we do this is that it is so
@@ -195,6 +221,114 @@ error_t hurd_ihash_add (hurd_ihash_t ht, hurd_ihash_key_t key,
    if it doesn't exist.  */
 hurd_ihash_value_t hurd_ihash_find (hurd_ihash_t ht, hurd_ihash_key_t key);
 
+/* The iteration macros step through each array of a hash table
+   backwards, starting just below an empty slot and wrapping around to
+   it.  Removing an element shifts the following elements of its
+   cluster back by one slot, and a cluster never extends over an empty
+   slot, so the elements moved by removing the current one have all
+   been visited already, and none is missed or seen twice.  Every array
+   has an empty slot: the current one is never filled completely, and
+   the old one only loses elements.  In the old array, the slots which
+   have been moved already are all empty.  */
+
+/* Return the first empty slot of the array ITEMS of SIZE slots.  */
+static inline _hurd_ihash_item_t
+_hurd_ihash_empty_slot (_hurd_ihash_item_t items, size_t size)
+{
+  _hurd_ihash_item_t item;
+
+  for (item = items; item < &items[size] - 1; item++)
+    if (item->value == _HURD_IHASH_EMPTY)
+      break;
+  return item;
+}
+
+/* Return the first slot to visit in the array ITEMS of SIZE slots,
+   and set *END to the empty slot to stop at, or return NULL if there
+   are no other slots.  */
+static inline _hurd_ihash_item_t
+_hurd_ihash_first_in (_hurd_ihash_item_t items, size_t size,
+		      _hurd_ihash_item_t *end)
+{
+  *end = _hurd_ihash_empty_slot (items, size);
+  if (*end == items)
+    return size > 1 ? &items[size - 1] : 0;
+  return *end - 1;
+}
+
+/* Return the first slot to visit in the part of the old array of the
+   hash table HT which has not been moved yet, and set *END to the
+   empty slot to stop at, or return NULL if there is none.  */
+static inline _hurd_ihash_item_t
+_hurd_ihash_first_old (hurd_ihash_t ht, _hurd_ihash_item_t *end)
+{
+  if (! ht->old_items)
+    return 0;
+
+  if (ht->migrated == 0)
+    return _hurd_ihash_first_in (ht->old_items, ht->old_size, end);
+
+  *end = &ht->old_items[ht->migrated - 1];
+  return &ht->old_items[ht->old_size - 1];
+}
+
+/* Return the first slot of the hash table HT to visit, and set *END to
+   the slot to stop at, or return NULL if it has none.  */
+static inline _hurd_ihash_item_t
+_hurd_ihash_first (hurd_ihash_t ht, _hurd_ihash_item_t *end)
+{
+  _hurd_ihash_item_t item;
+
+  if (ht->size == 0)
+    return 0;
+
+  item = _hurd_ihash_first_in (ht->items, ht->size, end);
+  return item ? item : _hurd_ihash_first_old (ht, end);
+}
+
+/* Return the slot of the hash table HT to visit after ITEM, updating
+   *END as _hurd_ihash_first does, or NULL if ITEM is the last one.  */
+static inline _hurd_ihash_item_t
+_hurd_ihash_next (hurd_ihash_t ht, _hurd_ihash_item_t item,
+		  _hurd_ihash_item_t *end)
+{
+  int old = (ht->old_items
+	     && item >= ht->old_items
+	     && item < &ht->old_items[ht->old_size]);
+  _hurd_ihash_item_t items = old ? ht->old_items : ht->items;
+  size_t size = old ? ht->old_size : ht->size;
+
+  item = item == items ? &items[size - 1] : item - 1;
+  if (item != *end)
+    return item;
+
+  return old ? 0 : _hurd_ihash_first_old (ht, end);
+}
+
+/* The same as _hurd_ihash_first and _hurd_ihash_next, for
+   HURD_IHASH_ITERATE, which can only declare pointers to values.  */
+static inline hurd_ihash_value_t *
+_hurd_ihash_first_value (hurd_ihash_t ht, hurd_ihash_value_t *end)
+{
+  _hurd_ihash_item_t end_item;
+  _hurd_ihash_item_t item = _hurd_ihash_first (ht, &end_item);
+
+  *end = end_item;
+  return (hurd_ihash_value_t *) item;
+}
+
+static inline hurd_ihash_value_t *
+_hurd_ihash_next_value (hurd_ihash_t ht, hurd_ihash_value_t *valuep,
+			hurd_ihash_value_t *end)
+{
+  _hurd_ihash_item_t end_item = *end;
+  _hurd_ihash_item_t item =
+    _hurd_ihash_next (ht, (_hurd_ihash_item_t) valuep, &end_item);
+
+  *end = end_item;
+  return (hurd_ihash_value_t *) item;
+}
+
 /* Iterate over all elements in the hash table.  You use this macro
    with a block, for example like this:
 
@@ -215,7 +349,12 @@ hurd_ihash_value_t hurd_ihash_find (hurd_ihash_t ht, hurd_ihash_key_t key);
 
    The block will be run for every element in the hash table HT.  The
    value of the current element is available in the variable VALUE
-   (which is declared for you and local to the block).  */
+   (which is declared for you and local to the block).
+
+   The block may remove the current element from the hash table.  It
+   must not add elements, or remove others, unless it leaves the loop
+   right afterwards: those may move the elements around, so that some
+   are skipped or visited twice.  */
 
 /* The implementation of this macro is peculiar.  We want the macro to
    execute a block following its invocation, so we can only prepend
@@ -236,18 +375,23 @@ hurd_ihash_value_t hurd_ihash_find (hurd_ihash_t ht, hurd_ihash_key_t key);
    after the loop condition is checked (but of course the value the
    pointer pointed to must not have an influence on the condition
    result, so the comma operator is used to make sure this
-   subexpression is always true).  */
+   subexpression is always true).
+
+   While the hash table is enlarged incrementally, its elements are in
+   two arrays.  _hurd_ihash_first and _hurd_ihash_next step through
+   ITEMS first, and then through the part of OLD_ITEMS which has not
+   been moved yet.  The slot to stop at in the current array is kept
+   in a third variable, _HURD_IHASH_END.  */
 #define HURD_IHASH_ITERATE(ht, val)					\
-  for (hurd_ihash_value_t val,						\
-         *_hurd_ihash_valuep = (ht)->size ? &(ht)->items[0].value : 0;	\
-       (ht)->size							\
-	 && (size_t) ((_hurd_ihash_item_t) _hurd_ihash_valuep		\
-		      - &(ht)->items[0])				\
-            < (ht)->size						\
+  for (hurd_ihash_value_t val, _hurd_ihash_end,			\
+         *_hurd_ihash_valuep =						\
+	   _hurd_ihash_first_value ((ht), &_hurd_ihash_end);		\
+       _hurd_ihash_valuep						\
          && (val = *_hurd_ihash_valuep, 1);				\
-       _hurd_ihash_valuep = (hurd_ihash_value_t *)			\
-	 (((_hurd_ihash_item_t) _hurd_ihash_valuep) + 1))		\
-    if (val != _HURD_IHASH_EMPTY && val != _HURD_IHASH_DELETED)
+       _hurd_ihash_valuep =						\
+	 _hurd_ihash_next_value ((ht), _hurd_ihash_valuep,		\
+				 &_hurd_ihash_end))			\
+    if (val != _HURD_IHASH_EMPTY)
 
 /* Iterate over all elements in the hash table making both the key and
    the value available.  You use this macro with a block, for example
@@ -258,13 +402,14 @@ hurd_ihash_value_t hurd_ihash_find (hurd_ihash_t ht, hurd_ihash_key_t key);
 
    The block will be run for every element in the hash table HT.  The
    key and value of the current element is available as ITEM->key and
-   ITEM->value.  */
+   ITEM->value.  The same restrictions as for HURD_IHASH_ITERATE
+   apply.  */
 #define HURD_IHASH_ITERATE_ITEMS(ht, item)                              \
-  for (_hurd_ihash_item_t item = (ht)->size? &(ht)->items[0]: 0;	\
-       (ht)->size && item - &(ht)->items[0] < (ht)->size;               \
-       item++)                                                          \
-    if (item->value != _HURD_IHASH_EMPTY &&                             \
-        item->value != _HURD_IHASH_DELETED)
+  for (_hurd_ihash_item_t _hurd_ihash_end,				\
+         item = _hurd_ihash_first ((ht), &_hurd_ihash_end);		\
+       item;								\
+       item = _hurd_ihash_next ((ht), item, &_hurd_ihash_end))	\
+    if (item->value != _HURD_IHASH_EMPTY)
 
 /* Remove the entry with the key KEY from the hash table HT.  If such
    an entry was found and removed, 1 is returned, otherwise 0.  */
@@ -75,3 +75,12 @@ netfs_S_fsys_startup (mach_port_t bootstrap,
 {
   return EOPNOTSUPP;
 }
+
+error_t
+netfs_S_fsys_get_statistics (struct netfs_control *cntl,
+			     mach_port_t reply,
+			     mach_msg_type_name_t reply_type,
+			     char **data, mach_msg_type_number_t *datalen)
+{
+  return EOPNOTSUPP;
+}
@@ -0,0 +1,73 @@
+/* Clustered page-in for pager library
+   Copyright (C) 2014 Free Software Foundation
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include "priv.h"
+
+/* Pagemap bits which make a page unsuitable for being read as part of
+   a cluster it was not explicitly requested for.  */
+#define PM_NOCLUSTER (PM_INCORE | PM_PAGINGOUT | PM_INVALID)
+
+/* Allow P to read up to SIZE bytes in response to a single fault.  */
+void
+pager_set_cluster_size (struct pager *p, vm_size_t size)
+{
+  size = trunc_page (size);
+  if (size < vm_page_size)
+    size = vm_page_size;
+
+  pthread_mutex_lock (&p->interlock);
+  p->cluster_size = size;
+  pthread_mutex_unlock (&p->interlock);
+}
+
+/* P is locked, and the page at OFFSET is about to be read.  Find how
+   many of the pages following it can be read along with it, mark them
+   as being in core, and return the length of the whole run, including
+   the page at OFFSET.  */
+vm_size_t
+_pager_cluster_extent (struct pager *p, vm_offset_t offset)
+{
+  vm_size_t length = vm_page_size;
+  short *pm_entry;
+
+  if (p->cluster_size <= vm_page_size
+      || _pager_pagemap_resize (p, offset + p->cluster_size))
+    return length;
+
+  pm_entry = &p->pagemap[offset / vm_page_size + 1];
+  while (length < p->cluster_size
+	 && ! (*pm_entry & PM_NOCLUSTER)
+	 && PM_NEXTERROR (*pm_entry) == PAGE_NOERR)
+    {
+      *pm_entry++ |= PM_INCORE;
+      length += vm_page_size;
+    }
+
+  return length;
+}
+
+/* P is locked.  The pages from START to END were marked by
+   _pager_cluster_extent, but will not be given to the kernel after
+   all.  */
+void
+_pager_cluster_release (struct pager *p, vm_offset_t start, vm_offset_t end)
+{
+  short *pm_entry = &p->pagemap[start / vm_page_size];
+
+  for (; start < end; start += vm_page_size)
+    *pm_entry++ &= ~PM_INCORE;
+}
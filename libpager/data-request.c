@@ -1,5 +1,5 @@
 /* Implementation of memory_object_data_request for pager library
-   Copyright (C) 1994,95,96,97,2000,02,10 Free Software Foundation
+   Copyright (C) 1994,95,96,97,2000,02,10,14 Free Software Foundation
 
    This program is free software; you can redistribute it and/or
    modify it under the terms of the GNU General Public License as
@@ -19,6 +19,7 @@
 #include "memory_object_S.h"
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
 
 /* Implement pagein callback as described in <mach/memory_object.defs>. */
 kern_return_t
@@ -32,6 +33,7 @@ _pager_S_memory_object_data_request (struct pager *p,
   int doread, doerror;
   error_t err;
   vm_address_t page;
+  vm_size_t cluster, read_length;
   int write_lock;
 
   if (!p
@@ -41,7 +43,8 @@ _pager_S_memory_object_data_request (struct pager *p,
   /* Acquire the right to meddle with the pagemap */
   pthread_mutex_lock (&p->interlock);
 
-  /* sanity checks -- we don't do multi-page requests yet.  */
+  /* sanity checks -- the kernel asks for one page at a time; any
+     clustering is done by us below.  */
   if (control != p->memobjcntl)
     {
       printf ("incg data request: wrong control port\n");
@@ -102,6 +105,14 @@ _pager_S_memory_object_data_request (struct pager *p,
       doread = 0;
     }
 
+  /* See whether the pages following this one can be read along with
+     it.  This may resize the pagemap, so PM_ENTRY is invalid after
+     this point.  */
+  if (doread && !doerror)
+    cluster = _pager_cluster_extent (p, offset);
+  else
+    cluster = length;
+
   /* Let someone else in.  */
   pthread_mutex_unlock (&p->interlock);
 
@@ -110,16 +121,40 @@ _pager_S_memory_object_data_request (struct pager *p,
   if (doerror)
     goto error_read;
 
-  err = pager_read_page (p->upi, offset, &page, &write_lock);
+  err = EOPNOTSUPP;
+  if (cluster > length)
+    {
+      read_length = cluster;
+      err = pager_read_pages (p->upi, offset, &read_length,
+			      &page, &write_lock);
+      if (!err)
+	assert (read_length >= length && read_length <= cluster
+		&& read_length % vm_page_size == 0);
+    }
+  if (err == EOPNOTSUPP)
+    {
+      read_length = length;
+      err = pager_read_page (p->upi, offset, &page, &write_lock);
+    }
+
+  if (err || read_length < cluster)
+    {
+      /* Some of the pages we marked won't be supplied after all.  */
+      pthread_mutex_lock (&p->interlock);
+      _pager_cluster_release (p, offset + (err ? length : read_length),
+			      offset + cluster);
+      pthread_mutex_unlock (&p->interlock);
+    }
+
   if (err)
     goto error_read;
 
-  memory_object_data_supply (p->memobjcntl, offset, page, length, 1,
+  memory_object_data_supply (p->memobjcntl, offset, page, read_length, 1,
 			     write_lock ? VM_PROT_WRITE : VM_PROT_NONE,
 			     p->notify_on_evict ? 1 : 0,
 			     MACH_PORT_NULL);
   pthread_mutex_lock (&p->interlock);
-  _pager_mark_object_error (p, offset, length, 0);
+  _pager_mark_object_error (p, offset, read_length, 0);
   _pager_allow_termination (p);
   pthread_mutex_unlock (&p->interlock);
   return 0;
@@ -1,5 +1,5 @@
 /* Implementation of memory_object_data_return for pager library
-   Copyright (C) 1994,95,96,99,2000,02 Free Software Foundation, Inc.
+   Copyright (C) 1994,95,96,99,2000,02,14 Free Software Foundation, Inc.
 
    This program is free software; you can redistribute it and/or
    modify it under the terms of the GNU General Public License as
@@ -36,7 +36,7 @@ _pager_do_write_request (struct pager *p,
 			 int initializing)
 {
   short *pm_entries;
-  int npages, i;
+  int npages, i, j, k;
   char *notified;
   error_t *pagerrs;
   struct lock_request *lr;
@@ -52,7 +52,7 @@ _pager_do_write_request (struct pager *p,
   /* Acquire the right to meddle with the pagemap */
   pthread_mutex_lock (&p->interlock);
 
-  /* sanity checks -- we don't do multi-page requests yet.  */
+  /* sanity checks */
   if (control != p->memobjcntl)
     {
       printf ("incg data return: wrong control port\n");
@@ -158,14 +158,37 @@ _pager_do_write_request (struct pager *p,
   /* Let someone else in. */
   pthread_mutex_unlock (&p->interlock);
 
-  /* This is inefficient; we should send all the pages to the device at once
-     but until the pager library interface is changed, this will have to do. */
+  /* Send each run of pages we have to write to the user at once, if
+     it is prepared to take them; otherwise fall back to writing them
+     one at a time.  */
+  for (i = 0; i < npages; i = j)
+    {
+      error_t err;
 
-  for (i = 0; i < npages; i++)
-    if (!(omitdata & (1 << i)))
-      pagerrs[i] = pager_write_page (p->upi,
-				     offset + (vm_page_size * i),
-				     data + (vm_page_size * i));
+      if (omitdata & (1 << i))
+	{
+	  j = i + 1;
+	  continue;
+	}
+
+      for (j = i + 1; j < npages && !(omitdata & (1 << j)); j++)
+	;
+
+      err = EOPNOTSUPP;
+      if (j - i > 1)
+	err = pager_write_pages (p->upi,
+				 offset + (vm_page_size * i),
+				 vm_page_size * (j - i),
+				 data + (vm_page_size * i));
+      if (err == EOPNOTSUPP)
+	for (k = i; k < j; k++)
+	  pagerrs[k] = pager_write_page (p->upi,
+					 offset + (vm_page_size * k),
+					 data + (vm_page_size * k));
+      else
+	for (k = i; k < j; k++)
+	  pagerrs[k] = err;
+    }
 
   /* Acquire the right to meddle with the pagemap */
   pthread_mutex_lock (&p->interlock);
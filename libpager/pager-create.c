@@ -46,6 +46,7 @@ pager_create (struct user_pager_info *upi,
   p->termwaiting = 0;
   p->pagemap = 0;
   p->pagemapsize = 0;
+  p->cluster_size = vm_page_size;
 
   return p;
 }
@@ -117,6 +117,15 @@ pager_change_attributes (struct pager *pager,
 			 memory_object_copy_strategy_t copy_strategy,
 			 int wait);
 
+/* Allow pager PAGER to read up to SIZE bytes (rounded down to a whole
+   number of pages, and at least one page) in response to a single page
+   fault, by supplying the pages following the faulting one along with
+   it.  The additional pages are only read if the kernel does not
+   already have them, and only if the user defines pager_read_pages.  */
+void
+pager_set_cluster_size (struct pager *pager,
+			vm_size_t size);
+
 /* Return the port (receive right) for requests to the pager.  It is
    absolutely necessary that a new send right be created from this
    receive right.  */
@@ -167,6 +176,34 @@ pager_write_page (struct user_pager_info *pager,
 		  vm_offset_t page,
 		  vm_address_t buf);
 
+/* The user may define this function.  For pager PAGER, read the run of
+   contiguous pages starting at offset START.  On entry, *LENGTH is the
+   size of the run the pager library would like to have (a multiple of
+   the page size); it may be reduced to any smaller multiple of the page
+   size, but never below one page.  Set *BUF to be the address of the
+   *LENGTH bytes read, and set *WRITE_LOCK if the pages must be provided
+   read-only.  The default definition returns EOPNOTSUPP, in which case
+   pager_read_page is used instead; otherwise the only permissible error
+   returns are as for pager_read_page.  */
+error_t
+pager_read_pages (struct user_pager_info *pager,
+		  vm_offset_t start,
+		  vm_size_t *length,
+		  vm_address_t *buf,
+		  int *write_lock);
+
+/* The user may define this function.  For pager PAGER, synchronously
+   write the LENGTH bytes of contiguous pages at BUF to offset START.
+   The default definition returns EOPNOTSUPP, in which case
+   pager_write_page is called for each page instead; otherwise the only
+   permissible error returns are as for pager_write_page, and an error
+   applies to every page in the run.  */
+error_t
+pager_write_pages (struct user_pager_info *pager,
+		   vm_offset_t start,
+		   vm_size_t length,
+		   vm_address_t buf);
+
 /* The user must define this function.  A page should be made writable. */
 error_t
 pager_unlock_page (struct user_pager_info *pager,
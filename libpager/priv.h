@@ -67,6 +67,8 @@ struct pager
 
   short *pagemap;
   int pagemapsize;		/* number of elements in PAGEMAP */
+
+  vm_size_t cluster_size;	/* largest run read by one data request */
 };
 
 struct lock_request
@@ -142,5 +144,7 @@ void _pager_lock_object (struct pager *, vm_offset_t, vm_size_t, int, int,
 			 vm_prot_t, int);
 void _pager_free_structure (struct pager *);
 void _pager_clean (void *arg);
+vm_size_t _pager_cluster_extent (struct pager *, vm_offset_t);
+void _pager_cluster_release (struct pager *, vm_offset_t, vm_offset_t);
 void _pager_real_dropweak (void *arg);
 #endif
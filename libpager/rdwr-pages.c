@@ -0,0 +1,37 @@
+/* Default versions of pager_read_pages and pager_write_pages
+   Copyright (C) 2014 Free Software Foundation
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include "priv.h"
+
+error_t __attribute__ ((weak))
+pager_read_pages (struct user_pager_info *pager,
+		  vm_offset_t start,
+		  vm_size_t *length,
+		  vm_address_t *buf,
+		  int *write_lock)
+{
+  return EOPNOTSUPP;
+}
+
+error_t __attribute__ ((weak))
+pager_write_pages (struct user_pager_info *pager,
+		   vm_offset_t start,
+		   vm_size_t length,
+		   vm_address_t buf)
+{
+  return EOPNOTSUPP;
+}
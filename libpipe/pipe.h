@@ -25,6 +25,7 @@
 
 #include <pthread.h>		/* For conditions & mutexes */
 #include <features.h>
+#include <sys/types.h>		/* For loff_t */
 
 #ifdef PIPE_DEFINE_EI
 #define PIPE_EI
@@ -118,6 +119,8 @@ struct pipe
 
 /* Pipe flags.  */
 #define PIPE_BROKEN	0x1	/* This pipe isn't connected.  */
+#define PIPE_SPLICE_OUT	0x2	/* Data is being spliced out of this pipe.  */
+#define PIPE_SPLICE_IN	0x4	/* Data is being spliced into this pipe.  */
 
 
 extern size_t pipe_readable (struct pipe *pipe, int data_only);
@@ -170,11 +173,14 @@ pipe_is_readable (struct pipe *pipe, int data_only)
 /* Waits for PIPE to be readable, or an error to occur.  If NOBLOCK is true,
    this operation will return EWOULDBLOCK instead of blocking when no data is
    immediately available.  If DATA_ONLY is true, then `control' packets are
-   ignored.  */
+   ignored.  While data is being spliced out of PIPE, it isn't readable by
+   anyone else.  */
 PIPE_EI error_t
 pipe_wait_readable (struct pipe *pipe, int noblock, int data_only)
 {
-  while (! pipe_is_readable (pipe, data_only) && ! (pipe->flags & PIPE_BROKEN))
+  while ((pipe->flags & PIPE_SPLICE_OUT)
+	 || (! pipe_is_readable (pipe, data_only)
+	     && ! (pipe->flags & PIPE_BROKEN)))
     {
       if (noblock)
 	return EWOULDBLOCK;
@@ -204,14 +210,15 @@ pipe_select_readable (struct pipe *pipe, struct timespec *tsp, int data_only)
 
 /* Block until data can be written to PIPE.  If NOBLOCK is true, then
    EWOULDBLOCK is returned instead of blocking if this can't be done
-   immediately.  */
+   immediately.  While data is being spliced into PIPE, it isn't writable by
+   anyone else.  */
 PIPE_EI error_t
 pipe_wait_writable (struct pipe *pipe, int noblock)
 {
   size_t limit = pipe->write_limit;
   if (pipe->flags & PIPE_BROKEN)
     return EPIPE;
-  while (pipe_readable (pipe, 1) >= limit)
+  while ((pipe->flags & PIPE_SPLICE_IN) || pipe_readable (pipe, 1) >= limit)
     {
       if (noblock)
 	return EWOULDBLOCK;
@@ -420,6 +427,29 @@ error_t pipe_recv (struct pipe *pipe, int noblock, unsigned *flags,
 #define pipe_read(pipe, noblock, source, data, data_len, amount) \
   pipe_recv (pipe, noblock, 0, source, data, data_len, amount, 0,0,0,0)
 
+/* Writes up to AMOUNT bytes of data from PIPE, which should be locked, to
+   the io object FILE at OFFSET, or at FILE's file pointer if OFFSET is -1,
+   and returns the amount moved in MOVED.  NOBLOCK is as for pipe_read.
+   PIPE is unlocked while FILE is written to, but no one else can read from
+   it meanwhile, and only what FILE accepted is then removed.  Large amounts
+   go from PIPE to FILE without being copied.  Only stream pipes are
+   supported.  */
+error_t pipe_splice_to_io (struct pipe *pipe, int noblock,
+			   mach_port_t file, loff_t offset,
+			   size_t amount, size_t *moved);
+
+/* Reads up to AMOUNT bytes from the io object FILE at OFFSET, or at FILE's
+   file pointer if OFFSET is -1, and writes them to PIPE, which should be
+   locked, returning the amount moved in MOVED.  NOBLOCK is as for
+   pipe_write.  PIPE is unlocked while FILE is read from, but no one else
+   can write to it meanwhile, and no more is read than PIPE can then hold.
+   When FILE provides a memory object and OFFSET is page-aligned, the data
+   is mapped from it and goes into PIPE without being copied.  Only stream
+   pipes are supported.  */
+error_t pipe_splice_from_io (struct pipe *pipe, int noblock,
+			     mach_port_t file, loff_t offset,
+			     size_t amount, size_t *moved);
+
 /* Hold this lock before attempting to lock multiple pipes. */
 extern pthread_mutex_t pipe_multiple_lock;
 
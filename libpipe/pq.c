@@ -136,6 +136,7 @@ pq_queue (struct pq *pq, unsigned type, void *source)
 
   packet->num_ports = 0;
   packet->buf_start = packet->buf_end = packet->buf;
+  packet->buf_wrapped = 0;
 
   packet->type = type;
   packet->source = source;
@@ -152,12 +153,36 @@ pq_queue (struct pq *pq, unsigned type, void *source)
 
 /* ---------------------------------------------------------------- */
 
+/* Copy LEN bytes from SRC to DST, which should both be page-aligned.  Whole
+   pages are copied with vm_copy, which shares them copy-on-write instead of
+   touching every byte; only a trailing partial page is copied by hand.  */
+static void
+page_copy (char *dst, char *src, size_t len)
+{
+  size_t pages = trunc_page (len);
+
+  if (pages > 0
+      && vm_copy (mach_task_self (),
+		  (vm_address_t)src, pages, (vm_address_t)dst) == 0)
+    {
+      src += pages;
+      dst += pages;
+      len -= pages;
+    }
+
+  memcpy (dst, src, len);
+}
+
 /* Returns a legal size to which PACKET can be set allowing enough room for
    EXTRA bytes more than what's already in it, and perhaps more.  */
 size_t
 packet_new_size (struct packet *packet, size_t extra)
 {
-  size_t new_len = (packet->buf_end - packet->buf) + extra;
+  size_t new_len = extra;
+  if (packet->buf_wrapped)
+    new_len += packet_readable (packet);
+  else
+    new_len += packet->buf_end - packet->buf;
   if (packet->buf_vm_alloced || new_len >= PACKET_SIZE_LARGE)
     /* Round NEW_LEN up to a page boundary (OLD_LEN should already be).  */
     return round_page (new_len);
@@ -180,6 +205,11 @@ packet_extend (struct packet *packet, size_t new_len)
     /* No existing buffer to extend.  */
     return 0;
 
+  if (packet->buf_wrapped)
+    /* The data at the end of the buffer would have to be moved to the end
+       of the extension.  */
+    return 0;
+
   if (packet->buf_vm_alloced)
     /* A vm_alloc'd packet.  */
     {
@@ -243,15 +273,30 @@ packet_realloc (struct packet *packet, size_t new_len)
     {
       size_t old_len = packet->buf_len;
       char *start = packet->buf_start, *end = packet->buf_end;
+      size_t readable = packet_readable (packet);
+      char *new_start = new_buf;
 
       /* Copy what we must.  */
-      if (end != start)
-	/* If there was an operation like vm_move, we could use that in the
-	   case where both the old and the new buffers were vm_alloced (on
-	   the assumption that creating COW pages is somewhat more costly).
-	   But there's not, and memcpy may do vm_copy where it can.  Will we
-	   still takes faults on the new copy, even though we've deallocated
-	   the old one???  XXX */
+      if (packet->buf_wrapped)
+	/* Straighten out the ring.  */
+	{
+	  size_t first = old_buf + old_len - start;
+	  memcpy (new_buf, start, first);
+	  memcpy (new_buf + first, old_buf, end - old_buf);
+	}
+      else if (vm_alloc && packet->buf_vm_alloced
+	       && end - start >= vm_page_size)
+	/* Both buffers are vm_alloced, so share the old pages with the new
+	   buffer instead of copying them; as the old buffer is deallocated
+	   right below, nothing is ever actually copied.  The data keeps its
+	   offset within the first page, which NEW_LEN has room for, as it
+	   counts from the start of the old buffer.  */
+	{
+	  char *page = (char *)trunc_page (start);
+	  page_copy (new_buf, page, end - page);
+	  new_start += start - page;
+	}
+      else if (end != start)
 	memcpy (new_buf, start, end - start);
 
       /* And get rid of the old buffer.  */
@@ -266,8 +311,9 @@ packet_realloc (struct packet *packet, size_t new_len)
       packet->buf = new_buf;
       packet->buf_len = new_len;
       packet->buf_vm_alloced = vm_alloc;
-      packet->buf_start = new_buf;
-      packet->buf_end = new_buf + (end - start);
+      packet->buf_start = new_start;
+      packet->buf_end = new_start + readable;
+      packet->buf_wrapped = 0;
     }
 
   return err;
@@ -335,14 +381,96 @@ error_t
 packet_write (struct packet *packet,
 	      char *data, size_t data_len, size_t *amount)
 {
-  error_t err = packet_ensure (packet, data_len);
+  if (data_len >= PACKET_SIZE_LARGE
+      && packet_readable (packet) == 0
+      && trunc_page (data) == (vm_address_t)data)
+    /* A large page-aligned buffer, most likely received out-of-line, going
+       into an empty packet: take its pages by reference rather than copying
+       them.  Readers get them back the same way from packet_read, so bulk
+       data goes through the pipe without ever being copied.  */
+    {
+      size_t new_len = round_page (data_len);
 
-  if (err)
-    return err;
+      if (! (packet->buf_len >= new_len && packet->buf_vm_alloced))
+	{
+	  char *new_buf =
+	    mmap (0, new_len, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+	  if (new_buf == (char *) -1)
+	    return errno;
+
+	  if (packet->buf_len > 0)
+	    {
+	      if (packet->buf_vm_alloced)
+		munmap (packet->buf, packet->buf_len);
+	      else
+		free (packet->buf);
+	    }
+
+	  packet->buf = new_buf;
+	  packet->buf_len = new_len;
+	  packet->buf_vm_alloced = 1;
+	}
+
+      page_copy (packet->buf, data, data_len);
+      packet->buf_start = packet->buf;
+      packet->buf_end = packet->buf + data_len;
+    }
+  else
+    {
+      error_t err = packet_ensure (packet, data_len);
+
+      if (err)
+	return err;
+
+      /* Add the new data.  */
+      memcpy (packet->buf_end, data, data_len);
+      packet->buf_end += data_len;
+    }
+  if (amount != NULL)
+    *amount = data_len;
+
+  return 0;
+}
+
+/* Append the bytes in DATA, of length DATA_LEN, to what's already in PACKET,
+   like packet_write, but if there's not enough room at the end of PACKET's
+   buffer and there is at its beginning, wrap around to it instead of moving
+   the data or growing the buffer.  */
+error_t
+packet_write_ring (struct packet *packet,
+		   char *data, size_t data_len, size_t *amount)
+{
+  char *buf = packet->buf, *end = packet->buf_end;
+  size_t buf_len = packet->buf_len;
+  size_t readable = packet_readable (packet);
+
+  if (buf_len == 0 || buf_len - readable <= data_len)
+    /* There's no buffer yet, or not enough room in it.  Keeping a byte free
+       means that BUF_START == BUF_END only when PACKET is empty.  A
+       vm_allocated buffer can wrap as well, as packet_fetch only hands out
+       its pages while the data doesn't.  */
+    return packet_write (packet, data, data_len, amount);
+
+  if (readable == 0)
+    /* Start again at the beginning, to wrap around as late as possible.  */
+    end = packet->buf_start = buf;
+
+  if (packet->buf_wrapped || end + data_len <= buf + buf_len)
+    /* It fits before BUF_START, or before the end of the buffer.  */
+    {
+      memcpy (end, data, data_len);
+      packet->buf_end = end + data_len;
+    }
+  else
+    /* Fill up the end of the buffer, and put the rest at its beginning.  */
+    {
+      size_t first = buf + buf_len - end;
+      memcpy (end, data, first);
+      memcpy (buf, data + first, data_len - first);
+      packet->buf_end = buf + data_len - first;
+      packet->buf_wrapped = 1;
+    }
 
-  /* Add the new data.  */
-  memcpy (packet->buf_end, data, data_len);
-  packet->buf_end += data_len;
   if (amount != NULL)
     *amount = data_len;
 
@@ -360,14 +488,43 @@ packet_fetch (struct packet *packet,
   char *start = packet->buf_start;
   char *end = packet->buf_end;
 
-  if (amount > end - start)
-    amount = end - start;
+  if (amount > packet_readable (packet))
+    amount = packet_readable (packet);
 
   if (amount > 0)
     {
       char *buf = packet->buf;
 
-      if (remove && packet->buf_vm_alloced && amount >= vm_page_size)
+      if (packet->buf_wrapped)
+	/* Copy the data from the end of the buffer, and then from its
+	   beginning if need be.  */
+	{
+	  size_t first = buf + packet->buf_len - start;
+
+	  if (*data_len < amount)
+	    *data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+
+	  if (amount < first)
+	    {
+	      memcpy (*data, start, amount);
+	      start += amount;
+	    }
+	  else
+	    {
+	      memcpy (*data, start, first);
+	      memcpy (*data + first, buf, amount - first);
+	      start = buf + amount - first;
+	    }
+
+	  if (remove)
+	    {
+	      packet->buf_start = start;
+	      if (start <= end)
+		/* We've read past the end of the buffer.  */
+		packet->buf_wrapped = 0;
+	    }
+	}
+      else if (remove && packet->buf_vm_alloced && amount >= vm_page_size)
 	/* We can return memory from BUF directly without copying.  */
 	{
 	  if (buf + vm_page_size <= start)
@@ -408,10 +565,26 @@ packet_fetch (struct packet *packet,
       else
 	/* Just copy the data the old fashioned way....  */
 	{
-	  if (*data_len < amount)
-	    *data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+	  if (*data_len < amount && packet->buf_vm_alloced
+	      && amount >= vm_page_size)
+	    /* A large peek: share the pages with the new buffer instead,
+	       keeping the data at the same offset within its first page.  */
+	    {
+	      size_t offs = start - (char *)trunc_page (start);
+	      char *pages = mmap (0, offs + amount,
+				  PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+	      if (pages == (char *) -1)
+		return errno;
+	      page_copy (pages, start - offs, offs + amount);
+	      *data = pages + offs;
+	    }
+	  else
+	    {
+	      if (*data_len < amount)
+		*data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
 
-	  memcpy (*data, start, amount);
+	      memcpy (*data, start, amount);
+	    }
 	  start += amount;
 
 	  if (remove && start - buf > 2 * PACKET_SIZE_LARGE)
@@ -50,6 +50,10 @@ struct packet
   /* True if BUF was allocated using vm_allocate rather than malloc; only
      valid if BUF_LEN > 0.  */
   int buf_vm_alloced;
+  /* True if BUF is being used as a ring, and the data has wrapped around
+     its end: it runs from BUF_START to the end of BUF, and then from BUF to
+     BUF_END.  Only packet_write_ring wraps data.  */
+  int buf_wrapped;
 
   /* Port data */
   mach_port_t *ports;
@@ -81,7 +85,10 @@ extern size_t packet_readable (struct packet *packet);
 PQ_EI size_t
 packet_readable (struct packet *packet)
 {
-  return packet->buf_end - packet->buf_start;
+  size_t readable = packet->buf_end - packet->buf_start;
+  if (packet->buf_wrapped)
+    readable += packet->buf_len;
+  return readable;
 }
 
 #endif /* Use extern inlines.  */
@@ -91,6 +98,13 @@ packet_readable (struct packet *packet)
 error_t packet_write (struct packet *packet,
 		      char *data, size_t data_len, size_t *amount);
 
+/* Append the bytes in DATA, of length DATA_LEN, to what's already in PACKET,
+   like packet_write, but if there's not enough room at the end of PACKET's
+   buffer and there is at its beginning, wrap around to it instead of moving
+   the data or growing the buffer.  */
+error_t packet_write_ring (struct packet *packet,
+			   char *data, size_t data_len, size_t *amount);
+
 /* Removes up to AMOUNT bytes from the beginning of the data in PACKET, and
    puts it into *DATA, and the amount read into DATA_LEN.  If more than the
    original *DATA_LEN bytes are available, new memory is vm_allocated, and
@@ -164,6 +178,11 @@ packet_fit (struct packet *packet, size_t amount)
   size_t buf_len = packet->buf_len;
   size_t left = buf + buf_len - end; /* Free space at the end of the buffer. */
 
+  if (packet->buf_wrapped)
+    /* The free space is in the middle of the buffer; packet_realloc
+       straightens it out.  */
+    return 0;
+
   if (amount > left)
     {
       char *start = packet->buf_start;
@@ -214,7 +233,7 @@ packet_ensure_efficiently (struct packet *packet, size_t amount)
       size_t new_len = packet_new_size (packet, amount);
       if (packet_extend (packet, new_len))
 	return 1;
-      if ((packet->buf_end - packet->buf_start) < PACKET_SIZE_LARGE)
+      if (packet_readable (packet) < PACKET_SIZE_LARGE)
 	return packet_realloc (packet, new_len) == 0;
     }
   return 0;
@@ -0,0 +1,206 @@
+/* Moving data between pipes and io objects
+
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <hurd/io.h>
+
+#include "pipe.h"
+
+/* Writes up to AMOUNT bytes of data from PIPE, which should be locked, to
+   FILE at OFFSET, or at FILE's file pointer if OFFSET is -1, and returns the
+   amount moved in MOVED.  */
+error_t
+pipe_splice_to_io (struct pipe *pipe, int noblock, mach_port_t file,
+		   loff_t offset, size_t amount, size_t *moved)
+{
+  error_t err;
+  struct packet *packet;
+  char *data = 0, *buf;
+  size_t data_len = 0, len;
+  vm_size_t written;
+
+  if (pipe->class != stream_pipe_class)
+    return EOPNOTSUPP;
+
+  err = pipe_wait_readable (pipe, noblock, 1);
+  if (err)
+    return err;
+
+  /* Skip any control packets, as pipe_read does.  */
+  packet = pq_head (pipe->queue, PACKET_TYPE_ANY, 0);
+  while (packet && packet->type == PACKET_TYPE_CONTROL)
+    packet = pq_next (pipe->queue, PACKET_TYPE_ANY, 0);
+
+  if (! packet)
+    /* EOF.  */
+    {
+      *moved = 0;
+      return 0;
+    }
+
+  /* Large amounts are peeked at by sharing the pages of the packet, so
+     they are not copied here, and io_write passes them on the same way.  */
+  err = packet_peek (packet, &data, &data_len, amount);
+  if (err)
+    return err;
+
+  /* FILE may take its time, and may even be waiting for another pipe
+     spliced to us, so PIPE isn't kept locked while it is written to.
+     Keep everyone else from reading PIPE meanwhile instead, so that what
+     FILE took is still at the head of PIPE to be removed afterwards.  */
+  pipe->flags |= PIPE_SPLICE_OUT;
+  pthread_mutex_unlock (&pipe->lock);
+  err = io_write (file, data, data_len, offset, &written);
+  pthread_mutex_lock (&pipe->lock);
+  pipe->flags &= ~PIPE_SPLICE_OUT;
+
+  if (! err)
+    {
+      /* Now remove the data FILE took from PIPE.  Reading it back into
+	 DATA costs at most a small copy, and wakes up any writers.  */
+      buf = data;
+      len = data_len;
+      err = pipe_read (pipe, 1, NULL, &buf, &len, written);
+      if (buf != data)
+	vm_deallocate (mach_task_self (), (vm_address_t) buf, len);
+      if (! err)
+	*moved = written;
+    }
+
+  /* Let in the readers kept waiting.  */
+  pthread_cond_broadcast (&pipe->pending_reads);
+
+  if (data_len > 0)
+    vm_deallocate (mach_task_self (), (vm_address_t) data, data_len);
+
+  return err;
+}
+
+/* Reads up to AMOUNT bytes from FILE at OFFSET, or at FILE's file pointer
+   if OFFSET is -1, into *DATA, which is vm_allocated, and returns their
+   number in *DATA_LEN.  When possible, FILE's memory object is mapped
+   rather than copying the data through io_read.  */
+static error_t
+read_io (io_t file, loff_t offset, char **data, size_t *data_len,
+	 size_t amount)
+{
+  error_t err;
+  loff_t pos = offset;
+  io_statbuf_t st;
+  mach_port_t rdobj, wrobj;
+
+  if (amount >= PACKET_SIZE_LARGE
+      && (pos != -1 || io_seek (file, 0, SEEK_CUR, &pos) == 0)
+      && trunc_page (pos) == pos
+      && io_stat (file, &st) == 0 && S_ISREG (st.st_mode)
+      && pos < st.st_size
+      && io_map (file, &rdobj, &wrobj) == 0)
+    {
+      if (wrobj != MACH_PORT_NULL)
+	mach_port_deallocate (mach_task_self (), wrobj);
+
+      if (rdobj != MACH_PORT_NULL)
+	{
+	  vm_address_t addr = 0;
+
+	  if (amount > st.st_size - pos)
+	    amount = st.st_size - pos;
+
+	  /* Map a copy of the pages, which shares them with FILE until
+	     either side writes to them.  */
+	  err = vm_map (mach_task_self (), &addr, amount, 0, 1,
+			rdobj, pos, 1, VM_PROT_READ, VM_PROT_READ,
+			VM_INHERIT_NONE);
+	  mach_port_deallocate (mach_task_self (), rdobj);
+
+	  if (! err && offset == -1)
+	    /* Advance the file pointer as io_read would.  */
+	    {
+	      err = io_seek (file, pos + amount, SEEK_SET, &pos);
+	      if (err)
+		vm_deallocate (mach_task_self (), addr, amount);
+	    }
+
+	  if (! err)
+	    {
+	      *data = (char *) addr;
+	      *data_len = amount;
+	      return 0;
+	    }
+	}
+    }
+
+  *data = 0;
+  *data_len = 0;
+  return io_read (file, data, data_len, offset, amount);
+}
+
+/* Reads up to AMOUNT bytes from FILE at OFFSET, or at FILE's file pointer
+   if OFFSET is -1, and writes them to PIPE, which should be locked,
+   returning the amount moved in MOVED.  */
+error_t
+pipe_splice_from_io (struct pipe *pipe, int noblock, mach_port_t file,
+		     loff_t offset, size_t amount, size_t *moved)
+{
+  error_t err;
+  char *data;
+  size_t data_len, left;
+
+  if (pipe->class != stream_pipe_class)
+    return EOPNOTSUPP;
+
+  err = pipe_wait_writable (pipe, noblock);
+  if (err)
+    return err;
+
+  /* Don't take more from FILE than PIPE can hold without blocking, as it
+     would be lost if the write then failed.  */
+  left = pipe->write_limit - pipe_readable (pipe, 1);
+  if (amount > left)
+    amount = left;
+
+  /* As in pipe_splice_to_io, PIPE isn't kept locked while FILE is read
+     from, but everyone else is kept from writing to it, so that the room
+     for the data is still there afterwards.  A large, page-aligned read is
+     taken into PIPE by reference.  */
+  pipe->flags |= PIPE_SPLICE_IN;
+  pthread_mutex_unlock (&pipe->lock);
+  err = read_io (file, offset, &data, &data_len, amount);
+  pthread_mutex_lock (&pipe->lock);
+  pipe->flags &= ~PIPE_SPLICE_IN;
+
+  if (! err)
+    {
+      if (data_len == 0)
+	/* EOF.  */
+	*moved = 0;
+      else
+	{
+	  err = pipe_write (pipe, noblock, NULL, data, data_len, moved);
+	  vm_deallocate (mach_task_self (), (vm_address_t) data, data_len);
+	}
+    }
+
+  /* Let in the writers kept waiting.  */
+  pthread_cond_broadcast (&pipe->pending_writes);
+
+  return err;
+}
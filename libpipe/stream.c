@@ -39,15 +39,23 @@ stream_write (struct pq *pq, void *source,
 
   if (packet_readable (packet) > 0
       && data_len > PACKET_SIZE_LARGE
-      && (! page_aligned (data - packet->buf_end)
+      && (page_aligned ((vm_offset_t)data)
+	  || ! page_aligned (data - packet->buf_end)
 	  || ! packet_ensure_efficiently (packet, data_len)))
-    /* Put a large page-aligned transfer in its own packet, if it's
-       page-aligned `differently' than the end of the current packet, or if
-       the current packet can't be extended in place.  */
+    /* Put a large transfer in its own packet if it's page-aligned, so that
+       packet_write can take its pages by reference instead of copying
+       them, or if it's page-aligned `differently' than the end of the
+       current packet, or if the current packet can't be extended in
+       place.  */
     packet = pq_queue (pq, PACKET_TYPE_DATA, source);
 
   if (!packet)
     return ENOBUFS;
+  else if (data_len <= PACKET_SIZE_LARGE)
+    /* Small writes go into the buffer of the last packet, used as a ring,
+       so a pipe that is read about as fast as it's written keeps reusing
+       the same buffer.  */
+    return packet_write_ring (packet, data, data_len, amount);
   else
     return packet_write (packet, data, data_len, amount);
 }
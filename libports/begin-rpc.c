@@ -104,5 +104,11 @@ ports_begin_rpc (void *portstruct, mach_msg_id_t msg_id, struct rpc_info *info)
 
   pthread_mutex_unlock (&_ports_lock);
 
+  info->msg_id = msg_id;
+  if (msg_id && __atomic_load_n (&_ports_rpc_stats_enabled, __ATOMIC_RELAXED))
+    gettimeofday (&info->start, NULL);
+  else
+    info->start.tv_sec = -1;
+
   return 0;
 }
@@ -22,6 +22,7 @@
 #include <stddef.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <hurd/ihash.h>
 
 struct port_bucket *
@@ -48,5 +49,6 @@ ports_create_bucket ()
 
   hurd_ihash_init (&ret->htable, offsetof (struct port_info, hentry));
   ret->rpcs = ret->flags = ret->count = 0;
+  memset (&ret->threads, 0, sizeof ret->threads);
   return ret;
 }
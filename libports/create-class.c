@@ -41,6 +41,7 @@ ports_create_class (void (*clean_routine)(void *),
   cl->rpcs = 0;
   cl->count = 0;
   cl->uninhibitable_rpcs = ports_default_uninhibitable_rpcs;
+  cl->lane = NULL;
 
   return cl;
 }
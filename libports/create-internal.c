@@ -103,7 +103,7 @@ _ports_create_port_internal (struct port_class *class,
   if (install)
     {
       err = mach_port_move_member (mach_task_self (), pi->port_right,
-				   bucket->portset);
+				   ports_get_portset (pi));
       if (err)
 	goto lose_unlocked;
     }
@@ -0,0 +1,52 @@
+/* Create a new lane of a port bucket.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+#include "ports.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct port_lane *
+ports_create_lane (struct port_bucket *bucket, int priority)
+{
+  struct port_lane *lane;
+  error_t err;
+
+  lane = malloc (sizeof (struct port_lane));
+  if (! lane)
+    {
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  err = mach_port_allocate (mach_task_self (), MACH_PORT_RIGHT_PORT_SET,
+			    &lane->portset);
+  if (err)
+    {
+      errno = err;
+      free (lane);
+      return NULL;
+    }
+
+  lane->bucket = bucket;
+  lane->priority = priority;
+  memset (&lane->threads, 0, sizeof lane->threads);
+  return lane;
+}
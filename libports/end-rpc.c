@@ -25,6 +25,9 @@ ports_end_rpc (void *port, struct rpc_info *info)
 {
   struct port_info *pi = port;
 
+  if (info->start.tv_sec != -1)
+    _ports_record_rpc (info);
+
   pthread_mutex_lock (&_ports_lock);
 
   if (info->notifies)
@@ -94,7 +94,7 @@ ports_import_port (struct port_class *class, struct port_bucket *bucket,
   class->count++;
   pthread_mutex_unlock (&_ports_lock);
   
-  mach_port_move_member (mach_task_self (), port, bucket->portset);
+  mach_port_move_member (mach_task_self (), port, ports_get_portset (pi));
 
   if (stat.mps_srights)
     {
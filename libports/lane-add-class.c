@@ -0,0 +1,37 @@
+/* Serve the ports of a class from a lane.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+
+#include "ports.h"
+#include <errno.h>
+
+error_t
+ports_lane_add_class (struct port_lane *lane, struct port_class *class)
+{
+  error_t err = 0;
+
+  pthread_mutex_lock (&_ports_lock);
+  if (class->lane && class->lane != lane)
+    err = EBUSY;
+  else
+    class->lane = lane;
+  pthread_mutex_unlock (&_ports_lock);
+
+  return err;
+}
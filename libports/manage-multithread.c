@@ -38,9 +38,9 @@
    lock is also implicitely depressed.
 
    Then, if permitted, a greater priority is requested to further decrease
-   the need for additional threads. */
+   the need for additional threads, or PRIORITY if it is not -1. */
 static void
-adjust_priority (unsigned int totalthreads)
+adjust_priority (unsigned int totalthreads, int priority)
 {
   mach_port_t host_priv, self, pset, pset_priv;
   unsigned int t;
@@ -71,7 +71,7 @@ adjust_priority (unsigned int totalthreads)
   if (err)
     goto error_max_priority;
 
-  err = thread_priority (self, THREAD_PRI, 0);
+  err = thread_priority (self, priority == -1 ? THREAD_PRI : priority, 0);
   if (err)
     goto error_priority;
 
@@ -94,18 +94,34 @@ error_host_priv:
     error (0, err, "unable to adjust libports thread priority");
 }
 
-void
-ports_manage_port_operations_multithread (struct port_bucket *bucket,
-					  ports_demuxer_type demuxer,
-					  int thread_timeout,
-					  int global_timeout,
-					  void (*hook)())
+/* Record that there are NTHREADS of THREADS now.  */
+static void
+note_peak (struct ports_threads *threads, unsigned int nthreads)
 {
-  /* totalthreads is the number of total threads created.  nreqthreads
-     is the number of threads not currently servicing any client.  The
-     initial values account for the main thread.  */
-  unsigned int totalthreads = 1;
-  unsigned int nreqthreads = 1;
+  unsigned int peak = __atomic_load_n (&threads->peak_threads,
+				       __ATOMIC_RELAXED);
+
+  while (nthreads > peak
+	 && ! __atomic_compare_exchange_n (&threads->peak_threads, &peak,
+					   nthreads, 0, __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED))
+    ;
+}
+
+/* Handle the operations for the ports of BUCKET in PORTSET with
+   THREADS, which run at PRIORITY.  The other arguments are as for
+   ports_manage_port_operations_multithread.  */
+static void
+manage_multithread (struct port_bucket *bucket, mach_port_t portset,
+		    struct ports_threads *threads, int priority,
+		    ports_demuxer_type demuxer, int thread_timeout,
+		    int global_timeout, void (*hook)())
+{
+  /* THREADS->nthreads is the number of total threads created.
+     THREADS->nidle_threads is the number of threads not currently
+     servicing any client.  Account for the main thread.  */
+  unsigned int *totalthreads = &threads->nthreads;
+  unsigned int *nreqthreads = &threads->nidle_threads;
 
   pthread_attr_t attr;
 
@@ -132,30 +148,44 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 		/* msgt_unused = */		0
 	};
 
-      if (__atomic_sub_fetch (&nreqthreads, 1, __ATOMIC_RELAXED) == 0)
-	/* No thread would be listening for requests, spawn one. */
+      if (__atomic_sub_fetch (nreqthreads, 1, __ATOMIC_RELAXED) == 0)
+	/* No thread would be listening for requests, spawn one, unless
+	   there are as many as allowed already.  In that case, the next
+	   requests stay queued until one is done.  */
 	{
+	  unsigned int max = __atomic_load_n (&threads->max_threads,
+					      __ATOMIC_RELAXED);
+	  unsigned int total;
 	  pthread_t pthread_id;
 	  error_t err;
 
-	  __atomic_add_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
-	  __atomic_add_fetch (&nreqthreads, 1, __ATOMIC_RELAXED);
-
-	  err = pthread_create (&pthread_id, &attr, thread_function, NULL);
-	  if (!err)
-	    pthread_detach (pthread_id);
+	  total = __atomic_add_fetch (totalthreads, 1, __ATOMIC_RELAXED);
+	  if (max && total > max)
+	    {
+	      __atomic_sub_fetch (totalthreads, 1, __ATOMIC_RELAXED);
+	      __atomic_add_fetch (&threads->queued_rpcs, 1, __ATOMIC_RELAXED);
+	    }
 	  else
 	    {
-	      __atomic_sub_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
-	      __atomic_sub_fetch (&nreqthreads, 1, __ATOMIC_RELAXED);
-	      /* There is not much we can do at this point.  The code
-		 and design of the Hurd servers just don't handle
-		 thread creation failure.  */
-	      errno = err;
-	      perror ("pthread_create");
+	      __atomic_add_fetch (nreqthreads, 1, __ATOMIC_RELAXED);
+	      note_peak (threads, total);
+
+	      err = pthread_create (&pthread_id, &attr, thread_function, NULL);
+	      if (!err)
+		pthread_detach (pthread_id);
+	      else
+		{
+		  __atomic_sub_fetch (totalthreads, 1, __ATOMIC_RELAXED);
+		  __atomic_sub_fetch (nreqthreads, 1, __ATOMIC_RELAXED);
+		  /* There is not much we can do at this point.  The code
+		     and design of the Hurd servers just don't handle
+		     thread creation failure.  */
+		  errno = err;
+		  perror ("pthread_create");
+		}
 	    }
 	}
-      
+
       /* Fill in default response. */
       outp->Head.msgh_bits 
 	= MACH_MSGH_BITS(MACH_MSGH_BITS_REMOTE(inp->msgh_bits), 0);
@@ -195,7 +225,7 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 	  status = 1;
 	}
 
-      __atomic_add_fetch (&nreqthreads, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch (nreqthreads, 1, __ATOMIC_RELAXED);
 
       return status;
     }
@@ -207,7 +237,8 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
       int timeout;
       error_t err;
 
-      adjust_priority (__atomic_load_n (&totalthreads, __ATOMIC_RELAXED));
+      adjust_priority (__atomic_load_n (totalthreads, __ATOMIC_RELAXED),
+		       priority);
 
       if (hook)
 	(*hook) ();
@@ -220,25 +251,27 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
     startover:
 
       do
-	err = mach_msg_server_timeout (internal_demuxer, 0, bucket->portset,
+	err = mach_msg_server_timeout (internal_demuxer, 0, portset,
 				       timeout ? MACH_RCV_TIMEOUT : 0,
 				       timeout);
       while (err != MACH_RCV_TIMED_OUT);
 
       if (master)
 	{
-	  if (__atomic_load_n (&totalthreads, __ATOMIC_RELAXED) != 1)
+	  if (__atomic_load_n (totalthreads, __ATOMIC_RELAXED) != 1)
 	    goto startover;
+	  __atomic_sub_fetch (totalthreads, 1, __ATOMIC_RELAXED);
+	  __atomic_sub_fetch (nreqthreads, 1, __ATOMIC_RELAXED);
 	}
       else
 	{
-	  if (__atomic_sub_fetch (&nreqthreads, 1, __ATOMIC_RELAXED) == 0)
+	  if (__atomic_sub_fetch (nreqthreads, 1, __ATOMIC_RELAXED) == 0)
 	    {
 	      /* No other thread is listening for requests, continue. */
-	      __atomic_add_fetch (&nreqthreads, 1, __ATOMIC_RELAXED);
+	      __atomic_add_fetch (nreqthreads, 1, __ATOMIC_RELAXED);
 	      goto startover;
 	    }
-	  __atomic_sub_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
+	  __atomic_sub_fetch (totalthreads, 1, __ATOMIC_RELAXED);
 	}
       return NULL;
     }
@@ -249,5 +282,32 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
      master thread from going away.  */
   global_timeout = 0;
 
+  __atomic_add_fetch (totalthreads, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (nreqthreads, 1, __ATOMIC_RELAXED);
+  note_peak (threads, __atomic_load_n (totalthreads, __ATOMIC_RELAXED));
+
   thread_function ((void *) 1);
 }
+
+void
+ports_manage_port_operations_multithread (struct port_bucket *bucket,
+					  ports_demuxer_type demuxer,
+					  int thread_timeout,
+					  int global_timeout,
+					  void (*hook)())
+{
+  manage_multithread (bucket, bucket->portset, &bucket->threads, -1,
+		      demuxer, thread_timeout, global_timeout, hook);
+}
+
+void
+ports_manage_lane_operations_multithread (struct port_lane *lane,
+					  ports_demuxer_type demuxer,
+					  int thread_timeout,
+					  int global_timeout,
+					  void (*hook)())
+{
+  manage_multithread (lane->bucket, lane->portset, &lane->threads,
+		      lane->priority, demuxer, thread_timeout,
+		      global_timeout, hook);
+}
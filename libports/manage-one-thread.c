@@ -20,6 +20,11 @@
 
 #include "ports.h"
 
+/* This serves the port set of BUCKET only, and not those of its lanes.
+   A single thread can only wait on one port set, and all RPCs wait for
+   each other anyway, so a lane could not get its ports served any
+   sooner; lanes are for multithreaded servers only.  */
+
 void
 ports_manage_port_operations_one_thread (struct port_bucket *bucket,
 					 ports_demuxer_type demuxer,
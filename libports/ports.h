@@ -28,6 +28,7 @@
 #include <mach/notify.h>
 #include <pthread.h>
 #include <refcount.h>
+#include <sys/time.h>
 
 #ifdef PORTS_DEFINE_EI
 #define PORTS_EI
@@ -64,6 +65,23 @@ typedef struct port_info *port_info_t;
 #define PORT_BLOCKED		PORTS_BLOCKED
 #define PORT_INHIBIT_WAIT	PORTS_INHIBIT_WAIT
 
+/* The threads ports_manage_port_operations_multithread runs for a
+   port set.  MAX_THREADS is the limit on their number, or zero if
+   there is none.  NTHREADS is their number, and NIDLE_THREADS the
+   number of them waiting for a message; PEAK_THREADS is the highest
+   NTHREADS so far.  QUEUED_RPCS counts the times the last idle thread
+   took a message while no other could be created because of the
+   limit; later messages had to wait in the port queue.  All are
+   accessed atomically.  */
+struct ports_threads
+{
+  unsigned int max_threads;
+  unsigned int nthreads;
+  unsigned int nidle_threads;
+  unsigned int peak_threads;
+  unsigned long queued_rpcs;
+};
+
 struct port_bucket
 {
   mach_port_t portset;
@@ -73,6 +91,7 @@ struct port_bucket
   int rpcs;
   int flags;
   int count;
+  struct ports_threads threads;
 };
 /* FLAGS above are the following: */
 #define PORT_BUCKET_INHIBITED	PORTS_INHIBITED
@@ -81,6 +100,20 @@ struct port_bucket
 #define PORT_BUCKET_NO_ALLOC	PORTS_NO_ALLOC
 #define PORT_BUCKET_ALLOC_WAIT	PORTS_ALLOC_WAIT
 
+/* A lane is a port set of its own for the ports of some classes of a
+   bucket, so that they are served by their own threads, and RPCs on
+   them do not wait behind those on the other ports of the bucket.
+   The ports stay in the bucket for all other purposes.  */
+struct port_lane
+{
+  struct port_bucket *bucket;
+  mach_port_t portset;
+  /* The Mach scheduling priority of the threads serving the lane, or
+     -1 for the default.  */
+  int priority;
+  struct ports_threads threads;
+};
+
 struct port_class
 {
   int flags;
@@ -89,6 +122,9 @@ struct port_class
   void (*clean_routine) (void *);
   void (*dropweak_routine) (void *);
   struct ports_msg_id_range *uninhibitable_rpcs;
+  /* The lane serving the ports of this class in the lane's bucket, or
+     null if they are served with the other ports of their bucket.  */
+  struct port_lane *lane;
 };
 /* FLAGS are the following: */
 #define PORT_CLASS_INHIBITED	PORTS_INHIBITED
@@ -103,6 +139,12 @@ struct rpc_info
   struct rpc_info *next, **prevp;
   struct rpc_notify *notifies;
   struct rpc_info *interrupted_next;
+
+  /* The message id of the RPC, and the time it began if RPC
+     statistics were being collected then (START.tv_sec is -1
+     otherwise).  */
+  mach_msg_id_t msg_id;
+  struct timeval start;
 };
 
 /* An rpc has requested interruption on a port notification.  */
@@ -186,6 +228,26 @@ ports_create_port_noinstall (struct port_class *class,
 			     size_t size,
 			     void *result);
 
+/* Return the portset the port PORT is to be in.  This is the portset
+   of the lane of its class if the lane is in the bucket of PORT, and
+   the portset of its bucket otherwise.  */
+extern mach_port_t ports_get_portset (void *port);
+
+/* Create and return a new lane of BUCKET, whose threads run at the
+   Mach scheduling priority PRIORITY, or at the default priority if
+   PRIORITY is -1.  Lanes are only for multithreaded servers: the ports
+   of a lane are not served by ports_manage_port_operations_one_thread,
+   so a bucket served that way must not have any.  */
+struct port_lane *ports_create_lane (struct port_bucket *bucket,
+				     int priority);
+
+/* Serve the ports of CLASS in the bucket of LANE from LANE.  The
+   ports of CLASS in other buckets are not affected.  This must be done
+   before any port of CLASS is created.  A class can be in one lane
+   only; EBUSY is returned if CLASS is in another one already.  */
+error_t ports_lane_add_class (struct port_lane *lane,
+			      struct port_class *class);
+
 /* For an existing RECEIVE right, create and return in RESULT a new port
    structure; BUCKET, SIZE, and CLASS args are as for ports_create_port. */
 error_t ports_import_port (struct port_class *class,
@@ -274,6 +336,17 @@ ports_lookup_payload (struct port_bucket *bucket,
   return pi;
 }
 
+PORTS_EI mach_port_t
+ports_get_portset (void *port)
+{
+  struct port_info *pi = port;
+  struct port_lane *lane = pi->class->lane;
+
+  if (lane && lane->bucket == pi->bucket)
+    return lane->portset;
+  return pi->bucket->portset;
+}
+
 PORTS_EI mach_port_t
 ports_payload_get_name (unsigned int payload)
 {
@@ -351,10 +424,57 @@ error_t ports_begin_rpc (void *port, mach_msg_id_t msg_id,
    paired call to ports_begin_rpc. */
 void ports_end_rpc (void *port, struct rpc_info *info);
 
+/* RPC statistics.  While enabled, ports_end_rpc records how many RPCs
+   with each message id were done, and how long they took from
+   ports_begin_rpc on.  RPCs begun with a message id of zero are not
+   recorded.  The number of RPCs in progress on the ports of a class
+   is always available in its RPCS member.  */
+
+/* The number of slots in the latency histogram.  */
+#define PORTS_RPC_HISTOGRAM_SIZE 16
+
+/* The statistics of the RPCs with one message id.  */
+struct ports_rpc_stats
+{
+  mach_msg_id_t msg_id;
+  unsigned long count;
+  unsigned long long total_us;	/* Total time taken, in microseconds.  */
+  unsigned long long max_us;	/* Longest time taken.  */
+
+  /* HISTOGRAM[0] counts the RPCs which took less than two
+     microseconds, HISTOGRAM[I] the ones which took at least 2^I and
+     less than 2^(I+1) microseconds, and the last slot all longer
+     ones.  */
+  unsigned long histogram[PORTS_RPC_HISTOGRAM_SIZE];
+};
+
+/* Start collecting RPC statistics if ENABLE is nonzero, and stop
+   otherwise.  What was collected so far is kept.  */
+void ports_enable_rpc_stats (int enable);
+
+/* Return nonzero if RPC statistics are being collected.  */
+int ports_rpc_stats_enabled (void);
+
+/* Forget the RPC statistics collected so far.  */
+void ports_reset_rpc_stats (void);
+
+/* Return the RPC statistics collected so far in a newly malloced
+   array in *STATS, sorted by message id, and its length in
+   *COUNT.  */
+error_t ports_get_rpc_stats (struct ports_rpc_stats **stats, size_t *count);
+
+/* Return the RPC statistics collected so far as text in a newly
+   malloced buffer in *TEXT of length *LEN, one line per message id.
+   Each line starts with `rpc', followed by NAME=VALUE pairs for the
+   message id, the count, the total and maximum time in microseconds,
+   and the histogram as a comma separated list.  */
+error_t ports_format_rpc_stats (char **text, size_t *len);
+
 /* Begin handling operations for the ports in BUCKET, calling DEMUXER
    for each incoming message.  Return if TIMEOUT is nonzero and no
    messages have been received for TIMEOUT milliseconds.  Use
-   only one thread (the calling thread).  */
+   only one thread (the calling thread).  The ports in lanes of BUCKET
+   are not served.  */
 void ports_manage_port_operations_one_thread(struct port_bucket *bucket,
 					     ports_demuxer_type demuxer,
 					     int timeout);
@@ -366,6 +486,7 @@ void ports_manage_port_operations_one_thread(struct port_bucket *bucket,
    port is starved because of sluggishness on another port.  If
    LOCAL_TIMEOUT is non-zero, then individual threads will die off if
    they handle no incoming messages for LOCAL_TIMEOUT milliseconds.
+   No more threads than allowed by ports_set_max_threads are created.
    HOOK (if not null) will be called in each new thread immediately
    after it is created. */
 void ports_manage_port_operations_multithread (struct port_bucket *bucket,
@@ -374,6 +495,49 @@ void ports_manage_port_operations_multithread (struct port_bucket *bucket,
 					       int global_timeout,
 					       void (*hook)(void));
 
+/* Like ports_manage_port_operations_multithread, but handle
+   operations for the ports in LANE only.  The ports in the bucket of
+   LANE which are not in a lane are not served by this.  Each server
+   thread runs at the priority of LANE.  */
+void ports_manage_lane_operations_multithread (struct port_lane *lane,
+					       ports_demuxer_type demuxer,
+					       int thread_timeout,
+					       int global_timeout,
+					       void (*hook)(void));
+
+/* Limit the number of threads ports_manage_port_operations_multithread
+   runs for BUCKET to MAX_THREADS, or lift the limit if MAX_THREADS is
+   zero, which is the default.  Once the limit is reached, incoming
+   messages wait in the port queue until a thread is done with its
+   current one.  The limit must be large enough for the server not to
+   deadlock if all threads are blocked in RPCs waiting for each
+   other.  */
+void ports_set_max_threads (struct port_bucket *bucket,
+			    unsigned int max_threads);
+
+/* Like ports_set_max_threads, but for the threads serving LANE.  */
+void ports_set_lane_max_threads (struct port_lane *lane,
+				 unsigned int max_threads);
+
+/* Statistics about the threads serving a bucket.  */
+struct ports_thread_stats
+{
+  unsigned int max;		/* Limit, or zero if none.  */
+  unsigned int active;		/* Threads handling a message.  */
+  unsigned int idle;		/* Threads waiting for a message.  */
+  unsigned int peak;		/* Highest number of threads so far.  */
+  unsigned long queued;		/* Times the limit kept a thread from
+				   being created.  */
+};
+
+/* Fill STATS with the statistics about the threads serving BUCKET.  */
+void ports_get_thread_stats (struct port_bucket *bucket,
+			     struct ports_thread_stats *stats);
+
+/* Fill STATS with the statistics about the threads serving LANE.  */
+void ports_get_lane_thread_stats (struct port_lane *lane,
+				  struct ports_thread_stats *stats);
+
 /* Interrupt any pending RPC on PORT.  Wait for all pending RPC's to
    finish, and then block any new RPC's starting on that port. */
 error_t ports_inhibit_port_rpcs (void *port);
@@ -470,6 +634,8 @@ extern pthread_rwlock_t _ports_htable_lock;
 
 extern int _ports_total_rpcs;
 extern int _ports_flags;
+extern int _ports_rpc_stats_enabled;
+void _ports_record_rpc (struct rpc_info *info);
 #define _PORTS_INHIBITED	PORTS_INHIBITED
 #define _PORTS_BLOCKED		PORTS_BLOCKED
 #define _PORTS_INHIBIT_WAIT	PORTS_INHIBIT_WAIT
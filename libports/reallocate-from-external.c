@@ -71,7 +71,7 @@ ports_reallocate_from_external (void *portstruct, mach_port_t receive)
   pthread_mutex_unlock (&_ports_lock);
   assert_perror (err);
 
-  mach_port_move_member (mach_task_self (), receive, pi->bucket->portset);
+  mach_port_move_member (mach_task_self (), receive, ports_get_portset (pi));
   
   if (stat.mps_srights)
     {
@@ -60,7 +60,7 @@ ports_reallocate_port (void *portstruct)
   assert_perror (err);
 
   err = mach_port_move_member (mach_task_self (), pi->port_right, 
-			       pi->bucket->portset);
+			       ports_get_portset (pi));
   assert_perror (err);
 
   if (dropref)
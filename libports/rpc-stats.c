@@ -0,0 +1,168 @@
+/* Per message id RPC statistics.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#include "ports.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <hurd/ihash.h>
+
+int _ports_rpc_stats_enabled;
+
+/* The statistics, each a malloced struct ports_rpc_stats keyed by its
+   message id, protected by STATS_LOCK.  */
+static struct hurd_ihash stats_table =
+  HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void
+ports_enable_rpc_stats (int enable)
+{
+  __atomic_store_n (&_ports_rpc_stats_enabled, !!enable, __ATOMIC_RELAXED);
+}
+
+int
+ports_rpc_stats_enabled (void)
+{
+  return __atomic_load_n (&_ports_rpc_stats_enabled, __ATOMIC_RELAXED);
+}
+
+void
+ports_reset_rpc_stats (void)
+{
+  pthread_mutex_lock (&stats_lock);
+  HURD_IHASH_ITERATE (&stats_table, value)
+    free (value);
+  hurd_ihash_destroy (&stats_table);
+  hurd_ihash_init (&stats_table, HURD_IHASH_NO_LOCP);
+  pthread_mutex_unlock (&stats_lock);
+}
+
+/* Record the RPC described by INFO, which is ending now.  */
+void
+_ports_record_rpc (struct rpc_info *info)
+{
+  struct ports_rpc_stats *stats;
+  struct timeval now;
+  uint64_t us;
+  int slot;
+
+  gettimeofday (&now, NULL);
+  if (timercmp (&now, &info->start, <))
+    /* The clock was set back.  */
+    us = 0;
+  else
+    us = ((uint64_t) (now.tv_sec - info->start.tv_sec) * 1000000
+	  + now.tv_usec - info->start.tv_usec);
+
+  slot = us < 2 ? 0 : 63 - __builtin_clzll (us);
+  if (slot >= PORTS_RPC_HISTOGRAM_SIZE)
+    slot = PORTS_RPC_HISTOGRAM_SIZE - 1;
+
+  pthread_mutex_lock (&stats_lock);
+  stats = hurd_ihash_find (&stats_table, (hurd_ihash_key_t) info->msg_id);
+  if (! stats)
+    {
+      stats = calloc (1, sizeof *stats);
+      if (! stats
+	  || hurd_ihash_add (&stats_table,
+			     (hurd_ihash_key_t) info->msg_id, stats))
+	{
+	  /* Statistics are not worth failing the RPC for.  */
+	  free (stats);
+	  pthread_mutex_unlock (&stats_lock);
+	  return;
+	}
+      stats->msg_id = info->msg_id;
+    }
+
+  stats->count++;
+  stats->total_us += us;
+  if (us > stats->max_us)
+    stats->max_us = us;
+  stats->histogram[slot]++;
+  pthread_mutex_unlock (&stats_lock);
+}
+
+static int
+compare_msg_ids (const void *a, const void *b)
+{
+  const struct ports_rpc_stats *x = a, *y = b;
+  return x->msg_id < y->msg_id ? -1 : x->msg_id > y->msg_id;
+}
+
+error_t
+ports_get_rpc_stats (struct ports_rpc_stats **stats, size_t *count)
+{
+  struct ports_rpc_stats *p;
+
+  pthread_mutex_lock (&stats_lock);
+  *count = stats_table.nr_items;
+  *stats = malloc ((*count ?: 1) * sizeof **stats);
+  if (! *stats)
+    {
+      pthread_mutex_unlock (&stats_lock);
+      return ENOMEM;
+    }
+
+  p = *stats;
+  HURD_IHASH_ITERATE (&stats_table, value)
+    *p++ = *(struct ports_rpc_stats *) value;
+  pthread_mutex_unlock (&stats_lock);
+
+  qsort (*stats, *count, sizeof **stats, compare_msg_ids);
+  return 0;
+}
+
+error_t
+ports_format_rpc_stats (char **text, size_t *len)
+{
+  struct ports_rpc_stats *stats;
+  size_t count, i;
+  FILE *f;
+  error_t err;
+  int j;
+
+  err = ports_get_rpc_stats (&stats, &count);
+  if (err)
+    return err;
+
+  f = open_memstream (text, len);
+  if (! f)
+    {
+      free (stats);
+      return errno;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      fprintf (f, "rpc msgid=%d count=%lu total-us=%llu max-us=%llu"
+	       " histogram=", stats[i].msg_id, stats[i].count,
+	       stats[i].total_us, stats[i].max_us);
+      for (j = 0; j < PORTS_RPC_HISTOGRAM_SIZE; j++)
+	fprintf (f, j ? ",%lu" : "%lu", stats[i].histogram[j]);
+      putc ('\n', f);
+    }
+
+  free (stats);
+  if (fclose (f))
+    return errno;
+  return 0;
+}
@@ -0,0 +1,69 @@
+/* Limit and statistics of the threads serving a bucket or lane.
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#include "ports.h"
+
+/* Fill STATS with the statistics of THREADS.  */
+static void
+get_stats (struct ports_threads *threads, struct ports_thread_stats *stats)
+{
+  unsigned int nthreads, nidle;
+
+  nthreads = __atomic_load_n (&threads->nthreads, __ATOMIC_RELAXED);
+  nidle = __atomic_load_n (&threads->nidle_threads, __ATOMIC_RELAXED);
+
+  /* The two are not read at once, and NIDLE_THREADS briefly drops
+     below its real value while a thread decides whether to exit.  */
+  if (nidle > nthreads)
+    nidle = nthreads;
+
+  stats->max = __atomic_load_n (&threads->max_threads, __ATOMIC_RELAXED);
+  stats->active = nthreads - nidle;
+  stats->idle = nidle;
+  stats->peak = __atomic_load_n (&threads->peak_threads, __ATOMIC_RELAXED);
+  stats->queued = __atomic_load_n (&threads->queued_rpcs, __ATOMIC_RELAXED);
+}
+
+void
+ports_set_max_threads (struct port_bucket *bucket, unsigned int max_threads)
+{
+  __atomic_store_n (&bucket->threads.max_threads, max_threads,
+		    __ATOMIC_RELAXED);
+}
+
+void
+ports_set_lane_max_threads (struct port_lane *lane, unsigned int max_threads)
+{
+  __atomic_store_n (&lane->threads.max_threads, max_threads,
+		    __ATOMIC_RELAXED);
+}
+
+void
+ports_get_thread_stats (struct port_bucket *bucket,
+			struct ports_thread_stats *stats)
+{
+  get_stats (&bucket->threads, stats);
+}
+
+void
+ports_get_lane_thread_stats (struct port_lane *lane,
+			     struct ports_thread_stats *stats)
+{
+  get_stats (&lane->threads, stats);
+}
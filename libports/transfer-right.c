@@ -91,10 +91,10 @@ ports_transfer_right (void *tostruct,
       err = hurd_ihash_add (&topi->bucket->htable, port, topi);
       pthread_rwlock_unlock (&_ports_htable_lock);
       assert_perror (err);
-      if (topi->bucket != frompi->bucket)
+      if (ports_get_portset (topi) != ports_get_portset (frompi))
         {
 	  err = mach_port_move_member (mach_task_self (), port,
-				       topi->bucket->portset);
+				       ports_get_portset (topi));
 	  assert_perror (err);
 	}
     }
@@ -0,0 +1,54 @@
+/* Get the statistics of a trivfs translator
+   Copyright (C) 2014 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+#include <stdio.h>
+
+#include "priv.h"
+#include "trivfs_fsys_S.h"
+
+error_t
+trivfs_S_fsys_get_statistics (struct trivfs_control *fsys,
+			      mach_port_t reply,
+			      mach_msg_type_name_t reply_type,
+			      char **data, mach_msg_type_number_t *len)
+{
+  error_t err;
+  char *text = 0;
+  size_t text_len = 0;
+  FILE *stream;
+
+  if (! fsys)
+    return EOPNOTSUPP;
+
+  stream = open_memstream (&text, &text_len);
+  if (! stream)
+    return errno;
+
+  err = trivfs_print_statistics (fsys, stream);
+  if (fclose (stream) && ! err)
+    err = errno;
+
+  if (! err)
+    /* Put TEXT into vm_alloced memory for the return trip.  */
+    err = iohelp_return_malloced_buffer (text, text_len, data, len);
+  else
+    free (text);
+
+  return err;
+}
@@ -86,7 +86,7 @@ trivfs_S_io_reauthenticate (struct trivfs_protid *cred,
     newcred->realnode = MACH_PORT_NULL;
 
   mach_port_move_member (mach_task_self (), newcred->pi.port_right,
-			 cred->po->cntl->protid_bucket->portset);
+			 ports_get_portset (newcred));
 
   ports_port_deref (newcred);
 
@@ -19,6 +19,7 @@
 #define __TRIVFS_H__
 
 #include <errno.h>
+#include <stdio.h>
 #include <pthread.h>		/* for mutexes &c */
 #include <sys/types.h>		/* for uid_t &c */
 #include <mach/mach.h>
@@ -224,6 +225,11 @@ error_t trivfs_set_options (struct trivfs_control *fsys,
 error_t trivfs_append_args (struct trivfs_control *fsys,
 			    char **argz, size_t *argz_len);
 
+/* Print to STREAM the statistics this translator keeps, one line for each
+   kind, for fsys_get_statistics.  The default definition of this routine
+   returns EOPNOTSUPP.  */
+error_t trivfs_print_statistics (struct trivfs_control *fsys, FILE *stream);
+
 /* The user may define this function.  The function must set source to
    the source device of CRED. The function may return an EOPNOTSUPP to
    indicate that the concept of a source device is not applicable. The
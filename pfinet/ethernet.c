@@ -97,19 +97,16 @@ static int bpf_ether_filter_len = sizeof (bpf_ether_filter) / sizeof (short);
 
 static struct port_bucket *etherport_bucket;
 
+/* The largest number of packets queued for net_bh at once.  net_bh
+   cannot run while the ethernet thread holds net_bh_lock for a batch,
+   so this bounds the delay added to the first packet of a batch.  */
+#define ETHERNET_BATCH	32
 
-static void *
-ethernet_thread (void *arg)
-{
-  ports_manage_port_operations_one_thread (etherport_bucket,
-					   ethernet_demuxer,
-					   0);
-  return NULL;
-}
 
-int
-ethernet_demuxer (mach_msg_header_t *inp,
-		  mach_msg_header_t *outp)
+/* Queue the packet in the message INP for net_bh.  Return zero if INP
+   is not a packet.  net_bh_lock must be held.  */
+static int
+ethernet_receive (mach_msg_header_t *inp)
 {
   struct net_rcv_msg *msg = (struct net_rcv_msg *) inp;
   struct sk_buff *skb;
@@ -152,8 +149,10 @@ ethernet_demuxer (mach_msg_header_t *inp,
   datalen = ETH_HLEN
     + msg->packet_type.msgt_number - sizeof (struct packet_header);
 
-  pthread_mutex_lock (&net_bh_lock);
   skb = alloc_skb (datalen, GFP_ATOMIC);
+  if (! skb)
+    /* Drop the packet.  */
+    return 1;
   skb_put (skb, datalen);
   skb->dev = dev;
 
@@ -166,11 +165,62 @@ ethernet_demuxer (mach_msg_header_t *inp,
   /* Drop it on the queue. */
   skb->protocol = eth_type_trans (skb, dev);
   netif_rx (skb);
-  pthread_mutex_unlock (&net_bh_lock);
 
   return 1;
 }
 
+/* Receive the packets of all ethernet devices.  This does not go
+   through libports, whose bookkeeping per message is not needed for
+   these one-way messages.  Once a packet arrives, the ones queued
+   behind it are taken without blocking, up to ETHERNET_BATCH of them,
+   so that net_bh_lock is taken, and the net_bh worker woken, once for
+   the whole batch.  */
+static void *
+ethernet_thread (void *arg)
+{
+  union
+  {
+    struct net_rcv_msg msg;
+    mach_msg_header_t head;
+  } buf;
+  mach_msg_return_t ret;
+  int n;
+
+  for (;;)
+    {
+      ret = mach_msg (&buf.head, MACH_RCV_MSG, 0, sizeof buf,
+		      etherport_bucket->portset, MACH_MSG_TIMEOUT_NONE,
+		      MACH_PORT_NULL);
+      if (ret == MACH_RCV_INTERRUPTED || ret == MACH_RCV_TOO_LARGE)
+	/* The message, if any, is lost, but the next one may be fine.  */
+	continue;
+      if (ret != MACH_MSG_SUCCESS)
+	{
+	  /* Anything else will not go away by trying again.  */
+	  error (0, ret, "receiving ethernet packets");
+	  break;
+	}
+
+      pthread_mutex_lock (&net_bh_lock);
+      n = 0;
+      do
+	{
+	  if (! ethernet_receive (&buf.head))
+	    mach_msg_destroy (&buf.head);
+
+	  if (++n == ETHERNET_BATCH)
+	    break;
+	  ret = mach_msg (&buf.head, MACH_RCV_MSG | MACH_RCV_TIMEOUT, 0,
+			  sizeof buf, etherport_bucket->portset, 0,
+			  MACH_PORT_NULL);
+	}
+      while (ret == MACH_MSG_SUCCESS);
+      pthread_mutex_unlock (&net_bh_lock);
+    }
+
+  return NULL;
+}
+
 
 void
 ethernet_initialize (void)
@@ -373,8 +373,12 @@ S_io_reauthenticate (struct sock_user *user,
   aux_uids = aubuf;
   aux_gids = agbuf;
 
-  pthread_mutex_lock (&global_lock);
+  /* This only makes a new port on the socket, so it is done without
+     global_lock; the auth server RPC can take a while, and must not
+     hold up the network meanwhile.  */
   newuser = make_sock_user (user->sock, 0, 1, 0);
+  if (! newuser)
+    return ENOMEM;
 
   auth = getauth ();
   newright = ports_get_send_right (newuser);
@@ -409,9 +413,7 @@ S_io_reauthenticate (struct sock_user *user,
       }
 
   mach_port_move_member (mach_task_self (), newuser->pi.port_right,
-			 pfinet_bucket->portset);
-
-  pthread_mutex_unlock (&global_lock);
+			 ports_get_portset (newuser));
 
   ports_port_deref (newuser);
 
@@ -441,8 +443,6 @@ S_io_restrict_auth (struct sock_user *user,
   if (!user)
     return EOPNOTSUPP;
 
-  pthread_mutex_lock (&global_lock);
-
   isroot = 0;
   if (user->isroot)
     /* Check permission as fshelp_isowner would do.  */
@@ -457,10 +457,11 @@ S_io_restrict_auth (struct sock_user *user,
       }
 
   newuser = make_sock_user (user->sock, isroot, 0, 0);
+  if (! newuser)
+    return ENOMEM;
   *newobject = ports_get_right (newuser);
   *newobject_type = MACH_MSG_TYPE_MAKE_SEND;
   ports_port_deref (newuser);
-  pthread_mutex_unlock (&global_lock);
   return 0;
 }
 
@@ -473,12 +474,12 @@ S_io_duplicate (struct sock_user *user,
   if (!user)
     return EOPNOTSUPP;
 
-  pthread_mutex_lock (&global_lock);
   newuser = make_sock_user (user->sock, user->isroot, 0, 0);
+  if (! newuser)
+    return ENOMEM;
   *newobject = ports_get_right (newuser);
   *newobject_type = MACH_MSG_TYPE_MAKE_SEND;
   ports_port_deref (newuser);
-  pthread_mutex_unlock (&global_lock);
   return 0;
 }
 
@@ -490,30 +491,39 @@ S_io_identity (struct sock_user *user,
 	       mach_msg_type_name_t *fsystype,
 	       ino_t *fileno)
 {
+  mach_port_t identity, expected;
   error_t err;
 
   if (!user)
     return EOPNOTSUPP;
 
-  pthread_mutex_lock (&global_lock);
-  if (user->sock->identity == MACH_PORT_NULL)
+  /* The identity port is no part of the protocol state, so this does
+     not need global_lock.  If two threads make one at once, the one
+     which loses the race destroys its own.  */
+  identity = __atomic_load_n (&user->sock->identity, __ATOMIC_ACQUIRE);
+  if (identity == MACH_PORT_NULL)
     {
       err = mach_port_allocate (mach_task_self (), MACH_PORT_RIGHT_RECEIVE,
-				&user->sock->identity);
+				&identity);
       if (err)
+	return err;
+
+      expected = MACH_PORT_NULL;
+      if (! __atomic_compare_exchange_n (&user->sock->identity, &expected,
+					 identity, 0, __ATOMIC_ACQ_REL,
+					 __ATOMIC_ACQUIRE))
 	{
-	  pthread_mutex_unlock (&global_lock);
-	  return err;
+	  mach_port_destroy (mach_task_self (), identity);
+	  identity = expected;
 	}
     }
 
-  *id = user->sock->identity;
+  *id = identity;
   *idtype = MACH_MSG_TYPE_MAKE_SEND;
   *fsys = fsys_identity;
   *fsystype = MACH_MSG_TYPE_MAKE_SEND;
   *fileno = user->sock->st_ino;
 
-  pthread_mutex_unlock (&global_lock);
   return 0;
 }
 
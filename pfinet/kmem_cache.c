@@ -1,5 +1,5 @@
-/* Hack replacement for Linux's kmem_cache_t allocator
-   Copyright (C) 2000 Free Software Foundation, Inc.
+/* Replacement for Linux's kmem_cache_t allocator
+   Copyright (C) 2000, 2014 Free Software Foundation, Inc.
 
    This file is part of the GNU Hurd.
 
@@ -17,23 +17,57 @@
    along with this program; if not, write to the Free Software
    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA. */
 
-/* Hack replacement for Linux's kmem_cache_t allocator, using plain malloc
-   and cthreads locking.  The locking here is probably unnecessary.  */
+/* Replacement for Linux's kmem_cache_t allocator, using libhurd-slab.
+   Each cache is a slab space, so objects are taken from per-thread
+   magazines most of the time, and stay constructed while they are
+   free, as in Linux.  */
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <hurd/slab.h>
 #include <linux/malloc.h>
 
 struct kmem_cache_s
 {
-  pthread_mutex_t lock;
-
-  void *freelist;
+  struct hurd_slab_space space;
+  const char *name;
   size_t item_size;
 
   void (*ctor) (void *, kmem_cache_t *, unsigned long);
   void (*dtor) (void *, kmem_cache_t *, unsigned long);
+
+  /* The number of objects allocated now, the highest it has been, and
+     the number of allocations so far.  Changed atomically.  */
+  unsigned long active;
+  unsigned long high_water;
+  unsigned long allocs;
+
+  /* The next cache in CACHES.  */
+  struct kmem_cache_s *next;
 };
 
+/* All caches, for kmem_cache_info.  Caches are never destroyed.  */
+static struct kmem_cache_s *caches;
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static error_t
+construct (void *hook, void *object)
+{
+  kmem_cache_t *cache = hook;
+
+  (*cache->ctor) (object, cache, 0);
+  return 0;
+}
+
+static void
+destruct (void *hook, void *object)
+{
+  kmem_cache_t *cache = hook;
+
+  (*cache->dtor) (object, cache, 0);
+}
+
 kmem_cache_t *
 kmem_cache_create (const char *name, size_t item_size,
 		   size_t something, unsigned long flags,
@@ -43,11 +77,23 @@ kmem_cache_create (const char *name, size_t item_size,
   kmem_cache_t *new = malloc (sizeof *new);
   if (!new)
     return 0;
-  pthread_mutex_init (&new->lock, NULL);
-  new->freelist = 0;
+
+  if (hurd_slab_init (&new->space, item_size, 0, NULL, NULL,
+		      ctor ? construct : NULL, dtor ? destruct : NULL, new))
+    {
+      free (new);
+      return 0;
+    }
+  new->name = name;
   new->item_size = item_size;
   new->ctor = ctor;
   new->dtor = dtor;
+  new->active = new->high_water = new->allocs = 0;
+
+  pthread_mutex_lock (&caches_lock);
+  new->next = caches;
+  caches = new;
+  pthread_mutex_unlock (&caches_lock);
 
   return new;
 }
@@ -56,20 +102,21 @@ kmem_cache_create (const char *name, size_t item_size,
 void *
 kmem_cache_alloc (kmem_cache_t *cache, int flags)
 {
+  unsigned long active, high_water;
   void *p;
 
-  pthread_mutex_lock (&cache->lock);
-  p = cache->freelist;
-  if (p != 0) {
-    cache->freelist = *(void **)(p + cache->item_size);
-    pthread_mutex_unlock (&cache->lock);
-    return p;
-  }
-  pthread_mutex_unlock (&cache->lock);
-
-  p = malloc (cache->item_size + sizeof (void *));
-  if (p && cache->ctor)
-    (*cache->ctor) (p, cache, flags);
+  if (hurd_slab_alloc (&cache->space, &p))
+    return 0;
+
+  __atomic_add_fetch (&cache->allocs, 1, __ATOMIC_RELAXED);
+  active = __atomic_add_fetch (&cache->active, 1, __ATOMIC_RELAXED);
+  high_water = __atomic_load_n (&cache->high_water, __ATOMIC_RELAXED);
+  while (active > high_water
+	 && ! __atomic_compare_exchange_n (&cache->high_water, &high_water,
+					   active, 0, __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED))
+    ;
+
   return p;
 }
 
@@ -77,12 +124,36 @@ kmem_cache_alloc (kmem_cache_t *cache, int flags)
 void
 kmem_cache_free (kmem_cache_t *cache, void *p)
 {
-  void **const nextp = (void **) (p + cache->item_size);
+  __atomic_sub_fetch (&cache->active, 1, __ATOMIC_RELAXED);
+  hurd_slab_dealloc (&cache->space, p);
+}
 
-  pthread_mutex_lock (&cache->lock);
-  *nextp = cache->freelist;
-  cache->freelist = p;
-  pthread_mutex_unlock (&cache->lock);
 
-  /* XXX eventually destroy some... */
+/* Return in TEXT and LEN a description of all caches, like Linux's
+   /proc/slabinfo: one line per cache with its name, the number of
+   objects allocated now and at most so far, the number of allocations
+   so far, and the size of the objects.  TEXT is malloced.  */
+error_t
+kmem_cache_info (char **text, size_t *len)
+{
+  struct kmem_cache_s *cache;
+  FILE *f;
+
+  f = open_memstream (text, len);
+  if (! f)
+    return ENOMEM;
+
+  fprintf (f, "# name                active   high-water      allocs  size\n");
+  pthread_mutex_lock (&caches_lock);
+  for (cache = caches; cache; cache = cache->next)
+    fprintf (f, "%-18s %9lu %12lu %11lu %5zu\n", cache->name,
+	     __atomic_load_n (&cache->active, __ATOMIC_RELAXED),
+	     __atomic_load_n (&cache->high_water, __ATOMIC_RELAXED),
+	     __atomic_load_n (&cache->allocs, __ATOMIC_RELAXED),
+	     cache->item_size);
+  pthread_mutex_unlock (&caches_lock);
+
+  if (fclose (f))
+    return ENOMEM;
+  return 0;
 }
@@ -465,6 +465,27 @@ trivfs_modify_stat (struct trivfs_protid *cred,
 {
 }
 
+error_t
+trivfs_print_statistics (struct trivfs_control *fsys, FILE *stream)
+{
+  struct ports_thread_stats threads;
+  char *rpcs;
+  size_t rpcs_len;
+  error_t err;
+
+  ports_get_thread_stats (pfinet_bucket, &threads);
+  fprintf (stream, "threads max=%u active=%u idle=%u peak=%u queued=%lu\n",
+	   threads.max, threads.active, threads.idle, threads.peak,
+	   threads.queued);
+
+  err = ports_format_rpc_stats (&rpcs, &rpcs_len);
+  if (err)
+    return err;
+  fwrite (rpcs, 1, rpcs_len, stream);
+  free (rpcs);
+  return 0;
+}
+
 error_t
 trivfs_goaway (struct trivfs_control *cntl, int flags)
 {
@@ -65,10 +65,18 @@ static struct rt6_info * ipv6_get_dflt_router (void);
 #endif
 
 
+/* Option keys for long options only.  */
+#define OPT_RPC_STATS		600	/* --rpc-statistics */
+#define OPT_NO_RPC_STATS	601	/* --no-rpc-statistics */
+
 /* Pfinet options.  Used for both startup and runtime.  */
 static const struct argp_option options[] =
 {
   {"interface", 'i', "DEVICE",   0,  "Network interface to use", 1},
+  {"rpc-statistics", OPT_RPC_STATS, 0, 0,
+   "Collect statistics about the requests served", 1},
+  {"no-rpc-statistics", OPT_NO_RPC_STATS, 0, 0,
+   "Stop collecting statistics about the requests served (the default)", 1},
   {0,0,0,0,"These apply to a given interface:", 2},
   {"address",   'a', "ADDRESS",  OPTION_ARG_OPTIONAL, "Set the network address"},
   {"netmask",   'm', "MASK",     OPTION_ARG_OPTIONAL, "Set the netmask"},
@@ -113,6 +121,9 @@ struct parse_hook
   /* Interface to which options apply.  If the device field isn't filled in
      then it should be by the next --interface option.  */
   struct parse_interface *curint;
+
+  /* Whether to collect RPC statistics, or -1 to leave it as it is.  */
+  int rpc_stats;
 };
 
 static void
@@ -384,6 +395,14 @@ parse_opt (int opt, char *arg, struct argp_state *state)
       break;
 #endif /* CONFIG_IPV6 */
 
+    case OPT_RPC_STATS:
+      h->rpc_stats = 1;
+      break;
+
+    case OPT_NO_RPC_STATS:
+      h->rpc_stats = 0;
+      break;
+
     case ARGP_KEY_INIT:
       /* Initialize our parsing state.  */
       h = malloc (sizeof (struct parse_hook));
@@ -392,6 +411,7 @@ parse_opt (int opt, char *arg, struct argp_state *state)
 
       h->interfaces = 0;
       h->num_interfaces = 0;
+      h->rpc_stats = -1;
       err = parse_hook_add_interface (h);
       if (err)
 	FAIL (err, 12, err, "option parsing");
@@ -446,6 +466,9 @@ parse_opt (int opt, char *arg, struct argp_state *state)
 	}
       /* Successfully finished parsing, return a result.  */
 
+      if (h->rpc_stats != -1)
+	ports_enable_rpc_stats (h->rpc_stats);
+
       pthread_mutex_lock (&global_lock);
 
       for (in = h->interfaces; in < h->interfaces + h->num_interfaces; in++)
@@ -741,5 +764,12 @@ trivfs_append_args (struct trivfs_control *fsys, char **argz, size_t *argz_len)
       return err;
     }
 
+  if (ports_rpc_stats_enabled ())
+    {
+      error_t err = argz_add (argz, argz_len, "--rpc-statistics");
+      if (err)
+	return err;
+    }
+
   return enumerate_devices (add_dev_opts);
 }
@@ -91,3 +91,34 @@ S_pfinet_siocgifconf (io_t port,
   pthread_mutex_unlock (&global_lock);
   return err;
 }
+
+/* Return the statistics of the object caches in BUF, as described at
+   kmem_cache_info.  */
+error_t
+S_pfinet_getslabinfo (io_t port,
+		      char **buf,
+		      mach_msg_type_number_t *len)
+{
+  char *text;
+  size_t textlen;
+  error_t err;
+
+  err = kmem_cache_info (&text, &textlen);
+  if (err)
+    return err;
+
+  if (*len < textlen)
+    {
+      *buf = mmap (0, textlen, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (*buf == MAP_FAILED)
+	{
+	  free (text);
+	  return ENOMEM;
+	}
+    }
+  memcpy (*buf, text, textlen);
+  *len = textlen;
+  free (text);
+
+  return 0;
+}
@@ -30,6 +30,11 @@
 #include <sys/socket.h>
 #include <pthread.h>
 
+/* GLOBAL_LOCK serializes everything running the Linux code, and
+   protects all the protocol state.  What the Hurd adds to a socket,
+   its reference count and identity port, is changed atomically, and
+   making or destroying a port on a socket does not need GLOBAL_LOCK
+   unless it drops the last reference.  */
 extern pthread_mutex_t global_lock;
 extern pthread_mutex_t net_bh_lock;
 
@@ -67,7 +72,6 @@ uid_t pfinet_owner;
 uid_t pfinet_group;
 
 void ethernet_initialize (void);
-int ethernet_demuxer (mach_msg_header_t *, mach_msg_header_t *);
 void setup_ethernet_device (char *, struct device **);
 void setup_dummy_device (char *, struct device **);
 void setup_tunnel_device (char *, struct device **);
@@ -85,6 +89,7 @@ error_t tcp_tiocinq (struct sock *sk, mach_msg_type_number_t *amount);
 
 void clean_addrport (void *);
 void clean_socketport (void *);
+error_t kmem_cache_info (char **, size_t *);
 
 /* pfinet6 port classes. */
 enum {
@@ -88,18 +88,28 @@ S_socket_create (struct trivfs_protid *master,
     err = - (*net_families[PF_INET6]->create) (sock, protocol);
 
   if (err)
-    sock_release (sock);
-  else
     {
-      user = make_sock_user (sock, isroot, 0, 1);
-      *port = ports_get_right (user);
-      *porttype = MACH_MSG_TYPE_MAKE_SEND;
-      ports_port_deref (user);
+      sock_release (sock);
+      pthread_mutex_unlock (&global_lock);
+      return err;
     }
-
   pthread_mutex_unlock (&global_lock);
 
-  return err;
+  /* Making the port does not touch the protocol state of SOCK, and no
+     other thread can get at SOCK before the port exists.  */
+  user = make_sock_user (sock, isroot, 0, 1);
+  if (! user)
+    {
+      pthread_mutex_lock (&global_lock);
+      sock_release (sock);
+      pthread_mutex_unlock (&global_lock);
+      return ENOMEM;
+    }
+  *port = ports_get_right (user);
+  *porttype = MACH_MSG_TYPE_MAKE_SEND;
+  ports_port_deref (user);
+
+  return 0;
 }
 
 
@@ -542,3 +552,36 @@ S_socket_recv (struct sock_user *user,
 
   return err;
 }
+
+error_t
+S_socket_splice_to_io (struct sock_user *user,
+		       mach_port_t file,
+		       off_t offset,
+		       vm_size_t amount,
+		       vm_size_t *moved)
+{
+  return EOPNOTSUPP;
+}
+
+error_t
+S_socket_splice_from_io (struct sock_user *user,
+			 mach_port_t file,
+			 off_t offset,
+			 vm_size_t amount,
+			 vm_size_t *moved)
+{
+  return EOPNOTSUPP;
+}
+
+error_t
+S_socket_accept_many (struct sock_user *user,
+		      int max,
+		      mach_port_t **ports,
+		      mach_msg_type_name_t *portstype,
+		      size_t *nports,
+		      mach_port_t **addrs,
+		      mach_msg_type_name_t *addrstype,
+		      size_t *naddrs)
+{
+  return EOPNOTSUPP;
+}
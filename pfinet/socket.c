@@ -65,7 +65,9 @@ sock_alloc (void)
 
 /* Create a sock_user structure, initialized from SOCK and ISROOT.
    If NOINSTALL is set, don't put it in the portset.
-   We increment SOCK->refcnt iff CONSUME is zero.  */
+   We increment SOCK->refcnt iff CONSUME is zero.  This does not touch
+   the protocol state of SOCK, so global_lock need not be held if the
+   caller has a reference on SOCK.  */
 struct sock_user *
 make_sock_user (struct socket *sock, int isroot, int noinstall, int consume)
 {
@@ -86,20 +88,23 @@ make_sock_user (struct socket *sock, int isroot, int noinstall, int consume)
   /* We maintain a reference count in `struct socket' (a member not
      in the original Linux structure), because there can be multiple
      ports (struct sock_user, aka protids) pointing to the same socket.
-     The socket lives until all the ports die.  */
+     The socket lives until all the ports die.  It is changed
+     atomically, so that ports can be made and destroyed without
+     global_lock.  */
   if (! consume)
-    ++sock->refcnt;
+    __atomic_add_fetch (&sock->refcnt, 1, __ATOMIC_RELAXED);
   user->isroot = isroot;
   user->sock = sock;
   return user;
 }
 
 /* This is called from the port cleanup function below, and on
-   a newly allocated socket when something went wrong in its creation.  */
+   a newly allocated socket when something went wrong in its creation.
+   global_lock must be held.  */
 void
 sock_release (struct socket *sock)
 {
-  if (--sock->refcnt != 0)
+  if (__atomic_sub_fetch (&sock->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
     return;
 
   if (sock->state != SS_UNCONNECTED)
@@ -119,8 +124,18 @@ void
 clean_socketport (void *arg)
 {
   struct sock_user *const user = arg;
+  struct socket *sock = user->sock;
+  uint_fast32_t refcnt = __atomic_load_n (&sock->refcnt, __ATOMIC_RELAXED);
+
+  /* Only dropping the last reference touches the protocol state, and
+     needs global_lock.  Nobody else can add a reference once ours is
+     the last one.  */
+  while (refcnt > 1)
+    if (__atomic_compare_exchange_n (&sock->refcnt, &refcnt, refcnt - 1,
+				     0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      return;
 
   pthread_mutex_lock (&global_lock);
-  sock_release (user->sock);
+  sock_release (sock);
   pthread_mutex_unlock (&global_lock);
 }
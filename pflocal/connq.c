@@ -24,12 +24,18 @@
 
 #include "connq.h"
 
+/* The most slots connq_set_length allocates ahead of time.  */
+#define CONNQ_PREALLOC	1024
+
 /* A queue for queueing incoming connections.  */
 struct connq
 {
-  /* The connection request queue.  */
-  struct connq_request *head;
-  struct connq_request **tail;
+  /* The sockets waiting to be accepted, in a ring of SIZE slots starting at
+     HEAD.  Slots are allocated ahead of time by connq_set_length and
+     connq_connect, so completing a connection never allocates.  */
+  struct sock **queue;
+  unsigned size;
+  unsigned head;
   unsigned count;
   unsigned max;
 
@@ -43,59 +49,66 @@ struct connq
 
   pthread_mutex_t lock;
 };
-
+
 /* ---------------------------------------------------------------- */
 
-/* A data block allocated by a thread waiting on a connq, which is used to
-   get information from and to the thread.  */
-struct connq_request
+/* Make sure CQ has at least SIZE slots.  CQ must be locked.  */
+static error_t
+connq_reserve (struct connq *cq, unsigned size)
 {
-  struct connq_request *next;
+  struct sock **queue;
+  unsigned i;
 
-  /* The socket that's waiting to connect.  */
-  struct sock *sock;
-};
+  assert (pthread_mutex_trylock (&cq->lock));
 
-static inline void
-connq_request_init (struct connq_request *req, struct sock *sock)
-{
-  req->sock = sock;
+  if (size <= cq->size)
+    return 0;
+  if (size < 2 * cq->size)
+    size = 2 * cq->size;
+
+  queue = malloc (size * sizeof *queue);
+  if (! queue)
+    return ENOBUFS;
+
+  for (i = 0; i < cq->count; i++)
+    queue[i] = cq->queue[(cq->head + i) % cq->size];
+
+  free (cq->queue);
+  cq->queue = queue;
+  cq->size = size;
+  cq->head = 0;
+
+  return 0;
 }
 
-/* Enqueue connection request REQ onto CQ.  CQ must be locked.  */
+/* Enqueue SOCK onto CQ.  CQ must be locked, and have a free slot.  */
 static void
-connq_request_enqueue (struct connq *cq, struct connq_request *req)
+connq_enqueue (struct connq *cq, struct sock *sock)
 {
   assert (pthread_mutex_trylock (&cq->lock));
+  assert (cq->count < cq->size);
 
-  req->next = NULL;
-  *cq->tail = req;
-  cq->tail = &req->next;
-
+  cq->queue[(cq->head + cq->count) % cq->size] = sock;
   cq->count ++;
 }
 
 /* Dequeue a pending request from CQ.  CQ must be locked and must not
    be empty.  */
-static struct connq_request *
-connq_request_dequeue (struct connq *cq)
+static struct sock *
+connq_dequeue (struct connq *cq)
 {
-  struct connq_request *req;
+  struct sock *sock;
 
   assert (pthread_mutex_trylock (&cq->lock));
-  assert (cq->head);
-
-  req = cq->head;
-  cq->head = req->next;
-  if (! cq->head)
-    /* We just dequeued the last element.  Fixup the tail pointer.  */
-    cq->tail = &cq->head;
+  assert (cq->count > 0);
 
+  sock = cq->queue[cq->head];
+  cq->head = (cq->head + 1) % cq->size;
   cq->count --;
 
-  return req;
+  return sock;
 }
-
+
 /* ---------------------------------------------------------------- */
 
 /* Create a new listening queue, returning it in CQ.  The resulting queue
@@ -109,8 +122,9 @@ connq_create (struct connq **cq)
   if (!new)
     return ENOBUFS;
 
-  new->head = NULL;
-  new->tail = &new->head;
+  new->queue = NULL;
+  new->size = 0;
+  new->head = 0;
   new->count = 0;
   /* By default, don't queue requests.  */
   new->max = 0;
@@ -132,21 +146,23 @@ connq_destroy (struct connq *cq)
 {
   /* Everybody in the queue should hold a reference to the socket
      containing the queue.  */
-  assert (! cq->head);
   assert (cq->count == 0);
 
+  free (cq->queue);
   free (cq);
 }
-
+
 /* ---------------------------------------------------------------- */
 
-/* Return a connection request on CQ.  If SOCK is NULL, the request is
+/* Return up to *NUM connection requests on CQ in SOCKS, and their number in
+   *NUM, waiting only for the first one.  If SOCKS is NULL, the requests are
    left in the queue.  If TIMEOUT denotes a value of 0, EWOULDBLOCK is
-   returned when there are no immediate connections available.
-   Otherwise this value is used to limit the wait duration.  If TIMEOUT
-   is NULL, the wait duration isn't bounded.  */
+   returned when there are no immediate connections available.  Otherwise
+   this value is used to limit the wait duration.  If TIMEOUT is NULL, the
+   wait duration isn't bounded.  */
 error_t
-connq_listen (struct connq *cq, struct timespec *tsp, struct sock **sock)
+connq_listen_many (struct connq *cq, struct timespec *tsp,
+		   struct sock **socks, unsigned *num)
 {
   error_t err = 0;
 
@@ -159,19 +175,21 @@ connq_listen (struct connq *cq, struct timespec *tsp, struct sock **sock)
       return EWOULDBLOCK;
     }
 
-  if (! sock && (cq->count > 0 || cq->num_connectors > 0))
+  if (! socks && (cq->count > 0 || cq->num_connectors > 0))
     /* The caller just wants to know if a connection ready.  */
     {
       pthread_mutex_unlock (&cq->lock);
       return 0;
     }
 
-  cq->num_listeners++;
-
   if (cq->count == 0)
     /* The request queue is empty.  */
     {
-      assert (! cq->head);
+      /* While we wait, we count as a slot in the queue for connectors.
+	 As we may dequeue several requests at once, we only stop counting
+	 once we're done waiting, rather than when a request is enqueued
+	 for us.  */
+      cq->num_listeners++;
 
       if (cq->num_connectors > 0)
 	/* Someone is waiting for an acceptor.  Signal that we can
@@ -179,25 +197,28 @@ connq_listen (struct connq *cq, struct timespec *tsp, struct sock **sock)
 	pthread_cond_signal (&cq->connectors);
 
       do
-	{
-	  err = pthread_hurd_cond_timedwait_np (&cq->listeners, &cq->lock, tsp);
-	  if (err)
-	  {
-	    cq->num_listeners--;
-	    goto out;
-	  }
-	}
-      while (cq->count == 0);
+	err = pthread_hurd_cond_timedwait_np (&cq->listeners, &cq->lock, tsp);
+      while (! err && cq->count == 0);
+
+      cq->num_listeners--;
+      if (err)
+	goto out;
     }
 
-  assert (cq->head);
+  assert (cq->count > 0);
 
-  if (sock)
-    /* Dequeue the next request, if desired.  */
+  if (socks)
+    /* Dequeue the next requests, if desired.  */
     {
-      struct connq_request *req = connq_request_dequeue (cq);
-      *sock = req->sock;
-      free (req);
+      unsigned n = 0;
+
+      while (n < *num && cq->count > 0)
+	socks[n++] = connq_dequeue (cq);
+      *num = n;
+
+      if (cq->num_connectors > 0)
+	/* We made room for connectors waiting for a slot.  */
+	pthread_cond_broadcast (&cq->connectors);
     }
   else if (cq->num_listeners > 0)
     /* The caller will not actually process this request but someone
@@ -218,7 +239,50 @@ connq_listen (struct connq *cq, struct timespec *tsp, struct sock **sock)
   pthread_mutex_unlock (&cq->lock);
   return err;
 }
-
+
+/* Return a connection request on CQ.  If SOCK is NULL, the request is
+   left in the queue.  If TIMEOUT denotes a value of 0, EWOULDBLOCK is
+   returned when there are no immediate connections available.
+   Otherwise this value is used to limit the wait duration.  If TIMEOUT
+   is NULL, the wait duration isn't bounded.  */
+error_t
+connq_listen (struct connq *cq, struct timespec *tsp, struct sock **sock)
+{
+  unsigned num = 1;
+  return connq_listen_many (cq, tsp, sock, &num);
+}
+
+/* Put the NUM connection requests in SOCKS, returned by connq_listen_many
+   but not accepted after all, back at the head of CQ in the same order.
+   Returns ENOBUFS if there is no room for them.  */
+error_t
+connq_requeue (struct connq *cq, struct sock **socks, unsigned num)
+{
+  error_t err;
+
+  pthread_mutex_lock (&cq->lock);
+
+  /* Connectors may have been given the slots SOCKS had since, so make
+     room for them on top of those.  */
+  err = connq_reserve (cq, cq->count + cq->num_connectors + num);
+  if (!err)
+    {
+      while (num > 0)
+	{
+	  cq->head = (cq->head + cq->size - 1) % cq->size;
+	  cq->queue[cq->head] = socks[--num];
+	  cq->count ++;
+	}
+
+      if (cq->num_listeners > 0)
+	pthread_cond_broadcast (&cq->listeners);
+    }
+
+  pthread_mutex_unlock (&cq->lock);
+
+  return err;
+}
+
 /* Try to connect SOCK with the socket listening on CQ.  If NOBLOCK is
    true, then return EWOULDBLOCK if there are no connections
    immediately available.  On success, this call must be followed up
@@ -226,6 +290,8 @@ connq_listen (struct connq *cq, struct timespec *tsp, struct sock **sock)
 error_t
 connq_connect (struct connq *cq, int noblock)
 {
+  error_t err;
+
   pthread_mutex_lock (&cq->lock);
 
   /* Check for listeners after we've locked CQ for good.  */
@@ -251,9 +317,14 @@ connq_connect (struct connq *cq, int noblock)
 	return EINTR;
       }
 
+  /* Make sure there will be a slot for us in connq_connect_complete.  */
+  err = connq_reserve (cq, cq->count + cq->num_connectors);
+  if (err)
+    cq->num_connectors --;
+
   pthread_mutex_unlock (&cq->lock);
 
-  return 0;
+  return err;
 }
 
 /* Follow up to connq_connect.  Completes the connect, SOCK is the new
@@ -261,29 +332,16 @@ connq_connect (struct connq *cq, int noblock)
 void
 connq_connect_complete (struct connq *cq, struct sock *sock)
 {
-  struct connq_request *req;
-
-  req = malloc (sizeof (struct connq_request));
-  if (! req)
-    abort ();
-
-  connq_request_init (req, sock);
-
   pthread_mutex_lock (&cq->lock);
 
   assert (cq->num_connectors > 0);
   cq->num_connectors --;
 
-  connq_request_enqueue (cq, req);
+  connq_enqueue (cq, sock);
 
   if (cq->num_listeners > 0)
-    /* Wake a listener up.  We must consume the listener ref here as
-       someone else might call this function before the listener
-       thread dequeues this request.  */
-    {
-      cq->num_listeners --;
-      pthread_cond_signal (&cq->listeners);
-    }
+    /* Wake a listener up.  */
+    pthread_cond_signal (&cq->listeners);
 
   pthread_mutex_unlock (&cq->lock);
 }
@@ -303,14 +361,27 @@ connq_connect_cancel (struct connq *cq)
 
   pthread_mutex_unlock (&cq->lock);
 }
-
+
 /* Set CQ's queue length to LENGTH.  */
 error_t
 connq_set_length (struct connq *cq, int max)
 {
+  error_t err;
   int omax;
 
   pthread_mutex_lock (&cq->lock);
+
+  /* Allocate the slots for the new length now, rather than as
+     connections come in; past CONNQ_PREALLOC, which is plenty for
+     anything but the silly lengths some programs pass to listen, they
+     are still allocated as needed.  */
+  err = connq_reserve (cq, max < CONNQ_PREALLOC ? max : CONNQ_PREALLOC);
+  if (err)
+    {
+      pthread_mutex_unlock (&cq->lock);
+      return err;
+    }
+
   omax = cq->max;
   cq->max = max;
 
@@ -43,6 +43,17 @@ void connq_destroy (struct connq *cq);
 error_t connq_listen (struct connq *cq, struct timespec *tsp,
 		      struct sock **sock);
 
+/* Return up to *NUM connection requests on CQ in SOCKS, and their number in
+   *NUM, waiting only for the first one.  If SOCKS is NULL, the requests are
+   left in the queue.  TIMEOUT is as for connq_listen.  */
+error_t connq_listen_many (struct connq *cq, struct timespec *tsp,
+			   struct sock **socks, unsigned *num);
+
+/* Put the NUM connection requests in SOCKS, returned by connq_listen_many
+   but not accepted after all, back at the head of CQ in the same order.
+   Returns ENOBUFS if there is no room for them.  */
+error_t connq_requeue (struct connq *cq, struct sock **socks, unsigned num);
+
 /* Try to connect SOCK with the socket listening on CQ.  If NOBLOCK is
    true, then return EWOULDBLOCK if there are no connections
    immediately available.  On success, this call must be followed up
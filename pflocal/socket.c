@@ -207,6 +207,129 @@ S_socket_accept (struct sock_user *user,
   return err;
 }
 
+/* Destroy PORT, made by sock_create_port but never handed out.  */
+static void
+destroy_sock_port (mach_port_t port)
+{
+  struct sock_user *user =
+    ports_lookup_port (0, port, sock_user_port_class);
+
+  ports_destroy_right (user);
+  ports_port_deref (user);
+}
+
+/* The most connections socket_accept_many returns at once.  */
+#define ACCEPT_MANY_MAX	64
+
+/* Return up to MAX new connections from a socket previously listened.  */
+error_t
+S_socket_accept_many (struct sock_user *user, int max,
+		      mach_port_t **ports, mach_msg_type_name_t *ports_type,
+		      size_t *num_ports,
+		      mach_port_t **addr_ports,
+		      mach_msg_type_name_t *addr_ports_type,
+		      size_t *num_addr_ports)
+{
+  error_t err;
+  struct sock *sock;
+  struct sock *peer_socks[ACCEPT_MANY_MAX];
+  struct timespec noblock = {0, 0};
+  mach_port_t *new_ports = *ports, *new_addr_ports = *addr_ports;
+  unsigned room, num, i;
+
+  if (!user)
+    return EOPNOTSUPP;
+  if (max <= 0)
+    return EINVAL;
+
+  sock = user->sock;
+  room = num = max < ACCEPT_MANY_MAX ? max : ACCEPT_MANY_MAX;
+
+  /* Make room for the ports before taking connections from the queue, so
+     as not to lose them for want of memory.  */
+  if (*num_ports < room)
+    {
+      new_ports = mmap (0, room * sizeof (mach_port_t),
+			PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (new_ports == MAP_FAILED)
+	return errno;
+    }
+  if (*num_addr_ports < room)
+    {
+      new_addr_ports = mmap (0, room * sizeof (mach_port_t),
+			     PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (new_addr_ports == MAP_FAILED)
+	{
+	  err = errno;
+	  if (new_ports != *ports)
+	    munmap (new_ports, room * sizeof (mach_port_t));
+	  return err;
+	}
+    }
+
+  err = ensure_connq (sock);
+  if (!err)
+    err = connq_listen_many (sock->listen_queue,
+			     (sock->flags & PFLOCAL_SOCK_NONBLOCK)
+			     ? &noblock : NULL,
+			     peer_socks, &num);
+
+  if (!err)
+    for (i = 0; i < num; i++)
+      {
+	struct addr *peer_addr;
+
+	new_ports[i] = MACH_PORT_NULL;
+	err = sock_create_port (peer_socks[i], &new_ports[i]);
+	if (!err)
+	  err = sock_get_addr (peer_socks[i], &peer_addr);
+	if (err)
+	  {
+	    unsigned next = i;
+
+	    if (new_ports[i] != MACH_PORT_NULL)
+	      /* Destroying the new port gets rid of its socket as well, and
+		 so of this connection.  */
+	      destroy_sock_port (new_ports[next++]);
+
+	    /* Give the connections not set up back to the queue for a later
+	       accept, or tear them down if even that fails.  */
+	    if (next < num
+		&& connq_requeue (sock->listen_queue,
+				  peer_socks + next, num - next))
+	      for (; next < num; next++)
+		sock_free (peer_socks[next]);
+
+	    if (i > 0)
+	      /* Return the connections we could set up.  */
+	      err = 0;
+	    num = i;
+	    break;
+	  }
+
+	new_addr_ports[i] = ports_get_right (peer_addr);
+	ports_port_deref (peer_addr);
+      }
+
+  if (err)
+    {
+      if (new_ports != *ports)
+	munmap (new_ports, room * sizeof (mach_port_t));
+      if (new_addr_ports != *addr_ports)
+	munmap (new_addr_ports, room * sizeof (mach_port_t));
+      return err;
+    }
+
+  *ports = new_ports;
+  *ports_type = MACH_MSG_TYPE_MAKE_SEND;
+  *num_ports = num;
+  *addr_ports = new_addr_ports;
+  *addr_ports_type = MACH_MSG_TYPE_MAKE_SEND;
+  *num_addr_ports = num;
+
+  return 0;
+}
+
 /* Bind a socket to an address.  */
 error_t
 S_socket_bind (struct sock_user *user, struct addr *addr)
@@ -417,6 +540,100 @@ S_socket_recv (struct sock_user *user,
 
   return err;
 }
+
+/* Return EINVAL if FILE is one of our sockets, connected to SOCK such that
+   splicing data between them would deadlock: an RPC on FILE would wait for
+   the pipe of SOCK that is being spliced, and so kept from it.  */
+static error_t
+check_splice (struct sock *sock, mach_port_t file)
+{
+  struct sock_user *other =
+    ports_lookup_port (0, file, sock_user_port_class);
+  struct pipe *read_pipe, *write_pipe;
+  error_t err = 0;
+
+  if (! other)
+    return 0;
+
+  pthread_mutex_lock (&sock->lock);
+  read_pipe = sock->read_pipe;
+  write_pipe = sock->write_pipe;
+  pthread_mutex_unlock (&sock->lock);
+
+  pthread_mutex_lock (&other->sock->lock);
+  if ((read_pipe && other->sock->write_pipe == read_pipe)
+      || (write_pipe && other->sock->read_pipe == write_pipe))
+    err = EINVAL;
+  pthread_mutex_unlock (&other->sock->lock);
+
+  ports_port_deref (other);
+  return err;
+}
+
+/* Move up to AMOUNT bytes from USER's socket to FILE.  */
+error_t
+S_socket_splice_to_io (struct sock_user *user, mach_port_t file,
+		       off_t offset, vm_size_t amount, vm_size_t *moved)
+{
+  error_t err;
+  struct pipe *pipe;
+
+  if (!user)
+    return EOPNOTSUPP;
+
+  err = check_splice (user->sock, file);
+  if (err)
+    return err;
+
+  err = sock_acquire_read_pipe (user->sock, &pipe);
+  if (err == EPIPE)
+    /* EOF */
+    {
+      err = 0;
+      *moved = 0;
+    }
+  else if (!err)
+    {
+      err = pipe_splice_to_io (pipe, user->sock->flags & PFLOCAL_SOCK_NONBLOCK,
+			       file, offset, amount, moved);
+      pipe_release_reader (pipe);
+    }
+
+  if (!err)
+    mach_port_deallocate (mach_task_self (), file);
+
+  return err;
+}
+
+/* Move up to AMOUNT bytes from FILE to USER's socket.  */
+error_t
+S_socket_splice_from_io (struct sock_user *user, mach_port_t file,
+			 off_t offset, vm_size_t amount, vm_size_t *moved)
+{
+  error_t err;
+  struct pipe *pipe;
+
+  if (!user)
+    return EOPNOTSUPP;
+
+  err = check_splice (user->sock, file);
+  if (err)
+    return err;
+
+  err = sock_acquire_write_pipe (user->sock, &pipe);
+  if (!err)
+    {
+      err = pipe_splice_from_io (pipe,
+				 user->sock->flags & PFLOCAL_SOCK_NONBLOCK,
+				 file, offset, amount, moved);
+      pipe_release_writer (pipe);
+    }
+
+  if (!err)
+    mach_port_deallocate (mach_task_self (), file);
+
+  return err;
+}
 
 error_t
 S_socket_getopt (struct sock_user *user,
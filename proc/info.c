@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <stdio.h>
 #include <sys/resource.h>
 #include <assert.h>
 #include <hurd/msg.h>
@@ -799,3 +800,57 @@ S_proc_getnports (struct proc *callerp,
 
   return err;
 }
+
+/* Implement proc_get_statistics as described in <hurd/process.defs>. */
+kern_return_t
+S_proc_get_statistics (struct proc *callerp,
+		       char **data,
+		       mach_msg_type_number_t *data_len)
+{
+  struct ports_thread_stats threads;
+  char *buf, *rpcs;
+  size_t len, rpcs_len;
+  FILE *stream;
+  error_t err = 0;
+
+  /* No need to check CALLERP here; we don't use it. */
+
+  stream = open_memstream (&buf, &len);
+  if (! stream)
+    return errno;
+
+  ports_get_thread_stats (proc_bucket, &threads);
+  fprintf (stream, "threads max=%u active=%u idle=%u peak=%u queued=%lu\n",
+	   threads.max, threads.active, threads.idle, threads.peak,
+	   threads.queued);
+
+  err = ports_format_rpc_stats (&rpcs, &rpcs_len);
+  if (! err)
+    {
+      fwrite (rpcs, 1, rpcs_len, stream);
+      free (rpcs);
+    }
+
+  if (fclose (stream))
+    err = errno;
+  if (err)
+    {
+      free (buf);
+      return err;
+    }
+
+  if (*data_len < len)
+    {
+      *data = mmap (0, len, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (*data == MAP_FAILED)
+	err = errno;
+    }
+  if (! err)
+    {
+      memcpy (*data, buf, len);
+      *data_len = len;
+    }
+
+  free (buf);
+  return err;
+}
@@ -65,6 +65,31 @@ message_demuxer (mach_msg_header_t *inp,
 pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
 int startup_fallback;
 
+#define OPT_RPC_STATS	600	/* --rpc-statistics */
+
+static const struct argp_option options[] =
+{
+  {"rpc-statistics", OPT_RPC_STATS, 0, 0,
+   "Collect statistics about the requests served, which proc_get_statistics"
+   " returns"},
+  {0}
+};
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  switch (key)
+    {
+    case OPT_RPC_STATS:
+      ports_enable_rpc_stats (1);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
 error_t
 increase_priority (void)
 {
@@ -102,7 +127,7 @@ main (int argc, char **argv, char **envp)
   void *genport;
   process_t startup_port;
   mach_port_t startup;
-  struct argp argp = { 0, 0, 0, "Hurd process server" };
+  struct argp argp = { options, parse_opt, 0, "Hurd process server" };
 
   argp_parse (&argp, argc, argv, 0, 0, 0);
 
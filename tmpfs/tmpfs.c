@@ -315,6 +315,18 @@ diskfs_thread_function (void *demuxer)
   return NULL;
 }
 
+/* Handling of operations for the ports in diskfs_control_lane.  */
+static void *
+diskfs_control_thread_function (void *demuxer)
+{
+  static int thread_timeout = 1000 * 60 * 2; /* two minutes */
+
+  ports_manage_lane_operations_multithread (diskfs_control_lane,
+					    (ports_demuxer_type) demuxer,
+					    thread_timeout, 0, 0);
+  return NULL;
+}
+
 
 /* Add our startup arguments to the standard diskfs set.  */
 static const struct argp_child startup_children[] =
@@ -390,6 +402,16 @@ main (int argc, char **argv)
       perror ("pthread_create");
     }
 
+  err = pthread_create (&pthread_id, NULL, diskfs_control_thread_function,
+			diskfs_demuxer);
+  if (!err)
+    pthread_detach (pthread_id);
+  else
+    {
+      errno = err;
+      perror ("pthread_create");
+    }
+
   /* Now that we are all set up to handle requests, and diskfs_root_node is
      set properly, it is safe to export our fsys control port to the
      outside world.  */
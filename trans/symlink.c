@@ -198,6 +198,13 @@ S_fsys_get_options (mach_port_t control,
   return EOPNOTSUPP;
 }
 
+error_t
+S_fsys_get_statistics (mach_port_t control,
+		       char **data, mach_msg_type_number_t *len)
+{
+  return EOPNOTSUPP;
+}
+
 error_t
 S_fsys_getfile (mach_port_t control,
 		uid_t *uids, size_t nuids,
@@ -38,6 +38,8 @@ static struct argp_option options[] =
 {
   {"dereference", 'L', 0, 0, "If FILESYS is a symbolic link, follow it"},
   {"recursive",   'R', 0, 0, "Pass these options to any child translators"},
+  {"statistics",  's', 0, 0, "Print FILESYS's statistics instead of its"
+   " options"},
   {0, 0, 0, 0}
 };
 static char *args_doc = "FILESYS [FS_OPTION...]";
@@ -62,7 +64,7 @@ main(int argc, char *argv[])
   char *argz = 0;
   size_t argz_len = 0;
 
-  int deref = 0, recursive = 0;
+  int deref = 0, recursive = 0, statistics = 0;
 
   /* Parse a command line option.  */
   error_t parse_opt (int key, char *arg, struct argp_state *state)
@@ -79,6 +81,7 @@ main(int argc, char *argv[])
 
 	case 'R': recursive = 1; break;
 	case 'L': deref = 1; break;
+	case 's': statistics = 1; break;
 
 	case ARGP_KEY_NO_ARGS:
 	  argp_usage (state);
@@ -98,7 +101,26 @@ main(int argc, char *argv[])
   if (node == MACH_PORT_NULL)
     error (1, errno, "%s", node_name);
 
-  if (argz_len)
+  if (statistics)
+    {
+      fsys_t fsys;
+      char *text = 0;
+      size_t text_len = 0;
+
+      if (argz_len)
+	error (1, 0, "%s: Options cannot be set with --statistics",
+	       node_name);
+
+      err = file_getcontrol (node, &fsys);
+      if (err)
+	error (2, err, "%s", node_name);
+
+      err = fsys_get_statistics (fsys, &text, &text_len);
+      if (err)
+	error (5, err, "%s", node_name);
+      fwrite (text, 1, text_len, stdout);
+    }
+  else if (argz_len)
     {
       /* The filesystem we're passing options to.  */
       fsys_t fsys;